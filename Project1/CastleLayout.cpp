@@ -0,0 +1,258 @@
+//***************************************************************************************
+// CastleLayout.cpp
+//***************************************************************************************
+
+#include "CastleLayout.h"
+
+#include <cfloat>
+#include <cmath>
+#include <utility>
+
+using namespace DirectX;
+
+namespace
+{
+	const CastleLayout::Layer AT = CastleLayout::AlphaTested;
+
+	XMFLOAT4X4 Store(FXMMATRIX m)
+	{
+		XMFLOAT4X4 f;
+		XMStoreFloat4x4(&f, m);
+		return f;
+	}
+
+	// Each shape gets its own bounds: the box around its slice
+	// [first, first + count) of the packed vertices.
+	BoundingBox ComputeBounds(const std::vector<GeometryGenerator::Vertex>& vertices, size_t first, size_t count)
+	{
+		XMVECTOR vMin = XMVectorReplicate(+FLT_MAX);
+		XMVECTOR vMax = XMVectorReplicate(-FLT_MAX);
+		for(size_t i = first; i < first + count; ++i)
+		{
+			XMVECTOR p = XMLoadFloat3(&vertices[i].Position);
+			vMin = XMVectorMin(vMin, p);
+			vMax = XMVectorMax(vMax, p);
+		}
+
+		BoundingBox bounds;
+		XMStoreFloat3(&bounds.Center, 0.5f * (vMin + vMax));
+		XMStoreFloat3(&bounds.Extents, 0.5f * (vMax - vMin));
+		return bounds;
+	}
+}
+
+const int CastleLayout::TreeCount;
+const float CastleLayout::TreeSize = 5.0f;
+
+const CastleLayout::MaterialDesc CastleLayout::Materials[MaterialCount] =
+{
+	// This is not a good water material definition, but we do not have all the
+	// rendering tools we need (transparency, environment reflection), so we fake it.
+	{ "water", "waterTex", "water1.dds", { 1.0f, 1.0f, 1.0f, 0.5f }, { 0.1f, 0.1f, 0.1f }, 0.0f },
+	{ "wirefence", "fenceTex", "WireFence.dds", { 1.0f, 1.0f, 1.0f, 1.0f }, { 0.02f, 0.02f, 0.02f }, 0.25f },
+	{ "bricks0", "bricksTex", "red_brick.dds", { 1.0f, 1.0f, 1.0f, 1.0f }, { 0.02f, 0.02f, 0.02f }, 0.1f },
+	{ "stone0", "stoneTex", "base.dds", { 1.0f, 1.0f, 1.0f, 1.0f }, { 0.05f, 0.05f, 0.05f }, 0.1f },
+	{ "grass", "LavaTex", "Lave_Cracks.dds", { 1.0f, 1.0f, 1.0f, 1.0f }, { 0.01f, 0.01f, 0.01f }, 0.125f },
+	{ "roof0", "roofTex", "cone_roof.dds", { 1.0f, 1.0f, 1.0f, 1.0f }, { 0.02f, 0.02f, 0.02f }, 0.0f },
+	{ "prism0", "prismTex", "corner.dds", { 1.0f, 1.0f, 1.0f, 1.0f }, { 0.02f, 0.02f, 0.02f }, 0.3f },
+	{ "door0", "doorTex", "door.dds", { 1.0f, 1.0f, 1.0f, 1.0f }, { 0.02f, 0.02f, 0.02f }, 0.3f },
+	{ "glass0", "glassTex", "glass.dds", { 1.0f, 1.0f, 1.0f, 1.0f }, { 0.02f, 0.02f, 0.02f }, 0.0f },
+	{ "rope0", "ropeTex", "rope.dds", { 1.0f, 1.0f, 1.0f, 1.0f }, { 0.02f, 0.02f, 0.02f }, 0.3f },
+	{ "Torus0", "TorusTex", "Torus.dds", { 1.0f, 1.0f, 1.0f, 1.0f }, { 0.02f, 0.02f, 0.02f }, 0.3f },
+	{ "treeSprites", "treeArrayTex", "treearray.dds", { 1.0f, 1.0f, 1.0f, 1.0f }, { 0.01f, 0.01f, 0.01f }, 0.125f },
+};
+
+const CastleLayout::GroupDesc CastleLayout::Groups[GroupCount] =
+{
+	{ -1, { 0.0f, 0.0f, 0.0f } },
+	{ CastleGroup, { 0.0f, 0.0f, 0.0f } },
+	{ CastleGroup, { 12.0f, 0.0f, 0.0f } },
+};
+
+const CastleLayout::Prop CastleLayout::Props[] =
+{
+	// Walls.
+	{ GateGroup, "box", Bricks, AT, { 1.0f, 2.0f, 15.5f }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 4.0f, 0.0f }, false },
+	{ CastleGroup, "box", Bricks, AT, { 1.0f, 5.0f, 14.5f }, { 0.0f, 1.0472f, 0.0f }, { 6.0f, 2.5f, -11.0f }, false },
+	{ CastleGroup, "box", Bricks, AT, { 1.0f, 5.0f, 14.5f }, { 0.0f, -1.0472f, 0.0f }, { -6.0f, 2.5f, -11.0f }, false },
+	{ CastleGroup, "box", Bricks, AT, { 1.0f, 5.0f, 15.5f }, { 0.0f, 0.0f, 0.0f }, { -12.0f, 2.5f, 0.0f }, false },
+	{ CastleGroup, "box", Bricks, AT, { 1.0f, 5.0f, 14.5f }, { 0.0f, 1.0472f, 0.0f }, { -6.0f, 2.5f, 11.0f }, false },
+	{ CastleGroup, "box", Bricks, AT, { 1.0f, 5.0f, 14.5f }, { 0.0f, -1.0472f, 0.0f }, { 6.0f, 2.5f, 11.0f }, false },
+
+	// Tower.
+	{ TowerGroup, "pyramid", Prism, AT, { 10.0f, 3.5f, 10.0f }, { 0.0f, 0.785398f, 0.0f }, { 0.0f, 1.75f, 0.0f }, false },
+	{ TowerGroup, "cylinder", Bricks, AT, { 2.0f, 8.0f, 2.0f }, { 0.0f, 0.785398f, 0.0f }, { 0.0f, 7.5f, 0.0f }, false },
+	{ TowerGroup, "cylinder", Bricks, AT, { 4.0f, 1.5f, 4.0f }, { 0.0f, 0.785398f, 0.0f }, { 0.0f, 12.0f, 0.0f }, false },
+	{ TowerGroup, "cone", Roof, AT, { 0.7f, 7.5f, 2.5f }, { 0.0f, 1.5708f, 0.0f }, { 0.0f, 15.5f, 3.0f }, false },
+	{ TowerGroup, "cone", Roof, AT, { 0.7f, 7.5f, 2.5f }, { 0.0f, 1.5708f, 0.0f }, { 0.0f, 15.5f, -3.0f }, false },
+
+	// Wall corners.
+	{ CastleGroup, "prism", Prism, AT, { 2.0f, 5.0f, 2.0f }, { 0.0f, -0.436332f, 0.0f }, { 14.0f, 2.5f, -9.0f }, true },
+	{ CastleGroup, "prism", Prism, AT, { 2.0f, 5.0f, 2.0f }, { 0.0f, 0.610865f, 0.0f }, { -14.0f, 2.5f, 9.0f }, true },
+	{ CastleGroup, "prism", Prism, AT, { 2.0f, 5.0f, 2.0f }, { 0.0f, -0.610865f, 0.0f }, { -14.0f, 2.5f, -9.0f }, true },
+	{ CastleGroup, "prism", Prism, AT, { 2.0f, 5.0f, 2.0f }, { 0.0f, 0.436332f, 0.0f }, { 14.0f, 2.5f, 9.0f }, true },
+	{ CastleGroup, "prism", Prism, AT, { 2.0f, 5.0f, 2.0f }, { 0.0f, -0.5f, 0.0f }, { 0.0f, 2.5f, 17.0f }, true },
+	{ CastleGroup, "prism", Prism, AT, { 2.0f, 5.0f, 2.0f }, { 0.0f, 0.5f, 0.0f }, { 0.0f, 2.5f, -17.0f }, true },
+
+	// Gate, its ropes and the drawbridge.
+	{ GateGroup, "box", Bricks, AT, { 1.0f, 5.0f, 6.5f }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 2.5f, 4.5f }, false },
+	{ GateGroup, "box", Bricks, AT, { 1.0f, 5.0f, 6.5f }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 2.5f, -4.5f }, false },
+	{ GateGroup, "cylinder", Rope, AT, { 0.1f, 4.0f, 0.1f }, { 0.0f, 0.0f, 0.785398f }, { 1.5f, 1.5f, -1.0f }, false },
+	{ GateGroup, "cylinder", Rope, AT, { 0.1f, 4.0f, 0.1f }, { 0.0f, 0.0f, 0.785398f }, { 1.5f, 1.5f, 1.0f }, false },
+	{ GateGroup, "box", Wirefence, AT, { 3.0f, 0.5f, 2.5f }, { 0.0f, 0.0f, 0.0f }, { 1.5f, 0.0f, 0.0f }, false },
+
+	// The eye on top of the tower.
+	{ TowerGroup, "torus", Torus, AT, { 2.0f, 1.0f, 2.0f }, { 0.0f, 1.5708f, 0.0f }, { 0.0f, 17.5f, 0.0f }, false },
+	{ TowerGroup, "diamond", Glass, Opaque, { 0.5f, 1.0f, 0.5f }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 18.0f, 0.0f }, false },
+};
+
+const int CastleLayout::PropCount = (int)(sizeof(Props) / sizeof(Props[0]));
+
+XMMATRIX CastleLayout::Prop::Local()const
+{
+	XMMATRIX S = XMMatrixScaling(Scale.x, Scale.y, Scale.z);
+	XMMATRIX R = XMMatrixRotationRollPitchYaw(Rotation.x, Rotation.y, Rotation.z);
+	XMMATRIX T = XMMatrixTranslation(Translation.x, Translation.y, Translation.z);
+	return RotateFirst ? R * S * T : S * R * T;
+}
+
+GeometryGenerator::MeshData CastleLayout::BuildShapes(std::vector<ShapeRange>& ranges)
+{
+	GeometryGenerator geoGen;
+
+	const std::pair<const char*, GeometryGenerator::MeshData> shapes[] =
+	{
+		{ "box", geoGen.CreateBox(1.0f, 1.0f, 1.0f, 0) },
+		{ "grid", geoGen.CreateGrid(1.0f, 1.0f, 41, 41) },
+		{ "sphere", geoGen.CreateSphere(0.2f, 20, 20) },
+		{ "cylinder", geoGen.CreateCylinder(1.0f, 1.0f, 1.0f, 20, 20) },
+		{ "pyramid", geoGen.CreatePyramid(1.0f, 1.0f, 0.35f) },
+		{ "cone", geoGen.CreateCone(1.0f, 1.0f, 20, 1) },
+		{ "prism", geoGen.CreatePrism(1.0f, 1.0f, 1.0f, 1.0f) },
+		{ "diamond", geoGen.CreateDiamond(1.0f, 1.0f, 1.0f, 0) },
+		{ "wedge", geoGen.CreateWedge(1.0f, 1.0f, 1.0f, 0) },
+		{ "torus", geoGen.CreateTorus(1.0f, 0.5f, 50, 50) },
+	};
+
+	GeometryGenerator::MeshData packed;
+	for(const auto& shape : shapes)
+	{
+		const GeometryGenerator::MeshData& mesh = shape.second;
+
+		ShapeRange range;
+		range.Name = shape.first;
+		range.IndexCount = (std::uint32_t)mesh.Indices32.size();
+		range.StartIndexLocation = (std::uint32_t)packed.Indices32.size();
+		range.BaseVertexLocation = (int)packed.Vertices.size();
+
+		packed.Vertices.insert(packed.Vertices.end(), mesh.Vertices.begin(), mesh.Vertices.end());
+		packed.Indices32.insert(packed.Indices32.end(), mesh.Indices32.begin(), mesh.Indices32.end());
+
+		range.Bounds = ComputeBounds(packed.Vertices, range.BaseVertexLocation, mesh.Vertices.size());
+		ranges.push_back(range);
+	}
+
+	return packed;
+}
+
+GeometryGenerator::MeshData CastleLayout::BuildLand()
+{
+	GeometryGenerator geoGen;
+	GeometryGenerator::MeshData grid = geoGen.CreateGrid(160.0f, 160.0f, 50, 50);
+
+	// Making level: the first fifth of the grid's far half drops 10 units.
+	const size_t half = grid.Vertices.size() / 2;
+	for(size_t i = 0; i < grid.Vertices.size() / 5; ++i)
+		grid.Vertices[i + half].Position.y -= 10.0f;
+
+	return grid;
+}
+
+std::vector<CastleLayout::InstancedProp> CastleLayout::InstancedProps()
+{
+	std::vector<InstancedProp> props(3);
+
+	// Battlements along the top of the castle walls.
+	InstancedProp& battlements = props[0];
+	battlements.Shape = "box";
+	battlements.Material = Bricks;
+	battlements.Layer = InstancedAlphaTested;
+	for(float i = -6.0f; i <= 6.0f; i += 2.0f)
+	{
+		const XMMATRIX worlds[6] =
+		{
+			XMMatrixTranslation(12.0f, 5.5f, i),
+			XMMatrixRotationRollPitchYaw(0.0f, 1.0472f, 0.0f) * XMMatrixTranslation(6.0f + (i * sinf(1.0472f)), 5.5f, -11.0f + (i * cosf(1.0472f))),
+			XMMatrixRotationRollPitchYaw(0.0f, -1.0472f, 0.0f) * XMMatrixTranslation(-6.0f + (i * sinf(-1.0472f)), 5.5f, -11.0f + (i * cosf(-1.0472f))),
+			XMMatrixTranslation(-12.0f, 5.5f, i),
+			XMMatrixRotationRollPitchYaw(0.0f, 1.0472f, 0.0f) * XMMatrixTranslation(-6.0f + (i * sinf(1.0472f)), 5.5f, 11.0f + (i * cosf(1.0472f))),
+			XMMatrixRotationRollPitchYaw(0.0f, -1.0472f, 0.0f) * XMMatrixTranslation(6.0f + (i * sinf(-1.0472f)), 5.5f, 11.0f + (i * cosf(-1.0472f))),
+		};
+		for(const auto& world : worlds)
+			battlements.Worlds.push_back(Store(world));
+	}
+
+	// Glass spheres on top of the wall corners.
+	const XMFLOAT3 spherePositions[] =
+	{
+		{ 14.0f, 5.0f, -9.0f }, { -14.0f, 5.0f, 9.0f }, { -14.0f, 5.0f, -9.0f },
+		{ 14.0f, 5.0f, 9.0f }, { 0.0f, 5.0f, 17.0f }, { 0.0f, 5.0f, -17.0f },
+	};
+	InstancedProp& spheres = props[1];
+	spheres.Shape = "sphere";
+	spheres.Material = Glass;
+	spheres.Layer = InstancedOpaque;
+	for(const auto& pos : spherePositions)
+		spheres.Worlds.push_back(Store(XMMatrixTranslation(pos.x, pos.y, pos.z)));
+
+	// Glass diamonds around the base of the tower.
+	const XMFLOAT3 diamondPositions[] =
+	{
+		{ 6.0f, 4.0f, 6.0f }, { -6.0f, 4.0f, 6.0f }, { 6.0f, 4.0f, -6.0f }, { -6.0f, 4.0f, -6.0f },
+	};
+	InstancedProp& diamonds = props[2];
+	diamonds.Shape = "diamond";
+	diamonds.Material = Glass;
+	diamonds.Layer = InstancedOpaque;
+	for(const auto& pos : diamondPositions)
+		diamonds.Worlds.push_back(Store(XMMatrixRotationRollPitchYaw(0.0f, 0.785398f, 0.0f) * XMMatrixTranslation(pos.x, pos.y, pos.z)));
+
+	return props;
+}
+
+CastleLayout::Placement CastleLayout::LandPlacement()
+{
+	Placement land;
+	land.World = Store(XMMatrixScaling(2.0f, 0.5f, 2.5f) * XMMatrixRotationRollPitchYaw(0.0f, 1.5708f, 0.0f) * XMMatrixTranslation(105.0f, 0.0f, 0.0f));
+	land.TexTransform = Store(XMMatrixScaling(10.0f, 15.0f, 1.0f));
+	return land;
+}
+
+CastleLayout::Placement CastleLayout::WaterPlacement()
+{
+	Placement water;
+	water.World = Store(XMMatrixScaling(2.5f, 0.6f, 2.5f) * XMMatrixTranslation(20.0f, -3.0f, 0.0f));
+	water.TexTransform = Store(XMMatrixScaling(7.0f, 7.0f, 1.0f));
+	return water;
+}
+
+std::vector<CastleLayout::Placement> CastleLayout::OutsideWalls()
+{
+	std::vector<Placement> walls(4);
+	walls[0].World = Store(XMMatrixScaling(1.0f, 6.0f, 80.0f) * XMMatrixTranslation(-20.0f, -3.01f, 0.0f));
+	walls[0].TexTransform = Store(XMMatrixScaling(15.0f, 1.0f, 1.0f));
+	walls[1].World = Store(XMMatrixScaling(95.0f, 6.0f, 10.0f) * XMMatrixTranslation(65.0f, -3.01f, 0.0f));
+	walls[1].TexTransform = Store(XMMatrixScaling(15.0f, 1.0f, 1.0f));
+	walls[2].World = Store(XMMatrixScaling(100.0f, 7.5f, 1.0f) * XMMatrixTranslation(66.0f, -3.01f, 5.0f));
+	walls[2].TexTransform = Store(XMMatrixScaling(15.0f, 0.5f, 1.0f));
+	walls[3].World = Store(XMMatrixScaling(100.0f, 7.5f, 1.0f) * XMMatrixTranslation(66.0f, -3.01f, -5.0f));
+	walls[3].TexTransform = Store(XMMatrixScaling(15.0f, 0.5f, 1.0f));
+	return walls;
+}
+
+XMFLOAT3 CastleLayout::TreePosition(int i, float u, float v)
+{
+	// Slightly above the land, 23 to 35 units out from the castle.
+	const float z = 23.0f + 12.0f * v;
+	return XMFLOAT3(-15.0f + 30.0f * u, 2.5f, i < TreeCount / 2 ? z : -z);
+}
@@ -0,0 +1,140 @@
+//***************************************************************************************
+// CastleLayout.h
+//
+// The castle scene as plain data, with no device behind it: the shape meshes and
+// how they are packed, the materials and the texture each one samples, and where
+// every castle part, instance and wall goes.  CastleDesign builds its D3D12
+// resources from it and HeadlessCastle its IRenderDevice ones, so a change to
+// the castle shows up in both.
+//
+// Castle parts hang off three transform groups (the castle, its tower and its
+// gate); everything else is placed in world space.  The groups are placed once,
+// at startup: the instanced props are absolute world matrices, and the static
+// batches, collision boxes and occluders are built from the startup placement.
+//***************************************************************************************
+
+#pragma once
+
+#include "GeometryGenerator.h"
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+
+class CastleLayout
+{
+public:
+	// Same order as the app's RenderLayer.
+	enum Layer
+	{
+		Opaque = 0,
+		Transparent,
+		AlphaTested,
+		AlphaTestedTreeSprites,
+		InstancedOpaque,
+		InstancedAlphaTested,
+		LayerCount
+	};
+
+	// Materials in MatCBIndex order; material i samples texture i.
+	enum MaterialIndex
+	{
+		Water, Wirefence, Bricks, Stone, Grass, Roof, Prism, Door, Glass, Rope, Torus, TreeSprites,
+		MaterialCount
+	};
+
+	enum Group { CastleGroup, TowerGroup, GateGroup, GroupCount };
+
+	struct MaterialDesc
+	{
+		const char* Name;
+		const char* TextureName;
+		// Relative to the texture directory.
+		const char* TextureFile;
+		DirectX::XMFLOAT4 DiffuseAlbedo;
+		DirectX::XMFLOAT3 FresnelR0;
+		float Roughness;
+	};
+
+	struct GroupDesc
+	{
+		// Index of the parent group, or -1 for the root.
+		int Parent;
+		DirectX::XMFLOAT3 Translation;
+	};
+
+	// A castle part: scale, then rotation, then translation relative to its
+	// group, except where RotateFirst is set.
+	struct Prop
+	{
+		Group Parent;
+		const char* Shape;
+		MaterialIndex Material;
+		CastleLayout::Layer Layer;
+		DirectX::XMFLOAT3 Scale;
+		DirectX::XMFLOAT3 Rotation;
+		DirectX::XMFLOAT3 Translation;
+		bool RotateFirst;
+
+		DirectX::XMMATRIX Local()const;
+	};
+
+	// Copies of one shape drawn as instances of a single item, in world space.
+	struct InstancedProp
+	{
+		const char* Shape;
+		MaterialIndex Material;
+		CastleLayout::Layer Layer;
+		std::vector<DirectX::XMFLOAT4X4> Worlds;
+	};
+
+	// An item placed straight in world space.
+	struct Placement
+	{
+		DirectX::XMFLOAT4X4 World;
+		DirectX::XMFLOAT4X4 TexTransform;
+	};
+
+	// Where one shape sits in the packed shape mesh.
+	struct ShapeRange
+	{
+		const char* Name;
+		std::uint32_t IndexCount;
+		std::uint32_t StartIndexLocation;
+		int BaseVertexLocation;
+		DirectX::BoundingBox Bounds;
+	};
+
+	static const MaterialDesc Materials[MaterialCount];
+	// Parents come before their children.
+	static const GroupDesc Groups[GroupCount];
+	static const Prop Props[];
+	static const int PropCount;
+
+	static const int TreeCount = 16;
+	static const float TreeSize;
+
+	///<summary>
+	/// Packs every castle shape into one mesh, the one "shapeGeo" is drawn
+	/// from, and appends the range of each to 'ranges'.  Indices restart at zero
+	/// for each shape, so a range is drawn with its base vertex.
+	///</summary>
+	static GeometryGenerator::MeshData BuildShapes(std::vector<ShapeRange>& ranges);
+
+	// The land grid, with its far half stepped down into the moat.
+	static GeometryGenerator::MeshData BuildLand();
+
+	static std::vector<InstancedProp> InstancedProps();
+
+	static Placement LandPlacement();
+	static Placement WaterPlacement();
+	// The outer walls, which block the camera and hide what is behind them.
+	static std::vector<Placement> OutsideWalls();
+
+	///<summary>
+	/// Position of tree 'i' from two uniform numbers in [0, 1): the first half of
+	/// the trees go on one side of the castle, the rest on the other.
+	///</summary>
+	static DirectX::XMFLOAT3 TreePosition(int i, float u, float v);
+};
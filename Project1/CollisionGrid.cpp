@@ -0,0 +1,151 @@
+//***************************************************************************************
+// CollisionGrid.cpp
+//***************************************************************************************
+
+#include "CollisionGrid.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+CollisionGrid::CollisionGrid(float cellSize, float originX, float originZ)
+{
+	Reset(cellSize, originX, originZ);
+}
+
+void CollisionGrid::Reset(float cellSize, float originX, float originZ)
+{
+	Clear();
+
+	mCellSize = cellSize > 0.0f ? cellSize : 1.0f;
+	mOriginX = originX;
+	mOriginZ = originZ;
+}
+
+void CollisionGrid::Clear()
+{
+	mBoxes.clear();
+	mFreeBoxes.clear();
+	mCells.clear();
+	mStamps.clear();
+	mQueryStamp = 0;
+}
+
+int CollisionGrid::Insert(const BoundingBox& box)
+{
+	int index;
+	if(!mFreeBoxes.empty())
+	{
+		index = mFreeBoxes.back();
+		mFreeBoxes.pop_back();
+		mBoxes[index] = box;
+	}
+	else
+	{
+		index = (int)mBoxes.size();
+		mBoxes.push_back(box);
+		mStamps.push_back(0);
+	}
+
+	int x0, z0, x1, z1;
+	CellRange(box, x0, z0, x1, z1);
+
+	for(int x = x0; x <= x1; ++x)
+	{
+		for(int z = z0; z <= z1; ++z)
+			mCells[CellKey(x, z)].push_back(index);
+	}
+
+	return index;
+}
+
+void CollisionGrid::Remove(int index)
+{
+	int x0, z0, x1, z1;
+	CellRange(mBoxes[index], x0, z0, x1, z1);
+
+	for(int x = x0; x <= x1; ++x)
+	{
+		for(int z = z0; z <= z1; ++z)
+		{
+			auto it = mCells.find(CellKey(x, z));
+			if(it == mCells.end())
+				continue;
+
+			auto& list = it->second;
+			list.erase(std::remove(list.begin(), list.end(), index), list.end());
+			if(list.empty())
+				mCells.erase(it);
+		}
+	}
+
+	mFreeBoxes.push_back(index);
+}
+
+bool CollisionGrid::Intersects(const BoundingBox& box)const
+{
+	return ForEachCandidate(box, [&](int i)
+	{
+		return mBoxes[i].Intersects(box);
+	});
+}
+
+void CollisionGrid::Query(const BoundingBox& box, std::vector<int>& hits)const
+{
+	ForEachCandidate(box, [&](int i)
+	{
+		if(mBoxes[i].Intersects(box))
+			hits.push_back(i);
+		return false;
+	});
+}
+
+void CollisionGrid::CellRange(const BoundingBox& box, int& x0, int& z0, int& x1, int& z1)const
+{
+	const float invCell = 1.0f / mCellSize;
+
+	x0 = (int)std::floor((box.Center.x - box.Extents.x - mOriginX) * invCell);
+	x1 = (int)std::floor((box.Center.x + box.Extents.x - mOriginX) * invCell);
+	z0 = (int)std::floor((box.Center.z - box.Extents.z - mOriginZ) * invCell);
+	z1 = (int)std::floor((box.Center.z + box.Extents.z - mOriginZ) * invCell);
+}
+
+template<typename F>
+bool CollisionGrid::ForEachCandidate(const BoundingBox& box, F f)const
+{
+	if(mBoxes.empty())
+		return false;
+
+	// On wrap-around every stamp could look current, so start over.
+	if(++mQueryStamp == 0)
+	{
+		std::fill(mStamps.begin(), mStamps.end(), 0);
+		mQueryStamp = 1;
+	}
+
+	int x0, z0, x1, z1;
+	CellRange(box, x0, z0, x1, z1);
+
+	for(int x = x0; x <= x1; ++x)
+	{
+		for(int z = z0; z <= z1; ++z)
+		{
+			auto it = mCells.find(CellKey(x, z));
+			if(it == mCells.end())
+				continue;
+
+			for(int i : it->second)
+			{
+				if(mStamps[i] == mQueryStamp)
+					continue;
+				mStamps[i] = mQueryStamp;
+
+				if(f(i))
+					return true;
+			}
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,70 @@
+//***************************************************************************************
+// CollisionGrid.h
+//
+// Uniform grid over the xz plane used as a broadphase for static collision boxes.
+// Cells are hashed, so the grid is unbounded and only occupied cells cost memory.
+// With the cell size set to the maze cell size, a query for the camera box touches
+// a handful of cells no matter how large the maze is.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <DirectXCollision.h>
+
+class CollisionGrid
+{
+public:
+	CollisionGrid() = default;
+	CollisionGrid(float cellSize, float originX, float originZ);
+
+	// Drops every box and changes the cell layout.
+	void Reset(float cellSize, float originX, float originZ);
+	void Clear();
+
+	// Returns the index of the box, which is what Query reports.  Indices of
+	// removed boxes are reused.
+	int Insert(const DirectX::BoundingBox& box);
+	void Remove(int index);
+
+	// True if any stored box touches 'box'.
+	bool Intersects(const DirectX::BoundingBox& box)const;
+
+	// Appends the index of every stored box touching 'box'; each index once.
+	void Query(const DirectX::BoundingBox& box, std::vector<int>& hits)const;
+
+	const DirectX::BoundingBox& Box(int index)const { return mBoxes[index]; }
+	int BoxCount()const { return (int)mBoxes.size() - (int)mFreeBoxes.size(); }
+	int CellCount()const { return (int)mCells.size(); }
+
+	float CellSize()const { return mCellSize; }
+
+private:
+	void CellRange(const DirectX::BoundingBox& box, int& x0, int& z0, int& x1, int& z1)const;
+
+	static std::uint64_t CellKey(int x, int z)
+	{
+		return ((std::uint64_t)(std::uint32_t)x << 32) | (std::uint32_t)z;
+	}
+
+	// Calls f(index) for every box in the cells 'box' overlaps, skipping repeats,
+	// until f returns true.  Returns whether f stopped the walk.
+	template<typename F>
+	bool ForEachCandidate(const DirectX::BoundingBox& box, F f)const;
+
+private:
+	float mCellSize = 1.0f;
+	float mOriginX = 0.0f;
+	float mOriginZ = 0.0f;
+
+	std::vector<DirectX::BoundingBox> mBoxes;
+	std::vector<int> mFreeBoxes;
+	std::unordered_map<std::uint64_t, std::vector<int>> mCells;
+
+	// A box spanning several cells is listed in each of them; stamping it with the
+	// query number makes sure it is tested once per query.
+	mutable std::vector<std::uint32_t> mStamps;
+	mutable std::uint32_t mQueryStamp = 0;
+};
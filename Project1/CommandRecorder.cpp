@@ -0,0 +1,133 @@
+//***************************************************************************************
+// CommandRecorder.cpp
+//***************************************************************************************
+
+#include "CommandRecorder.h"
+
+#include <algorithm>
+#include <exception>
+#include <future>
+
+int RecordListCount(int draws, int maxLists, int minDrawsPerList)
+{
+	return std::max(1, std::min(maxLists, draws / std::max(minDrawsPerList, 1)));
+}
+
+int RecordDraws(const DrawQueue& queue, ICommandRecorder& recorder, int maxLists, int minDrawsPerList,
+	DrawQueue::Stats* stats)
+{
+	const int draws = queue.Count();
+	const int listCount = RecordListCount(draws, maxLists, minDrawsPerList);
+
+	std::vector<DrawQueue::Stats> listStats(listCount);
+
+	auto recordList = [&](int list)
+	{
+		// Even split, to within one draw.
+		const int first = (int)((long long)draws * list / listCount);
+		const int last = (int)((long long)draws * (list + 1) / listCount);
+
+		recorder.Begin(list);
+		listStats[list] = queue.SubmitRange(first, last, [&](std::uint32_t item, const DrawQueue::State& state, unsigned changes)
+		{
+			recorder.Record(list, item, state, changes);
+		});
+		recorder.End(list);
+	};
+
+	std::vector<std::future<void>> jobs;
+	for(int list = 1; list < listCount; ++list)
+		jobs.push_back(std::async(std::launch::async, recordList, list));
+
+	// Let every list finish before an exception from any of them goes on up.
+	std::exception_ptr error;
+	try
+	{
+		recordList(0);
+	}
+	catch(...)
+	{
+		error = std::current_exception();
+	}
+
+	for(auto& job : jobs)
+	{
+		try
+		{
+			job.get();
+		}
+		catch(...)
+		{
+			if(!error)
+				error = std::current_exception();
+		}
+	}
+
+	if(error)
+		std::rethrow_exception(error);
+
+	if(stats != nullptr)
+	{
+		*stats = DrawQueue::Stats();
+		for(const auto& s : listStats)
+			*stats += s;
+	}
+
+	return listCount;
+}
+
+NullCommandRecorder::NullCommandRecorder(int maxLists)
+	: mLists(std::max(maxLists, 1)), mListsBegun(0), mListsEnded(0)
+{
+}
+
+void NullCommandRecorder::Reset()
+{
+	for(auto& list : mLists)
+	{
+		list.Items.clear();
+		list.Binds = 0;
+	}
+	mListsBegun = 0;
+	mListsEnded = 0;
+}
+
+void NullCommandRecorder::Begin(int list)
+{
+	mLists[list].Items.clear();
+	mLists[list].Binds = 0;
+	++mListsBegun;
+}
+
+void NullCommandRecorder::Record(int list, std::uint32_t item, const DrawQueue::State& /*state*/, unsigned changes)
+{
+	List& l = mLists[list];
+	l.Items.push_back(item);
+
+	for(unsigned bit = DrawQueue::PipelineChange; bit <= DrawQueue::TopologyChange; bit <<= 1)
+	{
+		if(changes & bit)
+			++l.Binds;
+	}
+}
+
+void NullCommandRecorder::End(int /*list*/)
+{
+	++mListsEnded;
+}
+
+int NullCommandRecorder::Draws()const
+{
+	int count = 0;
+	for(const auto& list : mLists)
+		count += (int)list.Items.size();
+	return count;
+}
+
+int NullCommandRecorder::Binds()const
+{
+	int count = 0;
+	for(const auto& list : mLists)
+		count += list.Binds;
+	return count;
+}
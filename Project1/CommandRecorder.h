@@ -0,0 +1,81 @@
+//***************************************************************************************
+// CommandRecorder.h
+//
+// Recording of a frame's sorted draws into several command lists at once.
+//
+// RecordDraws cuts the sorted DrawQueue into contiguous slices, one per list, and
+// records each slice on its own thread through an ICommandRecorder.  The lists
+// are meant to be executed in list order, which keeps the sorted order.  Each
+// slice starts with every bind marked as changed, since a fresh command list
+// inherits no state.
+//
+// The app implements ICommandRecorder on D3D12.  NullCommandRecorder only counts
+// what it is asked to record, so the slicing and threading can be run and timed
+// without a GPU.
+//***************************************************************************************
+
+#pragma once
+
+#include "DrawQueue.h"
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+class ICommandRecorder
+{
+public:
+	virtual ~ICommandRecorder() {}
+
+	// Called from several threads at once, each with a different list; a list
+	// is only touched by one thread per frame.
+	virtual void Begin(int list) = 0;
+	virtual void Record(int list, std::uint32_t item, const DrawQueue::State& state, unsigned changes) = 0;
+	virtual void End(int list) = 0;
+};
+
+// Lists RecordDraws uses for 'draws' draws: at most 'maxLists', fewer when a
+// list would get fewer than 'minDrawsPerList' draws, and always at least one,
+// even with nothing to draw.
+int RecordListCount(int draws, int maxLists, int minDrawsPerList);
+
+///<summary>
+/// Records the draws of the sorted 'queue' into RecordListCount lists.  List 0
+/// is recorded on the calling thread.  Returns the number of lists used;
+/// 'stats' receives the bind counts summed over all of them.  An exception
+/// thrown by the recorder reaches the caller once every list has finished.
+///</summary>
+int RecordDraws(const DrawQueue& queue, ICommandRecorder& recorder, int maxLists, int minDrawsPerList,
+	DrawQueue::Stats* stats = nullptr);
+
+class NullCommandRecorder : public ICommandRecorder
+{
+public:
+	explicit NullCommandRecorder(int maxLists);
+
+	virtual void Begin(int list)override;
+	virtual void Record(int list, std::uint32_t item, const DrawQueue::State& state, unsigned changes)override;
+	virtual void End(int list)override;
+
+	void Reset();
+
+	// Totals since the last Reset.
+	int ListsBegun()const { return mListsBegun; }
+	int ListsEnded()const { return mListsEnded; }
+	int Draws()const;
+	int Binds()const;
+
+	// Items recorded into 'list', in order.
+	const std::vector<std::uint32_t>& Items(int list)const { return mLists[list].Items; }
+
+private:
+	struct List
+	{
+		std::vector<std::uint32_t> Items;
+		int Binds = 0;
+	};
+
+	std::vector<List> mLists;
+	std::atomic<int> mListsBegun;
+	std::atomic<int> mListsEnded;
+};
@@ -0,0 +1,383 @@
+//***************************************************************************************
+// CullingBvh.cpp
+//***************************************************************************************
+
+#include "CullingBvh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <future>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+using namespace DirectX;
+
+namespace
+{
+	// Items that are never culled come with FLT_MAX extents.  Merging two of
+	// those would overflow to an infinite extent and then a NaN centre, which
+	// std::min and std::max drop, so a parent could end up not covering them.
+	// Capped here they stay finite and still pass every plane.
+	const float MaxExtent = 1.0e30f;
+
+	int LowestBit(std::uint64_t mask)
+	{
+#if defined(_MSC_VER) && defined(_M_X64)
+		unsigned long index;
+		_BitScanForward64(&index, mask);
+		return (int)index;
+#elif defined(_MSC_VER)
+		unsigned long index;
+		if(_BitScanForward(&index, (unsigned long)mask))
+			return (int)index;
+		_BitScanForward(&index, (unsigned long)(mask >> 32));
+		return (int)index + 32;
+#else
+		return __builtin_ctzll(mask);
+#endif
+	}
+}
+
+const int CullingBvh::LeafSize;
+
+CullingBvh::CullingBvh(int layerCount)
+	: mLayers(std::max(layerCount, 1))
+{
+}
+
+void CullingBvh::Clear()
+{
+	mItems.clear();
+	mFreeSlots.clear();
+	for(auto& layer : mLayers)
+	{
+		layer.Nodes.clear();
+		layer.Order.clear();
+		layer.Dirty = false;
+	}
+}
+
+int CullingBvh::Add(const BoundingBox& worldBounds, int layer)
+{
+	int slot;
+	if(!mFreeSlots.empty())
+	{
+		slot = mFreeSlots.back();
+		mFreeSlots.pop_back();
+	}
+	else
+	{
+		slot = (int)mItems.size();
+		mItems.push_back(Item());
+	}
+
+	Item& item = mItems[slot];
+	item.Bounds = ToBox(worldBounds);
+	item.Layer = layer;
+	item.Leaf = -1;
+
+	mLayers[layer].Dirty = true;
+
+	return slot;
+}
+
+void CullingBvh::Remove(int slot)
+{
+	Item& item = mItems[slot];
+	mLayers[item.Layer].Dirty = true;
+
+	item.Layer = -1;
+	item.Leaf = -1;
+	mFreeSlots.push_back(slot);
+}
+
+void CullingBvh::SetBounds(int slot, const BoundingBox& worldBounds)
+{
+	Item& item = mItems[slot];
+	item.Bounds = ToBox(worldBounds);
+
+	Layer& layer = mLayers[item.Layer];
+	if(!layer.Dirty && item.Leaf >= 0)
+		Refit(layer, item.Leaf);
+}
+
+int CullingBvh::NodeCount()const
+{
+	int count = 0;
+	for(const auto& layer : mLayers)
+		count += (int)layer.Nodes.size();
+	return count;
+}
+
+int CullingBvh::LastPlaneTests()const
+{
+	int count = 0;
+	for(const auto& layer : mLayers)
+		count += layer.PlaneTests;
+	return count;
+}
+
+CullingBvh::Box CullingBvh::ToBox(const BoundingBox& b)
+{
+	Box box;
+	box.Center[0] = b.Center.x;
+	box.Center[1] = b.Center.y;
+	box.Center[2] = b.Center.z;
+	box.Extent[0] = std::min(b.Extents.x, MaxExtent);
+	box.Extent[1] = std::min(b.Extents.y, MaxExtent);
+	box.Extent[2] = std::min(b.Extents.z, MaxExtent);
+	return box;
+}
+
+CullingBvh::Box CullingBvh::Merge(const Box& a, const Box& b)
+{
+	Box box;
+	for(int i = 0; i < 3; ++i)
+	{
+		const float lo = std::min(a.Center[i] - a.Extent[i], b.Center[i] - b.Extent[i]);
+		const float hi = std::max(a.Center[i] + a.Extent[i], b.Center[i] + b.Extent[i]);
+		box.Center[i] = 0.5f * (lo + hi);
+		box.Extent[i] = 0.5f * (hi - lo);
+	}
+	return box;
+}
+
+void CullingBvh::Rebuild(Layer& layer, int layerIndex)
+{
+	layer.Nodes.clear();
+	layer.Order.clear();
+	layer.Dirty = false;
+
+	for(int i = 0; i < (int)mItems.size(); ++i)
+	{
+		if(mItems[i].Layer == layerIndex)
+			layer.Order.push_back(i);
+	}
+
+	if(!layer.Order.empty())
+	{
+		layer.Nodes.reserve(2 * layer.Order.size() / LeafSize + 1);
+		BuildNode(layer, 0, (int)layer.Order.size(), -1);
+	}
+}
+
+int CullingBvh::BuildNode(Layer& layer, int first, int count, int parent)
+{
+	const int id = (int)layer.Nodes.size();
+	layer.Nodes.push_back(Node());
+
+	Box bounds = mItems[layer.Order[first]].Bounds;
+	float lo[3], hi[3];
+	for(int a = 0; a < 3; ++a)
+		lo[a] = hi[a] = bounds.Center[a];
+
+	for(int i = first; i < first + count; ++i)
+	{
+		const Box& b = mItems[layer.Order[i]].Bounds;
+		bounds = Merge(bounds, b);
+		for(int a = 0; a < 3; ++a)
+		{
+			lo[a] = std::min(lo[a], b.Center[a]);
+			hi[a] = std::max(hi[a], b.Center[a]);
+		}
+	}
+
+	Node& node = layer.Nodes[id];
+	node.Bounds = bounds;
+	node.Parent = parent;
+	node.First = first;
+	node.Count = count;
+
+	if(count <= LeafSize)
+	{
+		for(int i = first; i < first + count; ++i)
+			mItems[layer.Order[i]].Leaf = id;
+		return id;
+	}
+
+	// Split at the median centre along the axis the centres spread over most.
+	int axis = 0;
+	for(int a = 1; a < 3; ++a)
+	{
+		if(hi[a] - lo[a] > hi[axis] - lo[axis])
+			axis = a;
+	}
+
+	const int half = count / 2;
+	std::nth_element(layer.Order.begin() + first, layer.Order.begin() + first + half, layer.Order.begin() + first + count,
+		[&](int a, int b) { return mItems[a].Bounds.Center[axis] < mItems[b].Bounds.Center[axis]; });
+
+	const int left = BuildNode(layer, first, half, id);
+	const int right = BuildNode(layer, first + half, count - half, id);
+
+	layer.Nodes[id].Left = left;
+	layer.Nodes[id].Right = right;
+
+	return id;
+}
+
+void CullingBvh::Refit(Layer& layer, int node)
+{
+	while(node >= 0)
+	{
+		Node& n = layer.Nodes[node];
+		if(n.Left < 0)
+		{
+			n.Bounds = mItems[layer.Order[n.First]].Bounds;
+			for(int i = n.First + 1; i < n.First + n.Count; ++i)
+				n.Bounds = Merge(n.Bounds, mItems[layer.Order[i]].Bounds);
+		}
+		else
+		{
+			n.Bounds = Merge(layer.Nodes[n.Left].Bounds, layer.Nodes[n.Right].Bounds);
+		}
+
+		node = n.Parent;
+	}
+}
+
+void CullingBvh::Cull(const XMFLOAT4 planes[6], std::vector<std::uint32_t>* visible, int parallelThreshold)
+{
+	const int layerCount = (int)mLayers.size();
+
+	for(int i = 0; i < layerCount; ++i)
+	{
+		visible[i].clear();
+		if(mLayers[i].Dirty)
+			Rebuild(mLayers[i], i);
+	}
+
+	// Layers touch nothing shared, so big ones go to other threads while this
+	// one does the small ones.
+	std::vector<std::future<void>> jobs;
+	for(int i = 0; i < layerCount; ++i)
+	{
+		Layer& layer = mLayers[i];
+		if((int)layer.Order.size() >= parallelThreshold)
+			jobs.push_back(std::async(std::launch::async, [&, i]() { CullLayer(mLayers[i], planes, visible[i]); }));
+		else
+			CullLayer(layer, planes, visible[i]);
+	}
+
+	for(auto& job : jobs)
+		job.wait();
+}
+
+void CullingBvh::CullLayer(Layer& layer, const XMFLOAT4 planes[6], std::vector<std::uint32_t>& visible)
+{
+	layer.PlaneTests = 0;
+	if(layer.Nodes.empty())
+		return;
+
+	layer.Hits.resize((mItems.size() + 63) / 64, 0);
+	layer.MinHit = (int)mItems.size();
+	layer.MaxHit = -1;
+
+	Visit(layer, 0, 0x3f, planes);
+
+	// Subtrees come out in tree order, but callers draw in slot order.  Walking
+	// the words between the lowest and highest hit restores it without a sort.
+	for(int w = layer.MinHit >> 6; w <= (layer.MaxHit >> 6); ++w)
+	{
+		std::uint64_t bits = layer.Hits[w];
+		layer.Hits[w] = 0;
+
+		while(bits != 0)
+		{
+			const int bit = LowestBit(bits);
+			bits &= bits - 1;
+
+			visible.push_back((std::uint32_t)(w * 64 + bit));
+		}
+	}
+}
+
+void CullingBvh::Hit(Layer& layer, int slot)
+{
+	layer.Hits[slot >> 6] |= std::uint64_t(1) << (slot & 63);
+	layer.MinHit = std::min(layer.MinHit, slot);
+	layer.MaxHit = std::max(layer.MaxHit, slot);
+}
+
+void CullingBvh::Visit(Layer& layer, int nodeIndex, unsigned mask, const XMFLOAT4 planes[6])
+{
+	Node& node = layer.Nodes[nodeIndex];
+
+	// -1 outside, 1 fully inside, 0 straddling.
+	auto classify = [&](const Box& b, int p)
+	{
+		++layer.PlaneTests;
+
+		// The far corner's distance is summed in FrustumCuller's order, so an
+		// item gets the same answer from both.
+		const XMFLOAT4& pl = planes[p];
+		float d = pl.x * b.Center[0] + pl.w;
+		d += pl.y * b.Center[1];
+		d += pl.z * b.Center[2];
+
+		float farthest = d + std::fabs(pl.x) * b.Extent[0];
+		farthest += std::fabs(pl.y) * b.Extent[1];
+		farthest += std::fabs(pl.z) * b.Extent[2];
+		if(farthest < 0.0f)
+			return -1;
+
+		const float r = std::fabs(pl.x) * b.Extent[0] + std::fabs(pl.y) * b.Extent[1] + std::fabs(pl.z) * b.Extent[2];
+		return d - r >= 0.0f ? 1 : 0;
+	};
+
+	const int cached = node.CachedPlane;
+	if(mask & (1u << cached))
+	{
+		const int c = classify(node.Bounds, cached);
+		if(c < 0)
+			return;
+		if(c > 0)
+			mask &= ~(1u << cached);
+	}
+
+	for(int p = 0; p < 6; ++p)
+	{
+		if(p == cached || !(mask & (1u << p)))
+			continue;
+
+		const int c = classify(node.Bounds, p);
+		if(c < 0)
+		{
+			node.CachedPlane = p;
+			return;
+		}
+		if(c > 0)
+			mask &= ~(1u << p);
+	}
+
+	if(mask == 0)
+	{
+		for(int i = node.First; i < node.First + node.Count; ++i)
+			Hit(layer, layer.Order[i]);
+		return;
+	}
+
+	if(node.Left < 0)
+	{
+		for(int i = node.First; i < node.First + node.Count; ++i)
+		{
+			const Box& b = mItems[layer.Order[i]].Bounds;
+
+			bool inside = true;
+			for(int p = 0; p < 6 && inside; ++p)
+			{
+				if(mask & (1u << p))
+					inside = classify(b, p) >= 0;
+			}
+
+			if(inside)
+				Hit(layer, layer.Order[i]);
+		}
+		return;
+	}
+
+	Visit(layer, node.Left, mask, planes);
+	Visit(layer, node.Right, mask, planes);
+}
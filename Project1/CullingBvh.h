@@ -0,0 +1,110 @@
+//***************************************************************************************
+// CullingBvh.h
+//
+// Bounding volume hierarchy for frustum culling of items that rarely move.  Each
+// layer has its own tree, so layers can be culled on separate threads and an edit
+// to one layer leaves the others alone.
+//
+// Traversal rejects a node outside any plane and accepts the whole subtree once a
+// node is inside all six.  Planes a node is fully inside are not tested again
+// below it, and every node remembers the plane that rejected it last frame and
+// tries that one first; with a slowly moving camera, that plane usually rejects
+// the node again straight away.
+//
+// Moving an item refits the boxes above it.  Adding or removing one marks its
+// layer for a rebuild at the next Cull.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+
+class CullingBvh
+{
+public:
+	explicit CullingBvh(int layerCount);
+
+	int Add(const DirectX::BoundingBox& worldBounds, int layer);
+	void Remove(int slot);
+	void SetBounds(int slot, const DirectX::BoundingBox& worldBounds);
+	void Clear();
+
+	///<summary>
+	/// Clears visible[0..LayerCount()) and appends the slot of every item that is
+	/// not fully outside 'planes' (world space, normals inwards, as made by
+	/// FrustumCuller::ExtractPlanes) to the list of its layer, in slot order.
+	/// Layers with at least 'parallelThreshold' items run on their own thread.
+	///</summary>
+	void Cull(const DirectX::XMFLOAT4 planes[6], std::vector<std::uint32_t>* visible, int parallelThreshold = 1024);
+
+	int LayerCount()const { return (int)mLayers.size(); }
+	int Count()const { return (int)mItems.size() - (int)mFreeSlots.size(); }
+	int NodeCount()const;
+
+	// Plane tests made by the last Cull, over all layers.
+	int LastPlaneTests()const;
+
+private:
+	struct Box
+	{
+		float Center[3];
+		float Extent[3];
+	};
+
+	struct Item
+	{
+		Box Bounds;
+		int Layer = -1;
+		// Leaf holding the item, for refits.
+		int Leaf = -1;
+	};
+
+	struct Node
+	{
+		Box Bounds;
+		int Parent = -1;
+		// Children, or -1 for leaves.
+		int Left = -1;
+		int Right = -1;
+		// Range of the layer's Order array covered by this subtree.
+		int First = 0;
+		int Count = 0;
+		// Plane that rejected the node last time.
+		int CachedPlane = 0;
+	};
+
+	struct Layer
+	{
+		std::vector<Node> Nodes;
+		// Slots arranged so that every subtree is a contiguous run.
+		std::vector<int> Order;
+		bool Dirty = false;
+		int PlaneTests = 0;
+		// One bit per slot, set by the traversal and cleared as the hits are
+		// written out in slot order.
+		std::vector<std::uint64_t> Hits;
+		int MinHit = 0;
+		int MaxHit = -1;
+	};
+
+	void Rebuild(Layer& layer, int layerIndex);
+	int BuildNode(Layer& layer, int first, int count, int parent);
+	void Refit(Layer& layer, int node);
+
+	void CullLayer(Layer& layer, const DirectX::XMFLOAT4 planes[6], std::vector<std::uint32_t>& visible);
+	void Visit(Layer& layer, int node, unsigned mask, const DirectX::XMFLOAT4 planes[6]);
+	static void Hit(Layer& layer, int slot);
+
+	static Box ToBox(const DirectX::BoundingBox& b);
+	static Box Merge(const Box& a, const Box& b);
+
+private:
+	static const int LeafSize = 4;
+
+	std::vector<Item> mItems;
+	std::vector<int> mFreeSlots;
+	std::vector<Layer> mLayers;
+};
@@ -0,0 +1,108 @@
+//***************************************************************************************
+// DrawQueue.cpp
+//***************************************************************************************
+
+#include "DrawQueue.h"
+
+#include <cstring>
+
+const int DrawQueue::MaxPipelines;
+const int DrawQueue::MaxGeometries;
+const int DrawQueue::MaxMaterials;
+const int DrawQueue::MaxTopologies;
+
+DrawQueue::Stats& DrawQueue::Stats::operator+=(const Stats& rhs)
+{
+	Draws += rhs.Draws;
+	PipelineChanges += rhs.PipelineChanges;
+	GeometryChanges += rhs.GeometryChanges;
+	MaterialChanges += rhs.MaterialChanges;
+	TopologyChanges += rhs.TopologyChanges;
+	return *this;
+}
+
+DrawQueue::DrawQueue()
+	: mBackToFront(MaxPipelines, false)
+{
+}
+
+void DrawQueue::SetBackToFront(int pipeline, bool backToFront)
+{
+	mBackToFront[pipeline & (MaxPipelines - 1)] = backToFront;
+}
+
+void DrawQueue::Clear()
+{
+	mEntries.clear();
+}
+
+void DrawQueue::Add(const State& state, float depth, std::uint32_t item)
+{
+	Entry entry;
+	entry.Key = MakeKey(state, depth, mBackToFront[state.Pipeline & (MaxPipelines - 1)]);
+	entry.Item = item;
+	entry.Binds = state;
+	mEntries.push_back(entry);
+}
+
+std::uint64_t DrawQueue::MakeKey(const State& state, float depth, bool backToFront)
+{
+	// Positive floats order the same as their bit patterns.  !(depth > 0) also
+	// catches NaN.
+	std::uint32_t bits = 0;
+	if(depth > 0.0f)
+		std::memcpy(&bits, &depth, sizeof(bits));
+	const std::uint64_t depthBits = bits >> 3;
+
+	const std::uint64_t pipeline = (std::uint64_t)(state.Pipeline & (MaxPipelines - 1));
+	const std::uint64_t geometry = (std::uint64_t)(state.Geometry & (MaxGeometries - 1));
+	const std::uint64_t material = (std::uint64_t)(state.Material & (MaxMaterials - 1));
+	const std::uint64_t topology = (std::uint64_t)(state.Topology & (MaxTopologies - 1));
+
+	if(backToFront)
+	{
+		const std::uint64_t farFirst = ~depthBits & 0x0fffffff;
+		return (pipeline << 56) | (farFirst << 28) | (geometry << 16) | (material << 4) | topology;
+	}
+
+	return (pipeline << 56) | (geometry << 44) | (material << 32) | (topology << 28) | depthBits;
+}
+
+void DrawQueue::Sort()
+{
+	const std::size_t count = mEntries.size();
+	if(count < 2)
+		return;
+
+	// One read fills the histograms of all eight digits.
+	std::uint32_t histograms[8][256];
+	std::memset(histograms, 0, sizeof(histograms));
+	for(const auto& entry : mEntries)
+	{
+		for(int digit = 0; digit < 8; ++digit)
+			++histograms[digit][(entry.Key >> (8 * digit)) & 0xff];
+	}
+
+	mScratch.resize(count);
+	for(int digit = 0; digit < 8; ++digit)
+	{
+		std::uint32_t* histogram = histograms[digit];
+
+		// Every key has the same value here: nothing would move.
+		if(histogram[(mEntries[0].Key >> (8 * digit)) & 0xff] == count)
+			continue;
+
+		std::uint32_t offset = 0;
+		for(int i = 0; i < 256; ++i)
+		{
+			const std::uint32_t n = histogram[i];
+			histogram[i] = offset;
+			offset += n;
+		}
+
+		for(const auto& entry : mEntries)
+			mScratch[histogram[(entry.Key >> (8 * digit)) & 0xff]++] = entry;
+
+		mEntries.swap(mScratch);
+	}
+}
@@ -0,0 +1,153 @@
+//***************************************************************************************
+// DrawQueue.h
+//
+// Orders a frame's draws so that neighbouring draws share as much state as
+// possible, and reports which binds actually change from one draw to the next.
+//
+// Every draw gets a 64-bit key, sorted with an LSD radix sort (8 bits a pass,
+// passes where all keys agree are skipped).  From the top bit down:
+//
+//   pipeline (8) | geometry (12) | material (12) | topology (4) | depth (28)
+//
+// Pipelines marked back-to-front put the inverted depth straight after the
+// pipeline instead, so blended draws still come out farthest first.  Depth is
+// the top bits of the float itself, which sorts like the value for positive
+// numbers; no near/far range is needed.  The sort is stable, so draws with equal
+// keys keep the order they were added in.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+class DrawQueue
+{
+public:
+	static const int MaxPipelines = 256;
+	static const int MaxGeometries = 4096;
+	static const int MaxMaterials = 4096;
+	static const int MaxTopologies = 16;
+
+	// What a draw binds.  Ids only need to be equal for equal state; they are
+	// masked to the sizes above.  Pipeline also sets the pass order.
+	struct State
+	{
+		int Pipeline = 0;
+		int Geometry = 0;
+		int Material = 0;
+		int Topology = 0;
+	};
+
+	// Bits handed to Submit's callback for the binds that differ from the
+	// previous draw.  The first draw changes everything.
+	enum Change : unsigned
+	{
+		PipelineChange = 1,
+		GeometryChange = 2,
+		MaterialChange = 4,
+		TopologyChange = 8,
+		AllChanges = 15
+	};
+
+	struct Stats
+	{
+		int Draws = 0;
+		int PipelineChanges = 0;
+		int GeometryChanges = 0;
+		int MaterialChanges = 0;
+		int TopologyChanges = 0;
+
+		// Binds issued, and binds skipped against setting all four every draw.
+		int Issued()const { return PipelineChanges + GeometryChanges + MaterialChanges + TopologyChanges; }
+		int Avoided()const { return 4 * Draws - Issued(); }
+
+		Stats& operator+=(const Stats& rhs);
+	};
+
+	DrawQueue();
+
+	void SetBackToFront(int pipeline, bool backToFront);
+
+	void Clear();
+
+	// 'depth' is the view-space distance of the draw; negative values count as 0.
+	void Add(const State& state, float depth, std::uint32_t item);
+
+	void Sort();
+
+	///<summary>
+	/// Calls f(item, state, changes) for every draw in key order, where 'changes'
+	/// is a mask of Change bits, and records the counts in LastStats.
+	///</summary>
+	template<typename F>
+	void Submit(F f);
+
+	///<summary>
+	/// Same for the sorted draws [first, last) only, as if they went into a
+	/// command list of their own: the first one changes everything.  Returns the
+	/// counts instead of recording them, so ranges can run on several threads.
+	///</summary>
+	template<typename F>
+	Stats SubmitRange(int first, int last, F f)const;
+
+	int Count()const { return (int)mEntries.size(); }
+	const Stats& LastStats()const { return mStats; }
+
+	static std::uint64_t MakeKey(const State& state, float depth, bool backToFront);
+
+private:
+	struct Entry
+	{
+		std::uint64_t Key;
+		std::uint32_t Item;
+		State Binds;
+	};
+
+private:
+	std::vector<Entry> mEntries;
+	std::vector<Entry> mScratch;
+	std::vector<bool> mBackToFront;
+
+	Stats mStats;
+};
+
+template<typename F>
+void DrawQueue::Submit(F f)
+{
+	mStats = SubmitRange(0, (int)mEntries.size(), f);
+}
+
+template<typename F>
+DrawQueue::Stats DrawQueue::SubmitRange(int first, int last, F f)const
+{
+	Stats stats;
+
+	const State* prev = nullptr;
+	for(int i = first; i < last; ++i)
+	{
+		const Entry& entry = mEntries[i];
+		const State& s = entry.Binds;
+
+		unsigned changes = AllChanges;
+		if(prev != nullptr)
+		{
+			changes = 0;
+			if(s.Pipeline != prev->Pipeline) changes |= PipelineChange;
+			if(s.Geometry != prev->Geometry) changes |= GeometryChange;
+			if(s.Material != prev->Material) changes |= MaterialChange;
+			if(s.Topology != prev->Topology) changes |= TopologyChange;
+		}
+		prev = &s;
+
+		++stats.Draws;
+		if(changes & PipelineChange) ++stats.PipelineChanges;
+		if(changes & GeometryChange) ++stats.GeometryChanges;
+		if(changes & MaterialChange) ++stats.MaterialChanges;
+		if(changes & TopologyChange) ++stats.TopologyChanges;
+
+		f(entry.Item, s, changes);
+	}
+
+	return stats;
+}
@@ -0,0 +1,438 @@
+//***************************************************************************************
+// FlowField.cpp
+//***************************************************************************************
+
+#include "FlowField.h"
+
+#include <algorithm>
+#include <future>
+
+namespace
+{
+	const int StepRow[8] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+	const int StepCol[8] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+	const std::uint32_t StepCost[8] = { 10, 14, 10, 14, 10, 14, 10, 14 };
+
+	bool IsDiagonal(int d) { return (d & 1) != 0; }
+}
+
+const std::uint32_t FlowField::Unreachable;
+const int FlowField::BucketQueue::BucketCount;
+
+//
+// BucketQueue
+//
+
+void FlowField::BucketQueue::Clear()
+{
+	for(auto& bucket : mBuckets)
+		bucket.clear();
+
+	mSeeds.clear();
+	mSeedNext = 0;
+	mSize = 0;
+	mCursor = 0;
+	mSeedsSorted = true;
+}
+
+void FlowField::BucketQueue::Seed(std::uint32_t cost, int cell)
+{
+	if(!mSeeds.empty() && cost < mSeeds.back().first)
+		mSeedsSorted = false;
+
+	mSeeds.push_back(std::make_pair(cost, cell));
+}
+
+void FlowField::BucketQueue::Push(std::uint32_t cost, int cell)
+{
+	mBuckets[cost % BucketCount].push_back(std::make_pair(cost, cell));
+	++mSize;
+}
+
+void FlowField::BucketQueue::Admit()
+{
+	while(mSeedNext < mSeeds.size() && mSeeds[mSeedNext].first < mCursor + BucketCount)
+	{
+		Push(mSeeds[mSeedNext].first, mSeeds[mSeedNext].second);
+		++mSeedNext;
+	}
+}
+
+bool FlowField::BucketQueue::Pop(std::uint32_t& cost, int& cell)
+{
+	if(!mSeedsSorted)
+	{
+		std::sort(mSeeds.begin() + mSeedNext, mSeeds.end());
+		mSeedsSorted = true;
+	}
+
+	if(mSize == 0)
+	{
+		if(mSeedNext == mSeeds.size())
+			return false;
+
+		// Nothing pending, jump straight to the next seed.
+		mCursor = mSeeds[mSeedNext].first;
+	}
+
+	Admit();
+
+	while(mBuckets[mCursor % BucketCount].empty())
+	{
+		++mCursor;
+		Admit();
+	}
+
+	auto& bucket = mBuckets[mCursor % BucketCount];
+	cost = bucket.back().first;
+	cell = bucket.back().second;
+	bucket.pop_back();
+	--mSize;
+
+	return true;
+}
+
+//
+// FlowField
+//
+
+void FlowField::Resize(const TileMap& map)
+{
+	mNumRows = map.RowCount();
+	mNumCols = map.ColumnCount();
+	mStride = mNumCols + 2;
+
+	for(int d = 0; d < 8; ++d)
+		mOffset[d] = StepRow[d] * mStride + StepCol[d];
+
+	const std::size_t paddedCount = (std::size_t)(mNumRows + 2) * mStride;
+
+	mOpen.assign(paddedCount, 0);
+	for(int r = 0; r < mNumRows; ++r)
+	{
+		for(int c = 0; c < mNumCols; ++c)
+			mOpen[Pad(r, c)] = map.Get(r, c) == TileMap::Empty ? 1 : 0;
+	}
+
+	mCost.assign(paddedCount, Unreachable);
+	mDir.assign(paddedCount, None);
+	mMark.assign(paddedCount, 0);
+}
+
+bool FlowField::CanMove(int cell, int d)const
+{
+	if(!mOpen[cell + mOffset[d]])
+		return false;
+
+	// No squeezing diagonally between two walls or past a wall corner.
+	if(IsDiagonal(d))
+	{
+		return mOpen[cell + StepRow[d] * mStride] && mOpen[cell + StepCol[d]];
+	}
+
+	return true;
+}
+
+bool FlowField::IsGoal(int cell)const
+{
+	return std::find(mGoals.begin(), mGoals.end(), cell) != mGoals.end();
+}
+
+void FlowField::Build(const TileMap& map)
+{
+	Resize(map);
+
+	mQueue.Clear();
+	mSettled.clear();
+	mGoals.clear();
+
+	for(const auto& goal : mGoalCells)
+	{
+		if(!InBounds(goal.Row, goal.Col))
+			continue;
+
+		int cell = Pad(goal.Row, goal.Col);
+		if(!mOpen[cell] || mCost[cell] == 0)
+			continue;
+
+		mGoals.push_back(cell);
+		mCost[cell] = 0;
+		mQueue.Push(0, cell);
+	}
+
+	Propagate();
+
+	for(int r = 0; r < mNumRows; ++r)
+	{
+		for(int c = 0; c < mNumCols; ++c)
+			UpdateDirection(Pad(r, c));
+	}
+
+	mLastSettled = (int)mSettled.size();
+}
+
+void FlowField::Propagate()
+{
+	std::uint32_t cost;
+	int cell;
+	while(mQueue.Pop(cost, cell))
+	{
+		// Stale entry; the cell was reached more cheaply after it was queued.
+		if(cost != mCost[cell])
+			continue;
+
+		mSettled.push_back(cell);
+
+		for(int d = 0; d < 8; ++d)
+		{
+			if(!CanMove(cell, d))
+				continue;
+
+			const int next = cell + mOffset[d];
+			const std::uint32_t nextCost = cost + StepCost[d];
+			if(nextCost < mCost[next])
+			{
+				mCost[next] = nextCost;
+				mQueue.Push(nextCost, next);
+			}
+		}
+	}
+}
+
+void FlowField::UpdateDirection(int cell)
+{
+	if(!mOpen[cell] || mCost[cell] >= Unreachable)
+	{
+		mDir[cell] = None;
+		return;
+	}
+
+	if(mCost[cell] == 0)
+	{
+		mDir[cell] = Goal;
+		return;
+	}
+
+	// Point at the neighbour this cell's cost came from.  Moves are symmetric, so
+	// a legal move into the cell is also a legal move out of it.
+	std::uint32_t best = mCost[cell];
+	std::uint8_t bestDir = None;
+	for(int d = 0; d < 8; ++d)
+	{
+		const std::uint32_t through = mCost[cell + mOffset[d]] + StepCost[d];
+		if(through <= best && CanMove(cell, d))
+		{
+			best = through;
+			bestDir = (std::uint8_t)d;
+		}
+	}
+
+	mDir[cell] = bestDir;
+}
+
+void FlowField::UpdateDirectionsAround(const std::vector<int>& cells)
+{
+	for(int cell : cells)
+	{
+		UpdateDirection(cell);
+		for(int d = 0; d < 8; ++d)
+		{
+			const int next = cell + mOffset[d];
+			if(mOpen[next])
+				UpdateDirection(next);
+		}
+	}
+}
+
+void FlowField::OnTileChanged(const TileMap& map, int row, int col)
+{
+	if(map.RowCount() != mNumRows || map.ColumnCount() != mNumCols)
+	{
+		Build(map);
+		return;
+	}
+
+	if(!InBounds(row, col))
+		return;
+
+	const int cell = Pad(row, col);
+	const std::uint8_t open = map.Get(row, col) == TileMap::Empty ? 1 : 0;
+	if(open == mOpen[cell])
+		return;
+
+	// Goals come and go with their tile; rebuilding is simplest.
+	for(const auto& goal : mGoalCells)
+	{
+		if(goal.Row == row && goal.Col == col)
+		{
+			Build(map);
+			return;
+		}
+	}
+
+	mOpen[cell] = open;
+	mQueue.Clear();
+	mSettled.clear();
+
+	if(open)
+	{
+		// Costs can only drop.  Restart the search from the neighbours; they reach
+		// the new cell and any diagonal the old wall was blocking.
+		for(int d = 0; d < 8; ++d)
+		{
+			const int next = cell + mOffset[d];
+			if(mOpen[next] && mCost[next] < Unreachable)
+				mQueue.Seed(mCost[next], next);
+		}
+
+		Propagate();
+
+		mSettled.push_back(cell);
+		UpdateDirectionsAround(mSettled);
+		mLastSettled = (int)mSettled.size();
+		return;
+	}
+
+	// Costs can only rise, and only for cells whose path ran through the new
+	// wall.  Those are the cell itself, neighbours that moved diagonally past it,
+	// and everything downstream of them in the flow field.
+	mInvalid.clear();
+	mInvalid.push_back(cell);
+	mMark[cell] = 1;
+
+	for(int d = 0; d < 8; ++d)
+	{
+		const int next = cell + mOffset[d];
+		const std::uint8_t nd = mDir[next];
+		if(mMark[next] || nd >= Goal || !IsDiagonal(nd))
+			continue;
+
+		if(next + StepRow[nd] * mStride == cell || next + StepCol[nd] == cell)
+		{
+			mMark[next] = 1;
+			mInvalid.push_back(next);
+		}
+	}
+
+	for(std::size_t i = 0; i < mInvalid.size(); ++i)
+	{
+		const int parent = mInvalid[i];
+		for(int d = 0; d < 8; ++d)
+		{
+			const int child = parent + mOffset[d];
+			const std::uint8_t cd = mDir[child];
+			if(mMark[child] || cd >= Goal || child + mOffset[cd] != parent)
+				continue;
+
+			mMark[child] = 1;
+			mInvalid.push_back(child);
+		}
+	}
+
+	for(int c : mInvalid)
+	{
+		mCost[c] = Unreachable;
+		mDir[c] = None;
+	}
+
+	// Reseed each invalidated cell from its cheapest untouched neighbour.
+	for(int c : mInvalid)
+	{
+		if(!mOpen[c])
+			continue;
+
+		std::uint32_t best = Unreachable;
+		for(int d = 0; d < 8; ++d)
+		{
+			const int next = c + mOffset[d];
+			if(mMark[next] || mCost[next] >= Unreachable || !CanMove(c, d))
+				continue;
+
+			best = std::min(best, mCost[next] + StepCost[d]);
+		}
+
+		if(best < Unreachable)
+		{
+			mCost[c] = best;
+			mQueue.Seed(best, c);
+		}
+	}
+
+	for(int c : mInvalid)
+		mMark[c] = 0;
+
+	Propagate();
+
+	UpdateDirectionsAround(mInvalid);
+	mLastSettled = (int)mSettled.size();
+}
+
+void FlowField::WorldDirection(const TileMap& map, float x, float z, float& dirX, float& dirZ)const
+{
+	dirX = 0.0f;
+	dirZ = 0.0f;
+
+	int row, col;
+	if(!map.WorldToCell(x, z, row, col))
+		return;
+
+	const Direction d = At(row, col);
+	if(d >= Goal)
+		return;
+
+	// Rows run along +x and columns along +z.
+	const float s = IsDiagonal(d) ? 0.70710678f : 1.0f;
+	dirX = StepRow[d] * s;
+	dirZ = StepCol[d] * s;
+}
+
+void FlowField::Step(Direction d, int& dRow, int& dCol)
+{
+	dRow = (d < Goal) ? StepRow[d] : 0;
+	dCol = (d < Goal) ? StepCol[d] : 0;
+}
+
+//
+// FlowFieldSet
+//
+
+int FlowFieldSet::Add(const std::vector<FlowField::Cell>& goals)
+{
+	auto field = std::make_unique<FlowField>();
+	field->SetGoals(goals);
+	mFields.push_back(std::move(field));
+
+	return (int)mFields.size() - 1;
+}
+
+void FlowFieldSet::Build(const TileMap& map)
+{
+	std::vector<std::future<void>> jobs;
+	for(size_t i = 1; i < mFields.size(); ++i)
+	{
+		FlowField* field = mFields[i].get();
+		jobs.push_back(std::async(std::launch::async, [field, &map]() { field->Build(map); }));
+	}
+
+	if(!mFields.empty())
+		mFields[0]->Build(map);
+
+	for(auto& job : jobs)
+		job.get();
+}
+
+void FlowFieldSet::OnTileChanged(const TileMap& map, int row, int col)
+{
+	std::vector<std::future<void>> jobs;
+	for(size_t i = 1; i < mFields.size(); ++i)
+	{
+		FlowField* field = mFields[i].get();
+		jobs.push_back(std::async(std::launch::async, [field, &map, row, col]() { field->OnTileChanged(map, row, col); }));
+	}
+
+	if(!mFields.empty())
+		mFields[0]->OnTileChanged(map, row, col);
+
+	for(auto& job : jobs)
+		job.get();
+}
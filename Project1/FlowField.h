@@ -0,0 +1,158 @@
+//***************************************************************************************
+// FlowField.h
+//
+// Flow-field navigation over a TileMap.  An integration field holds the cost from
+// every open cell to the nearest goal (10 per straight step, 14 per diagonal, no
+// cutting past wall corners) and is built with a bucket-queue Dijkstra.  From it a
+// flow field stores, per cell, the step towards the goal, so any number of agents
+// sharing the goals can look up where to go in O(1).
+//
+// When a tile changes only the cells whose cost depends on it are recomputed.
+//***************************************************************************************
+
+#pragma once
+
+#include "TileMap.h"
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+class FlowField
+{
+public:
+	// Steps in (row, col): E = +col, N = +row.
+	enum Direction : std::uint8_t
+	{
+		East = 0,
+		NorthEast,
+		North,
+		NorthWest,
+		West,
+		SouthWest,
+		South,
+		SouthEast,
+		Goal,
+		None			// Wall or unreachable.
+	};
+
+	struct Cell
+	{
+		int Row = 0;
+		int Col = 0;
+	};
+
+	// Integration value of a cell no goal can be reached from.
+	static const std::uint32_t Unreachable = 0x3fffffff;
+
+	void SetGoals(const std::vector<Cell>& goals) { mGoalCells = goals; }
+	const std::vector<Cell>& Goals()const { return mGoalCells; }
+
+	// Full rebuild for the current goals.
+	void Build(const TileMap& map);
+
+	// Call after map.Set(row, col, ...).  The map must keep its size.
+	void OnTileChanged(const TileMap& map, int row, int col);
+
+	int RowCount()const { return mNumRows; }
+	int ColumnCount()const { return mNumCols; }
+
+	std::uint32_t Cost(int row, int col)const
+	{
+		return InBounds(row, col) ? mCost[Pad(row, col)] : Unreachable;
+	}
+
+	Direction At(int row, int col)const
+	{
+		return InBounds(row, col) ? (Direction)mDir[Pad(row, col)] : None;
+	}
+
+	// Unit xz vector to walk along from world position (x, z); zero at a goal,
+	// in a wall, off the map or where no goal is reachable.
+	void WorldDirection(const TileMap& map, float x, float z, float& dirX, float& dirZ)const;
+
+	static void Step(Direction d, int& dRow, int& dCol);
+
+	// Cells whose cost was settled by the last Build/OnTileChanged.
+	int LastSettledCount()const { return mLastSettled; }
+
+private:
+	// Dial's algorithm: step costs are at most 14, so 16 buckets indexed by
+	// cost modulo 16 hold every pending entry.  Seeds may span any range and are
+	// admitted in cost order as the cursor reaches them.
+	struct BucketQueue
+	{
+		static const int BucketCount = 16;
+
+		void Clear();
+		void Seed(std::uint32_t cost, int cell);
+		void Push(std::uint32_t cost, int cell);
+		bool Pop(std::uint32_t& cost, int& cell);
+
+	private:
+		void Admit();
+
+		std::vector<std::pair<std::uint32_t, int>> mBuckets[BucketCount];
+		std::vector<std::pair<std::uint32_t, int>> mSeeds;
+		std::size_t mSeedNext = 0;
+		std::size_t mSize = 0;
+		std::uint32_t mCursor = 0;
+		bool mSeedsSorted = true;
+	};
+
+	bool InBounds(int row, int col)const
+	{
+		return row >= 0 && col >= 0 && row < mNumRows && col < mNumCols;
+	}
+
+	// Cells are stored with a one cell closed border so neighbour lookups never
+	// need bounds checks.
+	int Pad(int row, int col)const { return (row + 1) * mStride + (col + 1); }
+
+	void Resize(const TileMap& map);
+	bool CanMove(int cell, int d)const;
+	void Propagate();
+	void UpdateDirection(int cell);
+	void UpdateDirectionsAround(const std::vector<int>& cells);
+	bool IsGoal(int cell)const;
+
+private:
+	int mNumRows = 0;
+	int mNumCols = 0;
+	int mStride = 0;
+	int mOffset[8] = {};
+
+	std::vector<Cell> mGoalCells;
+	std::vector<int> mGoals;
+
+	std::vector<std::uint32_t> mCost;
+	std::vector<std::uint8_t> mOpen;
+	std::vector<std::uint8_t> mDir;
+
+	// Scratch for incremental updates.
+	BucketQueue mQueue;
+	std::vector<int> mSettled;
+	std::vector<int> mInvalid;
+	std::vector<std::uint8_t> mMark;
+
+	int mLastSettled = 0;
+};
+
+// Several flow fields over the same map, one per goal set.  Fields are
+// independent, so builds and repairs run one field per thread.
+class FlowFieldSet
+{
+public:
+	int Add(const std::vector<FlowField::Cell>& goals);
+	void Clear() { mFields.clear(); }
+
+	void Build(const TileMap& map);
+	void OnTileChanged(const TileMap& map, int row, int col);
+
+	int FieldCount()const { return (int)mFields.size(); }
+	const FlowField& Field(int index)const { return *mFields[index]; }
+
+private:
+	std::vector<std::unique_ptr<FlowField>> mFields;
+};
@@ -4,13 +4,34 @@
 #include "../../Common/MathHelper.h"
 #include "../../Common/UploadBuffer.h"
 
-struct ObjectConstants
+// Per-object data, read from a structured buffer at the index the draw passes as
+// its only root constant.  The object names its material and, for instanced
+// items, where its instances start in the instance buffer.
+struct ObjectData
 {
-    DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
+	DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
+	DirectX::XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
+	UINT MaterialIndex = 0;
+	UINT InstanceOffset = 0;
+	UINT ObjPad0 = 0;
+	UINT ObjPad1 = 0;
+};
+
+// MaterialConstants, packed into a structured buffer instead of 256 byte
+// constant buffer slots.
+struct MaterialData
+{
+	DirectX::XMFLOAT4 DiffuseAlbedo = { 1.0f, 1.0f, 1.0f, 1.0f };
+	DirectX::XMFLOAT3 FresnelR0 = { 0.01f, 0.01f, 0.01f };
+	float Roughness = 0.25f;
+	DirectX::XMFLOAT4X4 MatTransform = MathHelper::Identity4x4();
+};
+
+// Per-instance data read by the instanced vertex shader from a structured buffer.
+struct InstanceData
+{
+	DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
 	DirectX::XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
-    DirectX::XMFLOAT2 DisplacementMapTexelSize = { 1.0f, 1.0f };
-    float GridSpatialStep = 1.0f;
-    float Pad;
 };
 
 struct PassConstants
@@ -57,8 +78,7 @@ struct FrameResource
 {
 public:
     
-    FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount, UINT waveVertCount);
-    FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount);
+    FrameResource(ID3D12Device* device, UINT objectCount, UINT materialCount, UINT recordListCount = 0);
     FrameResource(const FrameResource& rhs) = delete;
     FrameResource& operator=(const FrameResource& rhs) = delete;
     ~FrameResource();
@@ -67,15 +87,24 @@ public:
     // So each frame needs their own allocator.
     Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CmdListAlloc;
 
-    // We cannot update a cbuffer until the GPU is done processing the commands
-    // that reference it.  So each frame needs their own cbuffers.
-   // std::unique_ptr<UploadBuffer<FrameConstants>> FrameCB = nullptr;
-    std::unique_ptr<UploadBuffer<PassConstants>> PassCB = nullptr;
-    std::unique_ptr<UploadBuffer<MaterialConstants>> MaterialCB = nullptr;
-    std::unique_ptr<UploadBuffer<ObjectConstants>> ObjectCB = nullptr;
+	// An allocator and a command list for each thread recording draws; the
+	// lists are created closed.
+	std::vector<Microsoft::WRL::ComPtr<ID3D12CommandAllocator>> RecordAllocs;
+	std::vector<Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList>> RecordLists;
+
+	// Structured buffers indexed by MatCBIndex and ObjCBIndex.  Only the ranges
+	// that changed since this frame resource was last used are copied in, so
+	// their contents have to outlive the frame.
+	std::unique_ptr<UploadBuffer<MaterialData>> MaterialBuffer = nullptr;
+	std::unique_ptr<UploadBuffer<ObjectData>> ObjectBuffer = nullptr;
 
+	// Data rewritten every frame lives in the app's UploadRing instead: these
+	// are this frame's allocations, valid until Fence completes.
+	D3D12_GPU_VIRTUAL_ADDRESS PassCBAddress = 0;
+	// Visible instances of every instanced render item; 0 when there are none.
+	D3D12_GPU_VIRTUAL_ADDRESS InstanceAddress = 0;
+	D3D12_VERTEX_BUFFER_VIEW WavesVBView = {};
 
-    std::unique_ptr<UploadBuffer<Vertex>> WavesVB = nullptr;
     // Fence value to mark commands up to this fence point.  This lets us
     // check if these frame resources are still in use by the GPU.
     UINT64 Fence = 0;
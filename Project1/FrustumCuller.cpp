@@ -0,0 +1,270 @@
+//***************************************************************************************
+// FrustumCuller.cpp
+//***************************************************************************************
+
+#include "FrustumCuller.h"
+
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define FRUSTUM_CULLER_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC accepts AVX intrinsics anywhere; GCC and Clang need the function marked.
+#if defined(FRUSTUM_CULLER_X86) && (defined(__GNUC__) || defined(__clang__))
+#define FRUSTUM_CULLER_AVX_TARGET __attribute__((target("avx")))
+#else
+#define FRUSTUM_CULLER_AVX_TARGET
+#endif
+
+using namespace DirectX;
+
+namespace
+{
+	// Extent of unused slots.  d + r is then hugely negative for any normalised
+	// plane, so they never pass, and without the inf * 0 a true infinity gives.
+	const float DeadExtent = -1.0e30f;
+
+	bool CpuHasAvx()
+	{
+#if defined(FRUSTUM_CULLER_X86) && defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 1);
+
+		// The CPU has to support AVX and the OS has to save the YMM registers.
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool avx = (info[2] & (1 << 28)) != 0;
+		return osxsave && avx && (_xgetbv(0) & 6) == 6;
+#elif defined(FRUSTUM_CULLER_X86) && (defined(__GNUC__) || defined(__clang__))
+		return __builtin_cpu_supports("avx") != 0;
+#else
+		return false;
+#endif
+	}
+
+	int LowestBit(unsigned mask)
+	{
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return (int)index;
+#else
+		return __builtin_ctz(mask);
+#endif
+	}
+}
+
+const int FrustumCuller::MaxLayers;
+const std::uint8_t FrustumCuller::FreeLayer;
+
+FrustumCuller::FrustumCuller()
+{
+	mHasAvx = CpuHasAvx();
+	mUseAvx = mHasAvx;
+}
+
+void FrustumCuller::Clear()
+{
+	mCount = 0;
+	mFreeSlots.clear();
+	mCenterX.clear();
+	mCenterY.clear();
+	mCenterZ.clear();
+	mExtentX.clear();
+	mExtentY.clear();
+	mExtentZ.clear();
+	mLayer.clear();
+}
+
+int FrustumCuller::Add(const BoundingBox& worldBounds, int layer)
+{
+	int slot;
+	if(!mFreeSlots.empty())
+	{
+		slot = mFreeSlots.back();
+		mFreeSlots.pop_back();
+	}
+	else
+	{
+		slot = mCount++;
+
+		if(slot == (int)mLayer.size())
+		{
+			const std::size_t size = mLayer.size() + 8;
+			mCenterX.resize(size, 0.0f);
+			mCenterY.resize(size, 0.0f);
+			mCenterZ.resize(size, 0.0f);
+			mExtentX.resize(size, DeadExtent);
+			mExtentY.resize(size, DeadExtent);
+			mExtentZ.resize(size, DeadExtent);
+			mLayer.resize(size, FreeLayer);
+		}
+	}
+
+	mLayer[slot] = (std::uint8_t)layer;
+	Store(slot, worldBounds);
+
+	return slot;
+}
+
+void FrustumCuller::Remove(int slot)
+{
+	mCenterX[slot] = mCenterY[slot] = mCenterZ[slot] = 0.0f;
+	mExtentX[slot] = mExtentY[slot] = mExtentZ[slot] = DeadExtent;
+	mLayer[slot] = FreeLayer;
+
+	mFreeSlots.push_back(slot);
+}
+
+void FrustumCuller::SetBounds(int slot, const BoundingBox& worldBounds)
+{
+	Store(slot, worldBounds);
+}
+
+void FrustumCuller::Store(int slot, const BoundingBox& box)
+{
+	mCenterX[slot] = box.Center.x;
+	mCenterY[slot] = box.Center.y;
+	mCenterZ[slot] = box.Center.z;
+	mExtentX[slot] = box.Extents.x;
+	mExtentY[slot] = box.Extents.y;
+	mExtentZ[slot] = box.Extents.z;
+}
+
+void FrustumCuller::ExtractPlanes(const XMFLOAT4X4& m, XMFLOAT4 planes[6])
+{
+	// Row vectors: clip = v * M, so each clip coordinate is v dotted with a
+	// column.  D3D keeps 0 <= z <= w.
+	const XMFLOAT4 col0(m._11, m._21, m._31, m._41);
+	const XMFLOAT4 col1(m._12, m._22, m._32, m._42);
+	const XMFLOAT4 col2(m._13, m._23, m._33, m._43);
+	const XMFLOAT4 col3(m._14, m._24, m._34, m._44);
+
+	planes[0] = XMFLOAT4(col3.x + col0.x, col3.y + col0.y, col3.z + col0.z, col3.w + col0.w);
+	planes[1] = XMFLOAT4(col3.x - col0.x, col3.y - col0.y, col3.z - col0.z, col3.w - col0.w);
+	planes[2] = XMFLOAT4(col3.x + col1.x, col3.y + col1.y, col3.z + col1.z, col3.w + col1.w);
+	planes[3] = XMFLOAT4(col3.x - col1.x, col3.y - col1.y, col3.z - col1.z, col3.w - col1.w);
+	planes[4] = col2;
+	planes[5] = XMFLOAT4(col3.x - col2.x, col3.y - col2.y, col3.z - col2.z, col3.w - col2.w);
+
+	for(int i = 0; i < 6; ++i)
+	{
+		const float length = std::sqrt(planes[i].x * planes[i].x + planes[i].y * planes[i].y + planes[i].z * planes[i].z);
+		if(length > 0.0f)
+		{
+			planes[i].x /= length;
+			planes[i].y /= length;
+			planes[i].z /= length;
+			planes[i].w /= length;
+		}
+	}
+}
+
+void FrustumCuller::Cull(const XMFLOAT4X4& viewProj, std::vector<std::uint32_t>* visible, int layerCount)const
+{
+	XMFLOAT4 planes[6];
+	ExtractPlanes(viewProj, planes);
+	Cull(planes, visible, layerCount);
+}
+
+void FrustumCuller::Cull(const XMFLOAT4 planes[6], std::vector<std::uint32_t>* visible, int layerCount)const
+{
+	for(int i = 0; i < layerCount; ++i)
+		visible[i].clear();
+
+	if(mUseAvx)
+		CullAvx(planes, visible, layerCount);
+	else
+		CullScalar(planes, visible, layerCount);
+}
+
+void FrustumCuller::CullScalar(const XMFLOAT4 planes[6], std::vector<std::uint32_t>* visible, int layerCount)const
+{
+	// A box is out when it lies wholly behind one plane: the centre's distance
+	// plus the box's reach along the normal is still negative.  The terms are
+	// added in the AVX loop's order, so a box just touching a plane gets the
+	// same answer from both.
+	for(int i = 0; i < mCount; ++i)
+	{
+		if(mLayer[i] >= layerCount)
+			continue;
+
+		bool inside = true;
+		for(int p = 0; p < 6 && inside; ++p)
+		{
+			const XMFLOAT4& pl = planes[p];
+			float d = pl.x * mCenterX[i] + pl.w;
+			d += pl.y * mCenterY[i];
+			d += pl.z * mCenterZ[i];
+			d += std::fabs(pl.x) * mExtentX[i];
+			d += std::fabs(pl.y) * mExtentY[i];
+			d += std::fabs(pl.z) * mExtentZ[i];
+			inside = d >= 0.0f;
+		}
+
+		if(inside)
+			visible[mLayer[i]].push_back((std::uint32_t)i);
+	}
+}
+
+FRUSTUM_CULLER_AVX_TARGET
+void FrustumCuller::CullAvx(const XMFLOAT4 planes[6], std::vector<std::uint32_t>* visible, int layerCount)const
+{
+#if defined(FRUSTUM_CULLER_X86)
+	__m256 nx[6], ny[6], nz[6], ax[6], ay[6], az[6], w[6];
+	for(int p = 0; p < 6; ++p)
+	{
+		nx[p] = _mm256_set1_ps(planes[p].x);
+		ny[p] = _mm256_set1_ps(planes[p].y);
+		nz[p] = _mm256_set1_ps(planes[p].z);
+		ax[p] = _mm256_set1_ps(std::fabs(planes[p].x));
+		ay[p] = _mm256_set1_ps(std::fabs(planes[p].y));
+		az[p] = _mm256_set1_ps(std::fabs(planes[p].z));
+		w[p] = _mm256_set1_ps(planes[p].w);
+	}
+
+	const __m256 zero = _mm256_setzero_ps();
+	const int padded = (mCount + 7) & ~7;
+
+	for(int i = 0; i < padded; i += 8)
+	{
+		const __m256 cx = _mm256_loadu_ps(&mCenterX[i]);
+		const __m256 cy = _mm256_loadu_ps(&mCenterY[i]);
+		const __m256 cz = _mm256_loadu_ps(&mCenterZ[i]);
+		const __m256 ex = _mm256_loadu_ps(&mExtentX[i]);
+		const __m256 ey = _mm256_loadu_ps(&mExtentY[i]);
+		const __m256 ez = _mm256_loadu_ps(&mExtentZ[i]);
+
+		// Lanes stay set while d + r >= 0 for every plane.
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for(int p = 0; p < 6; ++p)
+		{
+			__m256 d = _mm256_add_ps(_mm256_mul_ps(nx[p], cx), w[p]);
+			d = _mm256_add_ps(d, _mm256_mul_ps(ny[p], cy));
+			d = _mm256_add_ps(d, _mm256_mul_ps(nz[p], cz));
+			d = _mm256_add_ps(d, _mm256_mul_ps(ax[p], ex));
+			d = _mm256_add_ps(d, _mm256_mul_ps(ay[p], ey));
+			d = _mm256_add_ps(d, _mm256_mul_ps(az[p], ez));
+
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, zero, _CMP_GE_OQ));
+		}
+
+		unsigned mask = (unsigned)_mm256_movemask_ps(inside);
+		while(mask != 0)
+		{
+			const int slot = i + LowestBit(mask);
+			mask &= mask - 1;
+
+			const int layer = mLayer[slot];
+			if(layer < layerCount)
+				visible[layer].push_back((std::uint32_t)slot);
+		}
+	}
+#else
+	CullScalar(planes, visible, layerCount);
+#endif
+}
@@ -0,0 +1,78 @@
+//***************************************************************************************
+// FrustumCuller.h
+//
+// Frustum culling for large numbers of world-space boxes.  Centres and extents are
+// kept in separate arrays (structure of arrays) so eight boxes can be tested
+// against a plane with a handful of AVX instructions.  Survivors are written out
+// as compact lists of slot numbers, one list per layer, ready to be drawn in order.
+//
+// The AVX path is picked at run time; machines without it use the scalar loop,
+// which gives the same answers.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+
+class FrustumCuller
+{
+public:
+	static const int MaxLayers = 255;
+
+	FrustumCuller();
+
+	// Returns the slot of the box; slots of removed boxes are reused.
+	int Add(const DirectX::BoundingBox& worldBounds, int layer);
+	void Remove(int slot);
+	void SetBounds(int slot, const DirectX::BoundingBox& worldBounds);
+	void Clear();
+
+	///<summary>
+	/// Clears visible[0..layerCount) and appends the slot of every box that is not
+	/// fully outside the frustum of 'viewProj' to the list of its layer, in slot
+	/// order.  Boxes on layers at or past layerCount are skipped.
+	///</summary>
+	void Cull(const DirectX::XMFLOAT4X4& viewProj, std::vector<std::uint32_t>* visible, int layerCount)const;
+
+	// Same test against planes already in world space (a, b, c, d with the
+	// normal pointing into the frustum).
+	void Cull(const DirectX::XMFLOAT4 planes[6], std::vector<std::uint32_t>* visible, int layerCount)const;
+
+	// Left, right, bottom, top, near and far planes of a D3D style projection,
+	// normalised, pointing inwards.
+	static void ExtractPlanes(const DirectX::XMFLOAT4X4& viewProj, DirectX::XMFLOAT4 planes[6]);
+
+	int Count()const { return mCount - (int)mFreeSlots.size(); }
+
+	bool AvxAvailable()const { return mHasAvx; }
+	// Forces the scalar loop even where AVX is available, for comparisons.
+	void SetAvxEnabled(bool enabled) { mUseAvx = enabled && mHasAvx; }
+
+private:
+	void CullScalar(const DirectX::XMFLOAT4 planes[6], std::vector<std::uint32_t>* visible, int layerCount)const;
+	void CullAvx(const DirectX::XMFLOAT4 planes[6], std::vector<std::uint32_t>* visible, int layerCount)const;
+
+	void Store(int slot, const DirectX::BoundingBox& box);
+
+private:
+	static const std::uint8_t FreeLayer = 0xff;
+
+	// Slots in use or freed; the arrays are padded to a multiple of eight with
+	// boxes that fail every plane, so the wide loop has no tail.
+	int mCount = 0;
+	std::vector<int> mFreeSlots;
+
+	std::vector<float> mCenterX;
+	std::vector<float> mCenterY;
+	std::vector<float> mCenterZ;
+	std::vector<float> mExtentX;
+	std::vector<float> mExtentY;
+	std::vector<float> mExtentZ;
+	std::vector<std::uint8_t> mLayer;
+
+	bool mHasAvx = false;
+	bool mUseAvx = false;
+};
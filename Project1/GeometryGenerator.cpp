@@ -646,7 +646,7 @@ GeometryGenerator::MeshData GeometryGenerator::CreateDiamond(float width, float
 
 
 
-	meshData.Indices32.assign(&i[0], &i[35]);
+	meshData.Indices32.assign(&i[0], &i[24]);
 
 	// Put a cap on the number of subdivisions.
 	numSubdivisions = std::min<uint32>(numSubdivisions, 6u);
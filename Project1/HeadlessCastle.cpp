@@ -0,0 +1,1166 @@
+//***************************************************************************************
+// HeadlessCastle.cpp
+//***************************************************************************************
+
+#include "HeadlessCastle.h"
+
+#include "GeometryGenerator.h"
+#include "StaticBatcher.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+	// Same layouts as the constant buffers in FrameResource.h and d3dUtil.h, so
+	// the byte counts match the app's.
+	const int MaxLights = 16;
+
+	struct Light
+	{
+		XMFLOAT3 Strength = { 0.5f, 0.5f, 0.5f };
+		float FalloffStart = 1.0f;
+		XMFLOAT3 Direction = { 0.0f, -1.0f, 0.0f };
+		float FalloffEnd = 10.0f;
+		XMFLOAT3 Position = { 0.0f, 0.0f, 0.0f };
+		float SpotPower = 64.0f;
+	};
+
+	struct PassConstants
+	{
+		XMFLOAT4X4 View;
+		XMFLOAT4X4 InvView;
+		XMFLOAT4X4 Proj;
+		XMFLOAT4X4 InvProj;
+		XMFLOAT4X4 ViewProj;
+		XMFLOAT4X4 InvViewProj;
+		XMFLOAT3 EyePosW = { 0.0f, 0.0f, 0.0f };
+		float cbPerObjectPad1 = 0.0f;
+		XMFLOAT2 RenderTargetSize = { 0.0f, 0.0f };
+		XMFLOAT2 InvRenderTargetSize = { 0.0f, 0.0f };
+		float NearZ = 0.0f;
+		float FarZ = 0.0f;
+		float TotalTime = 0.0f;
+		float DeltaTime = 0.0f;
+		XMFLOAT4 AmbientLight = { 0.0f, 0.0f, 0.0f, 1.0f };
+		XMFLOAT4 FogColor = { 0.7f, 0.7f, 0.7f, 1.0f };
+		float gFogStart = 5.0f;
+		float gFogRange = 150.0f;
+		XMFLOAT2 cbPerObjectPad2 = { 0.0f, 0.0f };
+		Light Lights[MaxLights];
+	};
+
+	// Passes in the app's draw order, with the PSO each one uses.  The pass index
+	// is the pipeline id.
+	struct Pass
+	{
+		CastleLayout::Layer Layer;
+		IRenderDevice::Shader Program;
+		bool AlphaTest;
+		bool Blend;
+		bool CullBack;
+	};
+
+	const Pass Passes[] =
+	{
+		{ CastleLayout::Opaque, IRenderDevice::Shader::Default, false, false, true },
+		{ CastleLayout::InstancedOpaque, IRenderDevice::Shader::Instanced, false, false, true },
+		{ CastleLayout::AlphaTested, IRenderDevice::Shader::Default, true, false, false },
+		{ CastleLayout::InstancedAlphaTested, IRenderDevice::Shader::Instanced, true, false, false },
+		{ CastleLayout::AlphaTestedTreeSprites, IRenderDevice::Shader::TreeSprite, true, false, false },
+		{ CastleLayout::Transparent, IRenderDevice::Shader::Default, false, true, true },
+	};
+
+	const int PassCount = (int)(sizeof(Passes) / sizeof(Passes[0]));
+
+	XMFLOAT4X4 Identity()
+	{
+		XMFLOAT4X4 m;
+		XMStoreFloat4x4(&m, XMMatrixIdentity());
+		return m;
+	}
+
+	XMFLOAT4X4 Store(FXMMATRIX m)
+	{
+		XMFLOAT4X4 f;
+		XMStoreFloat4x4(&f, m);
+		return f;
+	}
+
+	// True when the box is wholly behind one of the planes.
+	bool Outside(const XMFLOAT4 planes[6], const BoundingBox& box)
+	{
+		for(int i = 0; i < 6; ++i)
+		{
+			const XMFLOAT4& p = planes[i];
+			float d = p.x * box.Center.x + p.y * box.Center.y + p.z * box.Center.z + p.w;
+			float r = fabsf(p.x) * box.Extents.x + fabsf(p.y) * box.Extents.y + fabsf(p.z) * box.Extents.z;
+			if(d + r < 0.0f)
+				return true;
+		}
+		return false;
+	}
+
+	BoundingBox BoundsOf(const std::vector<GeometryGenerator::Vertex>& vertices)
+	{
+		XMVECTOR vMin = XMVectorReplicate(+FLT_MAX);
+		XMVECTOR vMax = XMVectorReplicate(-FLT_MAX);
+		for(const auto& v : vertices)
+		{
+			XMVECTOR p = XMLoadFloat3(&v.Position);
+			vMin = XMVectorMin(vMin, p);
+			vMax = XMVectorMax(vMax, p);
+		}
+
+		BoundingBox box;
+		BoundingBox::CreateFromPoints(box, vMin, vMax);
+		return box;
+	}
+}
+
+HeadlessCastle::HeadlessCastle(IRenderDevice& device, int frameResourceCount, int maxRecordLists)
+	: mDevice(device),
+	mFrameResourceCount(std::max(frameResourceCount, 1)),
+	mMaxRecordLists(std::max(maxRecordLists, 1)),
+	mObjectData(mFrameResourceCount),
+	mMaterialData(mFrameResourceCount),
+	mRandom(5489u),
+	mChunkStreamer(8)
+{
+	mUpdateTileChunksStage = mTimer.AddStage("UpdateTileChunks");
+	mUpdateTransformsStage = mTimer.AddStage("UpdateTransforms");
+	mUpdateObjectCBsStage = mTimer.AddStage("UpdateObjectCBs");
+	mUpdateInstanceDataStage = mTimer.AddStage("UpdateInstanceData");
+	mUpdateMaterialCBsStage = mTimer.AddStage("UpdateMaterialCBs");
+	mUpdateMainPassCBStage = mTimer.AddStage("UpdateMainPassCB");
+	mUpdateWavesStage = mTimer.AddStage("UpdateWaves");
+	mCullRenderItemsStage = mTimer.AddStage("CullRenderItems");
+	mDrawRenderItemsStage = mTimer.AddStage("DrawRenderItems");
+	mFrameStage = mTimer.AddStage("Frame");
+
+	Resize(mClientWidth, mClientHeight);
+}
+
+HeadlessCastle::~HeadlessCastle()
+{
+	mChunkStreamer.Stop();
+}
+
+void HeadlessCastle::Resize(int width, int height)
+{
+	mClientWidth = std::max(width, 1);
+	mClientHeight = std::max(height, 1);
+
+	XMStoreFloat4x4(&mProj, XMMatrixPerspectiveFovLH(0.25f * XM_PI, (float)mClientWidth / mClientHeight, 1.0f, 1000.0f));
+}
+
+bool HeadlessCastle::Initialize(const std::string& mapPath, int castleCopies, const std::string& textureDir)
+{
+	mWaves = std::make_unique<Waves>(128, 128, 1.0f, 0.03f, 4.0f, 0.2f);
+
+	// Same placement as the app: 4x4 unit cells with 10 unit walls from (112, -36).
+	bool mapLoaded = mTileMap.LoadFromFile(mapPath);
+	if(!mapLoaded)
+		mLastError = mapPath + ": " + mTileMap.LastError();
+	mTileMap.SetPlacement(112.0f, -36.0f, 4.0f, 10.0f);
+
+	if(mTileMap.RowCount() > 0)
+	{
+		mPathEnd = mTileMap.CellCenter(mTileMap.RowCount() / 2, mTileMap.ColumnCount() / 2);
+		mPathEnd.y = 2.0f;
+	}
+
+	BuildGeometry();
+	BuildMaterials();
+	BuildItems(castleCopies);
+	BuildStaticBatches();
+	BuildCullingData();
+	BuildFrameBuffers();
+	BuildPipelines();
+	bool texturesLoaded = LoadTextures(textureDir);
+
+	UpdateCamera();
+
+	// Mesh the chunks around the start so the first frame has walls.
+	mChunkStreamer.SetRadii(128.0f, 160.0f);
+	mChunkStreamer.Start(2);
+	UpdateTileChunks();
+	mChunkStreamer.Flush();
+	UploadTileChunks();
+
+	return mapLoaded && texturesLoaded;
+}
+
+HeadlessCastle::GeometryHandle HeadlessCastle::AddGeometry(const std::string& name,
+	std::vector<Vertex> vertices, std::vector<std::uint32_t> indices)
+{
+	auto geo = std::make_unique<Geometry>();
+	geo->Vertices = std::move(vertices);
+	geo->Indices = std::move(indices);
+
+	geo->VertexBuffer = mDevice.CreateBuffer(IRenderDevice::BufferType::Vertex, sizeof(Vertex), (std::uint32_t)geo->Vertices.size());
+	mDevice.WriteBuffer(geo->VertexBuffer, 0, geo->Vertices.data(), (std::uint32_t)geo->Vertices.size());
+
+	geo->IndexBuffer = mDevice.CreateBuffer(IRenderDevice::BufferType::Index, sizeof(std::uint32_t), (std::uint32_t)geo->Indices.size());
+	mDevice.WriteBuffer(geo->IndexBuffer, 0, geo->Indices.data(), (std::uint32_t)geo->Indices.size());
+
+	return mGeometries.Add(name, std::move(geo));
+}
+
+void HeadlessCastle::BuildGeometry()
+{
+	auto convert = [](const GeometryGenerator::MeshData& mesh, std::vector<Vertex>& vertices)
+	{
+		for(const auto& v : mesh.Vertices)
+		{
+			Vertex out;
+			out.Pos = v.Position;
+			out.Normal = v.Normal;
+			out.TexC = v.TexC;
+			vertices.push_back(out);
+		}
+	};
+
+	// Land and castle shapes as CastleLayout describes them.
+	{
+		GeometryGenerator::MeshData grid = CastleLayout::BuildLand();
+
+		std::vector<Vertex> vertices;
+		convert(grid, vertices);
+
+		Submesh submesh;
+		submesh.IndexCount = (std::uint32_t)grid.Indices32.size();
+		submesh.Bounds = BoundsOf(grid.Vertices);
+
+		Geometry* geo = mGeometries[AddGeometry("landGeo", std::move(vertices), grid.Indices32)].get();
+		geo->DrawArgs["grid"] = submesh;
+	}
+
+	{
+		std::vector<CastleLayout::ShapeRange> ranges;
+		GeometryGenerator::MeshData shapes = CastleLayout::BuildShapes(ranges);
+
+		std::vector<Vertex> vertices;
+		convert(shapes, vertices);
+
+		Geometry* geo = mGeometries[AddGeometry("shapeGeo", std::move(vertices), std::move(shapes.Indices32))].get();
+		for(const auto& range : ranges)
+		{
+			Submesh& submesh = geo->DrawArgs[range.Name];
+			submesh.IndexCount = range.IndexCount;
+			submesh.StartIndexLocation = range.StartIndexLocation;
+			submesh.BaseVertexLocation = range.BaseVertexLocation;
+			submesh.Bounds = range.Bounds;
+		}
+	}
+
+	// Waves: the index buffer is fixed; each frame writes its own vertex buffer.
+	{
+		const int m = mWaves->RowCount();
+		const int n = mWaves->ColumnCount();
+
+		std::vector<std::uint32_t> indices;
+		indices.reserve(3 * mWaves->TriangleCount());
+		for(int i = 0; i < m - 1; ++i)
+		{
+			for(int j = 0; j < n - 1; ++j)
+			{
+				const std::uint32_t quad[6] =
+				{
+					(std::uint32_t)(i * n + j), (std::uint32_t)(i * n + j + 1), (std::uint32_t)((i + 1) * n + j),
+					(std::uint32_t)((i + 1) * n + j), (std::uint32_t)(i * n + j + 1), (std::uint32_t)((i + 1) * n + j + 1),
+				};
+				indices.insert(indices.end(), quad, quad + 6);
+			}
+		}
+
+		Submesh submesh;
+		submesh.IndexCount = (std::uint32_t)indices.size();
+
+		mWavesGeo = AddGeometry("waterGeo", std::vector<Vertex>(mWaves->VertexCount()), std::move(indices));
+		Geometry* geo = mGeometries[mWavesGeo].get();
+		geo->DrawArgs["grid"] = submesh;
+	}
+
+	// Tree sprites.  Only the positions matter here, so the size goes in the
+	// normal.
+	{
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+		std::vector<Vertex> vertices(CastleLayout::TreeCount);
+		std::vector<std::uint32_t> indices(CastleLayout::TreeCount);
+		for(int i = 0; i < CastleLayout::TreeCount; ++i)
+		{
+			const float u = unit(mRandom);
+			const float v = unit(mRandom);
+			vertices[i].Pos = CastleLayout::TreePosition(i, u, v);
+			vertices[i].Normal = XMFLOAT3(CastleLayout::TreeSize, CastleLayout::TreeSize, 0.0f);
+			indices[i] = i;
+		}
+
+		Submesh submesh;
+		submesh.IndexCount = (std::uint32_t)CastleLayout::TreeCount;
+		submesh.Bounds = BoundingBox(XMFLOAT3(0.0f, 2.5f, 0.0f), XMFLOAT3(17.5f, 5.0f, 37.5f));
+
+		Geometry* geo = mGeometries[AddGeometry("treeSpritesGeo", std::move(vertices), std::move(indices))].get();
+		geo->DrawArgs["points"] = submesh;
+	}
+}
+
+void HeadlessCastle::BuildMaterials()
+{
+	mMaterials.resize(CastleLayout::MaterialCount);
+	for(int i = 0; i < CastleLayout::MaterialCount; ++i)
+	{
+		const CastleLayout::MaterialDesc& desc = CastleLayout::Materials[i];
+		mMaterials[i].DiffuseAlbedo = desc.DiffuseAlbedo;
+		mMaterials[i].FresnelR0 = desc.FresnelR0;
+		mMaterials[i].Roughness = desc.Roughness;
+		mMaterials[i].MatTransform = Identity();
+		mMaterials[i].NumFramesDirty = mFrameResourceCount;
+	}
+}
+
+HeadlessCastle::Item* HeadlessCastle::AddItem(Layer layer, GeometryHandle geo, const std::string& submesh, int material)
+{
+	const Submesh& args = mGeometries[geo]->DrawArgs[submesh];
+
+	auto item = std::make_unique<Item>();
+	item->Node = mScene.Create();
+	mScene.Material(item->Node) = (std::uint32_t)material;
+	mScene.Bounds(item->Node) = args.Bounds;
+	mScene.Geometry(item->Node) = geo.Index;
+	item->IndexCount = args.IndexCount;
+	item->StartIndexLocation = args.StartIndexLocation;
+	item->BaseVertexLocation = args.BaseVertexLocation;
+
+	Item* result = item.get();
+	MarkDirty(result);
+	if(layer != CastleLayout::LayerCount)
+		mLayers[layer].push_back(result);
+	mAllItems.push_back(std::move(item));
+	return result;
+}
+
+void HeadlessCastle::BuildItems(int castleCopies)
+{
+	const GeometryHandle shapes = mGeometries.Find("shapeGeo");
+
+	const CastleLayout::Placement land = CastleLayout::LandPlacement();
+	Item* landItem = AddItem(CastleLayout::Opaque, mGeometries.Find("landGeo"), "grid", CastleLayout::Grass);
+	mScene.World(landItem->Node) = land.World;
+	mScene.TexTransform(landItem->Node) = land.TexTransform;
+
+	const std::vector<CastleLayout::InstancedProp> instancedProps = CastleLayout::InstancedProps();
+
+	// Copies after the first go alternately either side along z.
+	for(int copy = 0; copy < std::max(castleCopies, 1); ++copy)
+	{
+		const float offsetZ = (copy % 2 ? 60.0f : -60.0f) * ((copy + 1) / 2);
+		const XMMATRIX offset = XMMatrixTranslation(0.0f, 0.0f, offsetZ);
+
+		// Props are placed relative to their group, as in BuildRenderItems; the
+		// copy's offset goes on the root.
+		std::uint32_t groups[CastleLayout::GroupCount];
+		for(int g = 0; g < CastleLayout::GroupCount; ++g)
+		{
+			const CastleLayout::GroupDesc& group = CastleLayout::Groups[g];
+			XMMATRIX local = XMMatrixTranslation(group.Translation.x, group.Translation.y, group.Translation.z);
+			if(group.Parent < 0)
+				groups[g] = mTransforms.Add(TransformHierarchy::NoParent, Store(local * offset));
+			else
+				groups[g] = mTransforms.Add(groups[group.Parent], Store(local));
+		}
+
+		for(int i = 0; i < CastleLayout::PropCount; ++i)
+		{
+			const CastleLayout::Prop& prop = CastleLayout::Props[i];
+			Item* item = AddItem(prop.Layer, shapes, prop.Shape, prop.Material);
+			AttachItem(item, groups[prop.Parent], prop.Local());
+		}
+
+		for(const auto& prop : instancedProps)
+		{
+			Item* item = AddItem(prop.Layer, shapes, prop.Shape, prop.Material);
+			for(const auto& world : prop.Worlds)
+				item->Instances.push_back({ Store(XMLoadFloat4x4(&world) * offset), Identity() });
+		}
+	}
+
+	const CastleLayout::Placement water = CastleLayout::WaterPlacement();
+	mWavesItem = AddItem(CastleLayout::Transparent, mWavesGeo, "grid", CastleLayout::Water);
+	mScene.World(mWavesItem->Node) = water.World;
+	mScene.TexTransform(mWavesItem->Node) = water.TexTransform;
+
+	Item* trees = AddItem(CastleLayout::AlphaTestedTreeSprites, mGeometries.Find("treeSpritesGeo"), "points", CastleLayout::TreeSprites);
+	trees->Topology = IRenderDevice::PointList;
+
+	for(const auto& placement : CastleLayout::OutsideWalls())
+	{
+		Item* wall = AddItem(CastleLayout::AlphaTested, shapes, "box", CastleLayout::Bricks);
+		mScene.World(wall->Node) = placement.World;
+		mScene.TexTransform(wall->Node) = placement.TexTransform;
+		wall->Collidable = true;
+	}
+
+	// Identity item the streamed chunks are drawn with; never drawn itself.
+	mChunkBaseItem = AddItem(CastleLayout::LayerCount, shapes, "box", CastleLayout::Bricks);
+
+	UpdateTransforms();
+
+	for(std::size_t i = 0; i < mAllItems.size(); ++i)
+		mAllItems[i]->ObjIndex = (int)i;
+
+	// Instances keep their place in the buffer; culled ones are just not written.
+	mInstanceCount = 0;
+	for(const auto& e : mAllItems)
+	{
+		e->InstanceBufferOffset = mInstanceCount;
+		mInstanceCount += (std::uint32_t)e->Instances.size();
+	}
+}
+
+void HeadlessCastle::AttachItem(Item* item, std::uint32_t parent, FXMMATRIX local)
+{
+	item->Transform = mTransforms.Add(parent, Store(local));
+	if(item->Transform >= mTransformItems.size())
+		mTransformItems.resize(item->Transform + 1, nullptr);
+	mTransformItems[item->Transform] = item;
+}
+
+void HeadlessCastle::UpdateTransforms()
+{
+	mChangedTransforms.clear();
+	mTransforms.Update(mChangedTransforms);
+
+	for(std::uint32_t id : mChangedTransforms)
+	{
+		Item* item = mTransformItems[id];
+		if(item == nullptr)
+			continue;
+
+		mScene.World(item->Node) = mTransforms.World(id);
+		MarkDirty(item);
+	}
+}
+
+void HeadlessCastle::BuildStaticBatches()
+{
+	// As in the app: opaque and alpha tested items never move, so they are baked
+	// into one mesh per (layer, material).
+	const Layer layers[] = { CastleLayout::Opaque, CastleLayout::AlphaTested };
+
+	StaticBatcher<Vertex> batcher;
+	for(Layer layer : layers)
+	{
+		std::vector<Item*> unbatched;
+		for(Item* ri : mLayers[layer])
+		{
+			if(!ri->Instances.empty() || ri->Topology != IRenderDevice::TriangleList)
+			{
+				unbatched.push_back(ri);
+				continue;
+			}
+
+			StaticBatcher<Vertex>::Item item;
+			item.Layer = layer;
+			item.MaterialIndex = (int)mScene.Material(ri->Node);
+			const Geometry* geo = GeometryOf(ri);
+			item.Vertices = geo->Vertices.data();
+			item.Indices32 = geo->Indices.data();
+			item.IndexCount = ri->IndexCount;
+			item.StartIndexLocation = ri->StartIndexLocation;
+			item.BaseVertexLocation = ri->BaseVertexLocation;
+			item.World = mScene.World(ri->Node);
+			item.TexTransform = mScene.TexTransform(ri->Node);
+			item.UserData = ri;
+			batcher.Add(item);
+		}
+
+		mLayers[layer] = unbatched;
+	}
+
+	std::vector<StaticBatcher<Vertex>::Batch> batches;
+	batcher.Build(batches);
+
+	for(std::size_t i = 0; i < batches.size(); ++i)
+	{
+		auto& batch = batches[i];
+
+		Submesh whole;
+		whole.IndexCount = (std::uint32_t)batch.Indices.size();
+		whole.Bounds = batch.Bounds;
+
+		GeometryHandle geo = AddGeometry("staticBatch" + std::to_string(i), std::move(batch.Vertices), std::move(batch.Indices));
+		mGeometries[geo]->DrawArgs["batch"] = whole;
+
+		Item* item = AddItem((Layer)batch.Layer, geo, "batch", batch.MaterialIndex);
+		item->ObjIndex = (int)mAllItems.size() - 1;
+	}
+}
+
+void HeadlessCastle::BuildCullingData()
+{
+	mStaticBvh.Clear();
+	mBvhItems.clear();
+	mOcclusion.ClearOccluders();
+
+	for(int layer = 0; layer < CastleLayout::LayerCount; ++layer)
+	{
+		for(Item* ri : mLayers[layer])
+		{
+			// Items without bounds (the waves) are never culled.
+			BoundingBox& bounds = mScene.Bounds(ri->Node);
+			if(bounds.Extents.x == 0.0f && bounds.Extents.y == 0.0f && bounds.Extents.z == 0.0f)
+				bounds.Extents = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+
+			ri->BvhSlot = mStaticBvh.Add(WorldBounds(ri), layer);
+
+			if(ri->BvhSlot >= (int)mBvhItems.size())
+				mBvhItems.resize(ri->BvhSlot + 1, nullptr);
+			mBvhItems[ri->BvhSlot] = ri;
+		}
+	}
+
+	// The outer walls went into a batch, but their own bounds still occlude.
+	for(const auto& e : mAllItems)
+	{
+		if(e->Collidable)
+			mOcclusion.AddOccluder(WorldBounds(e.get()));
+	}
+}
+
+void HeadlessCastle::BuildFrameBuffers()
+{
+	mFrames.resize(mFrameResourceCount);
+	for(auto& frame : mFrames)
+	{
+		frame.PassCB = mDevice.CreateBuffer(IRenderDevice::BufferType::Constant, sizeof(PassConstants), 1);
+		frame.ObjectBuffer = mDevice.CreateBuffer(IRenderDevice::BufferType::Structured, sizeof(ObjectData), (std::uint32_t)mAllItems.size());
+		frame.MaterialBuffer = mDevice.CreateBuffer(IRenderDevice::BufferType::Structured, sizeof(MaterialData), (std::uint32_t)mMaterials.size());
+		frame.InstanceBuffer = mDevice.CreateBuffer(IRenderDevice::BufferType::Structured, sizeof(Instance), std::max(mInstanceCount, 1u));
+		frame.WavesVB = mDevice.CreateBuffer(IRenderDevice::BufferType::Vertex, sizeof(Vertex), (std::uint32_t)mWaves->VertexCount());
+	}
+}
+
+void HeadlessCastle::BuildPipelines()
+{
+	for(int pass = 0; pass < PassCount; ++pass)
+	{
+		IRenderDevice::PipelineDesc desc;
+		desc.Program = Passes[pass].Program;
+		desc.AlphaTest = Passes[pass].AlphaTest;
+		desc.Blend = Passes[pass].Blend;
+		desc.CullBack = Passes[pass].CullBack;
+		mDevice.CreatePipeline(pass, desc);
+	}
+}
+
+bool HeadlessCastle::LoadTextures(const std::string& textureDir)
+{
+	bool loaded = true;
+	for(int i = 0; i < CastleLayout::MaterialCount; ++i)
+	{
+		const std::string path = textureDir + "/" + CastleLayout::Materials[i].TextureFile;
+		if(!mDevice.CreateTexture(i, path) && loaded)
+		{
+			// Keep the map's error, if any, ahead of the first texture's.
+			mLastError += (mLastError.empty() ? "" : "; ") + path + ": cannot load";
+			loaded = false;
+		}
+	}
+	return loaded;
+}
+
+BoundingBox HeadlessCastle::WorldBounds(const Item* ri)const
+{
+	const BoundingBox& bounds = mScene.Bounds(ri->Node);
+	if(bounds.Extents.x == FLT_MAX)
+		return bounds;
+
+	BoundingBox world;
+	if(ri->Instances.empty())
+	{
+		bounds.Transform(world, XMLoadFloat4x4(&mScene.World(ri->Node)));
+		return world;
+	}
+
+	bounds.Transform(world, XMLoadFloat4x4(&ri->Instances[0].World));
+	for(std::size_t i = 1; i < ri->Instances.size(); ++i)
+	{
+		BoundingBox instance;
+		bounds.Transform(instance, XMLoadFloat4x4(&ri->Instances[i].World));
+		BoundingBox::CreateMerged(world, world, instance);
+	}
+	return world;
+}
+
+void HeadlessCastle::Frame(float dt)
+{
+	StageTimer::Scope frameScope(mTimer, mFrameStage);
+
+	mTotalTime += dt;
+	UpdateCamera();
+
+	// Null devices finish every frame at once; buffers are still cycled so the
+	// writes land where a GPU backend would put them.
+	mCurrFrame = (mCurrFrame + 1) % mFrameResourceCount;
+	++mFrameNumber;
+
+	{
+		StageTimer::Scope scope(mTimer, mUpdateTileChunksStage);
+		UpdateTileChunks();
+		if(mWaitForChunks)
+			mChunkStreamer.Flush();
+		UploadTileChunks();
+	}
+
+	{
+		StageTimer::Scope scope(mTimer, mUpdateTransformsStage);
+		UpdateTransforms();
+	}
+
+	AnimateMaterials(dt);
+
+	{
+		StageTimer::Scope scope(mTimer, mUpdateObjectCBsStage);
+		UpdateObjectCBs();
+	}
+	{
+		StageTimer::Scope scope(mTimer, mUpdateInstanceDataStage);
+		UpdateInstanceData();
+	}
+	{
+		StageTimer::Scope scope(mTimer, mUpdateMaterialCBsStage);
+		UpdateMaterialCBs();
+	}
+	{
+		StageTimer::Scope scope(mTimer, mUpdateMainPassCBStage);
+		UpdateMainPassCB();
+	}
+	{
+		StageTimer::Scope scope(mTimer, mUpdateWavesStage);
+		UpdateWaves(dt);
+	}
+	{
+		StageTimer::Scope scope(mTimer, mCullRenderItemsStage);
+		CullRenderItems();
+	}
+	{
+		StageTimer::Scope scope(mTimer, mDrawRenderItemsStage);
+		DrawRenderItems();
+	}
+
+	mDevice.Present();
+}
+
+void HeadlessCastle::UpdateCamera()
+{
+	// An ellipse through the castle and the middle of the maze, walked at head
+	// height once a minute, looking along the path.
+	const float angle = 2.0f * XM_PI * mTotalTime / 60.0f;
+	const float cx = 0.5f * (mPathStart.x + mPathEnd.x);
+	const float cz = 0.5f * (mPathStart.z + mPathEnd.z);
+	const float rx = 0.5f * fabsf(mPathEnd.x - mPathStart.x) + 20.0f;
+	const float rz = 40.0f;
+
+	mEyePos = XMFLOAT3(cx + rx * cosf(angle), 2.0f, cz + rz * sinf(angle));
+
+	XMVECTOR look = XMVector3Normalize(XMVectorSet(-rx * sinf(angle), 0.0f, rz * cosf(angle), 0.0f));
+	XMStoreFloat3(&mLook, look);
+
+	XMVECTOR eye = XMLoadFloat3(&mEyePos);
+	XMStoreFloat4x4(&mView, XMMatrixLookAtLH(eye, eye + look, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)));
+}
+
+void HeadlessCastle::UpdateTileChunks()
+{
+	// Free the buffers of evicted chunks once no frame in flight can use them.
+	for(auto& retired : mRetiredGeos)
+	{
+		if(retired.first + mFrameResourceCount <= mFrameNumber)
+		{
+			mDevice.ReleaseBuffer(retired.second->VertexBuffer);
+			mDevice.ReleaseBuffer(retired.second->IndexBuffer);
+			retired.second.reset();
+		}
+	}
+	mRetiredGeos.erase(std::remove_if(mRetiredGeos.begin(), mRetiredGeos.end(),
+		[](const std::pair<std::uint64_t, std::unique_ptr<Geometry>>& r) { return r.second == nullptr; }),
+		mRetiredGeos.end());
+
+	if(mTileMap.RowCount() == 0)
+		return;
+
+	std::vector<TileChunkStreamer::Key> evicted;
+	mChunkStreamer.Update(mTileMap, mEyePos.x, mEyePos.z, evicted);
+
+	for(auto& chunk : evicted)
+		ReleaseTileChunk(TileChunkStreamer::Pack(chunk));
+}
+
+void HeadlessCastle::UploadTileChunks()
+{
+	std::vector<std::unique_ptr<TileChunkStreamer::ChunkMesh>> ready;
+	mChunkStreamer.TakeReady(ready);
+
+	for(auto& chunk : ready)
+	{
+		const std::uint64_t key = TileChunkStreamer::Pack(chunk->Chunk);
+		ReleaseTileChunk(key);
+
+		TileMapMesher::Output& walls = chunk->Mesh;
+		if(walls.Mesh.Indices32.empty())
+			continue;
+
+		std::vector<Vertex> vertices(walls.Mesh.Vertices.size());
+		for(std::size_t i = 0; i < walls.Mesh.Vertices.size(); ++i)
+		{
+			vertices[i].Pos = walls.Mesh.Vertices[i].Position;
+			vertices[i].Normal = walls.Mesh.Vertices[i].Normal;
+			vertices[i].TexC = walls.Mesh.Vertices[i].TexC;
+		}
+
+		Chunk streamed;
+		auto chunkGeo = std::make_unique<Geometry>();
+		Geometry* geo = chunkGeo.get();
+		geo->VertexBuffer = mDevice.CreateBuffer(IRenderDevice::BufferType::Vertex, sizeof(Vertex), (std::uint32_t)vertices.size());
+		mDevice.WriteBuffer(geo->VertexBuffer, 0, vertices.data(), (std::uint32_t)vertices.size());
+		geo->IndexBuffer = mDevice.CreateBuffer(IRenderDevice::BufferType::Index, sizeof(std::uint32_t), (std::uint32_t)walls.Mesh.Indices32.size());
+		mDevice.WriteBuffer(geo->IndexBuffer, 0, walls.Mesh.Indices32.data(), (std::uint32_t)walls.Mesh.Indices32.size());
+		streamed.Geo = mGeometries.Add("tileChunk" + std::to_string(key), std::move(chunkGeo));
+
+		// Chunks are built in world space and never move.
+		streamed.Ritem = std::make_unique<Item>();
+		Item* ritem = streamed.Ritem.get();
+		ritem->Node = mScene.Create();
+		mScene.Material(ritem->Node) = mScene.Material(mChunkBaseItem->Node);
+		mScene.Bounds(ritem->Node) = walls.Bounds;
+		mScene.WorldBounds(ritem->Node) = walls.Bounds;
+		ritem->ObjIndex = mChunkBaseItem->ObjIndex;
+		mScene.Geometry(ritem->Node) = streamed.Geo.Index;
+		ritem->IndexCount = (std::uint32_t)walls.Mesh.Indices32.size();
+		mLayers[CastleLayout::AlphaTested].push_back(ritem);
+
+		ritem->CullSlot = mCuller.Add(walls.Bounds, CastleLayout::AlphaTested);
+		if(ritem->CullSlot >= (int)mCullItems.size())
+			mCullItems.resize(ritem->CullSlot + 1, nullptr);
+		mCullItems[ritem->CullSlot] = ritem;
+
+		// The boxes are owned by the chunk's cull slot, so its own walls never hide it.
+		for(auto& box : walls.Boxes)
+			streamed.Occluders.push_back(mOcclusion.AddOccluder(box, ritem->CullSlot));
+
+		mChunks[key] = std::move(streamed);
+	}
+}
+
+void HeadlessCastle::ReleaseTileChunk(std::uint64_t key)
+{
+	auto it = mChunks.find(key);
+	if(it == mChunks.end())
+		return;
+
+	auto& layer = mLayers[CastleLayout::AlphaTested];
+	layer.erase(std::remove(layer.begin(), layer.end(), it->second.Ritem.get()), layer.end());
+
+	mCuller.Remove(it->second.Ritem->CullSlot);
+	mCullItems[it->second.Ritem->CullSlot] = nullptr;
+
+	for(int occluder : it->second.Occluders)
+		mOcclusion.RemoveOccluder(occluder);
+
+	mScene.Destroy(it->second.Ritem->Node);
+	mRetiredGeos.push_back(std::make_pair(mFrameNumber, mGeometries.Remove(it->second.Geo)));
+	mChunks.erase(it);
+}
+
+void HeadlessCastle::AnimateMaterials(float dt)
+{
+	Material& water = mMaterials[CastleLayout::Water];
+	float& tu = water.MatTransform(3, 0);
+	float& tv = water.MatTransform(3, 1);
+	tu += 0.1f * dt;
+	tv += 0.02f * dt;
+
+	if(tu >= 1.0f)
+		tu -= 1.0f;
+
+	if(tv >= 1.0f)
+		tv -= 1.0f;
+
+	water.NumFramesDirty = mFrameResourceCount;
+}
+
+void HeadlessCastle::MarkDirty(Item* item)
+{
+	if(mScene.MarkDirty(item->Node))
+		mDirtyItems.push_back(item);
+}
+
+void HeadlessCastle::UpdateObjectCBs()
+{
+	// Packing marks the element dirty in every frame's buffer, so items are
+	// visited once per change instead of once per frame resource, and only the
+	// changed ones are visited at all.  Their world bounds are cached in mScene
+	// for the occlusion test.
+	mObjectData.Resize((std::uint32_t)mAllItems.size());
+	for(Item* e : mDirtyItems)
+	{
+		const std::uint32_t node = mScene.Index(e->Node);
+
+		ObjectData data;
+		XMStoreFloat4x4(&data.World, XMMatrixTranspose(XMLoadFloat4x4(&mScene.Worlds()[node])));
+		XMStoreFloat4x4(&data.TexTransform, XMMatrixTranspose(XMLoadFloat4x4(&mScene.TexTransform(e->Node))));
+		data.MaterialIndex = mScene.Materials()[node];
+		data.InstanceOffset = e->InstanceBufferOffset;
+		mObjectData.Set((std::uint32_t)e->ObjIndex, data);
+
+		BoundingBox& worldBounds = mScene.WorldBounds(e->Node);
+		worldBounds = WorldBounds(e);
+		if(e->BvhSlot >= 0)
+			mStaticBvh.SetBounds(e->BvhSlot, worldBounds);
+
+		mScene.ClearDirty(e->Node);
+	}
+	mDirtyItems.clear();
+
+	const int objectBuffer = mFrames[mCurrFrame].ObjectBuffer;
+	mObjectData.Upload(mCurrFrame, [&](std::uint32_t first, const ObjectData* data, std::uint32_t count)
+	{
+		mDevice.WriteBuffer(objectBuffer, first, data, count);
+	});
+}
+
+void HeadlessCastle::UpdateInstanceData()
+{
+	const int instanceBuffer = mFrames[mCurrFrame].InstanceBuffer;
+
+	XMFLOAT4X4 viewProj;
+	XMStoreFloat4x4(&viewProj, XMMatrixMultiply(XMLoadFloat4x4(&mView), XMLoadFloat4x4(&mProj)));
+
+	XMFLOAT4 planes[6];
+	FrustumCuller::ExtractPlanes(viewProj, planes);
+
+	for(auto& e : mAllItems)
+	{
+		if(e->Instances.empty())
+			continue;
+
+		const BoundingBox& bounds = mScene.Bounds(e->Node);
+		const std::uint32_t offset = e->InstanceBufferOffset;
+		std::uint32_t visibleCount = 0;
+		for(const auto& instance : e->Instances)
+		{
+			XMMATRIX world = XMLoadFloat4x4(&instance.World);
+
+			BoundingBox worldBounds;
+			bounds.Transform(worldBounds, world);
+			if(Outside(planes, worldBounds))
+				continue;
+
+			Instance data;
+			XMStoreFloat4x4(&data.World, XMMatrixTranspose(world));
+			XMStoreFloat4x4(&data.TexTransform, XMMatrixTranspose(XMLoadFloat4x4(&instance.TexTransform)));
+
+			mDevice.WriteBuffer(instanceBuffer, offset + visibleCount++, &data, 1);
+		}
+
+		e->InstanceCount = visibleCount;
+	}
+}
+
+void HeadlessCastle::UpdateMaterialCBs()
+{
+	mMaterialData.Resize((std::uint32_t)mMaterials.size());
+	for(std::size_t i = 0; i < mMaterials.size(); ++i)
+	{
+		Material& mat = mMaterials[i];
+		if(mat.NumFramesDirty > 0)
+		{
+			MaterialData data;
+			data.DiffuseAlbedo = mat.DiffuseAlbedo;
+			data.FresnelR0 = mat.FresnelR0;
+			data.Roughness = mat.Roughness;
+			XMStoreFloat4x4(&data.MatTransform, XMMatrixTranspose(XMLoadFloat4x4(&mat.MatTransform)));
+			mMaterialData.Set((std::uint32_t)i, data);
+
+			mat.NumFramesDirty = 0;
+		}
+	}
+
+	const int materialBuffer = mFrames[mCurrFrame].MaterialBuffer;
+	mMaterialData.Upload(mCurrFrame, [&](std::uint32_t first, const MaterialData* data, std::uint32_t count)
+	{
+		mDevice.WriteBuffer(materialBuffer, first, data, count);
+	});
+}
+
+void HeadlessCastle::UpdateMainPassCB()
+{
+	XMMATRIX view = XMLoadFloat4x4(&mView);
+	XMMATRIX proj = XMLoadFloat4x4(&mProj);
+
+	XMMATRIX viewProj = XMMatrixMultiply(view, proj);
+	XMVECTOR viewDet = XMMatrixDeterminant(view);
+	XMVECTOR projDet = XMMatrixDeterminant(proj);
+	XMVECTOR viewProjDet = XMMatrixDeterminant(viewProj);
+	XMMATRIX invView = XMMatrixInverse(&viewDet, view);
+	XMMATRIX invProj = XMMatrixInverse(&projDet, proj);
+	XMMATRIX invViewProj = XMMatrixInverse(&viewProjDet, viewProj);
+
+	PassConstants pass;
+	XMStoreFloat4x4(&pass.View, XMMatrixTranspose(view));
+	XMStoreFloat4x4(&pass.InvView, XMMatrixTranspose(invView));
+	XMStoreFloat4x4(&pass.Proj, XMMatrixTranspose(proj));
+	XMStoreFloat4x4(&pass.InvProj, XMMatrixTranspose(invProj));
+	XMStoreFloat4x4(&pass.ViewProj, XMMatrixTranspose(viewProj));
+	XMStoreFloat4x4(&pass.InvViewProj, XMMatrixTranspose(invViewProj));
+	pass.EyePosW = mEyePos;
+	pass.RenderTargetSize = XMFLOAT2((float)mClientWidth, (float)mClientHeight);
+	pass.InvRenderTargetSize = XMFLOAT2(1.0f / mClientWidth, 1.0f / mClientHeight);
+	pass.NearZ = 1.0f;
+	pass.FarZ = 1000.0f;
+	pass.TotalTime = mTotalTime;
+	pass.AmbientLight = { 0.25f, 0.25f, 0.35f, 1.0f };
+
+	// The same lights as the app.
+	pass.Lights[0].Direction = { 0.0f, -5.0f, 0.0f };
+	pass.Lights[0].Strength = { 0.30f, 0.1f, 0.1f };
+	pass.Lights[1].Position = { 0.0f, 15.0f, 0.0f };
+	pass.Lights[1].Strength = { 1.65f, 0.1f, 0.0f };
+	const XMFLOAT3 pointLights[10] =
+	{
+		{ 6.5f, 2.0f, 6.5f }, { -6.5f, 2.0f, 6.5f }, { 6.5f, 2.0f, -6.5f }, { -6.5f, 2.0f, -6.5f },
+		{ 14.0f, 6.5f, -9.0f }, { -14.0f, 6.5f, 9.0f }, { -14.0f, 6.5f, -9.0f }, { 14.0f, 6.5f, 9.0f },
+		{ 0.0f, 6.5f, 17.0f }, { 0.0f, 6.5f, -17.0f },
+	};
+	for(int i = 0; i < 10; ++i)
+	{
+		pass.Lights[2 + i].Position = pointLights[i];
+		pass.Lights[2 + i].Strength = { 0.95f, 2.95f, 0.95f };
+		pass.Lights[2 + i].FalloffStart = 3;
+		pass.Lights[2 + i].FalloffEnd = 6;
+	}
+
+	mDevice.WriteBuffer(mFrames[mCurrFrame].PassCB, 0, &pass, 1);
+}
+
+void HeadlessCastle::UpdateWaves(float dt)
+{
+	// Every quarter second, generate a random wave.
+	mWaveTime += dt;
+	if(mWaveTime >= 0.25f)
+	{
+		mWaveTime -= 0.25f;
+
+		std::uniform_int_distribution<int> row(4, mWaves->RowCount() - 5);
+		std::uniform_int_distribution<int> col(4, mWaves->ColumnCount() - 5);
+		std::uniform_real_distribution<float> magnitude(0.2f, 0.5f);
+		int i = row(mRandom);
+		int j = col(mRandom);
+		mWaves->Disturb(i, j, magnitude(mRandom));
+	}
+
+	mWaves->Update(dt);
+
+	// One vertex at a time, like the app's CopyData loop.
+	const int wavesVB = mFrames[mCurrFrame].WavesVB;
+	for(int i = 0; i < mWaves->VertexCount(); ++i)
+	{
+		Vertex v;
+		v.Pos = mWaves->Position(i);
+		v.Normal = mWaves->Normal(i);
+		v.TexC.x = 1.0f + v.Pos.x / mWaves->Width();
+		v.TexC.y = 1.0f - v.Pos.z / mWaves->Depth();
+
+		mDevice.WriteBuffer(wavesVB, i, &v, 1);
+	}
+
+	mGeometries[mWavesGeo]->VertexBuffer = wavesVB;
+}
+
+void HeadlessCastle::CullRenderItems()
+{
+	for(int layer = 0; layer < CastleLayout::LayerCount; ++layer)
+		mVisibleItems[layer].clear();
+
+	XMFLOAT4X4 viewProj;
+	XMStoreFloat4x4(&viewProj, XMMatrixMultiply(XMLoadFloat4x4(&mView), XMLoadFloat4x4(&mProj)));
+
+	XMFLOAT4 planes[6];
+	FrustumCuller::ExtractPlanes(viewProj, planes);
+
+	mStaticBvh.Cull(planes, mVisibleSlots);
+	for(int layer = 0; layer < CastleLayout::LayerCount; ++layer)
+	{
+		for(std::uint32_t slot : mVisibleSlots[layer])
+			mVisibleItems[layer].push_back(mBvhItems[slot]);
+	}
+
+	mCuller.Cull(planes, mVisibleSlots, CastleLayout::LayerCount);
+	for(int layer = 0; layer < CastleLayout::LayerCount; ++layer)
+	{
+		for(std::uint32_t slot : mVisibleSlots[layer])
+			mVisibleItems[layer].push_back(mCullItems[slot]);
+	}
+
+	mOcclusion.Render(viewProj);
+
+	for(int layer = 0; layer < CastleLayout::LayerCount; ++layer)
+	{
+		auto& visible = mVisibleItems[layer];
+		visible.erase(std::remove_if(visible.begin(), visible.end(), [this](Item* ri)
+		{
+			const BoundingBox& bounds = mScene.WorldBounds(ri->Node);
+			if(!ri->Instances.empty() || bounds.Extents.x == FLT_MAX)
+				return false;
+			return !mOcclusion.IsVisible(bounds, ri->CullSlot);
+		}), visible.end());
+	}
+}
+
+void HeadlessCastle::DrawRenderItems()
+{
+	// Blended items go last and farthest first.
+	mDrawQueue.SetBackToFront(PassCount - 1, true);
+	mDrawQueue.Clear();
+	mDrawItems.clear();
+
+	for(int pass = 0; pass < PassCount; ++pass)
+	{
+		for(Item* ri : mVisibleItems[Passes[pass].Layer])
+		{
+			if(!ri->Visible || (!ri->Instances.empty() && ri->InstanceCount == 0))
+				continue;
+
+			const std::uint32_t node = mScene.Index(ri->Node);
+
+			DrawQueue::State state;
+			state.Pipeline = pass;
+			state.Geometry = (int)mScene.Geometries()[node];
+			state.Material = (int)mScene.Materials()[node];
+			state.Topology = (int)ri->Topology;
+
+			XMFLOAT3 center;
+			XMStoreFloat3(&center, XMVector3TransformCoord(XMLoadFloat3(&mScene.BoundsArray()[node].Center), XMLoadFloat4x4(&mScene.Worlds()[node])));
+			float depth = (center.x - mEyePos.x) * mLook.x + (center.y - mEyePos.y) * mLook.y + (center.z - mEyePos.z) * mLook.z;
+
+			mDrawQueue.Add(state, depth, (std::uint32_t)mDrawItems.size());
+			mDrawItems.push_back(ri);
+		}
+	}
+
+	mDrawQueue.Sort();
+
+	if(mIndirectDraws)
+	{
+		DrawRenderItemsIndirect();
+		return;
+	}
+
+	mRecordListCount = RecordDraws(mDrawQueue, *this, mMaxRecordLists, 32, &mDrawStats);
+	mDevice.Execute(mRecordListCount);
+}
+
+void HeadlessCastle::DrawRenderItemsIndirect()
+{
+	FrameBuffers& frame = mFrames[mCurrFrame];
+
+	// Chunks come and go, so the argument buffer grows with the draw count.
+	// Devices here finish every frame at once, so it can be replaced right away.
+	const std::uint32_t drawCount = (std::uint32_t)mDrawQueue.Count();
+	if(drawCount > frame.IndirectArgsCapacity)
+	{
+		if(frame.IndirectArgs >= 0)
+			mDevice.ReleaseBuffer(frame.IndirectArgs);
+
+		frame.IndirectArgsCapacity = std::max(2 * frame.IndirectArgsCapacity, std::max(drawCount, 64u));
+		frame.IndirectArgs = mDevice.CreateBuffer(IRenderDevice::BufferType::Indirect, sizeof(IndirectDrawCommand), frame.IndirectArgsCapacity);
+	}
+
+	// Built in CPU memory and copied in one go, as into a mapped upload heap.
+	mIndirectCommands.resize(drawCount);
+	mIndirectBuilder.Build(mDrawQueue, *this, mIndirectCommands.data(), mMaxRecordLists, 32);
+	if(drawCount > 0)
+		mDevice.WriteBuffer(frame.IndirectArgs, 0, mIndirectCommands.data(), drawCount);
+
+	// The commands set the object index; Begin binds the rest.
+	Begin(0);
+
+	for(const IndirectDrawBatch& batch : mIndirectBuilder.Batches())
+	{
+		const Item* ri = mDrawItems[batch.FirstItem];
+		const Geometry* geo = mGeometries[GeometryHandle((std::uint32_t)batch.State.Geometry)].get();
+
+		mDevice.SetPipeline(0, batch.State.Pipeline);
+		mDevice.SetGeometry(0, geo->VertexBuffer, geo->IndexBuffer, ri->Topology);
+		mDevice.SetTexture(0, 0, (int)mScene.Material(ri->Node));
+		mDevice.DrawIndirect(0, frame.IndirectArgs, batch.FirstCommand, batch.CommandCount);
+	}
+
+	End(0);
+	mRecordListCount = 1;
+	mDevice.Execute(1);
+}
+
+void HeadlessCastle::Begin(int list)
+{
+	const FrameBuffers& frame = mFrames[mCurrFrame];
+
+	// Every draw reads its own element of these through the object index.
+	mDevice.BeginList(list);
+	mDevice.SetBuffer(list, 2, frame.PassCB, 0);
+	mDevice.SetBuffer(list, 3, frame.MaterialBuffer, 0);
+	mDevice.SetBuffer(list, 4, frame.InstanceBuffer, 0);
+	mDevice.SetBuffer(list, 5, frame.ObjectBuffer, 0);
+}
+
+void HeadlessCastle::Record(int list, std::uint32_t item, const DrawQueue::State& state, unsigned changes)
+{
+	const Item* ri = mDrawItems[item];
+
+	if(changes & DrawQueue::PipelineChange)
+		mDevice.SetPipeline(list, state.Pipeline);
+
+	if(changes & (DrawQueue::GeometryChange | DrawQueue::TopologyChange))
+	{
+		const Geometry* geo = mGeometries[GeometryHandle((std::uint32_t)state.Geometry)].get();
+		mDevice.SetGeometry(list, geo->VertexBuffer, geo->IndexBuffer, ri->Topology);
+	}
+
+	// The texture table, like root parameter 0.
+	if(changes & DrawQueue::MaterialChange)
+		mDevice.SetTexture(list, 0, (int)mScene.Material(ri->Node));
+
+	mDevice.SetConstant(list, 1, (std::uint32_t)ri->ObjIndex);
+
+	if(!ri->Instances.empty())
+	{
+		mDevice.DrawIndexed(list, ri->IndexCount, ri->InstanceCount, ri->StartIndexLocation, ri->BaseVertexLocation);
+		return;
+	}
+
+	mDevice.DrawIndexed(list, ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation);
+}
+
+void HeadlessCastle::End(int list)
+{
+	mDevice.EndList(list);
+}
+
+void HeadlessCastle::Fill(std::uint32_t item, const DrawQueue::State& /*state*/, IndirectDrawCommand& command)const
+{
+	const Item* ri = mDrawItems[item];
+
+	const bool instanced = !ri->Instances.empty();
+	command.ObjectIndex = (std::uint32_t)ri->ObjIndex;
+	command.IndexCountPerInstance = ri->IndexCount;
+	command.InstanceCount = instanced ? ri->InstanceCount : 1;
+	command.StartIndexLocation = ri->StartIndexLocation;
+	command.BaseVertexLocation = ri->BaseVertexLocation;
+	command.StartInstanceLocation = 0;
+}
@@ -0,0 +1,321 @@
+//***************************************************************************************
+// HeadlessCastle.h
+//
+// The castle scene and its per-frame CPU work, drawn through an IRenderDevice
+// instead of D3D12 so that it runs without a window or a GPU.  Geometry, materials
+// and the castle layout come from CastleLayout, as CastleDesign's do, and the
+// maze is streamed in chunks from map.txt the same way.  The camera flies a fixed
+// loop from the castle through the maze, so two runs do the same work.
+//
+// Frame() runs the stages of CastleDesign::Update and Draw in the same order and
+// times each one.  The chunk streaming stage includes the uploads; the drawing
+// stage covers queueing, recording and submitting the draws.
+//
+// Pipelines are created with the ids the draws use (one per pass) and textures
+// with the material index, so a device that renders sees the app's states.
+//***************************************************************************************
+
+#pragma once
+
+#include "CastleLayout.h"
+#include "CommandRecorder.h"
+#include "CullingBvh.h"
+#include "DrawQueue.h"
+#include "FrustumCuller.h"
+#include "IndirectDrawArgs.h"
+#include "OcclusionBuffer.h"
+#include "PackedDataBuffer.h"
+#include "RenderDevice.h"
+#include "ResourceRegistry.h"
+#include "SceneStore.h"
+#include "StageTimer.h"
+#include "TileChunkStreamer.h"
+#include "TileMap.h"
+#include "TransformHierarchy.h"
+#include "Waves.h"
+
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+
+class HeadlessCastle : private ICommandRecorder, private IIndirectDrawSource
+{
+public:
+	// Same layers as the app's RenderLayer.
+	typedef CastleLayout::Layer Layer;
+
+	HeadlessCastle(IRenderDevice& device, int frameResourceCount = 3, int maxRecordLists = 4);
+	HeadlessCastle(const HeadlessCastle& rhs) = delete;
+	HeadlessCastle& operator=(const HeadlessCastle& rhs) = delete;
+	~HeadlessCastle();
+
+	///<summary>
+	/// Builds the scene, with 'castleCopies' copies of the castle placed side by
+	/// side to scale the work up, and loads the textures from 'textureDir'.
+	/// Returns false, with LastError set, when the map or a texture cannot be
+	/// read; the scene is still built, without the maze or with the texture
+	/// missing.
+	///</summary>
+	bool Initialize(const std::string& mapPath, int castleCopies = 1,
+		const std::string& textureDir = "Graphics Textures");
+
+	// Size of the target the projection is built for; 800x600 by default.
+	void Resize(int width, int height);
+
+	// Makes each frame wait for the chunks it asked for, so that what is drawn
+	// depends only on the frame number.  Off by default, as in the app.
+	void SetWaitForChunks(bool wait) { mWaitForChunks = wait; }
+
+	// Submits the sorted draws as indirect arguments, one DrawIndirect per
+	// batch, instead of recording them one by one.
+	void SetIndirectDraws(bool indirect) { mIndirectDraws = indirect; }
+
+	// Runs one frame, 'dt' seconds after the previous one.
+	void Frame(float dt);
+
+	const StageTimer& Timings()const { return mTimer; }
+	StageTimer& Timings() { return mTimer; }
+
+	int ItemCount()const { return (int)mAllItems.size(); }
+	int ResidentChunkCount()const { return (int)mChunks.size(); }
+	// Draws of the last frame, and the binds they needed.
+	const DrawQueue::Stats& DrawStats()const { return mDrawStats; }
+	// DrawIndirect calls of the last frame, when indirect draws are on.
+	int IndirectBatchCount()const { return (int)mIndirectBuilder.Batches().size(); }
+	// Occluder depths of the last frame.
+	const OcclusionBuffer& Occlusion()const { return mOcclusion; }
+	const std::string& LastError()const { return mLastError; }
+
+private:
+	struct Vertex
+	{
+		DirectX::XMFLOAT3 Pos;
+		DirectX::XMFLOAT3 Normal;
+		DirectX::XMFLOAT2 TexC;
+	};
+
+	struct Instance
+	{
+		DirectX::XMFLOAT4X4 World;
+		DirectX::XMFLOAT4X4 TexTransform;
+	};
+
+	// Same layouts as ObjectData and MaterialData in FrameResource.h.
+	struct ObjectData
+	{
+		DirectX::XMFLOAT4X4 World;
+		DirectX::XMFLOAT4X4 TexTransform;
+		std::uint32_t MaterialIndex = 0;
+		std::uint32_t InstanceOffset = 0;
+		std::uint32_t ObjPad0 = 0;
+		std::uint32_t ObjPad1 = 0;
+	};
+
+	struct MaterialData
+	{
+		DirectX::XMFLOAT4 DiffuseAlbedo;
+		DirectX::XMFLOAT3 FresnelR0;
+		float Roughness = 0.0f;
+		DirectX::XMFLOAT4X4 MatTransform;
+	};
+
+	struct Submesh
+	{
+		std::uint32_t IndexCount = 0;
+		std::uint32_t StartIndexLocation = 0;
+		int BaseVertexLocation = 0;
+		DirectX::BoundingBox Bounds;
+	};
+
+	// CPU copies are kept for static batching.
+	struct Geometry
+	{
+		int VertexBuffer = -1;
+		int IndexBuffer = -1;
+		std::vector<Vertex> Vertices;
+		std::vector<std::uint32_t> Indices;
+		std::unordered_map<std::string, Submesh> DrawArgs;
+	};
+	typedef ResourceHandle<Geometry> GeometryHandle;
+
+	struct Material
+	{
+		DirectX::XMFLOAT4 DiffuseAlbedo = { 1.0f, 1.0f, 1.0f, 1.0f };
+		DirectX::XMFLOAT3 FresnelR0 = { 0.01f, 0.01f, 0.01f };
+		float Roughness = 0.25f;
+		DirectX::XMFLOAT4X4 MatTransform;
+		int NumFramesDirty = 0;
+	};
+
+	// Transforms, bounds, material, geometry and dirty flag live in mScene
+	// under Node.
+	struct Item
+	{
+		SceneHandle Node;
+		bool Visible = true;
+		bool Collidable = false;
+		int BvhSlot = -1;
+		int CullSlot = -1;
+		int ObjIndex = 0;
+		// Node in mTransforms placing the item, or NoParent.
+		std::uint32_t Transform = TransformHierarchy::NoParent;
+
+		IRenderDevice::Topology Topology = IRenderDevice::TriangleList;
+		std::uint32_t IndexCount = 0;
+		std::uint32_t StartIndexLocation = 0;
+		int BaseVertexLocation = 0;
+
+		std::vector<Instance> Instances;
+		std::uint32_t InstanceCount = 0;
+		std::uint32_t InstanceBufferOffset = 0;
+	};
+
+	// One set per frame in flight, like FrameResource.
+	struct FrameBuffers
+	{
+		int PassCB = -1;
+		int ObjectBuffer = -1;
+		int MaterialBuffer = -1;
+		int InstanceBuffer = -1;
+		int WavesVB = -1;
+		int IndirectArgs = -1;
+		std::uint32_t IndirectArgsCapacity = 0;
+	};
+
+	struct Chunk
+	{
+		GeometryHandle Geo;
+		std::unique_ptr<Item> Ritem;
+		std::vector<int> Occluders;
+	};
+
+	GeometryHandle AddGeometry(const std::string& name, std::vector<Vertex> vertices, std::vector<std::uint32_t> indices);
+	Item* AddItem(Layer layer, GeometryHandle geo, const std::string& submesh, int material);
+	Geometry* GeometryOf(const Item* ri) { return mGeometries[GeometryHandle(mScene.Geometry(ri->Node))].get(); }
+
+	void BuildGeometry();
+	void BuildMaterials();
+	void BuildItems(int castleCopies);
+	void BuildStaticBatches();
+	void BuildCullingData();
+	void BuildFrameBuffers();
+	void BuildPipelines();
+	bool LoadTextures(const std::string& textureDir);
+
+	void UpdateCamera();
+	void UpdateTileChunks();
+	void UploadTileChunks();
+	void ReleaseTileChunk(std::uint64_t key);
+	void AnimateMaterials(float dt);
+	void MarkDirty(Item* item);
+	void AttachItem(Item* item, std::uint32_t parent, DirectX::FXMMATRIX local);
+	void UpdateTransforms();
+	void UpdateObjectCBs();
+	void UpdateInstanceData();
+	void UpdateMaterialCBs();
+	void UpdateMainPassCB();
+	void UpdateWaves(float dt);
+	void CullRenderItems();
+	void DrawRenderItems();
+	void DrawRenderItemsIndirect();
+
+	DirectX::BoundingBox WorldBounds(const Item* ri)const;
+
+	// ICommandRecorder
+	virtual void Begin(int list)override;
+	virtual void Record(int list, std::uint32_t item, const DrawQueue::State& state, unsigned changes)override;
+	virtual void End(int list)override;
+
+	// IIndirectDrawSource
+	virtual void Fill(std::uint32_t item, const DrawQueue::State& state, IndirectDrawCommand& command)const override;
+
+private:
+	IRenderDevice& mDevice;
+	const int mFrameResourceCount;
+	const int mMaxRecordLists;
+	std::string mLastError;
+	int mClientWidth = 800;
+	int mClientHeight = 600;
+	bool mWaitForChunks = false;
+
+	// Geometry handles double as the DrawQueue geometry ids.
+	ResourceRegistry<Geometry> mGeometries;
+	GeometryHandle mWavesGeo;
+	std::vector<Material> mMaterials;
+	std::vector<std::unique_ptr<Item>> mAllItems;
+	std::vector<Item*> mLayers[CastleLayout::LayerCount];
+	Item* mWavesItem = nullptr;
+	Item* mChunkBaseItem = nullptr;
+	std::uint32_t mInstanceCount = 0;
+
+	SceneStore mScene;
+	// Items changed since the last UpdateObjectCBs, as the app's mDirtyRitems.
+	std::vector<Item*> mDirtyItems;
+
+	// Placement of the castle props, as the app's mTransforms, and fixed after
+	// startup in the same way.
+	TransformHierarchy mTransforms;
+	std::vector<Item*> mTransformItems;
+	std::vector<std::uint32_t> mChangedTransforms;
+
+	// Packed once per change; each frame's buffers copy the ranges they missed.
+	PackedDataBuffer<ObjectData> mObjectData;
+	PackedDataBuffer<MaterialData> mMaterialData;
+
+	std::vector<FrameBuffers> mFrames;
+	int mCurrFrame = 0;
+	std::uint64_t mFrameNumber = 0;
+
+	CullingBvh mStaticBvh{ CastleLayout::LayerCount };
+	std::vector<Item*> mBvhItems;
+	FrustumCuller mCuller;
+	std::vector<Item*> mCullItems;
+	std::vector<std::uint32_t> mVisibleSlots[CastleLayout::LayerCount];
+	std::vector<Item*> mVisibleItems[CastleLayout::LayerCount];
+	OcclusionBuffer mOcclusion;
+
+	DrawQueue mDrawQueue;
+	std::vector<Item*> mDrawItems;
+	int mRecordListCount = 0;
+	DrawQueue::Stats mDrawStats;
+
+	bool mIndirectDraws = false;
+	IndirectDrawBuilder mIndirectBuilder;
+	std::vector<IndirectDrawCommand> mIndirectCommands;
+
+	std::unique_ptr<Waves> mWaves;
+	float mWaveTime = 0.0f;
+	std::mt19937 mRandom;
+
+	TileMap mTileMap;
+	TileChunkStreamer mChunkStreamer;
+	std::unordered_map<std::uint64_t, Chunk> mChunks;
+	// Buffers of evicted chunks, kept until every frame in flight is done.
+	std::vector<std::pair<std::uint64_t, std::unique_ptr<Geometry>>> mRetiredGeos;
+
+	// The camera path loops around these two points.
+	DirectX::XMFLOAT3 mPathStart = { 0.0f, 2.0f, 0.0f };
+	DirectX::XMFLOAT3 mPathEnd = { 150.0f, 2.0f, 0.0f };
+	float mTotalTime = 0.0f;
+	DirectX::XMFLOAT3 mEyePos;
+	DirectX::XMFLOAT3 mLook;
+	DirectX::XMFLOAT4X4 mView;
+	DirectX::XMFLOAT4X4 mProj;
+
+	StageTimer mTimer;
+	int mUpdateTileChunksStage;
+	int mUpdateTransformsStage;
+	int mUpdateObjectCBsStage;
+	int mUpdateInstanceDataStage;
+	int mUpdateMaterialCBsStage;
+	int mUpdateMainPassCBStage;
+	int mUpdateWavesStage;
+	int mCullRenderItemsStage;
+	int mDrawRenderItemsStage;
+	int mFrameStage;
+};
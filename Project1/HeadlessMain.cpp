@@ -0,0 +1,210 @@
+//***************************************************************************************
+// HeadlessMain.cpp
+//
+// Runs the castle's frame loop without a GPU and prints how long each stage took.
+// The null device only counts what it is asked to do; the software device renders
+// the frames, so the last one can be saved as an image or checked against a golden
+// image.  Not part of the Windows project; build it on its own with the portable
+// sources and a DirectXMath checkout on the include path:
+//
+//   g++ -std=c++14 -O2 -pthread -I<DirectXMath>/Inc HeadlessMain.cpp HeadlessCastle.cpp
+//       RenderDevice.cpp SoftwareRenderDevice.cpp SoftwareTexture.cpp StageTimer.cpp
+//       CommandRecorder.cpp DrawQueue.cpp IndirectDrawArgs.cpp CullingBvh.cpp
+//       FrustumCuller.cpp OcclusionBuffer.cpp TileChunkStreamer.cpp TileMap.cpp
+//       TileMapMesher.cpp GeometryGenerator.cpp Waves.cpp PackedDataBuffer.cpp
+//       SceneStore.cpp TransformHierarchy.cpp CastleLayout.cpp
+//
+// Usage: HeadlessMain [-device null|software] [-frames N] [-step seconds] [-map file]
+//                     [-copies N] [-lists N] [-indirect 0|1] [-width N] [-height N]
+//                     [-threads N] [-textures dir] [-image out.tga]
+//                     [-compare golden.tga] [-tolerance N] [-outliers N]
+//                     [-occlusion out.pgm]
+//
+// -step is the time between frames, 1/60 s by default; a longer step gets the
+// camera further along its loop in fewer frames.
+//
+// -indirect 1 submits the draws as indirect arguments; the images must not change.
+// With -compare the exit code is 1 when more than -outliers pixels (default 0)
+// differ from the golden image by more than the tolerance (default 2 per channel).
+// A few outliers absorb edge pixels that flip between DirectXMath builds.
+//
+// -occlusion writes the occlusion culling depths of the last frame, with either
+// device.
+//***************************************************************************************
+
+#include "HeadlessCastle.h"
+#include "RenderDevice.h"
+#include "SoftwareRenderDevice.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+
+int main(int argc, char** argv)
+{
+	std::string deviceName = "null";
+	int frames = -1;
+	float step = 1.0f / 60.0f;
+	std::string map = "map.txt";
+	int copies = 1;
+	int lists = 4;
+	bool indirect = false;
+	int width = 1280;
+	int height = 720;
+	int threads = 0;
+	std::string textures = "Graphics Textures";
+	std::string image;
+	std::string golden;
+	int tolerance = 2;
+	int outliers = 0;
+	std::string occlusion;
+
+	for(int i = 1; i + 1 < argc; i += 2)
+	{
+		if(std::strcmp(argv[i], "-device") == 0)
+			deviceName = argv[i + 1];
+		else if(std::strcmp(argv[i], "-frames") == 0)
+			frames = std::atoi(argv[i + 1]);
+		else if(std::strcmp(argv[i], "-step") == 0)
+			step = (float)std::atof(argv[i + 1]);
+		else if(std::strcmp(argv[i], "-map") == 0)
+			map = argv[i + 1];
+		else if(std::strcmp(argv[i], "-copies") == 0)
+			copies = std::atoi(argv[i + 1]);
+		else if(std::strcmp(argv[i], "-lists") == 0)
+			lists = std::atoi(argv[i + 1]);
+		else if(std::strcmp(argv[i], "-indirect") == 0)
+			indirect = std::atoi(argv[i + 1]) != 0;
+		else if(std::strcmp(argv[i], "-width") == 0)
+			width = std::atoi(argv[i + 1]);
+		else if(std::strcmp(argv[i], "-height") == 0)
+			height = std::atoi(argv[i + 1]);
+		else if(std::strcmp(argv[i], "-threads") == 0)
+			threads = std::atoi(argv[i + 1]);
+		else if(std::strcmp(argv[i], "-textures") == 0)
+			textures = argv[i + 1];
+		else if(std::strcmp(argv[i], "-image") == 0)
+			image = argv[i + 1];
+		else if(std::strcmp(argv[i], "-compare") == 0)
+			golden = argv[i + 1];
+		else if(std::strcmp(argv[i], "-tolerance") == 0)
+			tolerance = std::atoi(argv[i + 1]);
+		else if(std::strcmp(argv[i], "-outliers") == 0)
+			outliers = std::atoi(argv[i + 1]);
+		else if(std::strcmp(argv[i], "-occlusion") == 0)
+			occlusion = argv[i + 1];
+		else
+			deviceName.clear();
+	}
+
+	if((argc % 2) == 0 || (deviceName != "null" && deviceName != "software") || !(step > 0.0f))
+	{
+		std::fprintf(stderr, "Usage: %s [-device null|software] [-frames N] [-step seconds] [-map file] [-copies N]\n"
+			"  [-lists N] [-indirect 0|1] [-width N] [-height N] [-threads N] [-textures dir] [-image out.tga] [-compare golden.tga] [-tolerance N]\n"
+			"  [-outliers N] [-occlusion out.pgm]\n", argv[0]);
+		return 1;
+	}
+
+	const bool software = deviceName == "software";
+	if(frames < 0)
+		frames = software ? 60 : 5000;
+
+	std::unique_ptr<NullRenderDevice> nullDevice;
+	std::unique_ptr<SoftwareRenderDevice> softwareDevice;
+	IRenderDevice* device;
+	if(software)
+	{
+		softwareDevice = std::make_unique<SoftwareRenderDevice>(width, height, lists, threads);
+		softwareDevice->SetClearColor(0.7f, 0.7f, 0.7f, 1.0f);
+		device = softwareDevice.get();
+	}
+	else
+	{
+		nullDevice = std::make_unique<NullRenderDevice>(lists);
+		device = nullDevice.get();
+	}
+
+	HeadlessCastle castle(*device, 3, lists);
+	castle.SetIndirectDraws(indirect);
+	if(software)
+	{
+		// Golden images need the same frame every run.
+		castle.Resize(width, height);
+		castle.SetWaitForChunks(true);
+	}
+	if(!castle.Initialize(map, copies, textures))
+		std::fprintf(stderr, "%s; running without it\n", castle.LastError().c_str());
+
+	// Setup is not part of the numbers.
+	castle.Timings().Reset();
+	NullRenderDevice::Stats setup;
+	if(nullDevice)
+		setup = nullDevice->Total();
+
+	const auto start = std::chrono::steady_clock::now();
+	for(int i = 0; i < frames; ++i)
+		castle.Frame(step);
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	const double n = frames > 0 ? frames : 1;
+
+	std::printf("%d frames in %.2f s (%.1f per second), %d items, %d chunks resident\n",
+		frames, seconds, seconds > 0.0 ? frames / seconds : 0.0, castle.ItemCount(), castle.ResidentChunkCount());
+
+	if(nullDevice)
+	{
+		NullRenderDevice::Stats total = nullDevice->Total();
+		std::printf("%d live buffers (%.1f MB)\n", nullDevice->LiveBufferCount(), nullDevice->LiveBufferBytes() / (1024.0 * 1024.0));
+		std::printf("per frame: %.1f draws, %.1f instances, %.1f binds, %.1f indirect calls, %.1f buffer writes, %.1f KB written\n",
+			total.Draws / n, total.Instances / n, total.Binds / n, total.IndirectCalls / n,
+			(total.BufferWrites - setup.BufferWrites) / n, (total.BytesWritten - setup.BytesWritten) / n / 1024.0);
+	}
+	else
+	{
+		const SoftwareRenderDevice::Stats& last = softwareDevice->LastFrame();
+		std::printf("last frame at %dx%d: %d draws, %d triangles, %llu pixels shaded\n",
+			softwareDevice->Width(), softwareDevice->Height(), last.Draws, last.Triangles,
+			(unsigned long long)last.PixelsShaded);
+	}
+	std::printf("\n%s", castle.Timings().Report().c_str());
+
+	if(!occlusion.empty() && !castle.Occlusion().WriteDepthImage(occlusion.c_str()))
+	{
+		std::fprintf(stderr, "%s: cannot write\n", occlusion.c_str());
+		return 1;
+	}
+
+	if(!softwareDevice)
+	{
+		if(!image.empty() || !golden.empty())
+			std::fprintf(stderr, "-image and -compare need -device software\n");
+		return image.empty() && golden.empty() ? 0 : 1;
+	}
+
+	if(!image.empty() && !SaveTga(softwareDevice->FrontBuffer(), image))
+	{
+		std::fprintf(stderr, "%s: cannot write\n", image.c_str());
+		return 1;
+	}
+
+	if(!golden.empty())
+	{
+		Image expected;
+		if(!LoadTga(golden, expected))
+		{
+			std::fprintf(stderr, "%s: cannot read\n", golden.c_str());
+			return 1;
+		}
+
+		const ImageDiff diff = CompareImages(softwareDevice->FrontBuffer(), expected, tolerance);
+		std::printf("\n%s: %d pixels differ by more than %d (largest %d)\n",
+			golden.c_str(), diff.DifferentPixels, tolerance, diff.MaxChannelDiff);
+		if(diff.DifferentPixels > outliers)
+			return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,589 @@
+//***************************************************************************************
+// HpaPathfinder.cpp
+//***************************************************************************************
+
+#include "HpaPathfinder.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <queue>
+
+namespace
+{
+	const int StepRow[8] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+	const int StepCol[8] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+	const std::uint32_t StepCost[8] = { 10, 14, 10, 14, 10, 14, 10, 14 };
+
+	// Entrances this long or longer get a node at each end instead of one in the middle.
+	const int LongEntrance = 6;
+
+	typedef std::pair<std::uint32_t, int> QueueEntry;
+	typedef std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> OpenList;
+
+	// Exact cost of the cheapest 8-way path on an empty grid.
+	std::uint32_t Octile(int row0, int col0, int row1, int col1)
+	{
+		const int dr = std::abs(row1 - row0);
+		const int dc = std::abs(col1 - col0);
+		return 10 * (std::uint32_t)std::max(dr, dc) + 4 * (std::uint32_t)std::min(dr, dc);
+	}
+}
+
+const std::uint32_t HpaPathfinder::Unreachable;
+
+void HpaPathfinder::Scratch::Begin(std::size_t count)
+{
+	if(Stamp.size() < count)
+	{
+		Stamp.resize(count, 0);
+		Closed.resize(count, 0);
+		Cost.resize(count, 0);
+		Parent.resize(count, -1);
+	}
+
+	// On wrap-around old stamps could look current, so start over.
+	if(++Current == 0)
+	{
+		std::fill(Stamp.begin(), Stamp.end(), 0);
+		std::fill(Closed.begin(), Closed.end(), 0);
+		Current = 1;
+	}
+}
+
+HpaPathfinder::HpaPathfinder(int clusterSize)
+	: mClusterSize(std::max(clusterSize, 2))
+{
+}
+
+void HpaPathfinder::Build(const TileMap& map)
+{
+	mNumRows = map.RowCount();
+	mNumCols = map.ColumnCount();
+	mClustersAcross = (mNumCols + mClusterSize - 1) / mClusterSize;
+	mClustersDown = (mNumRows + mClusterSize - 1) / mClusterSize;
+
+	const int clusterCount = mClustersAcross * mClustersDown;
+
+	mNodes.clear();
+	mFreeNodes.clear();
+	mClusters.assign(clusterCount, Cluster());
+	mBorders[0].assign(clusterCount, std::vector<int>());
+	mBorders[1].assign(clusterCount, std::vector<int>());
+
+	for(int k = 0; k < clusterCount; ++k)
+	{
+		Rect& rect = mClusters[k].Bounds;
+		rect.Row0 = (k / mClustersAcross) * mClusterSize;
+		rect.Col0 = (k % mClustersAcross) * mClusterSize;
+		rect.Rows = std::min(mClusterSize, mNumRows - rect.Row0);
+		rect.Cols = std::min(mClusterSize, mNumCols - rect.Col0);
+	}
+
+	for(int k = 0; k < clusterCount; ++k)
+	{
+		BuildBorder(map, k, 0);
+		BuildBorder(map, k, 1);
+	}
+
+	for(int k = 0; k < clusterCount; ++k)
+		BuildIntraEdges(map, k);
+}
+
+void HpaPathfinder::OnTileChanged(const TileMap& map, int row, int col)
+{
+	if(map.RowCount() != mNumRows || map.ColumnCount() != mNumCols)
+	{
+		Build(map);
+		return;
+	}
+
+	if(!map.InBounds(row, col))
+		return;
+
+	Cell cell;
+	cell.Row = row;
+	cell.Col = col;
+
+	const int k = ClusterOf(cell);
+	const int cx = k % mClustersAcross;
+	const int cy = k / mClustersAcross;
+
+	const int west = cx > 0 ? k - 1 : -1;
+	const int south = cy > 0 ? k - mClustersAcross : -1;
+	const int east = cx + 1 < mClustersAcross ? k + 1 : -1;
+	const int north = cy + 1 < mClustersDown ? k + mClustersAcross : -1;
+
+	// The entrances on all four sides of the cluster may have moved.
+	ClearBorder(k, 0);
+	ClearBorder(k, 1);
+	if(west >= 0) ClearBorder(west, 0);
+	if(south >= 0) ClearBorder(south, 1);
+
+	BuildBorder(map, k, 0);
+	BuildBorder(map, k, 1);
+	if(west >= 0) BuildBorder(map, west, 0);
+	if(south >= 0) BuildBorder(map, south, 1);
+
+	// Every cluster that shares one of those borders needs new in-cluster paths.
+	const int touched[5] = { k, west, south, east, north };
+	for(int t : touched)
+	{
+		if(t >= 0)
+			BuildIntraEdges(map, t);
+	}
+}
+
+int HpaPathfinder::AddNode(Cell c)
+{
+	int id;
+	if(!mFreeNodes.empty())
+	{
+		id = mFreeNodes.back();
+		mFreeNodes.pop_back();
+	}
+	else
+	{
+		id = (int)mNodes.size();
+		mNodes.push_back(Node());
+	}
+
+	Node& node = mNodes[id];
+	node.Pos = c;
+	node.Cluster = ClusterOf(c);
+	node.Alive = true;
+	node.Edges.clear();
+
+	mClusters[node.Cluster].Nodes.push_back(id);
+
+	return id;
+}
+
+void HpaPathfinder::RemoveNode(int id)
+{
+	Node& node = mNodes[id];
+
+	for(const Edge& e : node.Edges)
+	{
+		auto& back = mNodes[e.To].Edges;
+		back.erase(std::remove_if(back.begin(), back.end(),
+			[id](const Edge& b) { return b.To == id; }), back.end());
+	}
+
+	auto& clusterNodes = mClusters[node.Cluster].Nodes;
+	clusterNodes.erase(std::remove(clusterNodes.begin(), clusterNodes.end(), id), clusterNodes.end());
+
+	node.Edges.clear();
+	node.Alive = false;
+	mFreeNodes.push_back(id);
+}
+
+void HpaPathfinder::Link(int a, int b, std::uint32_t cost, bool inter)
+{
+	Edge e;
+	e.Cost = cost;
+	e.Inter = inter;
+
+	e.To = b;
+	mNodes[a].Edges.push_back(e);
+
+	e.To = a;
+	mNodes[b].Edges.push_back(e);
+}
+
+void HpaPathfinder::ClearBorder(int cluster, int side)
+{
+	for(int id : mBorders[side][cluster])
+	{
+		if(mNodes[id].Alive)
+			RemoveNode(id);
+	}
+
+	mBorders[side][cluster].clear();
+}
+
+void HpaPathfinder::BuildBorder(const TileMap& map, int cluster, int side)
+{
+	const Rect& rect = mClusters[cluster].Bounds;
+
+	// The line of cells on our side of the border, and the step across it.
+	int length, dRow, dCol;
+	Cell first;
+	if(side == 0)
+	{
+		if(rect.Col0 + rect.Cols >= mNumCols)
+			return;
+		first.Row = rect.Row0;
+		first.Col = rect.Col0 + rect.Cols - 1;
+		length = rect.Rows;
+		dRow = 0;
+		dCol = 1;
+	}
+	else
+	{
+		if(rect.Row0 + rect.Rows >= mNumRows)
+			return;
+		first.Row = rect.Row0 + rect.Rows - 1;
+		first.Col = rect.Col0;
+		length = rect.Cols;
+		dRow = 1;
+		dCol = 0;
+	}
+
+	auto cellAt = [&](int i)
+	{
+		Cell c = first;
+		c.Row += side == 0 ? i : 0;
+		c.Col += side == 0 ? 0 : i;
+		return c;
+	};
+
+	auto crossable = [&](int i)
+	{
+		Cell c = cellAt(i);
+		return map.Get(c.Row, c.Col) == TileMap::Empty && map.Get(c.Row + dRow, c.Col + dCol) == TileMap::Empty;
+	};
+
+	auto addTransition = [&](int i)
+	{
+		Cell a = cellAt(i);
+		Cell b = a;
+		b.Row += dRow;
+		b.Col += dCol;
+
+		const int u = AddNode(a);
+		const int v = AddNode(b);
+		Link(u, v, 10, true);
+
+		mBorders[side][cluster].push_back(u);
+		mBorders[side][cluster].push_back(v);
+	};
+
+	int i = 0;
+	while(i < length)
+	{
+		if(!crossable(i))
+		{
+			++i;
+			continue;
+		}
+
+		int end = i + 1;
+		while(end < length && crossable(end))
+			++end;
+
+		if(end - i < LongEntrance)
+		{
+			addTransition(i + (end - i) / 2);
+		}
+		else
+		{
+			addTransition(i);
+			addTransition(end - 1);
+		}
+
+		i = end;
+	}
+}
+
+void HpaPathfinder::BuildIntraEdges(const TileMap& map, int cluster)
+{
+	const Cluster& cl = mClusters[cluster];
+
+	for(int id : cl.Nodes)
+	{
+		auto& edges = mNodes[id].Edges;
+		edges.erase(std::remove_if(edges.begin(), edges.end(),
+			[](const Edge& e) { return !e.Inter; }), edges.end());
+	}
+
+	// One Dijkstra per node gives its cost to every other node of the cluster.
+	const std::vector<int> nodes = cl.Nodes;
+	for(std::size_t i = 0; i + 1 < nodes.size(); ++i)
+	{
+		GridSearch(map, cl.Bounds, mNodes[nodes[i]].Pos, nullptr, nullptr);
+
+		for(std::size_t j = i + 1; j < nodes.size(); ++j)
+		{
+			const std::uint32_t cost = SearchCost(cl.Bounds, mNodes[nodes[j]].Pos);
+			if(cost < Unreachable)
+				Link(nodes[i], nodes[j], cost, false);
+		}
+	}
+}
+
+bool HpaPathfinder::CanMove(const TileMap& map, const Rect& rect, Cell c, int d)const
+{
+	Cell n;
+	n.Row = c.Row + StepRow[d];
+	n.Col = c.Col + StepCol[d];
+
+	if(!rect.Contains(n) || map.Get(n.Row, n.Col) != TileMap::Empty)
+		return false;
+
+	// No squeezing diagonally past a wall corner.
+	if(StepRow[d] != 0 && StepCol[d] != 0)
+	{
+		return map.Get(c.Row + StepRow[d], c.Col) == TileMap::Empty &&
+			map.Get(c.Row, c.Col + StepCol[d]) == TileMap::Empty;
+	}
+
+	return true;
+}
+
+std::uint32_t HpaPathfinder::GridSearch(const TileMap& map, const Rect& rect, Cell from, const Cell* to, std::vector<Cell>* cells)
+{
+	auto local = [&](Cell c) { return (c.Row - rect.Row0) * rect.Cols + (c.Col - rect.Col0); };
+	auto cellOf = [&](int i)
+	{
+		Cell c;
+		c.Row = rect.Row0 + i / rect.Cols;
+		c.Col = rect.Col0 + i % rect.Cols;
+		return c;
+	};
+	auto heuristic = [&](Cell c) { return to != nullptr ? Octile(c.Row, c.Col, to->Row, to->Col) : 0u; };
+
+	Scratch& s = mGridScratch;
+	s.Begin((std::size_t)rect.Rows * rect.Cols);
+
+	if(!rect.Contains(from) || map.Get(from.Row, from.Col) != TileMap::Empty)
+		return Unreachable;
+	if(to != nullptr && (!rect.Contains(*to) || map.Get(to->Row, to->Col) != TileMap::Empty))
+		return Unreachable;
+
+	OpenList open;
+	const int start = local(from);
+	const int goal = to != nullptr ? local(*to) : -1;
+
+	s.Stamp[start] = s.Current;
+	s.Cost[start] = 0;
+	s.Parent[start] = -1;
+	open.push(QueueEntry(heuristic(from), start));
+
+	while(!open.empty())
+	{
+		const int i = open.top().second;
+		open.pop();
+
+		if(s.Closed[i] == s.Current)
+			continue;
+		s.Closed[i] = s.Current;
+		++mLastExpanded;
+
+		if(i == goal)
+			break;
+
+		const Cell c = cellOf(i);
+		for(int d = 0; d < 8; ++d)
+		{
+			if(!CanMove(map, rect, c, d))
+				continue;
+
+			Cell n;
+			n.Row = c.Row + StepRow[d];
+			n.Col = c.Col + StepCol[d];
+
+			const int j = local(n);
+			const std::uint32_t cost = s.Cost[i] + StepCost[d];
+			if(s.Closed[j] == s.Current || (s.Seen(j) && s.Cost[j] <= cost))
+				continue;
+
+			s.Stamp[j] = s.Current;
+			s.Cost[j] = cost;
+			s.Parent[j] = i;
+			open.push(QueueEntry(cost + heuristic(n), j));
+		}
+	}
+
+	if(to == nullptr)
+		return 0;
+
+	if(!s.Seen(goal) || s.Closed[goal] != s.Current)
+		return Unreachable;
+
+	if(cells != nullptr)
+	{
+		const std::size_t first = cells->size();
+		for(int i = goal; i != -1; i = s.Parent[i])
+			cells->push_back(cellOf(i));
+		std::reverse(cells->begin() + first, cells->end());
+	}
+
+	return s.Cost[goal];
+}
+
+std::uint32_t HpaPathfinder::SearchCost(const Rect& rect, Cell c)const
+{
+	if(!rect.Contains(c))
+		return Unreachable;
+
+	const int i = (c.Row - rect.Row0) * rect.Cols + (c.Col - rect.Col0);
+	return mGridScratch.Seen(i) ? mGridScratch.Cost[i] : Unreachable;
+}
+
+bool HpaPathfinder::FindPath(const TileMap& map, Cell start, Cell goal, Path& path)
+{
+	path = Path();
+	mLastExpanded = 0;
+
+	if(mClusters.empty() || !map.InBounds(start.Row, start.Col) || !map.InBounds(goal.Row, goal.Col))
+		return false;
+
+	if(map.Get(start.Row, start.Col) != TileMap::Empty || map.Get(goal.Row, goal.Col) != TileMap::Empty)
+		return false;
+
+	path.Cells.push_back(start);
+
+	const int startCluster = ClusterOf(start);
+	const int goalCluster = ClusterOf(goal);
+
+	// Inside one cluster a direct search is tiny; fall back to the graph when the
+	// way round leaves the cluster.
+	if(startCluster == goalCluster)
+	{
+		const std::uint32_t cost = GridSearch(map, mClusters[startCluster].Bounds, start, &goal, nullptr);
+		if(cost < Unreachable)
+		{
+			path.Waypoints.push_back(start);
+			path.Waypoints.push_back(goal);
+			path.Cost = cost;
+			return true;
+		}
+	}
+
+	// Temporary nodes for the end points, linked to their cluster's entrances.
+	const int s = AddNode(start);
+	const int g = AddNode(goal);
+
+	auto connect = [&](int id)
+	{
+		const Cluster& cl = mClusters[mNodes[id].Cluster];
+		GridSearch(map, cl.Bounds, mNodes[id].Pos, nullptr, nullptr);
+
+		const std::vector<int> nodes = cl.Nodes;
+		for(int other : nodes)
+		{
+			if(other == s || other == g)
+				continue;
+
+			const std::uint32_t cost = SearchCost(cl.Bounds, mNodes[other].Pos);
+			if(cost < Unreachable)
+				Link(id, other, cost, false);
+		}
+	};
+
+	connect(s);
+	connect(g);
+
+	// A* over the abstract graph.
+	Scratch& sc = mNodeScratch;
+	sc.Begin(mNodes.size());
+
+	auto heuristic = [&](int id) { return Octile(mNodes[id].Pos.Row, mNodes[id].Pos.Col, goal.Row, goal.Col); };
+
+	OpenList open;
+	sc.Stamp[s] = sc.Current;
+	sc.Cost[s] = 0;
+	sc.Parent[s] = -1;
+	open.push(QueueEntry(heuristic(s), s));
+
+	while(!open.empty())
+	{
+		const int id = open.top().second;
+		open.pop();
+
+		if(sc.Closed[id] == sc.Current)
+			continue;
+		sc.Closed[id] = sc.Current;
+		++mLastExpanded;
+
+		if(id == g)
+			break;
+
+		for(const Edge& e : mNodes[id].Edges)
+		{
+			const std::uint32_t cost = sc.Cost[id] + e.Cost;
+			if(sc.Closed[e.To] == sc.Current || (sc.Seen(e.To) && sc.Cost[e.To] <= cost))
+				continue;
+
+			sc.Stamp[e.To] = sc.Current;
+			sc.Cost[e.To] = cost;
+			sc.Parent[e.To] = id;
+			open.push(QueueEntry(cost + heuristic(e.To), e.To));
+		}
+	}
+
+	const bool found = sc.Seen(g) && sc.Closed[g] == sc.Current;
+	if(found)
+	{
+		path.Cost = sc.Cost[g];
+		for(int id = g; id != -1; id = sc.Parent[id])
+		{
+			const Cell c = mNodes[id].Pos;
+			if(path.Waypoints.empty() || path.Waypoints.back().Row != c.Row || path.Waypoints.back().Col != c.Col)
+				path.Waypoints.push_back(c);
+		}
+		std::reverse(path.Waypoints.begin(), path.Waypoints.end());
+	}
+
+	RemoveNode(g);
+	RemoveNode(s);
+
+	return found;
+}
+
+bool HpaPathfinder::RefineNext(const TileMap& map, Path& path)
+{
+	mLastExpanded = 0;
+
+	if(path.Complete())
+		return false;
+
+	const Cell a = path.Waypoints[path.Refined];
+	const Cell b = path.Waypoints[path.Refined + 1];
+
+	const int cluster = ClusterOf(a);
+	if(cluster == ClusterOf(b))
+	{
+		std::vector<Cell> cells;
+		if(GridSearch(map, mClusters[cluster].Bounds, a, &b, &cells) >= Unreachable)
+			return false;
+
+		path.Cells.insert(path.Cells.end(), cells.begin() + 1, cells.end());
+	}
+	else
+	{
+		// An entrance: the two cells face each other across the border.
+		path.Cells.push_back(b);
+	}
+
+	++path.Refined;
+	return true;
+}
+
+bool HpaPathfinder::RefineAll(const TileMap& map, Path& path)
+{
+	int expanded = 0;
+	while(!path.Complete())
+	{
+		if(!RefineNext(map, path))
+			return false;
+		expanded += mLastExpanded;
+	}
+
+	mLastExpanded = expanded;
+	return true;
+}
+
+bool HpaPathfinder::FindGridPath(const TileMap& map, Cell start, Cell goal, std::vector<Cell>& cells, std::uint32_t& cost)
+{
+	mLastExpanded = 0;
+	cells.clear();
+
+	Rect whole;
+	whole.Rows = map.RowCount();
+	whole.Cols = map.ColumnCount();
+
+	cost = GridSearch(map, whole, start, &goal, &cells);
+	return cost < Unreachable;
+}
@@ -0,0 +1,160 @@
+//***************************************************************************************
+// HpaPathfinder.h
+//
+// Hierarchical path-finding (HPA*) over a TileMap.  The map is cut into square
+// clusters; every run of open cells along a cluster border gets one or two entrance
+// nodes, and the nodes of each cluster are linked with their in-cluster path costs.
+// A query searches that small abstract graph and the grid path is only filled in
+// one abstract edge at a time, when the caller asks for it.
+//
+// Movement matches FlowField: 8 directions, cost 10 straight and 14 diagonal, no
+// cutting past wall corners.  Editing a tile rebuilds the clusters around it only.
+//***************************************************************************************
+
+#pragma once
+
+#include "TileMap.h"
+
+#include <cstdint>
+#include <vector>
+
+class HpaPathfinder
+{
+public:
+	struct Cell
+	{
+		int Row = 0;
+		int Col = 0;
+	};
+
+	struct Path
+	{
+		// Start, the entrance cells on the way, and the goal.
+		std::vector<Cell> Waypoints;
+
+		// Grid cells refined so far, beginning with the start cell.
+		std::vector<Cell> Cells;
+
+		// Waypoints already expanded into Cells.
+		std::size_t Refined = 0;
+		std::uint32_t Cost = 0;
+
+		bool Complete()const { return Refined + 1 >= Waypoints.size(); }
+	};
+
+	static const std::uint32_t Unreachable = 0x3fffffff;
+
+	explicit HpaPathfinder(int clusterSize = 10);
+
+	void Build(const TileMap& map);
+
+	// Call after map.Set(row, col, ...).  The map must keep its size.
+	void OnTileChanged(const TileMap& map, int row, int col);
+
+	// Fills path.Waypoints and path.Cost; no grid cells are produced yet.
+	bool FindPath(const TileMap& map, Cell start, Cell goal, Path& path);
+
+	// Appends the cells of the next abstract edge to path.Cells.  Returns false
+	// when the path is already complete (or the map changed under it).
+	bool RefineNext(const TileMap& map, Path& path);
+	bool RefineAll(const TileMap& map, Path& path);
+
+	// Plain A* over the whole grid, kept as a reference for the hierarchy.
+	bool FindGridPath(const TileMap& map, Cell start, Cell goal, std::vector<Cell>& cells, std::uint32_t& cost);
+
+	int ClusterSize()const { return mClusterSize; }
+	int ClusterCount()const { return (int)mClusters.size(); }
+	int NodeCount()const { return (int)mNodes.size() - (int)mFreeNodes.size(); }
+
+	// Nodes expanded by the last FindPath/RefineNext/FindGridPath call.
+	int LastExpandedCount()const { return mLastExpanded; }
+
+private:
+	struct Rect
+	{
+		int Row0 = 0;
+		int Col0 = 0;
+		int Rows = 0;
+		int Cols = 0;
+
+		bool Contains(Cell c)const
+		{
+			return c.Row >= Row0 && c.Col >= Col0 && c.Row < Row0 + Rows && c.Col < Col0 + Cols;
+		}
+	};
+
+	struct Edge
+	{
+		int To = -1;
+		std::uint32_t Cost = 0;
+		bool Inter = false;
+	};
+
+	struct Node
+	{
+		Cell Pos;
+		int Cluster = -1;
+		bool Alive = false;
+		std::vector<Edge> Edges;
+	};
+
+	struct Cluster
+	{
+		Rect Bounds;
+		std::vector<int> Nodes;
+	};
+
+	int ClusterOf(Cell c)const
+	{
+		return (c.Row / mClusterSize) * mClustersAcross + (c.Col / mClusterSize);
+	}
+
+	int AddNode(Cell c);
+	void RemoveNode(int id);
+	void Link(int a, int b, std::uint32_t cost, bool inter);
+
+	// side 0: border with the +col neighbour, side 1: with the +row neighbour.
+	void ClearBorder(int cluster, int side);
+	void BuildBorder(const TileMap& map, int cluster, int side);
+	void BuildIntraEdges(const TileMap& map, int cluster);
+
+	// A* from 'from' to 'to' inside 'rect', or Dijkstra to every cell of 'rect'
+	// when 'to' is null (costs are then read with SearchCost).
+	std::uint32_t GridSearch(const TileMap& map, const Rect& rect, Cell from, const Cell* to, std::vector<Cell>* cells);
+	std::uint32_t SearchCost(const Rect& rect, Cell c)const;
+
+	bool CanMove(const TileMap& map, const Rect& rect, Cell c, int d)const;
+
+private:
+	int mClusterSize = 10;
+	int mNumRows = 0;
+	int mNumCols = 0;
+	int mClustersAcross = 0;
+	int mClustersDown = 0;
+
+	std::vector<Cluster> mClusters;
+	std::vector<Node> mNodes;
+	std::vector<int> mFreeNodes;
+
+	// Node ids on each cluster's +col and +row border, in pairs.
+	std::vector<std::vector<int>> mBorders[2];
+
+	// Search scratch, reused between calls.  An entry is valid when its stamp
+	// matches the current search, so nothing is cleared between searches.
+	struct Scratch
+	{
+		void Begin(std::size_t count);
+		bool Seen(int i)const { return Stamp[i] == Current; }
+
+		std::vector<std::uint32_t> Stamp;
+		std::vector<std::uint32_t> Closed;
+		std::vector<std::uint32_t> Cost;
+		std::vector<int> Parent;
+		std::uint32_t Current = 0;
+	};
+
+	Scratch mGridScratch;
+	Scratch mNodeScratch;
+
+	int mLastExpanded = 0;
+};
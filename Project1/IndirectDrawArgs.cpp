@@ -0,0 +1,90 @@
+//***************************************************************************************
+// IndirectDrawArgs.cpp
+//***************************************************************************************
+
+#include "IndirectDrawArgs.h"
+
+#include "CommandRecorder.h"
+
+#include <future>
+
+const unsigned IndirectDrawBuilder::DefaultBatchBreaks;
+const int IndirectDrawCommand::RootConstantCount;
+
+IndirectDrawBuilder::IndirectDrawBuilder(unsigned batchBreaks)
+{
+	SetBatchBreaks(batchBreaks);
+}
+
+void IndirectDrawBuilder::SetBatchBreaks(unsigned batchBreaks)
+{
+	// Vertex and index buffers and the topology are set outside the signature.
+	mBatchBreaks = (batchBreaks | DrawQueue::PipelineChange | DrawQueue::GeometryChange | DrawQueue::TopologyChange) &
+		DrawQueue::AllChanges;
+}
+
+int IndirectDrawBuilder::Build(const DrawQueue& queue, const IIndirectDrawSource& source, IndirectDrawCommand* commands,
+	int maxThreads, int minDrawsPerThread)
+{
+	const int draws = queue.Count();
+	const int sliceCount = RecordListCount(draws, maxThreads, minDrawsPerThread);
+
+	mSliceBatches.resize(sliceCount);
+	std::vector<std::uint32_t> leading(sliceCount, 0);
+
+	auto buildSlice = [&](int slice)
+	{
+		const int first = (int)((long long)draws * slice / sliceCount);
+		const int last = (int)((long long)draws * (slice + 1) / sliceCount);
+
+		std::vector<IndirectDrawBatch>& batches = mSliceBatches[slice];
+		batches.clear();
+
+		// Starting one draw early gives the first draw of the slice its changes
+		// against the previous slice's last.
+		const int start = first > 0 ? first - 1 : 0;
+		int i = start;
+		queue.SubmitRange(start, last, [&](std::uint32_t item, const DrawQueue::State& state, unsigned changes)
+		{
+			const int draw = i++;
+			if(draw < first)
+				return;
+
+			source.Fill(item, state, commands[draw]);
+
+			if(changes & mBatchBreaks)
+			{
+				IndirectDrawBatch batch;
+				batch.State = state;
+				batch.FirstItem = item;
+				batch.FirstCommand = (std::uint32_t)draw;
+				batches.push_back(batch);
+			}
+
+			if(batches.empty())
+				++leading[slice];
+			else
+				++batches.back().CommandCount;
+		});
+	};
+
+	std::vector<std::future<void>> jobs;
+	for(int slice = 1; slice < sliceCount; ++slice)
+		jobs.push_back(std::async(std::launch::async, buildSlice, slice));
+
+	buildSlice(0);
+
+	for(auto& job : jobs)
+		job.get();
+
+	// A slice that starts mid-batch extends the previous slice's last batch.
+	mBatches.clear();
+	for(int slice = 0; slice < sliceCount; ++slice)
+	{
+		if(!mBatches.empty())
+			mBatches.back().CommandCount += leading[slice];
+		mBatches.insert(mBatches.end(), mSliceBatches[slice].begin(), mSliceBatches[slice].end());
+	}
+
+	return draws;
+}
@@ -0,0 +1,104 @@
+//***************************************************************************************
+// IndirectDrawArgs.h
+//
+// Turns a frame's sorted draws into the argument buffer of ExecuteIndirect, so
+// the draws themselves cost the CPU a memcpy each instead of a round of binds.
+//
+// Every draw becomes one IndirectDrawCommand: one root constant (the object
+// index; the object's data names its material and instances) followed by
+// D3D12_DRAW_INDEXED_ARGUMENTS, in the layout of the command signature described
+// below.  Commands keep the DrawQueue's sorted
+// order, and consecutive commands that agree on everything the signature cannot
+// change form a batch, which is one ExecuteIndirect call.  What breaks a batch
+// is a mask of DrawQueue::Change bits: pipeline, geometry and topology always
+// do; material does for as long as each material binds its own texture table.
+// With only PipelineChange in the mask, a batch is a whole layer.
+//
+// IndirectDrawBuilder fills the commands on several threads, each taking an even
+// slice of the queue as RecordDraws does, and writes them straight into the
+// caller's memory, which can be a mapped upload buffer.  Nothing here needs a
+// device, so the output can be checked byte by byte.
+//***************************************************************************************
+
+#pragma once
+
+#include "DrawQueue.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Command signature, in argument order:
+//   D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT, 1 value at offset 0 of the root
+//     constants parameter (object index)
+//   D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED
+// ByteStride is sizeof(IndirectDrawCommand).
+struct IndirectDrawCommand
+{
+	std::uint32_t ObjectIndex = 0;
+
+	// D3D12_DRAW_INDEXED_ARGUMENTS.
+	std::uint32_t IndexCountPerInstance = 0;
+	std::uint32_t InstanceCount = 0;
+	std::uint32_t StartIndexLocation = 0;
+	std::int32_t BaseVertexLocation = 0;
+	std::uint32_t StartInstanceLocation = 0;
+
+	static const int RootConstantCount = 1;
+};
+
+static_assert(sizeof(IndirectDrawCommand) == 24, "IndirectDrawCommand must match the command signature");
+static_assert(offsetof(IndirectDrawCommand, IndexCountPerInstance) == 4 * IndirectDrawCommand::RootConstantCount,
+	"draw arguments must follow the root constants");
+
+// Commands [FirstCommand, FirstCommand + CommandCount) share State's binds, apart
+// from the ones the commands carry.
+struct IndirectDrawBatch
+{
+	DrawQueue::State State;
+	// Item of the first draw, to look its binds up by.
+	std::uint32_t FirstItem = 0;
+	std::uint32_t FirstCommand = 0;
+	std::uint32_t CommandCount = 0;
+};
+
+class IIndirectDrawSource
+{
+public:
+	virtual ~IIndirectDrawSource() {}
+
+	// Fills the command of draw 'item'.  Called from several threads at once.
+	virtual void Fill(std::uint32_t item, const DrawQueue::State& state, IndirectDrawCommand& command)const = 0;
+};
+
+class IndirectDrawBuilder
+{
+public:
+	static const unsigned DefaultBatchBreaks =
+		DrawQueue::PipelineChange | DrawQueue::GeometryChange | DrawQueue::MaterialChange | DrawQueue::TopologyChange;
+
+	// Pipeline, geometry and topology changes are always added to 'batchBreaks'.
+	explicit IndirectDrawBuilder(unsigned batchBreaks = DefaultBatchBreaks);
+
+	void SetBatchBreaks(unsigned batchBreaks);
+	unsigned BatchBreaks()const { return mBatchBreaks; }
+
+	///<summary>
+	/// Writes one command per draw of the sorted 'queue' to 'commands', which must
+	/// hold queue.Count() of them, and splits them into Batches().  Uses up to
+	/// 'maxThreads' threads, fewer when one would get fewer than
+	/// 'minDrawsPerThread' draws; the calling thread is one of them.  Returns the
+	/// number of commands.
+	///</summary>
+	int Build(const DrawQueue& queue, const IIndirectDrawSource& source, IndirectDrawCommand* commands,
+		int maxThreads, int minDrawsPerThread);
+
+	const std::vector<IndirectDrawBatch>& Batches()const { return mBatches; }
+
+private:
+	unsigned mBatchBreaks;
+
+	// Batches starting in each thread's slice, joined after the threads finish.
+	std::vector<std::vector<IndirectDrawBatch>> mSliceBatches;
+	std::vector<IndirectDrawBatch> mBatches;
+};
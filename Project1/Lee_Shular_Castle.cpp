@@ -11,9 +11,31 @@
 #include "../../Common/Camera.h"
 #include <DirectXCollision.h>
 #include "GeometryGenerator.h"
+#include "CastleLayout.h"
 #include "FrameResource.h"
 #include "Waves.h"
-#include <fstream>
+#include "TileMap.h"
+#include "TileMapMesher.h"
+#include "StaticBatcher.h"
+#include "CollisionGrid.h"
+#include "FlowField.h"
+#include "HpaPathfinder.h"
+#include "TileChunkStreamer.h"
+#include "TileMapPvs.h"
+#include "TileMapPortals.h"
+#include "FrustumCuller.h"
+#include "CullingBvh.h"
+#include "OcclusionBuffer.h"
+#include "DrawQueue.h"
+#include "CommandRecorder.h"
+#include "IndirectDrawArgs.h"
+#include "PackedDataBuffer.h"
+#include "UploadRing.h"
+#include "SceneStore.h"
+#include "TransformHierarchy.h"
+#include "ResourceRegistry.h"
+
+#include <future>
 
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
@@ -21,38 +43,62 @@ using namespace DirectX::PackedVector;
 
 #pragma comment(lib, "d3dcompiler.lib")
 #pragma comment(lib, "D3D12.lib")
-#define tileMapWidth 40
-#define tileMapHeight 19
 const int gNumFrameResources = 3;
 
+// Draws are recorded into up to this many command lists at once, each with at
+// least gMinDrawsPerRecordList draws.
+const int gNumRecordLists = 4;
+const int gMinDrawsPerRecordList = 32;
+
+// The window caption's scene statistics are rebuilt at most this often, in
+// seconds; D3DApp only shows the caption once a second anyway.
+const float gStatsTextInterval = 0.5f;
+
+typedef ResourceHandle<MeshGeometry> GeometryHandle;
+typedef ResourceHandle<Material> MaterialHandle;
+typedef ResourceHandle<Texture> TextureHandle;
+typedef ResourceHandle<ID3D12PipelineState> PsoHandle;
+
+// A named draw range of a registered geometry, as "shapeGeo/box".
+struct SubmeshRef
+{
+	GeometryHandle Geo;
+	SubmeshGeometry Args;
+};
+typedef ResourceHandle<SubmeshRef> SubmeshHandle;
+
 // Lightweight structure stores parameters to draw a shape.  This will
 // vary from app-to-app.
 struct RenderItem
 {	
 	RenderItem() = default;
 
+	// The item's transforms, bounds, material and geometry handles and dirty
+	// flag, which are read every frame, live in mScene under this handle; what is left here is only
+	// needed once the item is drawn.  Local bounds cover the drawn range;
+	// BuildCullingData fills in any that were left empty.
+	SceneHandle Node;
+
 	bool Visible = true;
-	BoundingBox Bounds;
 
-    // World matrix of the shape that describes the object's local space
-    // relative to the world space, which defines the position, orientation,
-    // and scale of the object in the world.
-    XMFLOAT4X4 World = MathHelper::Identity4x4();
+	// Node in mTransforms that places the item, or NoParent for items whose
+	// world matrix is set directly.  Items baked into a static batch keep the
+	// place they had at startup.
+	std::uint32_t Transform = TransformHierarchy::NoParent;
 
-	XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
+	// Static item whose Bounds, moved by World, block the camera.
+	bool Collidable = false;
 
-	// Dirty flag indicating the object data has changed and we need to update the constant buffer.
-	// Because we have an object cbuffer for each FrameResource, we have to apply the
-	// update to each FrameResource.  Thus, when we modify obect data we should set 
-	// NumFramesDirty = gNumFrameResources so that each frame resource gets the update.
-	int NumFramesDirty = gNumFrameResources;
+	// Slot in mStaticBvh for items built at start-up, or in mCuller for streamed
+	// ones; -1 when the item is not drawn through a layer.
+	int BvhSlot = -1;
+	int CullSlot = -1;
 
-	// Index into GPU constant buffer corresponding to the ObjectCB for this render item.
+	// Index of this render item's ObjectData, the draw's root constant.  Call
+	// MarkRitemDirty after changing anything UpdateObjectCBs reads; mObjectData
+	// then copies the new data into every FrameResource's object buffer in turn.
 	UINT ObjCBIndex = -1;
 
-	Material* Mat = nullptr;
-	MeshGeometry* Geo = nullptr;
-
     // Primitive topology.
     D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 	
@@ -60,6 +106,14 @@ struct RenderItem
     UINT IndexCount = 0;
     UINT StartIndexLocation = 0;
     int BaseVertexLocation = 0;
+
+	// Instanced items draw one copy of the mesh per entry; Bounds is then in
+	// the mesh's local space.  Each frame the visible instances are packed into
+	// the frame's instance buffer starting at InstanceBufferOffset, which is
+	// handed out once and passed to the shader in the object data.
+	std::vector<InstanceData> Instances;
+	UINT InstanceCount = 0;
+	UINT InstanceBufferOffset = 0;
 };
 
 enum class RenderLayer : int
@@ -68,10 +122,13 @@ enum class RenderLayer : int
 	Transparent,
 	AlphaTested,
 	AlphaTestedTreeSprites,
+	InstancedOpaque,
+	InstancedAlphaTested,
 	Count
 };
+static_assert((int)RenderLayer::Count == CastleLayout::LayerCount, "RenderLayer must follow CastleLayout::Layer");
 
-class CastleDesign : public D3DApp
+class CastleDesign : public D3DApp, private ICommandRecorder, private IUploadHeapSource, private IIndirectDrawSource
 {
 public:
     CastleDesign(HINSTANCE hInstance);
@@ -93,13 +150,22 @@ private:
     void OnKeyboardInput(const GameTimer& gt);
 	void UpdateCamera(const GameTimer& gt);
 	void AnimateMaterials(const GameTimer& gt);
+	std::unique_ptr<RenderItem> NewRenderItem();
+	void SetSubmesh(RenderItem* ri, SubmeshHandle submesh);
+	GeometryHandle AddGeometry(const std::string& name, std::unique_ptr<MeshGeometry> geo);
+	void MarkRitemDirty(RenderItem* ri);
+	void AttachRitem(RenderItem* ri, std::uint32_t parent, DirectX::FXMMATRIX local);
+	void UpdateTransforms();
 	void UpdateObjectCBs(const GameTimer& gt);
+	void UpdateInstanceData(const GameTimer& gt);
 	void UpdateMaterialCBs(const GameTimer& gt);
 	void UpdateMainPassCB(const GameTimer& gt);
 	void UpdateWaves(const GameTimer& gt); 
+	void UpdateStatsText(const GameTimer& gt);
 	
 	void LoadTextures();
     void BuildRootSignature();
+	void BuildCommandSignature();
 	void BuildDescriptorHeaps();
     void BuildShadersAndInputLayouts();
     void BuildLandGeometry();
@@ -110,8 +176,33 @@ private:
     void BuildFrameResources();
     void BuildMaterials();
     void BuildRenderItems();
-    void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
-	void TileMapDrawing(char key, float offsetX, float offsetY, float offsetZ, int index);
+	void BuildStaticBatches();
+	void BuildCollisionGrid();
+	void BuildCullingData();
+	BoundingBox WorldBounds(RenderItem* ri)const;
+	void CullRenderItems();
+	void UpdateTileChunks();
+	void UploadTileChunks();
+	void ReleaseTileChunk(std::uint64_t key);
+	void SetTile(int row, int col, TileMap::Tile tile);
+	void UpdateTileChunkVisibility();
+	bool TileChunkVisible(const TileChunkStreamer::Key& chunk)const;
+    void QueueRenderItems();
+	void DrawRenderItemsIndirect();
+	void BindDrawState(ID3D12GraphicsCommandList* cmdList, const RenderItem* ri, const DrawQueue::State& state, unsigned changes);
+
+	// ICommandRecorder: records slices of mDrawQueue into the frame resource's
+	// record lists.
+	virtual void Begin(int list)override;
+	virtual void Record(int list, std::uint32_t item, const DrawQueue::State& state, unsigned changes)override;
+	virtual void End(int list)override;
+
+	// IUploadHeapSource: persistently mapped upload buffers for mUploadRing.
+	virtual bool CreateHeap(std::uint64_t size, UploadHeap& heap)override;
+	virtual void ReleaseHeap(const UploadHeap& heap)override;
+
+	// IIndirectDrawSource: the ExecuteIndirect arguments of one queued draw.
+	virtual void Fill(std::uint32_t item, const DrawQueue::State& state, IndirectDrawCommand& command)const override;
 
 	bool CollisionDetection(char type, float d);
 	std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> GetStaticSamplers();
@@ -126,36 +217,159 @@ private:
     UINT mCbvSrvDescriptorSize = 0;
 
     ComPtr<ID3D12RootSignature> mRootSignature = nullptr;
+	// One root constant (the object index) and an indexed draw per command.
+	ComPtr<ID3D12CommandSignature> mDrawCommandSignature = nullptr;
 
 	ComPtr<ID3D12DescriptorHeap> mSrvDescriptorHeap = nullptr;
 
-	std::unordered_map<std::string, std::unique_ptr<MeshGeometry>> mGeometries;
-	std::unordered_map<std::string, std::unique_ptr<Material>> mMaterials;
-	std::unordered_map<std::string, std::unique_ptr<Texture>> mTextures;
+	// Names are only looked up while loading; the frame works with handles.  A
+	// material's handle is its MatCBIndex, and geometry and material handles
+	// double as the DrawQueue ids.
+	ResourceRegistry<MeshGeometry> mGeometries;
+	ResourceRegistry<SubmeshRef, SubmeshRef> mSubmeshes;
+	ResourceRegistry<Material> mMaterials;
+	ResourceRegistry<Texture> mTextures;
 	std::unordered_map<std::string, ComPtr<ID3DBlob>> mShaders;
-	std::unordered_map<std::string, ComPtr<ID3D12PipelineState>> mPSOs;
+	ResourceRegistry<ID3D12PipelineState, ComPtr<ID3D12PipelineState>> mPSOs;
+
+	// What the frame touches by name: the waves' geometry, rewritten every
+	// frame, and the two materials the waves switch between.
+	GeometryHandle mWavesGeo;
+	MaterialHandle mWaterMat;
+	MaterialHandle mTorusMat;
 
     std::vector<D3D12_INPUT_ELEMENT_DESC> mStdInputLayout;
 	std::vector<D3D12_INPUT_ELEMENT_DESC> mTreeSpriteInputLayout;
 
     RenderItem* mWavesRitem = nullptr;
 
+	// Per-item data read every frame, one array per field.
+	SceneStore mScene;
+
+	// Parent/child placement of the castle parts.  UpdateTransforms copies the
+	// world matrices it recomputed into mScene and queues those items, which
+	// moves their object data and cull bounds.  Nothing calls SetLocal after
+	// startup; a group moved later would leave behind its static batches, its
+	// boxes in mCollisionGrid and mOcclusion, and the instanced props, which
+	// are all built once from the startup placement.
+	TransformHierarchy mTransforms;
+	// Item placed by each node, or nullptr for group nodes.
+	std::vector<RenderItem*> mTransformRitems;
+	std::vector<std::uint32_t> mChangedTransforms;
+
 	// List of all the render items.
 	std::vector<std::unique_ptr<RenderItem>> mAllRitems;
 
 	// Render items divided by PSO.
 	std::vector<RenderItem*> mRitemLayer[(int)RenderLayer::Count];
 
+	// World bounds of every layered item, and what survived this frame's test.
+	// Items that live for the whole run sit in a tree; streamed chunks come and
+	// go too often for that and are tested one by one.
+	CullingBvh mStaticBvh{ (int)RenderLayer::Count };
+	std::vector<RenderItem*> mBvhRitems;
+	FrustumCuller mCuller;
+	std::vector<RenderItem*> mCullRitems;
+	std::vector<std::uint32_t> mVisibleSlots[(int)RenderLayer::Count];
+	std::vector<RenderItem*> mVisibleRitems[(int)RenderLayer::Count];
+
+	// This frame's draws, sorted to share state.
+	DrawQueue mDrawQueue;
+	std::vector<RenderItem*> mDrawItems;
+	// PSO of each DrawQueue pipeline, looked up once in BuildPSOs.
+	std::vector<ID3D12PipelineState*> mPassPSOs;
+	int mRecordListCount = 0;
+	DrawQueue::Stats mDrawStats;
+
+	// With indirect draws on, the queue becomes one ExecuteIndirect per run of
+	// draws sharing a state, its arguments written into the upload ring.
+	bool mIndirectDraws = true;
+	IndirectDrawBuilder mIndirectBuilder;
+
+	// Items whose object data changed since the last UpdateObjectCBs.
+	std::vector<RenderItem*> mDirtyRitems;
+
+	// Object and material data packed once per change, indexed by ObjCBIndex and
+	// MatCBIndex; each frame resource copies the ranges it has not seen yet.
+	PackedDataBuffer<ObjectData> mObjectData{ gNumFrameResources };
+	PackedDataBuffer<MaterialData> mMaterialData{ gNumFrameResources };
+
+	// Pass constants, instance data, the waves vertices and the indirect draw
+	// arguments of every frame in flight, in one mapped heap.  Heaps are indexed by UploadHeap::Id.
+	std::unique_ptr<UploadRing> mUploadRing;
+	std::vector<ComPtr<ID3D12Resource>> mUploadHeaps;
+	int mUploadRingGrows = 0;
+
+	// When UpdateStatsText last rebuilt the caption.
+	float mStatsTextTime = -gStatsTextInterval;
+	// Instances of every instanced item, the most a frame can upload.
+	UINT mInstanceCount = 0;
+
+	// Coarse depth of the maze and castle walls; items wholly behind it are
+	// dropped after the frustum test.
+	OcclusionBuffer mOcclusion;
+	bool mOcclusionCullingEnabled = true;
+	bool mOcclusionDumpKeyDown = false;
+
 	std::unique_ptr<Waves> mWaves;
 
     PassConstants mMainPassCB;
 
 	Camera mCamera;
 	BoundingBox mCamBound;
+	// View-space frustum; rebuilt whenever the projection changes.
+	BoundingFrustum mCamFrustum;
+	bool mFrustumCullingEnabled = true;
     float mTheta = 1.5f*XM_PI;
     float mPhi = XM_PIDIV2 - 0.1f;
     float mRadius = 50.0f;
-	std::array<std::array<char, 40>, 40> tilemap;
+	TileMap mTileMap;
+	// Maze walls are meshed in chunks around the camera on worker threads.
+	struct StreamedChunk
+	{
+		GeometryHandle Geo;
+		std::unique_ptr<RenderItem> Ritem;
+		// Indices of the chunk's wall boxes in mCollisionGrid and mOcclusion.
+		std::vector<int> CollisionBoxes;
+		std::vector<int> Occluders;
+	};
+	TileChunkStreamer mChunkStreamer;
+	std::unordered_map<std::uint64_t, StreamedChunk> mStreamedChunks;
+	// Buffers of evicted chunks, kept until the GPU passes the fence value.
+	std::vector<std::pair<UINT64, std::unique_ptr<MeshGeometry>>> mRetiredChunkGeos;
+	// Identity item whose object constants every chunk is drawn with.
+	RenderItem* mChunkBaseRitem = nullptr;
+	// Broadphase over every static collision box, one cell per maze cell.
+	CollisionGrid mCollisionGrid;
+	// Shared navigation fields for NPCs; field 0 leads to the maze entrance.
+	FlowFieldSet mNavFields;
+	// Point to point queries across the maze.
+	HpaPathfinder mPathfinder;
+	// Tile edits are replayed into mNavMap and the navigation data on a worker.
+	// While mNavJob runs it owns mNavMap, mNavFields and mPathfinder; the next
+	// frame boundary after it finishes hands them back.
+	struct TileEdit
+	{
+		int Row;
+		int Col;
+		TileMap::Tile Tile;
+	};
+	TileMap mNavMap;
+	std::vector<TileEdit> mPendingNavEdits;
+	std::future<void> mNavJob;
+	bool mEditKeyDown = false;
+	// Cell to cell visibility inside the maze.  Rebuilt by mNavJob after edits and
+	// not used until then.
+	TileMapPvs mPvs;
+	bool mPvsStale = false;
+	// Expanded set of the camera's cell; only valid while mPvsActive.
+	int mPvsSet = -1;
+	bool mPvsActive = false;
+	std::vector<std::uint64_t> mPvsBits;
+	// View dependent visibility through the maze openings, kept current on edits.
+	TileMapPortals mPortals;
+	bool mPortalsActive = false;
+	std::vector<std::uint64_t> mPortalBits;
     POINT mLastMousePos;
 	bool mLava; 
 	int timer = 0;
@@ -187,12 +401,14 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 }
 
 CastleDesign::CastleDesign(HINSTANCE hInstance)
-    : D3DApp(hInstance)
+    : D3DApp(hInstance), mChunkStreamer(8)
 {
 }
 
 CastleDesign::~CastleDesign()
 {
+	if (mNavJob.valid())
+		mNavJob.wait();
     if(md3dDevice != nullptr)
         FlushCommandQueue();
 }
@@ -211,23 +427,33 @@ bool CastleDesign::Initialize()
 
     mWaves = std::make_unique<Waves>(128, 128, 1.0f, 0.03f, 4.0f, 0.2f);
 	
-	std::ifstream inFile("map.txt");
-	if (inFile.is_open())
+	// Maze cells are 4x4 units with 10 unit tall walls, starting at (112, -36).
+	if (!mTileMap.LoadFromFile("map.txt"))
 	{
-		char key;
-		for (auto row = 0; row < tileMapWidth; ++row)
-		{
-			for (auto col = 0; col < tileMapHeight; ++col)
-			{
-				inFile >> key;
-
-				tilemap[row][col] = key;
-			}
-		}
-	}	
+		std::string msg = "map.txt: " + mTileMap.LastError() + "\n";
+		::OutputDebugStringA(msg.c_str());
+	}
+	mTileMap.SetPlacement(112.0f, -36.0f, 4.0f, 10.0f);
+	if (mTileMap.RowCount() > 0)
+	{
+		FlowField::Cell entrance;
+		entrance.Row = mTileMap.RowCount() - 1;
+		entrance.Col = 1;
+		mNavFields.Add({ entrance });
+		mNavFields.Build(mTileMap);
+		mPathfinder.Build(mTileMap);
+		mPvs.Build(mTileMap);
+		mPortals.Build(mTileMap);
+
+		std::string msg = "PVS: " + std::to_string(mPvs.UniqueSetCount()) + " sets, " +
+			std::to_string(mPvs.CompressedBytes()) + " bytes (" + std::to_string(mPvs.UncompressedBytes()) + " unpacked)\n";
+		::OutputDebugStringA(msg.c_str());
+	}
+	mNavMap = mTileMap;
 	mCamera.SetPosition(250.0f, 15.0f, -80.0f);
 	LoadTextures();
     BuildRootSignature();
+	BuildCommandSignature();
 	BuildDescriptorHeaps();
     BuildShadersAndInputLayouts();
     BuildLandGeometry();
@@ -236,9 +462,19 @@ bool CastleDesign::Initialize()
 	BuildTreeSpritesGeometry();
 	BuildMaterials();
     BuildRenderItems();
+	BuildStaticBatches();
+	BuildCollisionGrid();
+	BuildCullingData();
     BuildFrameResources();
     BuildPSOs();
 
+	// Mesh the chunks around the start position now so the first frame has walls.
+	mChunkStreamer.SetRadii(128.0f, 160.0f);
+	mChunkStreamer.Start(2);
+	UpdateTileChunks();
+	mChunkStreamer.Flush();
+	UploadTileChunks();
+
     // Execute the initialization commands.
     ThrowIfFailed(mCommandList->Close());
     ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
@@ -258,7 +494,8 @@ void CastleDesign::OnResize()
 	
 	// The window resized, so update the aspect ratio and recompute the projection matrix.
 	BoundingBox::CreateFromPoints(mCamBound, size_t(8), &mCamera.GetPosition3f(), sizeof(Vertex));
-	
+
+	BoundingFrustum::CreateFromMatrix(mCamFrustum, mCamera.GetProj());
 }
 
 void CastleDesign::Update(const GameTimer& gt)
@@ -280,11 +517,29 @@ void CastleDesign::Update(const GameTimer& gt)
         CloseHandle(eventHandle);
     }
 
+	// Whatever the finished frames allocated can be reused.
+	mUploadRing->Release(mFence->GetCompletedValue());
+
+	UpdateTileChunks();
+	UpdateTileChunkVisibility();
+
+	// Switch between water and lava.  The object data names the material, so
+	// the switch has to happen before it is packed.
+	UINT wavesMat = mLava ? mWaterMat.Index : mTorusMat.Index;
+	if (mScene.Material(mWavesRitem->Node) != wavesMat)
+	{
+		mScene.Material(mWavesRitem->Node) = wavesMat;
+		MarkRitemDirty(mWavesRitem);
+	}
+
+	UpdateTransforms();
 	AnimateMaterials(gt);
 	UpdateObjectCBs(gt);
+	UpdateInstanceData(gt);
 	UpdateMaterialCBs(gt);
 	UpdateMainPassCB(gt);
     UpdateWaves(gt);
+	UpdateStatsText(gt);
 	//To lock Y position and allow the camera to change pitch
 	if(!mCollision)
 		mCamera.SetPosition({mCamera.GetPosition3f().x,2.0f,mCamera.GetPosition3f().z});
@@ -293,14 +548,6 @@ void CastleDesign::Update(const GameTimer& gt)
 
 void CastleDesign::Draw(const GameTimer& gt)
 {
-	// Swtitch between Water and Lava.
-	if (mLava) {
-		mAllRitems[75]->Mat = mMaterials["water"].get();
-	}
-	else {
-		mAllRitems[75]->Mat = mMaterials["Torus0"].get();
-	}
-
     auto cmdListAlloc = mCurrFrameResource->CmdListAlloc;
 
     // Reuse the memory associated with command recording.
@@ -309,7 +556,12 @@ void CastleDesign::Draw(const GameTimer& gt)
 
     // A command list can be reset after it has been added to the command queue via ExecuteCommandList.
     // Reusing the command list reuses memory.
-    ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs["opaque"].Get()));
+    ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPassPSOs[0]));
+
+	UploadTileChunks();
+
+	// After the uploads, which can replace chunk items.
+	CullRenderItems();
 
     mCommandList->RSSetViewports(1, &mScreenViewport);
     mCommandList->RSSetScissorRects(1, &mScissorRect);
@@ -322,38 +574,24 @@ void CastleDesign::Draw(const GameTimer& gt)
     mCommandList->ClearRenderTargetView(CurrentBackBufferView(), (float*)&mMainPassCB.FogColor, 0, nullptr);
     mCommandList->ClearDepthStencilView(DepthStencilView(), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
 
-    // Specify the buffers we are going to render to.
-    mCommandList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, &DepthStencilView());
-
-	ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvDescriptorHeap.Get() };
-	mCommandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
-
-	mCommandList->SetGraphicsRootSignature(mRootSignature.Get());
-
-	auto passCB = mCurrFrameResource->PassCB->Resource();
-	mCommandList->SetGraphicsRootConstantBufferView(2, passCB->GetGPUVirtualAddress());
-
-    DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
-
-	mCommandList->SetPipelineState(mPSOs["alphaTested"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::AlphaTested]);
-
-	mCommandList->SetPipelineState(mPSOs["treeSprites"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::AlphaTestedTreeSprites]);
-
-	mCommandList->SetPipelineState(mPSOs["transparent"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Transparent]);
+    // Done with uploads and clears; the draws go into the record lists.
+    ThrowIfFailed(mCommandList->Close());
 
-    // Indicate a state transition on the resource usage.
-	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
-		D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
+	QueueRenderItems();
 
-    // Done recording commands.
-    ThrowIfFailed(mCommandList->Close());
+	if (mIndirectDraws)
+		DrawRenderItemsIndirect();
+	else
+	{
+		mRecordListCount = RecordListCount(mDrawQueue.Count(), gNumRecordLists, gMinDrawsPerRecordList);
+		RecordDraws(mDrawQueue, *this, gNumRecordLists, gMinDrawsPerRecordList, &mDrawStats);
+	}
 
-    // Add the command list to the queue for execution.
-    ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
-    mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+    // Add the command lists to the queue for execution, in order.
+    ID3D12CommandList* cmdsLists[1 + gNumRecordLists] = { mCommandList.Get() };
+	for (int i = 0; i < mRecordListCount; ++i)
+		cmdsLists[1 + i] = mCurrFrameResource->RecordLists[i].Get();
+    mCommandQueue->ExecuteCommandLists(1 + mRecordListCount, cmdsLists);
 
     // Swap the back and front buffers
     ThrowIfFailed(mSwapChain->Present(0, 0));
@@ -362,6 +600,17 @@ void CastleDesign::Draw(const GameTimer& gt)
     // Advance the fence value to mark commands up to this fence point.
     mCurrFrameResource->Fence = ++mCurrentFence;
 
+	// This frame's upload ring allocations are in use until the same fence.
+	mUploadRing->EndFrame(mCurrentFence);
+	const UploadRing::Stats& ringStats = mUploadRing->GetStats();
+	if (ringStats.Grows != mUploadRingGrows)
+	{
+		mUploadRingGrows = ringStats.Grows;
+		std::string msg = "Upload ring grew to " + std::to_string(ringStats.Capacity) + " bytes (frame used " +
+			std::to_string(ringStats.FrameBytes) + ", peak " + std::to_string(ringStats.PeakFrameBytes) + ")\n";
+		::OutputDebugStringA(msg.c_str());
+	}
+
     // Add an instruction to the command queue to set a new fence point. 
     // Because we are on the GPU timeline, the new fence point won't be 
     // set until the GPU finishes processing all the commands prior to this Signal().
@@ -390,7 +639,7 @@ void CastleDesign::OnMouseMove(WPARAM btnState, int x, int y)
 		float dy = XMConvertToRadians(0.25f * static_cast<float>(y - mLastMousePos.y));
 
 		//step4: Instead of updating the angles based on input to orbit camera around scene, 
-		//we rotate the cameras look direction:
+		//we rotate the camera�s look direction:
 		//mTheta += dx;
 		//mPhi += dy;
 
@@ -424,6 +673,50 @@ void CastleDesign::OnKeyboardInput(const GameTimer& gt)
 	if (GetKeyState('1') & 0x8000)
 		mCollision = !mCollision;
 
+	// Frustum culling of instanced items on/off.
+	if (GetAsyncKeyState('2') & 0x8000)
+		mFrustumCullingEnabled = true;
+
+	if (GetAsyncKeyState('3') & 0x8000)
+		mFrustumCullingEnabled = false;
+
+	// Occlusion culling on/off.
+	if (GetAsyncKeyState('4') & 0x8000)
+		mOcclusionCullingEnabled = true;
+
+	if (GetAsyncKeyState('5') & 0x8000)
+		mOcclusionCullingEnabled = false;
+
+	// ExecuteIndirect batches, or one DrawIndexedInstanced per item.
+	if (GetAsyncKeyState('6') & 0x8000)
+		mIndirectDraws = true;
+
+	if (GetAsyncKeyState('7') & 0x8000)
+		mIndirectDraws = false;
+
+	// Save the occlusion depth buffer next to the executable.
+	bool dumpKeyDown = (GetAsyncKeyState('O') & 0x8000) != 0;
+	if (dumpKeyDown && !mOcclusionDumpKeyDown)
+	{
+		std::string msg = mOcclusion.WriteDepthImage("occlusion.pgm") ?
+			"Occlusion depth written to occlusion.pgm\n" : "Could not write occlusion.pgm\n";
+		::OutputDebugStringA(msg.c_str());
+	}
+	mOcclusionDumpKeyDown = dumpKeyDown;
+
+	// Knock down (or put back) the maze wall in front of the camera.
+	bool editKeyDown = (GetAsyncKeyState('E') & 0x8000) != 0;
+	if (editKeyDown && !mEditKeyDown)
+	{
+		XMFLOAT3 pos = mCamera.GetPosition3f();
+		XMFLOAT3 look = mCamera.GetLook3f();
+
+		int row, col;
+		if (mTileMap.WorldToCell(pos.x + look.x * mTileMap.CellSize(), pos.z + look.z * mTileMap.CellSize(), row, col))
+			SetTile(row, col, mTileMap.IsWall(row, col) ? TileMap::Empty : TileMap::Wall);
+	}
+	mEditKeyDown = editKeyDown;
+
 	mCamera.UpdateViewMatrix();
 	// Making Switching system with keyboard 1.
 	if (GetAsyncKeyState('0') & 0x8000)
@@ -470,17 +763,12 @@ bool CastleDesign::CollisionDetection(char type, float d)
 			break;
 
 		}
-		for (auto& e : mAllRitems)
-		{
-			XMVECTOR rt = XMLoadFloat3(&XMFLOAT3(temp.x + 1.5f, temp.y + 1.5f, temp.z + 1.0f));
-			XMVECTOR ld = XMLoadFloat3(&XMFLOAT3(temp.x - 1.5f, temp.y - 1.5f, temp.z - 0.5f));
-			BoundingBox::CreateFromPoints(mCamBound, rt, ld);
-			if (mCamBound.Contains(e->Bounds) != DirectX::DISJOINT)
-			{
-				return true;
-			}
-		}
-		return false;
+		XMVECTOR rt = XMLoadFloat3(&XMFLOAT3(temp.x + 1.5f, temp.y + 1.5f, temp.z + 1.0f));
+		XMVECTOR ld = XMLoadFloat3(&XMFLOAT3(temp.x - 1.5f, temp.y - 1.5f, temp.z - 0.5f));
+		BoundingBox::CreateFromPoints(mCamBound, rt, ld);
+
+		// Only the boxes in the grid cells under the camera box are tested.
+		return mCollisionGrid.Intersects(mCamBound);
 	}
 	return false;
 }
@@ -494,7 +782,7 @@ void CastleDesign::AnimateMaterials(const GameTimer& gt)
 {
 	// Making waves with animating by deltaTime
 	// shifting textur's uv
-	auto waterMat = mMaterials["water"].get();
+	auto waterMat = mMaterials[mWaterMat].get();
 	float& tu = waterMat->MatTransform(3, 0);
 	float& tv = waterMat->MatTransform(3, 1);
 	tu += 0.1f * gt.DeltaTime();
@@ -513,72 +801,192 @@ void CastleDesign::AnimateMaterials(const GameTimer& gt)
 	waterMat->NumFramesDirty = gNumFrameResources;
 }
 
+std::unique_ptr<RenderItem> CastleDesign::NewRenderItem()
+{
+	auto ri = std::make_unique<RenderItem>();
+	ri->Node = mScene.Create();
+	return ri;
+}
+
+void CastleDesign::SetSubmesh(RenderItem* ri, SubmeshHandle submesh)
+{
+	const SubmeshRef& ref = mSubmeshes[submesh];
+	ri->IndexCount = ref.Args.IndexCount;
+	ri->StartIndexLocation = ref.Args.StartIndexLocation;
+	ri->BaseVertexLocation = ref.Args.BaseVertexLocation;
+	mScene.Bounds(ri->Node) = ref.Args.Bounds;
+	mScene.Geometry(ri->Node) = ref.Geo.Index;
+}
+
+GeometryHandle CastleDesign::AddGeometry(const std::string& name, std::unique_ptr<MeshGeometry> geo)
+{
+	// Each draw range is registered as "geometry/submesh" so items can be set
+	// up from a handle instead of searching DrawArgs.
+	SubmeshRef ref;
+	ref.Geo = mGeometries.Add(name, std::move(geo));
+	for (auto& args : mGeometries[ref.Geo]->DrawArgs)
+	{
+		ref.Args = args.second;
+		mSubmeshes.Add(name + "/" + args.first, ref);
+	}
+	return ref.Geo;
+}
+
+void CastleDesign::MarkRitemDirty(RenderItem* ri)
+{
+	if (mScene.MarkDirty(ri->Node))
+		mDirtyRitems.push_back(ri);
+}
+
+void CastleDesign::AttachRitem(RenderItem* ri, std::uint32_t parent, FXMMATRIX local)
+{
+	XMFLOAT4X4 localF;
+	XMStoreFloat4x4(&localF, local);
+	ri->Transform = mTransforms.Add(parent, localF);
+
+	if (ri->Transform >= mTransformRitems.size())
+		mTransformRitems.resize(ri->Transform + 1, nullptr);
+	mTransformRitems[ri->Transform] = ri;
+}
+
+void CastleDesign::UpdateTransforms()
+{
+	// Only the subtrees under changed locals are recomputed, and only the items
+	// they move are queued for packing.
+	mChangedTransforms.clear();
+	mTransforms.Update(mChangedTransforms);
+
+	for (std::uint32_t id : mChangedTransforms)
+	{
+		RenderItem* ri = mTransformRitems[id];
+		if (ri == nullptr)
+			continue;
+
+		mScene.World(ri->Node) = mTransforms.World(id);
+		MarkRitemDirty(ri);
+	}
+}
+
 void CastleDesign::UpdateObjectCBs(const GameTimer& gt)
 {
-	int isCollision = 0;
-	auto currObjectCB = mCurrFrameResource->ObjectCB.get();
-	for(auto& e : mAllRitems)
+	// Only items that changed are packed; mObjectData remembers which frame
+	// resources still need the new values, so a still scene costs nothing here.
+	// The new world bounds are kept in mScene for the occlusion test.
+	mObjectData.Resize((std::uint32_t)mAllRitems.size());
+	for(RenderItem* e : mDirtyRitems)
 	{
-		// Only update the cbuffer data if the constants have changed.  
-		// This needs to be tracked per frame resource.
-		if(e->NumFramesDirty > 0)
-		{
-			XMMATRIX world = XMLoadFloat4x4(&e->World);
-			XMMATRIX texTransform = XMLoadFloat4x4(&e->TexTransform);
-			
-			/*XMFLOAT4X4 camWorld;
-			XMStoreFloat4x4(&camWorld, XMMatrixTranslation(mCamera.GetPosition3f().x, mCamera.GetPosition3f().y, mCamera.GetPosition3f().z));
-			XMMATRIX cam = XMLoadFloat4x4(&camWorld);
-			mCamBound.Transform(mCamBound, cam);*/
-			
-			//mCamBound.Transform(localSpaceFrustum, viewToLocal);			
-			
-			ObjectConstants objConstants;
-			XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(world));
-			XMStoreFloat4x4(&objConstants.TexTransform, XMMatrixTranspose(texTransform));
-
-			currObjectCB->CopyData(e->ObjCBIndex, objConstants);
-
-			// Next FrameResource need to be updated too.
-			e->NumFramesDirty--;			
-		}
-		//BoundingBox::CreateFromPoints(mCamBound, size_t(1), &mCamera.GetPosition3f(), sizeof(Vertex));
-		std::wostringstream outs;
-		outs.precision(6);
-		outs << L"Instancing and Culling Demo" <<
-			L"    " << mCamera.GetPosition3f().z;
-		mMainWndCaption = outs.str();
+		const std::uint32_t node = mScene.Index(e->Node);
+
+		XMMATRIX world = XMLoadFloat4x4(&mScene.Worlds()[node]);
+		XMMATRIX texTransform = XMLoadFloat4x4(&mScene.TexTransform(e->Node));
+
+		ObjectData objData;
+		XMStoreFloat4x4(&objData.World, XMMatrixTranspose(world));
+		XMStoreFloat4x4(&objData.TexTransform, XMMatrixTranspose(texTransform));
+		objData.MaterialIndex = mScene.Materials()[node];
+		objData.InstanceOffset = e->InstanceBufferOffset;
+
+		mObjectData.Set(e->ObjCBIndex, objData);
+
+		BoundingBox& worldBounds = mScene.WorldBounds(e->Node);
+		worldBounds = WorldBounds(e);
+		if (e->BvhSlot >= 0)
+			mStaticBvh.SetBounds(e->BvhSlot, worldBounds);
+		if (e->CullSlot >= 0)
+			mCuller.SetBounds(e->CullSlot, worldBounds);
+
+		mScene.ClearDirty(e->Node);
 	}
-	
-		
+	mDirtyRitems.clear();
+
+	auto currObjectBuffer = mCurrFrameResource->ObjectBuffer.get();
+	mObjectData.Upload(mCurrFrameResourceIndex, [&](std::uint32_t first, const ObjectData* data, std::uint32_t count)
+	{
+		for (std::uint32_t i = 0; i < count; ++i)
+			currObjectBuffer->CopyData(first + i, data[i]);
+	});
 }
 
+void CastleDesign::UpdateInstanceData(const GameTimer& gt)
+{
+	mCurrFrameResource->InstanceAddress = 0;
+	if (mInstanceCount == 0)
+		return;
+
+	UploadRing::Allocation instances = mUploadRing->Allocate(mInstanceCount * sizeof(InstanceData), 16);
+	InstanceData* currInstances = static_cast<InstanceData*>(instances.Cpu);
+	mCurrFrameResource->InstanceAddress = instances.Gpu;
+
+	// The frustum is built in view space; take it to world space once and test
+	// each instance's world-space box against it.  Transforming the frustum into
+	// every instance's local space instead would break under nonuniform scale.
+	XMMATRIX view = mCamera.GetView();
+	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
+
+	BoundingFrustum worldSpaceFrustum;
+	mCamFrustum.Transform(worldSpaceFrustum, invView);
+
+	for (auto& e : mAllRitems)
+	{
+		if (e->Instances.empty())
+			continue;
+
+		const BoundingBox& bounds = mScene.Bounds(e->Node);
+		const UINT offset = e->InstanceBufferOffset;
+		UINT visibleCount = 0;
+		for (const auto& instance : e->Instances)
+		{
+			XMMATRIX world = XMLoadFloat4x4(&instance.World);
+
+			BoundingBox worldBounds;
+			bounds.Transform(worldBounds, world);
+
+			if (mFrustumCullingEnabled && worldSpaceFrustum.Contains(worldBounds) == DirectX::DISJOINT)
+				continue;
+
+			XMMATRIX texTransform = XMLoadFloat4x4(&instance.TexTransform);
+
+			InstanceData data;
+			XMStoreFloat4x4(&data.World, XMMatrixTranspose(world));
+			XMStoreFloat4x4(&data.TexTransform, XMMatrixTranspose(texTransform));
+
+			currInstances[offset + visibleCount++] = data;
+		}
 
+		e->InstanceCount = visibleCount;
+	}
+}
 
 void CastleDesign::UpdateMaterialCBs(const GameTimer& gt)
 {
-	auto currMaterialCB = mCurrFrameResource->MaterialCB.get();
-	for(auto& e : mMaterials)
+	mMaterialData.Resize(mMaterials.IndexLimit());
+	mMaterials.ForEach([this](MaterialHandle, std::unique_ptr<Material>& e)
 	{
-		// Only update the cbuffer data if the constants have changed.  If the cbuffer
-		// data changes, it needs to be updated for each FrameResource.
-		Material* mat = e.second.get();
+		// Only pack the material data if it has changed; mMaterialData remembers
+		// which frame resources still need the new values.
+		Material* mat = e.get();
 		if(mat->NumFramesDirty > 0)
 		{
 			XMMATRIX matTransform = XMLoadFloat4x4(&mat->MatTransform);
 
-			MaterialConstants matConstants;
-			matConstants.DiffuseAlbedo = mat->DiffuseAlbedo;
-			matConstants.FresnelR0 = mat->FresnelR0;
-			matConstants.Roughness = mat->Roughness;
-			XMStoreFloat4x4(&matConstants.MatTransform, XMMatrixTranspose(matTransform));
+			MaterialData matData;
+			matData.DiffuseAlbedo = mat->DiffuseAlbedo;
+			matData.FresnelR0 = mat->FresnelR0;
+			matData.Roughness = mat->Roughness;
+			XMStoreFloat4x4(&matData.MatTransform, XMMatrixTranspose(matTransform));
 
-			currMaterialCB->CopyData(mat->MatCBIndex, matConstants);
+			mMaterialData.Set(mat->MatCBIndex, matData);
 
-			// Next FrameResource need to be updated too.
-			mat->NumFramesDirty--;
+			mat->NumFramesDirty = 0;
 		}
-	}
+	});
+
+	auto currMaterialBuffer = mCurrFrameResource->MaterialBuffer.get();
+	mMaterialData.Upload(mCurrFrameResourceIndex, [&](std::uint32_t first, const MaterialData* data, std::uint32_t count)
+	{
+		for (std::uint32_t i = 0; i < count; ++i)
+			currMaterialBuffer->CopyData(first + i, data[i]);
+	});
 }
 
 void CastleDesign::UpdateMainPassCB(const GameTimer& gt)
@@ -632,8 +1040,9 @@ void CastleDesign::UpdateMainPassCB(const GameTimer& gt)
 		mMainPassCB.Lights[i].FalloffEnd = 6;
 	}
 
-	auto currPassCB = mCurrFrameResource->PassCB.get();
-	currPassCB->CopyData(0, mMainPassCB);
+	UploadRing::Allocation passCB = mUploadRing->Allocate(sizeof(PassConstants), D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+	CopyMemory(passCB.Cpu, &mMainPassCB, sizeof(PassConstants));
+	mCurrFrameResource->PassCBAddress = passCB.Gpu;
 }
 
 void CastleDesign::UpdateWaves(const GameTimer& gt)
@@ -654,7 +1063,9 @@ void CastleDesign::UpdateWaves(const GameTimer& gt)
 	mWaves->Update(gt.DeltaTime());
 
 	// Update the wave vertex buffer with the new solution.
-	auto currWavesVB = mCurrFrameResource->WavesVB.get();
+	const UINT wavesVBByteSize = (UINT)mWaves->VertexCount() * sizeof(Vertex);
+	UploadRing::Allocation wavesVB = mUploadRing->Allocate(wavesVBByteSize, 16);
+	Vertex* currWavesVB = static_cast<Vertex*>(wavesVB.Cpu);
 	for(int i = 0; i < mWaves->VertexCount(); ++i)
 	{
 		Vertex v;
@@ -665,113 +1076,52 @@ void CastleDesign::UpdateWaves(const GameTimer& gt)
 		v.TexC.x = 1.0f + v.Pos.x / mWaves->Width();
 		v.TexC.y = 1.0f - v.Pos.z / mWaves->Depth();
 
-		currWavesVB->CopyData(i, v);
+		currWavesVB[i] = v;
 	}
 
-	// Set the dynamic VB of the wave renderitem to the current frame VB.
-	mWavesRitem->Geo->VertexBufferGPU = currWavesVB->Resource();
+	// Record binds this instead of the wave geometry's own (empty) buffer.
+	D3D12_VERTEX_BUFFER_VIEW& vbv = mCurrFrameResource->WavesVBView;
+	vbv.BufferLocation = wavesVB.Gpu;
+	vbv.StrideInBytes = sizeof(Vertex);
+	vbv.SizeInBytes = wavesVBByteSize;
+}
+
+void CastleDesign::UpdateStatsText(const GameTimer& gt)
+{
+	if (gt.TotalTime() - mStatsTextTime < gStatsTextInterval)
+		return;
+	mStatsTextTime = gt.TotalTime();
+
+	const DrawQueue::Stats& draws = mDrawStats;
+	std::wostringstream outs;
+	outs.precision(6);
+	outs << L"Instancing and Culling Demo" <<
+		L"    " << mCamera.GetPosition3f().z <<
+		L"    draws " << draws.Draws << L", binds " << draws.Issued() << L" (" << draws.Avoided() << L" skipped)";
+	if (mIndirectDraws)
+		outs << L" in " << mIndirectBuilder.Batches().size() << L" ExecuteIndirect calls";
+	outs <<
+		L"    upload " << mUploadRing->GetStats().FrameBytes / 1024 << L" KB";
+	mMainWndCaption = outs.str();
 }
 
 
 void CastleDesign::LoadTextures()
 {
-	auto waterTex = std::make_unique<Texture>();
-	waterTex->Name = "waterTex";
-	waterTex->Filename = L"Graphics Textures/water1.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), waterTex->Filename.c_str(),
-		waterTex->Resource, waterTex->UploadHeap));
-
-	auto fenceTex = std::make_unique<Texture>();
-	fenceTex->Name = "fenceTex";
-	fenceTex->Filename = L"Graphics Textures/WireFence.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), fenceTex->Filename.c_str(),
-		fenceTex->Resource, fenceTex->UploadHeap));
-	
-	auto bricksTex = std::make_unique<Texture>();
-	bricksTex->Name = "bricksTex";
-	bricksTex->Filename = L"Graphics Textures/red_brick.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), bricksTex->Filename.c_str(),
-		bricksTex->Resource, bricksTex->UploadHeap));
-
-	auto stoneTex = std::make_unique<Texture>();
-	stoneTex->Name = "stoneTex";
-	stoneTex->Filename = L"Graphics Textures/base.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), stoneTex->Filename.c_str(),
-		stoneTex->Resource, stoneTex->UploadHeap));
-
-	auto LavaTex = std::make_unique<Texture>();
-	LavaTex->Name = "LavaTex";
-	LavaTex->Filename = L"Graphics Textures/Lave_Cracks.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), LavaTex->Filename.c_str(),
-		LavaTex->Resource, LavaTex->UploadHeap));
-
-	auto roofTex = std::make_unique<Texture>();
-	roofTex->Name = "roofTex";
-	roofTex->Filename = L"Graphics Textures/cone_roof.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), roofTex->Filename.c_str(),
-		roofTex->Resource, roofTex->UploadHeap));
-
-	auto prismTex = std::make_unique<Texture>();
-	prismTex->Name = "prismTex";
-	prismTex->Filename = L"Graphics Textures/corner.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), prismTex->Filename.c_str(),
-		prismTex->Resource, prismTex->UploadHeap));
-
-	auto doorTex = std::make_unique<Texture>();
-	doorTex->Name = "doorTex";
-	doorTex->Filename = L"Graphics Textures/door.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), doorTex->Filename.c_str(),
-		doorTex->Resource, doorTex->UploadHeap));
-
-	auto glassTex = std::make_unique<Texture>();
-	glassTex->Name = "glassTex";
-	glassTex->Filename = L"Graphics Textures/glass.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), glassTex->Filename.c_str(),
-		glassTex->Resource, glassTex->UploadHeap));
-
-	auto ropeTex = std::make_unique<Texture>();
-	ropeTex->Name = "ropeTex";
-	ropeTex->Filename = L"Graphics Textures/rope.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), ropeTex->Filename.c_str(),
-		ropeTex->Resource, ropeTex->UploadHeap));
-
-	auto TorusTex = std::make_unique<Texture>();
-	TorusTex->Name = "TorusTex";
-	TorusTex->Filename = L"Graphics Textures/Torus.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), TorusTex->Filename.c_str(),
-		TorusTex->Resource, TorusTex->UploadHeap));
-
-	auto treeArrayTex = std::make_unique<Texture>();
-	treeArrayTex->Name = "treeArrayTex";
-	treeArrayTex->Filename = L"Graphics Textures/treearray.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), treeArrayTex->Filename.c_str(),
-		treeArrayTex->Resource, treeArrayTex->UploadHeap));
-	// storing the texture in mTexture map;
-	mTextures[waterTex->Name] = std::move(waterTex);
-	mTextures[fenceTex->Name] = std::move(fenceTex);	
-	mTextures[bricksTex->Name] = std::move(bricksTex);
-	mTextures[stoneTex->Name] = std::move(stoneTex);
-	mTextures[LavaTex->Name] = std::move(LavaTex);
-	mTextures[roofTex->Name] = std::move(roofTex);
-	mTextures[prismTex->Name] = std::move(prismTex);
-	mTextures[doorTex->Name] = std::move(doorTex);
-	mTextures[glassTex->Name] = std::move(glassTex);
-	mTextures[ropeTex->Name] = std::move(ropeTex);
-	mTextures[TorusTex->Name] = std::move(TorusTex);
-	mTextures[treeArrayTex->Name] = std::move(treeArrayTex);	
+	// One texture per material, stored in the same order.
+	for (const auto& desc : CastleLayout::Materials)
+	{
+		const std::string filename = std::string("Graphics Textures/") + desc.TextureFile;
+
+		auto tex = std::make_unique<Texture>();
+		tex->Name = desc.TextureName;
+		tex->Filename = std::wstring(filename.begin(), filename.end());
+		ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
+			mCommandList.Get(), tex->Filename.c_str(),
+			tex->Resource, tex->UploadHeap));
 
+		mTextures.Add(tex->Name, std::move(tex));
+	}
 }
 
 void CastleDesign::BuildRootSignature()
@@ -780,18 +1130,23 @@ void CastleDesign::BuildRootSignature()
 	texTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0);
 
     // Root parameter can be a table, root descriptor or root constants.
-    CD3DX12_ROOT_PARAMETER slotRootParameter[4];
+    CD3DX12_ROOT_PARAMETER slotRootParameter[6];
 
 	// Perfomance TIP: Order from most frequent to least frequent.
 	slotRootParameter[0].InitAsDescriptorTable(1, &texTable, D3D12_SHADER_VISIBILITY_PIXEL);
-    slotRootParameter[1].InitAsConstantBufferView(0);
+	// The draw's object index (b0), the only thing set per draw.
+	slotRootParameter[1].InitAsConstants(1, 0);
     slotRootParameter[2].InitAsConstantBufferView(1);
-    slotRootParameter[3].InitAsConstantBufferView(2);
+	// Material, instance and object data (t1, t0 and t2, space1), bound once
+	// per list and indexed through the object.
+	slotRootParameter[3].InitAsShaderResourceView(1, 1);
+	slotRootParameter[4].InitAsShaderResourceView(0, 1);
+	slotRootParameter[5].InitAsShaderResourceView(2, 1);
 
 	auto staticSamplers = GetStaticSamplers();
 
     // A root signature is an array of root parameters.
-	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(4, slotRootParameter,
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(6, slotRootParameter,
 		(UINT)staticSamplers.size(), staticSamplers.data(),
 		D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
@@ -814,6 +1169,27 @@ void CastleDesign::BuildRootSignature()
         IID_PPV_ARGS(mRootSignature.GetAddressOf())));
 }
 
+void CastleDesign::BuildCommandSignature()
+{
+	// Matches IndirectDrawCommand: the object index goes to root parameter 1,
+	// as SetGraphicsRoot32BitConstant does for direct draws, then the draw.
+	D3D12_INDIRECT_ARGUMENT_DESC args[2] = {};
+	args[0].Type = D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT;
+	args[0].Constant.RootParameterIndex = 1;
+	args[0].Constant.DestOffsetIn32BitValues = 0;
+	args[0].Constant.Num32BitValuesToSet = IndirectDrawCommand::RootConstantCount;
+	args[1].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
+
+	D3D12_COMMAND_SIGNATURE_DESC desc = {};
+	desc.ByteStride = sizeof(IndirectDrawCommand);
+	desc.NumArgumentDescs = _countof(args);
+	desc.pArgumentDescs = args;
+
+	// A signature that sets root arguments is tied to the root signature.
+	ThrowIfFailed(md3dDevice->CreateCommandSignature(&desc, mRootSignature.Get(),
+		IID_PPV_ARGS(mDrawCommandSignature.GetAddressOf())));
+}
+
 void CastleDesign::BuildDescriptorHeaps()
 {
 	//
@@ -831,18 +1207,18 @@ void CastleDesign::BuildDescriptorHeaps()
 	
 	CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
 	// build meterial's decriptor heap by meterial's order. 
-	auto waterTex = mTextures["waterTex"]->Resource;
-	auto fenceTex = mTextures["fenceTex"]->Resource;
-	auto bricksTex = mTextures["bricksTex"]->Resource;
-	auto stoneTex = mTextures["stoneTex"]->Resource;
-	auto grassTex = mTextures["LavaTex"]->Resource;	
-	auto roofTex = mTextures["roofTex"]->Resource;
-	auto prismTex = mTextures["prismTex"]->Resource;
-	auto doorTex = mTextures["doorTex"]->Resource;
-	auto glassTex = mTextures["glassTex"]->Resource;
-	auto ropeTex = mTextures["ropeTex"]->Resource;
-	auto TorusTex = mTextures["TorusTex"]->Resource;
-	auto treeArrayTex = mTextures["treeArrayTex"]->Resource;
+	auto waterTex = mTextures[mTextures.Find("waterTex")]->Resource;
+	auto fenceTex = mTextures[mTextures.Find("fenceTex")]->Resource;
+	auto bricksTex = mTextures[mTextures.Find("bricksTex")]->Resource;
+	auto stoneTex = mTextures[mTextures.Find("stoneTex")]->Resource;
+	auto grassTex = mTextures[mTextures.Find("LavaTex")]->Resource;	
+	auto roofTex = mTextures[mTextures.Find("roofTex")]->Resource;
+	auto prismTex = mTextures[mTextures.Find("prismTex")]->Resource;
+	auto doorTex = mTextures[mTextures.Find("doorTex")]->Resource;
+	auto glassTex = mTextures[mTextures.Find("glassTex")]->Resource;
+	auto ropeTex = mTextures[mTextures.Find("ropeTex")]->Resource;
+	auto TorusTex = mTextures[mTextures.Find("TorusTex")]->Resource;
+	auto treeArrayTex = mTextures[mTextures.Find("treeArrayTex")]->Resource;
 
 	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
 	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
@@ -953,8 +1329,15 @@ void CastleDesign::BuildShadersAndInputLayouts()
 		"ALPHA_TEST",
 		NULL, NULL
 	};
+
+	const D3D_SHADER_MACRO instancedDefines[] =
+	{
+		"INSTANCED", "1",
+		NULL, NULL
+	};
 	// Default shader.
 	mShaders["standardVS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", nullptr, "VS", "vs_5_1");
+	mShaders["instancedVS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", instancedDefines, "VS", "vs_5_1");
 	mShaders["opaquePS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", defines, "PS", "ps_5_1");
 	mShaders["alphaTestedPS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", alphaTestDefines, "PS", "ps_5_1");
 	// Tree Shader.
@@ -978,49 +1361,15 @@ void CastleDesign::BuildShadersAndInputLayouts()
 
 void CastleDesign::BuildLandGeometry()
 {
-    GeometryGenerator geoGen;
-    GeometryGenerator::MeshData grid = geoGen.CreateGrid(160.0f, 160.0f, 50, 50);
+	GeometryGenerator::MeshData grid = CastleLayout::BuildLand();
 
-    //
-    // Extract the vertex elements we are interested and apply the height function to
-    // each vertex.  In addition, color the vertices based on their height so we have
-    // sandy looking beaches, grassy low hills, and snow mountain peaks.
-    //
-
-    std::vector<Vertex> vertices(grid.Vertices.size());
+	std::vector<Vertex> vertices(grid.Vertices.size());
 	for (size_t i = 0; i < grid.Vertices.size(); ++i)
 	{
-		auto& p = grid.Vertices[i].Position;
-		vertices[i].Pos = p;		
+		vertices[i].Pos = grid.Vertices[i].Position;
 		vertices[i].Normal = grid.Vertices[i].Normal;
 		vertices[i].TexC = grid.Vertices[i].TexC;
 	}
-	// Making level.
-	// half of the grid's y postion set it to down position.
-	 
-    for(size_t i = 0; i < (grid.Vertices.size() / 5); ++i)
-    {
-        auto& p = grid.Vertices[i].Position;
-        vertices[i].Pos = p;
-		vertices[i].Pos.y;        
-		vertices[i].TexC = grid.Vertices[i].TexC;
-		
-		auto& a = grid.Vertices[i + (grid.Vertices.size() / 2)].Position;
-		vertices[i + (grid.Vertices.size() / 2)].Pos = a;
-		vertices[i + (grid.Vertices.size() / 2)].Pos.y -= 10.0f;
-		vertices[i + (grid.Vertices.size() / 2)].TexC = grid.Vertices[i + (grid.Vertices.size() / 2)].TexC;
-
-		/*auto& b = grid.Vertices[i + (grid.Vertices.size() / 2)].Position;
-		vertices[i + (grid.Vertices.size() / 2)].Pos = b;
-		vertices[i + (grid.Vertices.size() / 2)].Pos.y;
-		vertices[i + (grid.Vertices.size() / 2)].TexC = grid.Vertices[i + (grid.Vertices.size() / 2)].TexC;
-		auto& c = grid.Vertices[i + (grid.Vertices.size() / 2)].Position;
-		vertices[i + (grid.Vertices.size() / 2)].Pos = c;
-		vertices[i + (grid.Vertices.size() / 2)].Pos.y;
-		vertices[i + (grid.Vertices.size() / 2)].TexC = grid.Vertices[i + (grid.Vertices.size() / 2)].TexC;*/
-    }
-	
-
 
     const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
 
@@ -1051,10 +1400,11 @@ void CastleDesign::BuildLandGeometry()
 	submesh.IndexCount = (UINT)indices.size();
 	submesh.StartIndexLocation = 0;
 	submesh.BaseVertexLocation = 0;
+	BoundingBox::CreateFromPoints(submesh.Bounds, vertices.size(), &vertices[0].Pos, sizeof(Vertex));
 
 	geo->DrawArgs["grid"] = submesh;
 
-	mGeometries["landGeo"] = std::move(geo);
+	AddGeometry("landGeo", std::move(geo));
 }
 
 void CastleDesign::BuildWavesGeometry()
@@ -1089,7 +1439,7 @@ void CastleDesign::BuildWavesGeometry()
 	auto geo = std::make_unique<MeshGeometry>();
 	geo->Name = "waterGeo";
 
-	// Set dynamically.
+	// Set dynamically; UpdateWaves writes the vertices into the upload ring.
 	geo->VertexBufferCPU = nullptr;
 	geo->VertexBufferGPU = nullptr;
 
@@ -1109,1799 +1459,1154 @@ void CastleDesign::BuildWavesGeometry()
 	submesh.StartIndexLocation = 0;
 	submesh.BaseVertexLocation = 0;
 
+	// The vertices move every frame; allow the surface a few units either way.
+	submesh.Bounds.Center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	submesh.Bounds.Extents = XMFLOAT3(0.5f * mWaves->Width(), 5.0f, 0.5f * mWaves->Depth());
+
 	geo->DrawArgs["grid"] = submesh;
 
-	mGeometries["waterGeo"] = std::move(geo);
+	mWavesGeo = AddGeometry("waterGeo", std::move(geo));
 }
 
 void CastleDesign::BuildShapeGeometry()
 {
-	GeometryGenerator geoGen;
-
-	GeometryGenerator::MeshData box = geoGen.CreateBox(1.0f, 1.0f, 1.0f, 0);
+	// Every castle shape is concatenated into one big vertex/index buffer; the
+	// ranges say which region of the buffers each submesh covers.
+	std::vector<CastleLayout::ShapeRange> ranges;
+	GeometryGenerator::MeshData shapes = CastleLayout::BuildShapes(ranges);
 
-	GeometryGenerator::MeshData grid = geoGen.CreateGrid(1.0f, 1.0f, 41, 41);
+	std::vector<Vertex> vertices(shapes.Vertices.size());
+	for (size_t i = 0; i < shapes.Vertices.size(); ++i)
+	{
+		vertices[i].Pos = shapes.Vertices[i].Position;
+		vertices[i].Normal = shapes.Vertices[i].Normal;
+		vertices[i].TexC = shapes.Vertices[i].TexC;
+	}
 
-	GeometryGenerator::MeshData sphere = geoGen.CreateSphere(0.2f, 20, 20);
+	std::vector<std::uint16_t> indices = shapes.GetIndices16();
 
-	GeometryGenerator::MeshData cylinder = geoGen.CreateCylinder(1.0f, 1.0f, 1.0f, 20, 20);
+	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
+	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
 
+	auto geo = std::make_unique<MeshGeometry>();
+	geo->Name = "shapeGeo";
 
+	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
+	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
 
-	GeometryGenerator::MeshData pyramid = geoGen.CreatePyramid(1.0f, 1.0f, 0.35f);
-	//
-	GeometryGenerator::MeshData cone = geoGen.CreateCone(1.0f, 1.0f, 20, 1);
-	//
-	GeometryGenerator::MeshData prism = geoGen.CreatePrism(1.0f, 1.0f, 1.0f, 1.0f);
-	//
-	GeometryGenerator::MeshData diamond = geoGen.CreateDiamond(1.0f, 1.0f, 1.0f, 0);
-	//
-	GeometryGenerator::MeshData wedge = geoGen.CreateWedge(1.0f, 1.0f, 1.0f, 0);
+	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
+	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
-	GeometryGenerator::MeshData torus = geoGen.CreateTorus(1.0f, 0.5f, 50, 50);
-		
-	//
+	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
 
-	// We are concatenating all the geometry into one big vertex/index buffer.  So
+	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
 
-	// define the regions in the buffer each submesh covers.
+	geo->VertexByteStride = sizeof(Vertex);
+	geo->VertexBufferByteSize = vbByteSize;
+	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
+	geo->IndexBufferByteSize = ibByteSize;
 
-	//
+	for (const auto& range : ranges)
+	{
+		SubmeshGeometry submesh;
+		submesh.IndexCount = range.IndexCount;
+		submesh.StartIndexLocation = range.StartIndexLocation;
+		submesh.BaseVertexLocation = range.BaseVertexLocation;
+		submesh.Bounds = range.Bounds;
+		geo->DrawArgs[range.Name] = submesh;
+	}
 
+	AddGeometry(geo->Name, std::move(geo));
+}
 
+void CastleDesign::BuildTreeSpritesGeometry()
+{
+	// make a vertex struct for Tree array.
+	struct TreeSpriteVertex
+	{
+		XMFLOAT3 Pos;
+		XMFLOAT2 Size;
+	};
+	//Tree count
+	static const int treeCount = CastleLayout::TreeCount;
+	std::array<TreeSpriteVertex, treeCount> vertices;
+	for (int i = 0; i < treeCount; ++i)
+	{
+		float u = MathHelper::RandF();
+		float v = MathHelper::RandF();
+		vertices[i].Pos = CastleLayout::TreePosition(i, u, v);
+		vertices[i].Size = XMFLOAT2(CastleLayout::TreeSize, CastleLayout::TreeSize);
+	}
+	std::array<std::uint16_t, treeCount> indices =
+	{
+		0, 1, 2, 3, 4, 5, 6, 7,
+		8, 9, 10, 11, 12, 13, 14, 15
+	};
 
-	// Cache the vertex offsets to each object in the concatenated vertex buffer.
+	const UINT vbByteSize = (UINT)vertices.size() * sizeof(TreeSpriteVertex);
+	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
 
-	UINT boxVertexOffset = 0;
+	auto geo = std::make_unique<MeshGeometry>();
+	geo->Name = "treeSpritesGeo";
 
-	UINT gridVertexOffset = (UINT)box.Vertices.size();
+	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
+	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
 
-	UINT sphereVertexOffset = gridVertexOffset + (UINT)grid.Vertices.size();
+	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
+	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
-	UINT cylinderVertexOffset = sphereVertexOffset + (UINT)sphere.Vertices.size();
+	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
 
-	UINT pyramidVertexOffset = cylinderVertexOffset + (UINT)cylinder.Vertices.size();
+	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
 
-	UINT coneVertexOffset = pyramidVertexOffset + (UINT)pyramid.Vertices.size();
+	geo->VertexByteStride = sizeof(TreeSpriteVertex);
+	geo->VertexBufferByteSize = vbByteSize;
+	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
+	geo->IndexBufferByteSize = ibByteSize;
 
-	UINT prismVertexOffset = coneVertexOffset + (UINT)cone.Vertices.size();
+	SubmeshGeometry submesh;
+	submesh.IndexCount = (UINT)indices.size();
+	submesh.StartIndexLocation = 0;
+	submesh.BaseVertexLocation = 0;
 
-	UINT diamondVertexOffset = prismVertexOffset + (UINT)prism.Vertices.size();
+	// Points grow into billboards in the geometry shader, so pad by the largest.
+	float maxSize = 0.0f;
+	for (auto& v : vertices)
+		maxSize = std::max(maxSize, std::max(v.Size.x, v.Size.y));
+	BoundingBox::CreateFromPoints(submesh.Bounds, vertices.size(), &vertices[0].Pos, sizeof(TreeSpriteVertex));
+	submesh.Bounds.Extents.x += 0.5f * maxSize;
+	submesh.Bounds.Extents.y += 0.5f * maxSize;
+	submesh.Bounds.Extents.z += 0.5f * maxSize;
 
-	UINT wedgeVertexOffset = diamondVertexOffset + (UINT)diamond.Vertices.size();
+	geo->DrawArgs["points"] = submesh;
 
-	UINT torusVertexOffset = wedgeVertexOffset + (UINT)wedge.Vertices.size();
+	AddGeometry("treeSpritesGeo", std::move(geo));
+}
 
-	// Cache the starting index for each object in the concatenated index buffer.
+void CastleDesign::BuildPSOs()
+{
+	ComPtr<ID3D12PipelineState> pso;
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC opaquePsoDesc;
 
-	UINT boxIndexOffset = 0;
+	//
+	// PSO for opaque objects.
+	//
+    ZeroMemory(&opaquePsoDesc, sizeof(D3D12_GRAPHICS_PIPELINE_STATE_DESC));
+	opaquePsoDesc.InputLayout = { mStdInputLayout.data(), (UINT)mStdInputLayout.size() };
+	opaquePsoDesc.pRootSignature = mRootSignature.Get();
+	opaquePsoDesc.VS = 
+	{ 
+		reinterpret_cast<BYTE*>(mShaders["standardVS"]->GetBufferPointer()), 
+		mShaders["standardVS"]->GetBufferSize()
+	};
+	opaquePsoDesc.PS = 
+	{ 
+		reinterpret_cast<BYTE*>(mShaders["opaquePS"]->GetBufferPointer()),
+		mShaders["opaquePS"]->GetBufferSize()
+	};
+	opaquePsoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
+	opaquePsoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
+	opaquePsoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
+	opaquePsoDesc.SampleMask = UINT_MAX;
+	opaquePsoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+	opaquePsoDesc.NumRenderTargets = 1;
+	opaquePsoDesc.RTVFormats[0] = mBackBufferFormat;
 
-	UINT gridIndexOffset = (UINT)box.Indices32.size();
+	//there is abug with F2 key that is supposed to turn on the multisampling!
+//Set4xMsaaState(true);
+	//m4xMsaaState = true;
 
-	UINT sphereIndexOffset = gridIndexOffset + (UINT)grid.Indices32.size();
+	opaquePsoDesc.SampleDesc.Count = m4xMsaaState ? 4 : 1;
+	opaquePsoDesc.SampleDesc.Quality = m4xMsaaState ? (m4xMsaaQuality - 1) : 0;
+	opaquePsoDesc.DSVFormat = mDepthStencilFormat;
+    ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&opaquePsoDesc, IID_PPV_ARGS(&pso)));
+    mPSOs.Add("opaque", pso);
 
-	UINT cylinderIndexOffset = sphereIndexOffset + (UINT)sphere.Indices32.size();
+	//
+	// PSO for transparent objects
+	//
 
-	UINT pyramidIndexOffset = cylinderIndexOffset + (UINT)cylinder.Indices32.size();
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC transparentPsoDesc = opaquePsoDesc;
 
-	UINT coneIndexOffset = pyramidIndexOffset + (UINT)pyramid.Indices32.size();
-
-	UINT prismIndexOffset = coneIndexOffset + (UINT)cone.Indices32.size();
-
-	UINT diamondIndexOffset = prismIndexOffset + (UINT)prism.Indices32.size();
-
-	UINT wedgeIndexOffset = diamondIndexOffset + (UINT)diamond.Indices32.size();
-
-	UINT torusIndexOffset = wedgeIndexOffset + (UINT)wedge.Indices32.size();
-
-	// Define the SubmeshGeometry that cover different
-
-	// regions of the vertex/index buffers.
-
-
-
-	SubmeshGeometry boxSubmesh;
-	
-	boxSubmesh.IndexCount = (UINT)box.Indices32.size();
-
-	boxSubmesh.StartIndexLocation = boxIndexOffset;
-
-	boxSubmesh.BaseVertexLocation = boxVertexOffset;
-
-
-
-	SubmeshGeometry gridSubmesh;
-
-	gridSubmesh.IndexCount = (UINT)grid.Indices32.size();
-
-	gridSubmesh.StartIndexLocation = gridIndexOffset;
-
-	gridSubmesh.BaseVertexLocation = gridVertexOffset;
-	
-
-
-	SubmeshGeometry sphereSubmesh;
-
-	sphereSubmesh.IndexCount = (UINT)sphere.Indices32.size();
-
-	sphereSubmesh.StartIndexLocation = sphereIndexOffset;
-
-	sphereSubmesh.BaseVertexLocation = sphereVertexOffset;
-
-
-
-	SubmeshGeometry cylinderSubmesh;
-
-	cylinderSubmesh.IndexCount = (UINT)cylinder.Indices32.size();
-
-	cylinderSubmesh.StartIndexLocation = cylinderIndexOffset;
-
-	cylinderSubmesh.BaseVertexLocation = cylinderVertexOffset;
-
-
-
-	SubmeshGeometry pyramidSubmesh;
-
-	pyramidSubmesh.IndexCount = (UINT)pyramid.Indices32.size();
-
-	pyramidSubmesh.StartIndexLocation = pyramidIndexOffset;
-
-	pyramidSubmesh.BaseVertexLocation = pyramidVertexOffset;
-
-
-
-	SubmeshGeometry coneSubmesh;
-
-	coneSubmesh.IndexCount = (UINT)cone.Indices32.size();
-
-	coneSubmesh.StartIndexLocation = coneIndexOffset;
-
-	coneSubmesh.BaseVertexLocation = coneVertexOffset;
-
-
-
-	SubmeshGeometry diamondSubmesh;
-
-	diamondSubmesh.IndexCount = (UINT)diamond.Indices32.size();
-
-	diamondSubmesh.StartIndexLocation = diamondIndexOffset;
-
-	diamondSubmesh.BaseVertexLocation = diamondVertexOffset;
-
-
-
-	SubmeshGeometry wedgeSubmesh;
-
-	wedgeSubmesh.IndexCount = (UINT)wedge.Indices32.size();
-
-	wedgeSubmesh.StartIndexLocation = wedgeIndexOffset;
-
-	wedgeSubmesh.BaseVertexLocation = wedgeVertexOffset;
-
-
-
-	SubmeshGeometry prismSubmesh;
-
-	prismSubmesh.IndexCount = (UINT)prism.Indices32.size();
-
-	prismSubmesh.StartIndexLocation = prismIndexOffset;
-
-	prismSubmesh.BaseVertexLocation = prismVertexOffset;
-
-
-	SubmeshGeometry torusSubmesh;
-
-	torusSubmesh.IndexCount = (UINT)torus.Indices32.size();
-
-	torusSubmesh.StartIndexLocation = torusIndexOffset;
-
-	torusSubmesh.BaseVertexLocation = torusVertexOffset;
-
-	//
-
-	// Extract the vertex elements we are interested in and pack the
-
-	// vertices of all the meshes into one vertex buffer.
-
-	//
-
-
-
-	auto totalVertexCount =
-
-		box.Vertices.size() +
-
-		grid.Vertices.size() +
-
-		sphere.Vertices.size() +
-
-		cylinder.Vertices.size() +
-
-		pyramid.Vertices.size() +
-
-		cone.Vertices.size() +
-
-		prism.Vertices.size() +
-
-		diamond.Vertices.size() +
-
-		wedge.Vertices.size() +
-
-		torus.Vertices.size();
-
-
-
-	std::vector<Vertex> vertices(totalVertexCount);
-
-	XMFLOAT3 vMinf3(+MathHelper::Infinity, +MathHelper::Infinity, +MathHelper::Infinity);
-	XMFLOAT3 vMaxf3(-MathHelper::Infinity, -MathHelper::Infinity, -MathHelper::Infinity);
-
-	XMVECTOR vMin = XMLoadFloat3(&vMinf3);
-	XMVECTOR vMax = XMLoadFloat3(&vMaxf3);
-
-	UINT k = 0;
-
-	for (size_t i = 0; i < box.Vertices.size(); ++i, ++k)
-
-	{
-		vertices[k].Pos = box.Vertices[i].Position;
-		vertices[k].Normal = box.Vertices[i].Normal;
-		vertices[k].TexC = box.Vertices[i].TexC;
-
-		XMVECTOR P = XMLoadFloat3(&vertices[k].Pos);
-		
-		vMin = XMVectorMin(vMin, P);
-		vMax = XMVectorMax(vMax, P);
-	}
-	BoundingBox boxbounds;	
-	XMStoreFloat3(&boxbounds.Center, 0.5f * (vMin + vMax));
-	XMStoreFloat3(&boxbounds.Extents, 0.5f * (vMax - vMin));
-	boxSubmesh.Bounds = boxbounds;
-
-	for (size_t i = 0; i < grid.Vertices.size(); ++i, ++k)
-
-	{
-		vertices[k].Pos = grid.Vertices[i].Position;
-		vertices[k].Normal = grid.Vertices[i].Normal;
-		vertices[k].TexC = grid.Vertices[i].TexC;
-		XMVECTOR P = XMLoadFloat3(&vertices[k].Pos);
-
-		vMin = XMVectorMin(vMin, P);
-		vMax = XMVectorMax(vMax, P);
-	}
-	BoundingBox gridbounds;
-	XMStoreFloat3(&gridbounds.Center, 0.5f * (vMin + vMax));
-	XMStoreFloat3(&gridbounds.Extents, 0.5f * (vMax - vMin));
-	gridSubmesh.Bounds = gridbounds;
-
-
-	for (size_t i = 0; i < sphere.Vertices.size(); ++i, ++k)
-
-	{
-		vertices[k].Pos = sphere.Vertices[i].Position;
-		vertices[k].Normal = sphere.Vertices[i].Normal;
-		vertices[k].TexC = sphere.Vertices[i].TexC;
-		XMVECTOR P = XMLoadFloat3(&vertices[k].Pos);
-
-		vMin = XMVectorMin(vMin, P);
-		vMax = XMVectorMax(vMax, P);
-	}
-	BoundingBox spherebounds;
-	XMStoreFloat3(&spherebounds.Center, 0.5f * (vMin + vMax));
-	XMStoreFloat3(&spherebounds.Extents, 0.5f * (vMax - vMin));
-	sphereSubmesh.Bounds = spherebounds;
-
-
-	for (size_t i = 0; i < cylinder.Vertices.size(); ++i, ++k)
-
-	{
-		vertices[k].Pos = cylinder.Vertices[i].Position;
-		vertices[k].Normal = cylinder.Vertices[i].Normal;
-		vertices[k].TexC = cylinder.Vertices[i].TexC;
-		XMVECTOR P = XMLoadFloat3(&vertices[k].Pos);
-
-		vMin = XMVectorMin(vMin, P);
-		vMax = XMVectorMax(vMax, P);
-	}
-
-	BoundingBox cylinderbounds;
-	XMStoreFloat3(&cylinderbounds.Center, 0.5f * (vMin + vMax));
-	XMStoreFloat3(&cylinderbounds.Extents, 0.5f * (vMax - vMin));
-	cylinderSubmesh.Bounds = cylinderbounds;
-
-	for (size_t i = 0; i < pyramid.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = pyramid.Vertices[i].Position;
-		vertices[k].Normal = pyramid.Vertices[i].Normal;
-		vertices[k].TexC = pyramid.Vertices[i].TexC;
-		XMVECTOR P = XMLoadFloat3(&vertices[k].Pos);
-
-		vMin = XMVectorMin(vMin, P);
-		vMax = XMVectorMax(vMax, P);
-	}
-
-	BoundingBox pyramidbounds;
-	XMStoreFloat3(&pyramidbounds.Center, 0.5f * (vMin + vMax));
-	XMStoreFloat3(&pyramidbounds.Extents, 0.5f * (vMax - vMin));
-	pyramidSubmesh.Bounds = pyramidbounds;
-
-	for (size_t i = 0; i < cone.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = cone.Vertices[i].Position;
-		vertices[k].Normal = cone.Vertices[i].Normal;
-		vertices[k].TexC = cone.Vertices[i].TexC;
-		XMVECTOR P = XMLoadFloat3(&vertices[k].Pos);
-
-		vMin = XMVectorMin(vMin, P);
-		vMax = XMVectorMax(vMax, P);
-	}
-
-	BoundingBox conebounds;
-	XMStoreFloat3(&conebounds.Center, 0.5f * (vMin + vMax));
-	XMStoreFloat3(&conebounds.Extents, 0.5f * (vMax - vMin));
-	coneSubmesh.Bounds = conebounds;
-
-	for (size_t i = 0; i < prism.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = prism.Vertices[i].Position;
-		vertices[k].Normal = prism.Vertices[i].Normal;
-		vertices[k].TexC = prism.Vertices[i].TexC;
-		XMVECTOR P = XMLoadFloat3(&vertices[k].Pos);
-
-		vMin = XMVectorMin(vMin, P);
-		vMax = XMVectorMax(vMax, P);
-	}
-
-	BoundingBox prismbounds;
-	XMStoreFloat3(&prismbounds.Center, 0.5f * (vMin + vMax));
-	XMStoreFloat3(&prismbounds.Extents, 0.5f * (vMax - vMin));
-	prismSubmesh.Bounds = prismbounds;
-
-	for (size_t i = 0; i < diamond.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = diamond.Vertices[i].Position;
-		vertices[k].Normal = diamond.Vertices[i].Normal;
-		vertices[k].TexC = diamond.Vertices[i].TexC;
-		XMVECTOR P = XMLoadFloat3(&vertices[k].Pos);
-
-		vMin = XMVectorMin(vMin, P);
-		vMax = XMVectorMax(vMax, P);
-	}
-	BoundingBox diamondbounds;
-	XMStoreFloat3(&diamondbounds.Center, 0.5f * (vMin + vMax));
-	XMStoreFloat3(&diamondbounds.Extents, 0.5f * (vMax - vMin));
-	diamondSubmesh.Bounds = diamondbounds;
-
-	for (size_t i = 0; i < wedge.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = wedge.Vertices[i].Position;
-		vertices[k].Normal = wedge.Vertices[i].Normal;
-		vertices[k].TexC = wedge.Vertices[i].TexC;
-		XMVECTOR P = XMLoadFloat3(&vertices[k].Pos);
-
-		vMin = XMVectorMin(vMin, P);
-		vMax = XMVectorMax(vMax, P);
-	}
-
-	BoundingBox wedgebounds;
-	XMStoreFloat3(&wedgebounds.Center, 0.5f * (vMin + vMax));
-	XMStoreFloat3(&wedgebounds.Extents, 0.5f * (vMax - vMin));
-	wedgeSubmesh.Bounds = wedgebounds;
-
-	for (size_t i = 0; i < torus.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = torus.Vertices[i].Position;
-		vertices[k].Normal = torus.Vertices[i].Normal;
-		vertices[k].TexC = torus.Vertices[i].TexC;
-		XMVECTOR P = XMLoadFloat3(&vertices[k].Pos);
-
-		vMin = XMVectorMin(vMin, P);
-		vMax = XMVectorMax(vMax, P);
-	}
-	BoundingBox torusbounds;
-	XMStoreFloat3(&torusbounds.Center, 0.5f * (vMin + vMax));
-	XMStoreFloat3(&torusbounds.Extents, 0.5f * (vMax - vMin));
-	torusSubmesh.Bounds = torusbounds;
-
-	std::vector<std::uint16_t> indices;
-
-	indices.insert(indices.end(), std::begin(box.GetIndices16()), std::end(box.GetIndices16()));
-
-	indices.insert(indices.end(), std::begin(grid.GetIndices16()), std::end(grid.GetIndices16()));
-
-	indices.insert(indices.end(), std::begin(sphere.GetIndices16()), std::end(sphere.GetIndices16()));
-
-	indices.insert(indices.end(), std::begin(cylinder.GetIndices16()), std::end(cylinder.GetIndices16()));
-
-	indices.insert(indices.end(), std::begin(pyramid.GetIndices16()), std::end(pyramid.GetIndices16()));
-
-	indices.insert(indices.end(), std::begin(cone.GetIndices16()), std::end(cone.GetIndices16()));
-
-	indices.insert(indices.end(), std::begin(prism.GetIndices16()), std::end(prism.GetIndices16()));
-
-	indices.insert(indices.end(), std::begin(diamond.GetIndices16()), std::end(diamond.GetIndices16()));
-
-	indices.insert(indices.end(), std::begin(wedge.GetIndices16()), std::end(wedge.GetIndices16()));
-
-	indices.insert(indices.end(), std::begin(torus.GetIndices16()), std::end(torus.GetIndices16()));
-
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
-
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
-
-
-
-	auto geo = std::make_unique<MeshGeometry>();
-
-	geo->Name = "shapeGeo";
-
-
-
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
-
-
-
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
-
-
-
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-
-
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
-
-
-
-	geo->VertexByteStride = sizeof(Vertex);
-
-	geo->VertexBufferByteSize = vbByteSize;
-
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-
-	geo->IndexBufferByteSize = ibByteSize;
-
-
-
-	geo->DrawArgs["box"] = boxSubmesh;
-
-	geo->DrawArgs["grid"] = gridSubmesh;
-
-	geo->DrawArgs["sphere"] = sphereSubmesh;
-
-	geo->DrawArgs["cylinder"] = cylinderSubmesh;
-
-	geo->DrawArgs["pyramid"] = pyramidSubmesh;
-
-	geo->DrawArgs["cone"] = coneSubmesh;
-
-	geo->DrawArgs["prism"] = prismSubmesh;
-
-	geo->DrawArgs["diamond"] = diamondSubmesh;
-
-	geo->DrawArgs["wedge"] = wedgeSubmesh;
-
-	geo->DrawArgs["torus"] = torusSubmesh;
-
-	mGeometries[geo->Name] = std::move(geo);
-
-
-	//GeometryGenerator geoGen;
-	//GeometryGenerator::MeshData box = geoGen.CreateBox(8.0f, 8.0f, 8.0f, 3);
-
-	//std::vector<Vertex> vertices(box.Vertices.size());
-	//for (size_t i = 0; i < box.Vertices.size(); ++i)
-	//{
-	//	auto& p = box.Vertices[i].Position;
-	//	vertices[i].Pos = p;
-	//	vertices[i].Normal = box.Vertices[i].Normal;
-	//	vertices[i].TexC = box.Vertices[i].TexC;
-	//}
-
-	//const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
-
-	//std::vector<std::uint16_t> indices = box.GetIndices16();
-	//const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
-
-	//auto geo = std::make_unique<MeshGeometry>();
-	//geo->Name = "boxGeo";
-
-	//ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	//CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
-
-	//ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	//CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
-
-	//geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-	//	mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-	//geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-	//	mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
-
-	//geo->VertexByteStride = sizeof(Vertex);
-	//geo->VertexBufferByteSize = vbByteSize;
-	//geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-	//geo->IndexBufferByteSize = ibByteSize;
-
-	//SubmeshGeometry submesh;
-	//submesh.IndexCount = (UINT)indices.size();
-	//submesh.StartIndexLocation = 0;
-	//submesh.BaseVertexLocation = 0;
-
-	//geo->DrawArgs["box"] = submesh;
-
-	//mGeometries["boxGeo"] = std::move(geo);
-}
-
-void CastleDesign::BuildTreeSpritesGeometry()
-{
-	// make a vertex struct for Tree array.
-	struct TreeSpriteVertex
-	{
-		XMFLOAT3 Pos;
-		XMFLOAT2 Size;
-	};
-	//Tree count
-	static const int treeCount = 16;
-	std::array<TreeSpriteVertex, 16> vertices;
-	// half of the trees place right position from the castle
-	for(UINT i = 0; i < treeCount/2; ++i)
-	{
-		float x = MathHelper::RandF(-15, 15);
-		float z = MathHelper::RandF(23.0f, 35.0f);
-		float y = 1.5f;
-
-		// Move tree slightly above land height.
-		y += 1.0f;
-
-		vertices[i].Pos = XMFLOAT3(x, y, z);
-		vertices[i].Size = XMFLOAT2(5.0f, 5.0f);
-	}
-	// left trees place left position from the castle
-	for (UINT i = treeCount / 2; i < treeCount; ++i)
-	{
-		float x = MathHelper::RandF(-15, 15);
-		float z = MathHelper::RandF(-23.0f, -35.0f);
-		float y = 1.5f;
-
-		// Move tree slightly above land height.
-		y += 1.0f;
-
-		vertices[i].Pos = XMFLOAT3(x, y, z);
-		vertices[i].Size = XMFLOAT2(5.0f, 5.0f);
-	}
-	std::array<std::uint16_t, 16> indices =
-	{
-		0, 1, 2, 3, 4, 5, 6, 7,
-		8, 9, 10, 11, 12, 13, 14, 15
-	};
-
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(TreeSpriteVertex);
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
-
-	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "treeSpritesGeo";
-
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
-
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
-
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
-
-	geo->VertexByteStride = sizeof(TreeSpriteVertex);
-	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-	geo->IndexBufferByteSize = ibByteSize;
-
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
-
-	geo->DrawArgs["points"] = submesh;
-
-	mGeometries["treeSpritesGeo"] = std::move(geo);
-}
-
-void CastleDesign::BuildPSOs()
-{
-    D3D12_GRAPHICS_PIPELINE_STATE_DESC opaquePsoDesc;
-
-	//
-	// PSO for opaque objects.
-	//
-    ZeroMemory(&opaquePsoDesc, sizeof(D3D12_GRAPHICS_PIPELINE_STATE_DESC));
-	opaquePsoDesc.InputLayout = { mStdInputLayout.data(), (UINT)mStdInputLayout.size() };
-	opaquePsoDesc.pRootSignature = mRootSignature.Get();
-	opaquePsoDesc.VS = 
-	{ 
-		reinterpret_cast<BYTE*>(mShaders["standardVS"]->GetBufferPointer()), 
-		mShaders["standardVS"]->GetBufferSize()
-	};
-	opaquePsoDesc.PS = 
-	{ 
-		reinterpret_cast<BYTE*>(mShaders["opaquePS"]->GetBufferPointer()),
-		mShaders["opaquePS"]->GetBufferSize()
-	};
-	opaquePsoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
-	opaquePsoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
-	opaquePsoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
-	opaquePsoDesc.SampleMask = UINT_MAX;
-	opaquePsoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-	opaquePsoDesc.NumRenderTargets = 1;
-	opaquePsoDesc.RTVFormats[0] = mBackBufferFormat;
-
-	//there is abug with F2 key that is supposed to turn on the multisampling!
-//Set4xMsaaState(true);
-	//m4xMsaaState = true;
-
-	opaquePsoDesc.SampleDesc.Count = m4xMsaaState ? 4 : 1;
-	opaquePsoDesc.SampleDesc.Quality = m4xMsaaState ? (m4xMsaaQuality - 1) : 0;
-	opaquePsoDesc.DSVFormat = mDepthStencilFormat;
-    ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&opaquePsoDesc, IID_PPV_ARGS(&mPSOs["opaque"])));
-
-	//
-	// PSO for transparent objects
-	//
-
-	D3D12_GRAPHICS_PIPELINE_STATE_DESC transparentPsoDesc = opaquePsoDesc;
-
-	D3D12_RENDER_TARGET_BLEND_DESC transparencyBlendDesc;
-	transparencyBlendDesc.BlendEnable = true;
-	transparencyBlendDesc.LogicOpEnable = false;
-	transparencyBlendDesc.SrcBlend = D3D12_BLEND_SRC_ALPHA;
-	transparencyBlendDesc.DestBlend = D3D12_BLEND_INV_SRC_ALPHA;
-	transparencyBlendDesc.BlendOp = D3D12_BLEND_OP_ADD;
-	transparencyBlendDesc.SrcBlendAlpha = D3D12_BLEND_ONE;
-	transparencyBlendDesc.DestBlendAlpha = D3D12_BLEND_ZERO;
-	transparencyBlendDesc.BlendOpAlpha = D3D12_BLEND_OP_ADD;
-	transparencyBlendDesc.LogicOp = D3D12_LOGIC_OP_NOOP;
-	transparencyBlendDesc.RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
-
-	//transparentPsoDesc.BlendState.AlphaToCoverageEnable = true;
-
-	transparentPsoDesc.BlendState.RenderTarget[0] = transparencyBlendDesc;
-	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&transparentPsoDesc, IID_PPV_ARGS(&mPSOs["transparent"])));
-
-	//
-	// PSO for alpha tested objects
-	//
-
-	D3D12_GRAPHICS_PIPELINE_STATE_DESC alphaTestedPsoDesc = opaquePsoDesc;
-	alphaTestedPsoDesc.PS = 
-	{ 
-		reinterpret_cast<BYTE*>(mShaders["alphaTestedPS"]->GetBufferPointer()),
-		mShaders["alphaTestedPS"]->GetBufferSize()
-	};
-	alphaTestedPsoDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
-	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&alphaTestedPsoDesc, IID_PPV_ARGS(&mPSOs["alphaTested"])));
-
-	//
-	// PSO for tree sprites
-	//
-	D3D12_GRAPHICS_PIPELINE_STATE_DESC treeSpritePsoDesc = opaquePsoDesc;
-	treeSpritePsoDesc.VS =
-	{
-		reinterpret_cast<BYTE*>(mShaders["treeSpriteVS"]->GetBufferPointer()),
-		mShaders["treeSpriteVS"]->GetBufferSize()
-	};
-	treeSpritePsoDesc.GS =
-	{
-		reinterpret_cast<BYTE*>(mShaders["treeSpriteGS"]->GetBufferPointer()),
-		mShaders["treeSpriteGS"]->GetBufferSize()
-	};
-	treeSpritePsoDesc.PS =
-	{
-		reinterpret_cast<BYTE*>(mShaders["treeSpritePS"]->GetBufferPointer()),
-		mShaders["treeSpritePS"]->GetBufferSize()
-	};
-	//step1
-	treeSpritePsoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_POINT;
-	treeSpritePsoDesc.InputLayout = { mTreeSpriteInputLayout.data(), (UINT)mTreeSpriteInputLayout.size() };
-	treeSpritePsoDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
-
-	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&treeSpritePsoDesc, IID_PPV_ARGS(&mPSOs["treeSprites"])));
-}
-
-void CastleDesign::BuildFrameResources()
-{
-    for(int i = 0; i < gNumFrameResources; ++i)
-    {
-        mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(),
-            1, (UINT)mAllRitems.size(), (UINT)mMaterials.size(), mWaves->VertexCount()));
-    }
-}
-
-void CastleDesign::BuildMaterials()
-{	
-	// This is not a good water material definition, but we do not have all the rendering
-	// tools we need (transparency, environment reflection), so we fake it for now.
-	auto water = std::make_unique<Material>();
-	water->Name = "water";
-	water->MatCBIndex = 0;
-	water->DiffuseSrvHeapIndex = 0;
-	water->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 0.5f);
-	water->FresnelR0 = XMFLOAT3(0.1f, 0.1f, 0.1f);
-	water->Roughness = 0.0f;
-
-	auto wirefence = std::make_unique<Material>();
-	wirefence->Name = "wirefence";
-	wirefence->MatCBIndex = 1;
-	wirefence->DiffuseSrvHeapIndex = 1;
-	wirefence->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	wirefence->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
-	wirefence->Roughness = 0.25f;
-
-	auto bricks0 = std::make_unique<Material>();
-	bricks0->Name = "bricks0";
-	bricks0->MatCBIndex = 2;
-	bricks0->DiffuseSrvHeapIndex = 2;
-	bricks0->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	bricks0->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
-	bricks0->Roughness = 0.1f;
-
-	auto stone0 = std::make_unique<Material>();
-	stone0->Name = "stone0";
-	stone0->MatCBIndex = 3;
-	stone0->DiffuseSrvHeapIndex = 3;
-	stone0->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	stone0->FresnelR0 = XMFLOAT3(0.05f, 0.05f, 0.05f);
-	stone0->Roughness = 0.1f;
-
-	auto grass = std::make_unique<Material>();
-	grass->Name = "grass";
-	grass->MatCBIndex = 4;
-	grass->DiffuseSrvHeapIndex = 4;
-	grass->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	grass->FresnelR0 = XMFLOAT3(0.01f, 0.01f, 0.01f);
-	grass->Roughness = 0.125f;
-
-
-	auto roof0 = std::make_unique<Material>();
-	roof0->Name = "roof0";
-	roof0->MatCBIndex = 5;
-	roof0->DiffuseSrvHeapIndex = 5;
-	roof0->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	roof0->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
-	roof0->Roughness = 0.0f;
-
-	auto prism0 = std::make_unique<Material>();
-	prism0->Name = "prism0";
-	prism0->MatCBIndex = 6;
-	prism0->DiffuseSrvHeapIndex = 6;
-	prism0->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	prism0->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
-	prism0->Roughness = 0.3f;
-
-	auto door0 = std::make_unique<Material>();
-	door0->Name = "door0";
-	door0->MatCBIndex = 7;
-	door0->DiffuseSrvHeapIndex = 7;
-	door0->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	door0->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
-	door0->Roughness = 0.3f;
-
-	auto glass0 = std::make_unique<Material>();
-	glass0->Name = "glass0";
-	glass0->MatCBIndex = 8;
-	glass0->DiffuseSrvHeapIndex = 8;
-	glass0->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	glass0->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
-	glass0->Roughness = 0.0f;
-
-
-	auto rope0 = std::make_unique<Material>();
-	rope0->Name = "rope0";
-	rope0->MatCBIndex = 9;
-	rope0->DiffuseSrvHeapIndex = 9;
-	rope0->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	rope0->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
-	rope0->Roughness = 0.3f;
-
-	auto Torus0 = std::make_unique<Material>();
-	Torus0->Name = "Torus0";
-	Torus0->MatCBIndex = 10;
-	Torus0->DiffuseSrvHeapIndex = 10;
-	Torus0->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	Torus0->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
-	Torus0->Roughness = 0.3f;
-
-	auto treeSprites = std::make_unique<Material>();
-	treeSprites->Name = "treeSprites";
-	treeSprites->MatCBIndex = 11;
-	treeSprites->DiffuseSrvHeapIndex = 11;
-	treeSprites->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	treeSprites->FresnelR0 = XMFLOAT3(0.01f, 0.01f, 0.01f);
-	treeSprites->Roughness = 0.125f;
-	
-	mMaterials["water"] = std::move(water);
-	mMaterials["wirefence"] = std::move(wirefence);
-	mMaterials["bricks0"] = std::move(bricks0);
-	mMaterials["stone0"] = std::move(stone0);
-	mMaterials["grass"] = std::move(grass);
-	mMaterials["roof0"] = std::move(roof0);
-	mMaterials["prism0"] = std::move(prism0);
-	mMaterials["door0"] = std::move(door0);
-	mMaterials["glass0"] = std::move(glass0);
-	mMaterials["rope0"] = std::move(rope0);
-	mMaterials["Torus0"] = std::move(Torus0);
-	mMaterials["treeSprites"] = std::move(treeSprites);
-	
-}
-
-void CastleDesign::BuildRenderItems()
-{
-	auto gridRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&gridRitem->World, XMMatrixScaling(2.0f, 0.5f, 2.5f) * XMMatrixRotationRollPitchYaw(0.0f, 1.5708f, 0.0f) * XMMatrixTranslation(105.0f, 0.0f, 0.0f));
-	XMStoreFloat4x4(&gridRitem->TexTransform, XMMatrixScaling(10.0f, 15.0f, 1.0f) );
-	gridRitem->ObjCBIndex = 0;
-	gridRitem->Mat = mMaterials["grass"].get();
-	gridRitem->Geo = mGeometries["landGeo"].get();	
-	gridRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	gridRitem->IndexCount = gridRitem->Geo->DrawArgs["grid"].IndexCount;
-	gridRitem->StartIndexLocation = gridRitem->Geo->DrawArgs["grid"].StartIndexLocation;
-	gridRitem->BaseVertexLocation = gridRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
-
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(gridRitem.get());
-	mAllRitems.push_back(std::move(gridRitem));
-		
-
-	 //CatleWall;
-	//****************************************************
-	XMMatrixRotationRollPitchYaw(0.0f, 1.0472f, 0.0f);
-
-	auto boxRitem = std::make_unique<RenderItem>();
-
-	XMStoreFloat4x4(&boxRitem->World, XMMatrixScaling(1.0f, 2.0f, 15.5f) * XMMatrixTranslation(12.0f, 4.0f, 0.0f));
-
-	boxRitem->ObjCBIndex = 1;
-
-	boxRitem->Geo = mGeometries["shapeGeo"].get();
-	boxRitem->Mat = mMaterials["bricks0"].get();
-	boxRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-
-	boxRitem->IndexCount = boxRitem->Geo->DrawArgs["box"].IndexCount;
-
-	boxRitem->StartIndexLocation = boxRitem->Geo->DrawArgs["box"].StartIndexLocation;
-
-	boxRitem->BaseVertexLocation = boxRitem->Geo->DrawArgs["box"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(boxRitem.get());
-	mAllRitems.push_back(std::move(boxRitem));
-
-
-
-	auto boxRitem2 = std::make_unique<RenderItem>();
-
-	XMStoreFloat4x4(&boxRitem2->World, XMMatrixScaling(1.0f, 5.0f, 14.5f) * XMMatrixRotationRollPitchYaw(0.0f, 1.0472f, 0.0f) * XMMatrixTranslation(6.0f, 2.5f, -11.0f));
-
-	boxRitem2->ObjCBIndex = 2;
-
-	boxRitem2->Geo = mGeometries["shapeGeo"].get();
-	boxRitem2->Mat = mMaterials["bricks0"].get();
-	boxRitem2->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-
-	boxRitem2->IndexCount = boxRitem2->Geo->DrawArgs["box"].IndexCount;
-
-	boxRitem2->StartIndexLocation = boxRitem2->Geo->DrawArgs["box"].StartIndexLocation;
-
-	boxRitem2->BaseVertexLocation = boxRitem2->Geo->DrawArgs["box"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(boxRitem2.get());
-	mAllRitems.push_back(std::move(boxRitem2));
-
-	
-
-	auto boxRitem3 = std::make_unique<RenderItem>();
-
-	XMStoreFloat4x4(&boxRitem3->World, XMMatrixScaling(1.0f, 5.0f, 14.5f) * XMMatrixRotationRollPitchYaw(0.0f, -1.0472f, 0.0f) * XMMatrixTranslation(-6.0f, 2.5f, -11.0f));
-
-	boxRitem3->ObjCBIndex = 3;
-
-	boxRitem3->Geo = mGeometries["shapeGeo"].get();
-	boxRitem3->Mat = mMaterials["bricks0"].get();
-	boxRitem3->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-
-	boxRitem3->IndexCount = boxRitem3->Geo->DrawArgs["box"].IndexCount;
-
-	boxRitem3->StartIndexLocation = boxRitem3->Geo->DrawArgs["box"].StartIndexLocation;
-
-	boxRitem3->BaseVertexLocation = boxRitem3->Geo->DrawArgs["box"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(boxRitem3.get());
-	mAllRitems.push_back(std::move(boxRitem3));
-	
-
-	auto boxRitem4 = std::make_unique<RenderItem>();
-
-	XMStoreFloat4x4(&boxRitem4->World, XMMatrixScaling(1.0f, 5.0f, 15.5f) * XMMatrixTranslation(-12.0f, 2.5f, 0.0f));
-
-	boxRitem4->ObjCBIndex = 4;
-
-	boxRitem4->Geo = mGeometries["shapeGeo"].get();
-	boxRitem4->Mat = mMaterials["bricks0"].get();
-	boxRitem4->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-
-	boxRitem4->IndexCount = boxRitem4->Geo->DrawArgs["box"].IndexCount;
-
-	boxRitem4->StartIndexLocation = boxRitem4->Geo->DrawArgs["box"].StartIndexLocation;
-
-	boxRitem4->BaseVertexLocation = boxRitem4->Geo->DrawArgs["box"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(boxRitem4.get());
-	mAllRitems.push_back(std::move(boxRitem4));
-	
-	auto boxRitem5 = std::make_unique<RenderItem>();
-
-	XMStoreFloat4x4(&boxRitem5->World, XMMatrixScaling(1.0f, 5.0f, 14.5f) * XMMatrixRotationRollPitchYaw(0.0f, 1.0472f, 0.0f) * XMMatrixTranslation(-6.0f, 2.5f, 11.0f));
-
-	boxRitem5->ObjCBIndex = 5;
-
-	boxRitem5->Geo = mGeometries["shapeGeo"].get();
-	boxRitem5->Mat = mMaterials["bricks0"].get();
-	boxRitem5->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-
-	boxRitem5->IndexCount = boxRitem5->Geo->DrawArgs["box"].IndexCount;
-
-	boxRitem5->StartIndexLocation = boxRitem5->Geo->DrawArgs["box"].StartIndexLocation;
-
-	boxRitem5->BaseVertexLocation = boxRitem5->Geo->DrawArgs["box"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(boxRitem5.get());
-	mAllRitems.push_back(std::move(boxRitem5));
-
-
-
-	auto boxRitem6 = std::make_unique<RenderItem>();
-
-	XMStoreFloat4x4(&boxRitem6->World, XMMatrixScaling(1.0f, 5.0f, 14.5f) * XMMatrixRotationRollPitchYaw(0.0f, -1.0472f, 0.0f) * XMMatrixTranslation(6.0f, 2.5f, 11.0f));
-
-	boxRitem6->ObjCBIndex = 6;
-
-	boxRitem6->Geo = mGeometries["shapeGeo"].get();
-	boxRitem6->Mat = mMaterials["bricks0"].get();
-	boxRitem6->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-
-	boxRitem6->IndexCount = boxRitem6->Geo->DrawArgs["box"].IndexCount;
-
-	boxRitem6->StartIndexLocation = boxRitem6->Geo->DrawArgs["box"].StartIndexLocation;
-
-	boxRitem6->BaseVertexLocation = boxRitem6->Geo->DrawArgs["box"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(boxRitem6.get());
-	mAllRitems.push_back(std::move(boxRitem6));
-
-	//****************************************************
-
-	//Tower
-	//****************************************************
-	auto pyramidRitem = std::make_unique<RenderItem>();
-
-	XMStoreFloat4x4(&pyramidRitem->World, XMMatrixScaling(10.0f, 3.5f, 10.0f) * XMMatrixRotationRollPitchYaw(0.0f, 0.785398f, 0.0f) * XMMatrixTranslation(0.0f, 1.75f, 0.0f));
-
-	pyramidRitem->ObjCBIndex = 7;
-
-	pyramidRitem->Geo = mGeometries["shapeGeo"].get();
-	pyramidRitem->Mat = mMaterials["prism0"].get();
-	pyramidRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-
-	pyramidRitem->IndexCount = pyramidRitem->Geo->DrawArgs["pyramid"].IndexCount;
-
-	pyramidRitem->StartIndexLocation = pyramidRitem->Geo->DrawArgs["pyramid"].StartIndexLocation;
-
-	pyramidRitem->BaseVertexLocation = pyramidRitem->Geo->DrawArgs["pyramid"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(pyramidRitem.get());
-	mAllRitems.push_back(std::move(pyramidRitem));
-
-
-	auto cylinderRitem = std::make_unique<RenderItem>();
-
-	XMStoreFloat4x4(&cylinderRitem->World, XMMatrixScaling(2.0f, 8.0f, 2.0f) * XMMatrixRotationRollPitchYaw(0.0f, 0.785398f, 0.0f) * XMMatrixTranslation(0.0f, 7.5f, 0.0f));
-
-	cylinderRitem->ObjCBIndex = 8;
-
-	cylinderRitem->Geo = mGeometries["shapeGeo"].get();
-	cylinderRitem->Mat = mMaterials["bricks0"].get();
-	cylinderRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-
-	cylinderRitem->IndexCount = cylinderRitem->Geo->DrawArgs["cylinder"].IndexCount;
-
-	cylinderRitem->StartIndexLocation = cylinderRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
-
-	cylinderRitem->BaseVertexLocation = cylinderRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(cylinderRitem.get());
-	mAllRitems.push_back(std::move(cylinderRitem));
-
-	auto cylinderRitem2 = std::make_unique<RenderItem>();
-
-	XMStoreFloat4x4(&cylinderRitem2->World, XMMatrixScaling(4.0f, 1.5f, 4.0f) * XMMatrixRotationRollPitchYaw(0.0f, 0.785398f, 0.0f) * XMMatrixTranslation(0.0f, 12.0f, 0.0f));
-
-	cylinderRitem2->ObjCBIndex = 9;
-
-	cylinderRitem2->Geo = mGeometries["shapeGeo"].get();
-	cylinderRitem2->Mat = mMaterials["bricks0"].get();
-	cylinderRitem2->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-
-	cylinderRitem2->IndexCount = cylinderRitem2->Geo->DrawArgs["cylinder"].IndexCount;
-
-	cylinderRitem2->StartIndexLocation = cylinderRitem2->Geo->DrawArgs["cylinder"].StartIndexLocation;
-
-	cylinderRitem2->BaseVertexLocation = cylinderRitem2->Geo->DrawArgs["cylinder"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(cylinderRitem2.get());
-	mAllRitems.push_back(std::move(cylinderRitem2));
-
-
-	auto coneRitem = std::make_unique<RenderItem>();
-
-	XMStoreFloat4x4(&coneRitem->World, XMMatrixScaling(0.7f, 7.5f, 2.5f) * XMMatrixRotationRollPitchYaw(0.0f, 1.5708f, 0.0f) * XMMatrixTranslation(0.0f, 15.5f, 3.0f));
-
-	coneRitem->ObjCBIndex = 10;
-
-	coneRitem->Geo = mGeometries["shapeGeo"].get();
-	coneRitem->Mat = mMaterials["roof0"].get();
-	coneRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-
-	coneRitem->IndexCount = coneRitem->Geo->DrawArgs["cone"].IndexCount;
-
-	coneRitem->StartIndexLocation = coneRitem->Geo->DrawArgs["cone"].StartIndexLocation;
-
-	coneRitem->BaseVertexLocation = coneRitem->Geo->DrawArgs["cone"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(coneRitem.get());
-	mAllRitems.push_back(std::move(coneRitem));
-
-
-	auto diamondRitem = std::make_unique<RenderItem>();
-
-	XMStoreFloat4x4(&diamondRitem->World, XMMatrixScaling(1.0f, 1.0f, 1.0f) * XMMatrixRotationRollPitchYaw(0.0f, 0.785398f, 0.0f) * XMMatrixTranslation(6.0f, 4.0f, 6.0f));
-
-	diamondRitem->ObjCBIndex = 11;
-
-	diamondRitem->Geo = mGeometries["shapeGeo"].get();
-	diamondRitem->Mat = mMaterials["glass0"].get();
-	diamondRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-
-	diamondRitem->IndexCount = diamondRitem->Geo->DrawArgs["diamond"].IndexCount;
-
-	diamondRitem->StartIndexLocation = diamondRitem->Geo->DrawArgs["diamond"].StartIndexLocation;
-
-	diamondRitem->BaseVertexLocation = diamondRitem->Geo->DrawArgs["diamond"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(diamondRitem.get());
-	mAllRitems.push_back(std::move(diamondRitem));
-
-	auto diamondRitem2 = std::make_unique<RenderItem>();
-
-	XMStoreFloat4x4(&diamondRitem2->World, XMMatrixScaling(1.0f, 1.0f, 1.0f) * XMMatrixRotationRollPitchYaw(0.0f, 0.785398f, 0.0f) * XMMatrixTranslation(-6.0f, 4.0f, 6.0f));
-
-	diamondRitem2->ObjCBIndex = 12;
-
-	diamondRitem2->Geo = mGeometries["shapeGeo"].get();
-	diamondRitem2->Mat = mMaterials["glass0"].get();
-	diamondRitem2->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-
-	diamondRitem2->IndexCount = diamondRitem2->Geo->DrawArgs["diamond"].IndexCount;
-
-	diamondRitem2->StartIndexLocation = diamondRitem2->Geo->DrawArgs["diamond"].StartIndexLocation;
-
-	diamondRitem2->BaseVertexLocation = diamondRitem2->Geo->DrawArgs["diamond"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(diamondRitem2.get());
-	mAllRitems.push_back(std::move(diamondRitem2));
-
-	auto diamondRitem3 = std::make_unique<RenderItem>();
-
-	XMStoreFloat4x4(&diamondRitem3->World, XMMatrixScaling(1.0f, 1.0f, 1.0f) * XMMatrixRotationRollPitchYaw(0.0f, 0.785398f, 0.0f) * XMMatrixTranslation(6.0f, 4.0f, -6.0f));
-
-	diamondRitem3->ObjCBIndex = 13;
-
-	diamondRitem3->Geo = mGeometries["shapeGeo"].get();
-	diamondRitem3->Mat = mMaterials["glass0"].get();
-	diamondRitem3->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-
-	diamondRitem3->IndexCount = diamondRitem3->Geo->DrawArgs["diamond"].IndexCount;
-
-	diamondRitem3->StartIndexLocation = diamondRitem3->Geo->DrawArgs["diamond"].StartIndexLocation;
-
-	diamondRitem3->BaseVertexLocation = diamondRitem3->Geo->DrawArgs["diamond"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(diamondRitem3.get());
-	mAllRitems.push_back(std::move(diamondRitem3));
-
-	auto diamondRitem4 = std::make_unique<RenderItem>();
-
-	XMStoreFloat4x4(&diamondRitem4->World, XMMatrixScaling(1.0f, 1.0f, 1.0f) * XMMatrixRotationRollPitchYaw(0.0f, 0.785398f, 0.0f) * XMMatrixTranslation(-6.0f, 4.0f, -6.0f));
-
-	diamondRitem4->ObjCBIndex = 14;
-
-	diamondRitem4->Geo = mGeometries["shapeGeo"].get();
-	diamondRitem4->Mat = mMaterials["glass0"].get();
-	diamondRitem4->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-
-	diamondRitem4->IndexCount = diamondRitem4->Geo->DrawArgs["diamond"].IndexCount;
-
-	diamondRitem4->StartIndexLocation = diamondRitem4->Geo->DrawArgs["diamond"].StartIndexLocation;
-
-	diamondRitem4->BaseVertexLocation = diamondRitem4->Geo->DrawArgs["diamond"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(diamondRitem4.get());
-	mAllRitems.push_back(std::move(diamondRitem4));
-	//****************************************************
-
-	//Wall Corner 
-	//****************************************************
-	auto prismRitem = std::make_unique<RenderItem>();
-
-	XMStoreFloat4x4(&prismRitem->World, XMMatrixRotationRollPitchYaw(0.0f, -0.436332f, 0.0f) * XMMatrixScaling(2.0f, 5.0f, 2.0f) * XMMatrixTranslation(14.0f, 2.5f, -9.0f));
-
-	prismRitem->ObjCBIndex = 15;
-
-	prismRitem->Geo = mGeometries["shapeGeo"].get();
-	prismRitem->Mat = mMaterials["prism0"].get();
-	prismRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-
-	prismRitem->IndexCount = prismRitem->Geo->DrawArgs["prism"].IndexCount;
-
-	prismRitem->StartIndexLocation = prismRitem->Geo->DrawArgs["prism"].StartIndexLocation;
-
-	prismRitem->BaseVertexLocation = prismRitem->Geo->DrawArgs["prism"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(prismRitem.get());
-	mAllRitems.push_back(std::move(prismRitem));
-
-
-	auto sphereRitem = std::make_unique<RenderItem>();
-
-	XMStoreFloat4x4(&sphereRitem->World, XMMatrixScaling(1.0f, 1.0f, 1.0f) * XMMatrixTranslation(14.0f, 5.0f, -9.0f));
-
-	sphereRitem->ObjCBIndex = 16;
-
-	sphereRitem->Geo = mGeometries["shapeGeo"].get();
-	sphereRitem->Mat = mMaterials["glass0"].get();
-	sphereRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-
-	sphereRitem->IndexCount = sphereRitem->Geo->DrawArgs["sphere"].IndexCount;
-
-	sphereRitem->StartIndexLocation = sphereRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
-
-	sphereRitem->BaseVertexLocation = sphereRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(sphereRitem.get());
-	mAllRitems.push_back(std::move(sphereRitem));
-
-
-	auto prismRitem2 = std::make_unique<RenderItem>();
-
-	XMStoreFloat4x4(&prismRitem2->World, XMMatrixRotationRollPitchYaw(0.0f, 0.610865f, 0.0f) * XMMatrixScaling(2.0f, 5.0f, 2.0f) * XMMatrixTranslation(-14.0f, 2.5f, 9.0f));
-
-	prismRitem2->ObjCBIndex = 17;
-
-	prismRitem2->Geo = mGeometries["shapeGeo"].get();
-	prismRitem2->Mat = mMaterials["prism0"].get();
-	prismRitem2->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-
-	prismRitem2->IndexCount = prismRitem2->Geo->DrawArgs["prism"].IndexCount;
-
-	prismRitem2->StartIndexLocation = prismRitem2->Geo->DrawArgs["prism"].StartIndexLocation;
-
-	prismRitem2->BaseVertexLocation = prismRitem2->Geo->DrawArgs["prism"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(prismRitem2.get());
-	mAllRitems.push_back(std::move(prismRitem2));
-
-
-	auto sphereRitem2 = std::make_unique<RenderItem>();
-
-	XMStoreFloat4x4(&sphereRitem2->World, XMMatrixScaling(1.0f, 1.0f, 1.0f) * XMMatrixTranslation(-14.0f, 5.0f, 9.0f));
-
-	sphereRitem2->ObjCBIndex = 18;
-
-	sphereRitem2->Geo = mGeometries["shapeGeo"].get();
-	sphereRitem2->Mat = mMaterials["glass0"].get();
-	sphereRitem2->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-
-	sphereRitem2->IndexCount = sphereRitem2->Geo->DrawArgs["sphere"].IndexCount;
-
-	sphereRitem2->StartIndexLocation = sphereRitem2->Geo->DrawArgs["sphere"].StartIndexLocation;
-
-	sphereRitem2->BaseVertexLocation = sphereRitem2->Geo->DrawArgs["sphere"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(sphereRitem2.get());
-	mAllRitems.push_back(std::move(sphereRitem2));
-
-
-	auto prismRitem3 = std::make_unique<RenderItem>();
-
-	XMStoreFloat4x4(&prismRitem3->World, XMMatrixRotationRollPitchYaw(0.0f, -0.610865f, 0.0f) * XMMatrixScaling(2.0f, 5.0f, 2.0f) * XMMatrixTranslation(-14.0f, 2.5f, -9.0f));
-
-	prismRitem3->ObjCBIndex = 19;
-
-	prismRitem3->Geo = mGeometries["shapeGeo"].get();
-	prismRitem3->Mat = mMaterials["prism0"].get();
-	prismRitem3->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-
-	prismRitem3->IndexCount = prismRitem3->Geo->DrawArgs["prism"].IndexCount;
-
-	prismRitem3->StartIndexLocation = prismRitem3->Geo->DrawArgs["prism"].StartIndexLocation;
-
-	prismRitem3->BaseVertexLocation = prismRitem3->Geo->DrawArgs["prism"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(prismRitem3.get());
-	mAllRitems.push_back(std::move(prismRitem3));
-
-
-	auto sphereRitem3 = std::make_unique<RenderItem>();
-
-	XMStoreFloat4x4(&sphereRitem3->World, XMMatrixScaling(1.0f, 1.0f, 1.0f) * XMMatrixTranslation(-14.0f, 5.0f, -9.0f));
-
-	sphereRitem3->ObjCBIndex = 20;
-
-	sphereRitem3->Geo = mGeometries["shapeGeo"].get();
-	sphereRitem3->Mat = mMaterials["glass0"].get();
-	sphereRitem3->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-
-	sphereRitem3->IndexCount = sphereRitem3->Geo->DrawArgs["sphere"].IndexCount;
-
-	sphereRitem3->StartIndexLocation = sphereRitem3->Geo->DrawArgs["sphere"].StartIndexLocation;
-
-	sphereRitem3->BaseVertexLocation = sphereRitem3->Geo->DrawArgs["sphere"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(sphereRitem3.get());
-	mAllRitems.push_back(std::move(sphereRitem3));
-
-
-	auto prismRitem4 = std::make_unique<RenderItem>();
-
-	XMStoreFloat4x4(&prismRitem4->World, XMMatrixRotationRollPitchYaw(0.0f, 0.436332f, 0.0f) * XMMatrixScaling(2.0f, 5.0f, 2.0f) * XMMatrixTranslation(14.0f, 2.5f, 9.0f));
-
-	prismRitem4->ObjCBIndex = 21;
-
-	prismRitem4->Geo = mGeometries["shapeGeo"].get();
-	prismRitem4->Mat = mMaterials["prism0"].get();
-	prismRitem4->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-
-	prismRitem4->IndexCount = prismRitem4->Geo->DrawArgs["prism"].IndexCount;
-
-	prismRitem4->StartIndexLocation = prismRitem4->Geo->DrawArgs["prism"].StartIndexLocation;
+	D3D12_RENDER_TARGET_BLEND_DESC transparencyBlendDesc;
+	transparencyBlendDesc.BlendEnable = true;
+	transparencyBlendDesc.LogicOpEnable = false;
+	transparencyBlendDesc.SrcBlend = D3D12_BLEND_SRC_ALPHA;
+	transparencyBlendDesc.DestBlend = D3D12_BLEND_INV_SRC_ALPHA;
+	transparencyBlendDesc.BlendOp = D3D12_BLEND_OP_ADD;
+	transparencyBlendDesc.SrcBlendAlpha = D3D12_BLEND_ONE;
+	transparencyBlendDesc.DestBlendAlpha = D3D12_BLEND_ZERO;
+	transparencyBlendDesc.BlendOpAlpha = D3D12_BLEND_OP_ADD;
+	transparencyBlendDesc.LogicOp = D3D12_LOGIC_OP_NOOP;
+	transparencyBlendDesc.RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
 
-	prismRitem4->BaseVertexLocation = prismRitem4->Geo->DrawArgs["prism"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(prismRitem4.get());
-	mAllRitems.push_back(std::move(prismRitem4));
+	//transparentPsoDesc.BlendState.AlphaToCoverageEnable = true;
 
+	transparentPsoDesc.BlendState.RenderTarget[0] = transparencyBlendDesc;
+	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&transparentPsoDesc, IID_PPV_ARGS(&pso)));
+	mPSOs.Add("transparent", pso);
 
-	auto sphereRitem4 = std::make_unique<RenderItem>();
+	//
+	// PSO for alpha tested objects
+	//
 
-	XMStoreFloat4x4(&sphereRitem4->World, XMMatrixScaling(1.0f, 1.0f, 1.0f) * XMMatrixTranslation(14.0f, 5.0f, 9.0f));
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC alphaTestedPsoDesc = opaquePsoDesc;
+	alphaTestedPsoDesc.PS = 
+	{ 
+		reinterpret_cast<BYTE*>(mShaders["alphaTestedPS"]->GetBufferPointer()),
+		mShaders["alphaTestedPS"]->GetBufferSize()
+	};
+	alphaTestedPsoDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
+	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&alphaTestedPsoDesc, IID_PPV_ARGS(&pso)));
+	mPSOs.Add("alphaTested", pso);
 
-	sphereRitem4->ObjCBIndex = 22;
+	//
+	// PSOs for instanced objects
+	//
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC instancedOpaquePsoDesc = opaquePsoDesc;
+	instancedOpaquePsoDesc.VS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["instancedVS"]->GetBufferPointer()),
+		mShaders["instancedVS"]->GetBufferSize()
+	};
+	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&instancedOpaquePsoDesc, IID_PPV_ARGS(&pso)));
+	mPSOs.Add("instancedOpaque", pso);
 
-	sphereRitem4->Geo = mGeometries["shapeGeo"].get();
-	sphereRitem4->Mat = mMaterials["glass0"].get();
-	sphereRitem4->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC instancedAlphaTestedPsoDesc = alphaTestedPsoDesc;
+	instancedAlphaTestedPsoDesc.VS = instancedOpaquePsoDesc.VS;
+	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&instancedAlphaTestedPsoDesc, IID_PPV_ARGS(&pso)));
+	mPSOs.Add("instancedAlphaTested", pso);
 
-	sphereRitem4->IndexCount = sphereRitem4->Geo->DrawArgs["sphere"].IndexCount;
+	//
+	// PSO for tree sprites
+	//
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC treeSpritePsoDesc = opaquePsoDesc;
+	treeSpritePsoDesc.VS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["treeSpriteVS"]->GetBufferPointer()),
+		mShaders["treeSpriteVS"]->GetBufferSize()
+	};
+	treeSpritePsoDesc.GS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["treeSpriteGS"]->GetBufferPointer()),
+		mShaders["treeSpriteGS"]->GetBufferSize()
+	};
+	treeSpritePsoDesc.PS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["treeSpritePS"]->GetBufferPointer()),
+		mShaders["treeSpritePS"]->GetBufferSize()
+	};
+	//step1
+	treeSpritePsoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_POINT;
+	treeSpritePsoDesc.InputLayout = { mTreeSpriteInputLayout.data(), (UINT)mTreeSpriteInputLayout.size() };
+	treeSpritePsoDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
 
-	sphereRitem4->StartIndexLocation = sphereRitem4->Geo->DrawArgs["sphere"].StartIndexLocation;
+	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&treeSpritePsoDesc, IID_PPV_ARGS(&pso)));
+	mPSOs.Add("treeSprites", pso);
 
-	sphereRitem4->BaseVertexLocation = sphereRitem4->Geo->DrawArgs["sphere"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(sphereRitem4.get());
-	mAllRitems.push_back(std::move(sphereRitem4));
+	// One PSO per DrawQueue pipeline, in QueueRenderItems' pass order.
+	const char* passPSOs[] = { "opaque", "instancedOpaque", "alphaTested", "instancedAlphaTested", "treeSprites", "transparent" };
+	mPassPSOs.clear();
+	for (const char* name : passPSOs)
+		mPassPSOs.push_back(mPSOs[mPSOs.Find(name)].Get());
+}
 
+void CastleDesign::BuildFrameResources()
+{
+	// Worst case every instance is visible.  Each item keeps its range for
+	// good, since the object data points at it.
+	mInstanceCount = 0;
+	for(auto& e : mAllRitems)
+	{
+		e->InstanceBufferOffset = mInstanceCount;
+		mInstanceCount += (UINT)e->Instances.size();
+	}
 
-	auto prismRitem5 = std::make_unique<RenderItem>();
+    for(int i = 0; i < gNumFrameResources; ++i)
+    {
+        mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(),
+            (UINT)mAllRitems.size(), mMaterials.IndexLimit(), gNumRecordLists));
+    }
 
-	XMStoreFloat4x4(&prismRitem5->World, XMMatrixRotationRollPitchYaw(0.0f, -0.5f, 0.0f) * XMMatrixScaling(2.0f, 5.0f, 2.0f) * XMMatrixTranslation(0.0f, 2.5f, 17.0f));
+	// Room for what a frame uploads now, for every frame in flight.  Anything
+	// added later grows the ring instead of failing.
+	const UINT64 frameBytes =
+		d3dUtil::CalcConstantBufferByteSize(sizeof(PassConstants)) +
+		(UINT64)mInstanceCount * sizeof(InstanceData) +
+		(UINT64)mWaves->VertexCount() * sizeof(Vertex) +
+		(UINT64)mAllRitems.size() * sizeof(IndirectDrawCommand) + 256;
+	mUploadRing = std::make_unique<UploadRing>(*this, (gNumFrameResources + 1) * frameBytes);
 
-	prismRitem5->ObjCBIndex = 23;
+	// Every item starts out unpacked.
+	for(auto& e : mAllRitems)
+		MarkRitemDirty(e.get());
+}
 
-	prismRitem5->Geo = mGeometries["shapeGeo"].get();
-	prismRitem5->Mat = mMaterials["prism0"].get();
-	prismRitem5->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+bool CastleDesign::CreateHeap(std::uint64_t size, UploadHeap& heap)
+{
+	ComPtr<ID3D12Resource> buffer;
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(size),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&buffer)));
+
+	// Upload heaps can stay mapped for as long as they live.
+	void* mapped = nullptr;
+	ThrowIfFailed(buffer->Map(0, nullptr, &mapped));
+
+	int id = 0;
+	while (id < (int)mUploadHeaps.size() && mUploadHeaps[id] != nullptr)
+		++id;
+	if (id == (int)mUploadHeaps.size())
+		mUploadHeaps.push_back(nullptr);
+	mUploadHeaps[id] = buffer;
+
+	heap.Cpu = mapped;
+	heap.Gpu = buffer->GetGPUVirtualAddress();
+	heap.Size = size;
+	heap.Id = id;
+	return true;
+}
 
-	prismRitem5->IndexCount = prismRitem5->Geo->DrawArgs["prism"].IndexCount;
+void CastleDesign::ReleaseHeap(const UploadHeap& heap)
+{
+	mUploadHeaps[heap.Id]->Unmap(0, nullptr);
+	mUploadHeaps[heap.Id] = nullptr;
+}
 
-	prismRitem5->StartIndexLocation = prismRitem5->Geo->DrawArgs["prism"].StartIndexLocation;
+void CastleDesign::BuildMaterials()
+{
+	// Materials are registered in MatCBIndex order, so a handle is the index.
+	for (int i = 0; i < CastleLayout::MaterialCount; ++i)
+	{
+		const CastleLayout::MaterialDesc& desc = CastleLayout::Materials[i];
+
+		auto mat = std::make_unique<Material>();
+		mat->Name = desc.Name;
+		mat->MatCBIndex = i;
+		mat->DiffuseSrvHeapIndex = i;
+		mat->DiffuseAlbedo = desc.DiffuseAlbedo;
+		mat->FresnelR0 = desc.FresnelR0;
+		mat->Roughness = desc.Roughness;
+		mMaterials.Add(mat->Name, std::move(mat));
+	}
 
-	prismRitem5->BaseVertexLocation = prismRitem5->Geo->DrawArgs["prism"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(prismRitem5.get());
-	mAllRitems.push_back(std::move(prismRitem5));
+	mWaterMat = mMaterials.Find("water");
+	mTorusMat = mMaterials.Find("Torus0");
+}
 
+void CastleDesign::BuildRenderItems()
+{
+	// Shapes and materials are looked up by the names CastleLayout gives them.
+	auto shapeMesh = [this](const char* shape)
+	{
+		return mSubmeshes.Find(std::string("shapeGeo/") + shape);
+	};
+	auto material = [this](CastleLayout::MaterialIndex mat)
+	{
+		return mMaterials.Find(CastleLayout::Materials[mat].Name).Index;
+	};
 
-	auto sphereRitem5 = std::make_unique<RenderItem>();
+	// Castle parts are placed relative to the group they belong to, so moving
+	// the castle, its tower or its gate means changing that group's transform.
+	// Instanced parts keep world-space instances and stay out of the hierarchy.
+	std::uint32_t groupNodes[CastleLayout::GroupCount];
+	for (int g = 0; g < CastleLayout::GroupCount; ++g)
+	{
+		const CastleLayout::GroupDesc& group = CastleLayout::Groups[g];
+		XMFLOAT4X4 groupLocal;
+		XMStoreFloat4x4(&groupLocal, XMMatrixTranslation(group.Translation.x, group.Translation.y, group.Translation.z));
+		groupNodes[g] = mTransforms.Add(group.Parent < 0 ? TransformHierarchy::NoParent : groupNodes[group.Parent], groupLocal);
+	}
 
-	XMStoreFloat4x4(&sphereRitem5->World, XMMatrixScaling(1.0f, 1.0f, 1.0f) * XMMatrixTranslation(0.0f, 5.0f, 17.0f));
+	const CastleLayout::Placement land = CastleLayout::LandPlacement();
+	auto gridRitem = NewRenderItem();
+	mScene.World(gridRitem->Node) = land.World;
+	mScene.TexTransform(gridRitem->Node) = land.TexTransform;
+	mScene.Material(gridRitem->Node) = material(CastleLayout::Grass);
+	gridRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	SetSubmesh(gridRitem.get(), mSubmeshes.Find("landGeo/grid"));
+	mRitemLayer[(int)RenderLayer::Opaque].push_back(gridRitem.get());
+	mAllRitems.push_back(std::move(gridRitem));
 
-	sphereRitem5->ObjCBIndex = 24;
+	// Walls, tower, wall corners, gate and the eye on top.
+	for (int i = 0; i < CastleLayout::PropCount; ++i)
+	{
+		const CastleLayout::Prop& prop = CastleLayout::Props[i];
+
+		auto ritem = NewRenderItem();
+		AttachRitem(ritem.get(), groupNodes[prop.Parent], prop.Local());
+		mScene.Material(ritem->Node) = material(prop.Material);
+		ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		SetSubmesh(ritem.get(), shapeMesh(prop.Shape));
+		mRitemLayer[prop.Layer].push_back(ritem.get());
+		mAllRitems.push_back(std::move(ritem));
+	}
 
-	sphereRitem5->Geo = mGeometries["shapeGeo"].get();
-	sphereRitem5->Mat = mMaterials["glass0"].get();
-	sphereRitem5->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	// Battlements, glass spheres and diamonds: every copy shares one shape, so
+	// each set is drawn as instances of a single render item.
+	for (const auto& prop : CastleLayout::InstancedProps())
+	{
+		auto ritem = NewRenderItem();
+		mScene.Material(ritem->Node) = material(prop.Material);
+		ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		SetSubmesh(ritem.get(), shapeMesh(prop.Shape));
+		for (const auto& world : prop.Worlds)
+		{
+			InstanceData instance;
+			instance.World = world;
+			ritem->Instances.push_back(instance);
+		}
+		mRitemLayer[prop.Layer].push_back(ritem.get());
+		mAllRitems.push_back(std::move(ritem));
+	}
 
-	sphereRitem5->IndexCount = sphereRitem5->Geo->DrawArgs["sphere"].IndexCount;
+	const CastleLayout::Placement water = CastleLayout::WaterPlacement();
+	auto wavesRitem = NewRenderItem();
+	mScene.World(wavesRitem->Node) = water.World;
+	mScene.TexTransform(wavesRitem->Node) = water.TexTransform;
+	mScene.Material(wavesRitem->Node) = material(CastleLayout::Water);
+	wavesRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	SetSubmesh(wavesRitem.get(), mSubmeshes.Find("waterGeo/grid"));
+	mWavesRitem = wavesRitem.get();
+	mRitemLayer[(int)RenderLayer::Transparent].push_back(wavesRitem.get());
+	mAllRitems.push_back(std::move(wavesRitem));
 
-	sphereRitem5->StartIndexLocation = sphereRitem5->Geo->DrawArgs["sphere"].StartIndexLocation;
+	auto treeSpritesRitem = NewRenderItem();
+	mScene.World(treeSpritesRitem->Node) = MathHelper::Identity4x4();
+	mScene.Material(treeSpritesRitem->Node) = material(CastleLayout::TreeSprites);
+	treeSpritesRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_POINTLIST;
+	SetSubmesh(treeSpritesRitem.get(), mSubmeshes.Find("treeSpritesGeo/points"));
+	mRitemLayer[(int)RenderLayer::AlphaTestedTreeSprites].push_back(treeSpritesRitem.get());
+	mAllRitems.push_back(std::move(treeSpritesRitem));
 
-	sphereRitem5->BaseVertexLocation = sphereRitem5->Geo->DrawArgs["sphere"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(sphereRitem5.get());
-	mAllRitems.push_back(std::move(sphereRitem5));
+	for (const auto& placement : CastleLayout::OutsideWalls())
+	{
+		auto outsideBox = NewRenderItem();
+		mScene.World(outsideBox->Node) = placement.World;
+		mScene.TexTransform(outsideBox->Node) = placement.TexTransform;
+		mScene.Material(outsideBox->Node) = material(CastleLayout::Bricks);
+		outsideBox->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		SetSubmesh(outsideBox.get(), shapeMesh("box"));
+		outsideBox->Collidable = true;
+		mRitemLayer[(int)RenderLayer::AlphaTested].push_back(outsideBox.get());
+		mAllRitems.push_back(std::move(outsideBox));
+	}
 
+	// Maze wall chunks are streamed in already in world space.  They all point at
+	// this item's identity constants; the item itself is never drawn.
+	auto chunkBaseRitem = NewRenderItem();
+	mScene.Material(chunkBaseRitem->Node) = material(CastleLayout::Bricks);
+	mChunkBaseRitem = chunkBaseRitem.get();
+	mAllRitems.push_back(std::move(chunkBaseRitem));
 
-	auto prismRitem6 = std::make_unique<RenderItem>();
+	// Place the attached parts before anything reads their world matrices.
+	UpdateTransforms();
 
-	XMStoreFloat4x4(&prismRitem6->World, XMMatrixRotationRollPitchYaw(0.0f, 0.5f, 0.0f) * XMMatrixScaling(2.0f, 5.0f, 2.0f) * XMMatrixTranslation(0.0f, 2.5f, -17.0f));
+	// Object cbuffer slots follow the item order.
+	for (size_t i = 0; i < mAllRitems.size(); ++i)
+		mAllRitems[i]->ObjCBIndex = (UINT)i;
 
-	prismRitem6->ObjCBIndex = 25;
+	// Start in the second column of the last maze row.
+	if (mTileMap.RowCount() > 0)
+	{
+		XMFLOAT3 start = mTileMap.CellCenter(mTileMap.RowCount() - 1, 1);
+		mCamera.SetPosition(start.x + 10.0f, 1, start.z);
+		mCamera.RotateY(-1.5708);
+	}
+	
 
-	prismRitem6->Geo = mGeometries["shapeGeo"].get();
-	prismRitem6->Mat = mMaterials["prism0"].get();
-	prismRitem6->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+}
 
-	prismRitem6->IndexCount = prismRitem6->Geo->DrawArgs["prism"].IndexCount;
+void CastleDesign::BuildStaticBatches()
+{
+	// Nothing in the opaque and alpha tested layers moves after startup, so bake
+	// those items into one world-space mesh per (layer, material).  The originals
+	// stay in mAllRitems (collision still reads their bounds) but are not drawn.
+	const RenderLayer layers[] = { RenderLayer::Opaque, RenderLayer::AlphaTested };
 
-	prismRitem6->StartIndexLocation = prismRitem6->Geo->DrawArgs["prism"].StartIndexLocation;
+	StaticBatcher<Vertex> batcher;
+	for (RenderLayer layer : layers)
+	{
+		std::vector<RenderItem*> unbatched;
+		for (RenderItem* ri : mRitemLayer[(int)layer])
+		{
+			MeshGeometry* geo = mGeometries[GeometryHandle(mScene.Geometry(ri->Node))].get();
+			if (!ri->Instances.empty() || ri->PrimitiveType != D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST ||
+				geo->VertexBufferCPU == nullptr || geo->IndexBufferCPU == nullptr)
+			{
+				unbatched.push_back(ri);
+				continue;
+			}
 
-	prismRitem6->BaseVertexLocation = prismRitem6->Geo->DrawArgs["prism"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(prismRitem6.get());
-	mAllRitems.push_back(std::move(prismRitem6));
+			StaticBatcher<Vertex>::Item item;
+			item.Layer = (int)layer;
+			item.MaterialIndex = (int)mScene.Material(ri->Node);
+			item.Vertices = static_cast<const Vertex*>(geo->VertexBufferCPU->GetBufferPointer());
+			if (geo->IndexFormat == DXGI_FORMAT_R16_UINT)
+				item.Indices16 = static_cast<const std::uint16_t*>(geo->IndexBufferCPU->GetBufferPointer());
+			else
+				item.Indices32 = static_cast<const std::uint32_t*>(geo->IndexBufferCPU->GetBufferPointer());
+			item.IndexCount = ri->IndexCount;
+			item.StartIndexLocation = ri->StartIndexLocation;
+			item.BaseVertexLocation = ri->BaseVertexLocation;
+			item.World = mScene.World(ri->Node);
+			item.TexTransform = mScene.TexTransform(ri->Node);
+			item.UserData = ri;
+			batcher.Add(item);
+		}
 
+		mRitemLayer[(int)layer] = unbatched;
+	}
 
-	auto sphereRitem6 = std::make_unique<RenderItem>();
+	std::vector<StaticBatcher<Vertex>::Batch> batches;
+	batcher.Build(batches);
 
-	XMStoreFloat4x4(&sphereRitem6->World, XMMatrixScaling(1.0f, 1.0f, 1.0f) * XMMatrixTranslation(0.0f, 5.0f, -17.0f));
+	for (size_t i = 0; i < batches.size(); ++i)
+	{
+		auto& batch = batches[i];
 
-	sphereRitem6->ObjCBIndex = 26;
+		const UINT vbByteSize = (UINT)batch.Vertices.size() * sizeof(Vertex);
+		const UINT ibByteSize = (UINT)batch.Indices.size() * sizeof(std::uint32_t);
 
-	sphereRitem6->Geo = mGeometries["shapeGeo"].get();
-	sphereRitem6->Mat = mMaterials["glass0"].get();
-	sphereRitem6->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		auto geo = std::make_unique<MeshGeometry>();
+		geo->Name = "staticBatch" + std::to_string(i);
 
-	sphereRitem6->IndexCount = sphereRitem6->Geo->DrawArgs["sphere"].IndexCount;
+		ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
+		CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), batch.Vertices.data(), vbByteSize);
 
-	sphereRitem6->StartIndexLocation = sphereRitem6->Geo->DrawArgs["sphere"].StartIndexLocation;
+		ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
+		CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), batch.Indices.data(), ibByteSize);
 
-	sphereRitem6->BaseVertexLocation = sphereRitem6->Geo->DrawArgs["sphere"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(sphereRitem6.get());
-	mAllRitems.push_back(std::move(sphereRitem6));
-	//****************************************************
+		geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+			mCommandList.Get(), batch.Vertices.data(), vbByteSize, geo->VertexBufferUploader);
 
-	//Wall stuff for front
-	//****************************************************
-	auto boxRitem7 = std::make_unique<RenderItem>();
+		geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+			mCommandList.Get(), batch.Indices.data(), ibByteSize, geo->IndexBufferUploader);
 
-	XMStoreFloat4x4(&boxRitem7->World, XMMatrixScaling(1.0f, 5.0f, 6.5f) * XMMatrixTranslation(12.0f, 2.5f, 4.5f));
+		geo->VertexByteStride = sizeof(Vertex);
+		geo->VertexBufferByteSize = vbByteSize;
+		geo->IndexFormat = DXGI_FORMAT_R32_UINT;
+		geo->IndexBufferByteSize = ibByteSize;
 
-	boxRitem7->ObjCBIndex = 27;
+		SubmeshGeometry whole;
+		whole.IndexCount = (UINT)batch.Indices.size();
+		whole.StartIndexLocation = 0;
+		whole.BaseVertexLocation = 0;
+		whole.Bounds = batch.Bounds;
+		geo->DrawArgs["batch"] = whole;
 
-	boxRitem7->Geo = mGeometries["shapeGeo"].get();
-	boxRitem7->Mat = mMaterials["bricks0"].get();
-	boxRitem7->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		// Keep each source item's slice so the batch can be culled piecewise.
+		for (size_t j = 0; j < batch.Ranges.size(); ++j)
+		{
+			SubmeshGeometry submesh;
+			submesh.IndexCount = batch.Ranges[j].IndexCount;
+			submesh.StartIndexLocation = batch.Ranges[j].StartIndexLocation;
+			submesh.BaseVertexLocation = 0;
+			submesh.Bounds = batch.Ranges[j].Bounds;
+			geo->DrawArgs["item" + std::to_string(j)] = submesh;
+		}
 
-	boxRitem7->IndexCount = boxRitem7->Geo->DrawArgs["box"].IndexCount;
+		const std::string name = geo->Name;
+		AddGeometry(name, std::move(geo));
 
-	boxRitem7->StartIndexLocation = boxRitem7->Geo->DrawArgs["box"].StartIndexLocation;
+		auto batchRitem = NewRenderItem();
+		batchRitem->ObjCBIndex = (UINT)mAllRitems.size();
+		mScene.Material(batchRitem->Node) = (UINT)batch.MaterialIndex;
+		batchRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		SetSubmesh(batchRitem.get(), mSubmeshes.Find(name + "/batch"));
+		mRitemLayer[batch.Layer].push_back(batchRitem.get());
+		mAllRitems.push_back(std::move(batchRitem));
+	}
 
-	boxRitem7->BaseVertexLocation = boxRitem7->Geo->DrawArgs["box"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(boxRitem7.get());
-	mAllRitems.push_back(std::move(boxRitem7));
+	std::string msg = "Static batching: " + std::to_string(batcher.ItemCount()) + " items in " +
+		std::to_string(batches.size()) + " draws\n";
+	::OutputDebugStringA(msg.c_str());
+}
 
+void CastleDesign::BuildCollisionGrid()
+{
+	// Line the cells up with the maze so each wall box lands in the cells it covers.
+	mCollisionGrid.Reset(mTileMap.CellSize(), mTileMap.OriginX(), mTileMap.OriginZ());
 
-	auto boxRitem8 = std::make_unique<RenderItem>();
+	for (auto& e : mAllRitems)
+	{
+		if (e->Collidable)
+			mCollisionGrid.Insert(WorldBounds(e.get()));
+	}
+}
 
-	XMStoreFloat4x4(&boxRitem8->World, XMMatrixScaling(1.0f, 5.0f, 6.5f) * XMMatrixTranslation(12.0f, 2.5f, -4.5f));
+void CastleDesign::BuildCullingData()
+{
+	mStaticBvh.Clear();
+	mBvhRitems.clear();
+	mOcclusion.ClearOccluders();
 
-	boxRitem8->ObjCBIndex = 28;
+	for (int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+	{
+		for (auto ri : mRitemLayer[layer])
+		{
+			// Items take their bounds from the submesh they draw; whatever is
+			// still empty is never culled.
+			BoundingBox& bounds = mScene.Bounds(ri->Node);
+			if (bounds.Extents.x == 0.0f && bounds.Extents.y == 0.0f && bounds.Extents.z == 0.0f)
+				bounds.Extents = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
 
-	boxRitem8->Geo = mGeometries["shapeGeo"].get();
-	boxRitem8->Mat = mMaterials["bricks0"].get();
-	boxRitem8->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+			ri->BvhSlot = mStaticBvh.Add(WorldBounds(ri), layer);
 
-	boxRitem8->IndexCount = boxRitem8->Geo->DrawArgs["box"].IndexCount;
+			// Solid castle walls hide what is behind them.
+			if (ri->Collidable)
+				mOcclusion.AddOccluder(WorldBounds(ri));
 
-	boxRitem8->StartIndexLocation = boxRitem8->Geo->DrawArgs["box"].StartIndexLocation;
+			if (ri->BvhSlot >= (int)mBvhRitems.size())
+				mBvhRitems.resize(ri->BvhSlot + 1, nullptr);
+			mBvhRitems[ri->BvhSlot] = ri;
+		}
+	}
+}
 
-	boxRitem8->BaseVertexLocation = boxRitem8->Geo->DrawArgs["box"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(boxRitem8.get());
-	mAllRitems.push_back(std::move(boxRitem8));
+BoundingBox CastleDesign::WorldBounds(RenderItem* ri)const
+{
+	const BoundingBox& bounds = mScene.Bounds(ri->Node);
+	if (bounds.Extents.x == FLT_MAX)
+		return bounds;
 
+	BoundingBox world;
+	if (ri->Instances.empty())
+	{
+		bounds.Transform(world, XMLoadFloat4x4(&mScene.World(ri->Node)));
+		return world;
+	}
 
-	auto cylinderRitem3 = std::make_unique<RenderItem>();
+	// Instanced items cover every copy; the copies are culled one by one later.
+	bounds.Transform(world, XMLoadFloat4x4(&ri->Instances[0].World));
+	for (size_t i = 1; i < ri->Instances.size(); ++i)
+	{
+		BoundingBox instance;
+		bounds.Transform(instance, XMLoadFloat4x4(&ri->Instances[i].World));
+		BoundingBox::CreateMerged(world, world, instance);
+	}
+	return world;
+}
 
-	XMStoreFloat4x4(&cylinderRitem3->World, XMMatrixScaling(0.1f, 4.0f, 0.1f) * XMMatrixRotationRollPitchYaw(0.0f, 0.0f, 0.785398f) * XMMatrixTranslation(13.5f, 1.5f, -1.0f));
+void CastleDesign::CullRenderItems()
+{
+	for (int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+		mVisibleRitems[layer].clear();
 
-	cylinderRitem3->ObjCBIndex = 29;
+	if (!mFrustumCullingEnabled)
+	{
+		for (int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+			mVisibleRitems[layer] = mRitemLayer[layer];
+		return;
+	}
 
-	cylinderRitem3->Geo = mGeometries["shapeGeo"].get();
-	cylinderRitem3->Mat = mMaterials["rope0"].get();
-	cylinderRitem3->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	XMFLOAT4X4 viewProj;
+	XMStoreFloat4x4(&viewProj, XMMatrixMultiply(mCamera.GetView(), mCamera.GetProj()));
 
-	cylinderRitem3->IndexCount = cylinderRitem3->Geo->DrawArgs["cylinder"].IndexCount;
+	XMFLOAT4 planes[6];
+	FrustumCuller::ExtractPlanes(viewProj, planes);
 
-	cylinderRitem3->StartIndexLocation = cylinderRitem3->Geo->DrawArgs["cylinder"].StartIndexLocation;
+	// Static items first, in the order they were built, then the streamed chunks.
+	mStaticBvh.Cull(planes, mVisibleSlots);
+	for (int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+	{
+		for (std::uint32_t slot : mVisibleSlots[layer])
+			mVisibleRitems[layer].push_back(mBvhRitems[slot]);
+	}
 
-	cylinderRitem3->BaseVertexLocation = cylinderRitem3->Geo->DrawArgs["cylinder"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(cylinderRitem3.get());
-	mAllRitems.push_back(std::move(cylinderRitem3));
+	mCuller.Cull(planes, mVisibleSlots, (int)RenderLayer::Count);
+	for (int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+	{
+		for (std::uint32_t slot : mVisibleSlots[layer])
+			mVisibleRitems[layer].push_back(mCullRitems[slot]);
+	}
 
+	if (!mOcclusionCullingEnabled)
+		return;
 
-	auto cylinderRitem4 = std::make_unique<RenderItem>();
+	mOcclusion.Render(viewProj);
 
-	XMStoreFloat4x4(&cylinderRitem4->World, XMMatrixScaling(0.1f, 4.0f, 0.1f) * XMMatrixRotationRollPitchYaw(0.0f, 0.0f, 0.785398f) * XMMatrixTranslation(13.5f, 1.5f, 1.0f));
+	// Instanced items are tested copy by copy later, and unbounded ones always
+	// draw.
+	for (int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+	{
+		auto& visible = mVisibleRitems[layer];
+		visible.erase(std::remove_if(visible.begin(), visible.end(), [this](RenderItem* ri)
+		{
+			const BoundingBox& bounds = mScene.WorldBounds(ri->Node);
+			if (!ri->Instances.empty() || bounds.Extents.x == FLT_MAX)
+				return false;
+			return !mOcclusion.IsVisible(bounds, ri->CullSlot);
+		}), visible.end());
+	}
+}
 
-	cylinderRitem4->ObjCBIndex = 30;
+void CastleDesign::UpdateTileChunks()
+{
+	// Free the buffers of evicted chunks once no frame in flight can use them.
+	const UINT64 completed = mFence->GetCompletedValue();
+	mRetiredChunkGeos.erase(std::remove_if(mRetiredChunkGeos.begin(), mRetiredChunkGeos.end(),
+		[completed](const std::pair<UINT64, std::unique_ptr<MeshGeometry>>& r) { return r.first <= completed; }),
+		mRetiredChunkGeos.end());
 
-	cylinderRitem4->Geo = mGeometries["shapeGeo"].get();
-	cylinderRitem4->Mat = mMaterials["rope0"].get();
-	cylinderRitem4->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	if (mTileMap.RowCount() == 0)
+		return;
 
-	cylinderRitem4->IndexCount = cylinderRitem4->Geo->DrawArgs["cylinder"].IndexCount;
+	XMFLOAT3 pos = mCamera.GetPosition3f();
 
-	cylinderRitem4->StartIndexLocation = cylinderRitem4->Geo->DrawArgs["cylinder"].StartIndexLocation;
+	std::vector<TileChunkStreamer::Key> evicted;
+	mChunkStreamer.Update(mTileMap, pos.x, pos.z, evicted);
 
-	cylinderRitem4->BaseVertexLocation = cylinderRitem4->Geo->DrawArgs["cylinder"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(cylinderRitem4.get());
-	mAllRitems.push_back(std::move(cylinderRitem4));
-	//****************************************************
+	for (auto& chunk : evicted)
+		ReleaseTileChunk(TileChunkStreamer::Pack(chunk));
 
-	//Eye/Torus
-	//****************************************************
-	auto torusRitem = std::make_unique<RenderItem>();
+	// Collect a finished navigation job and send out the edits made since.
+	if (mNavJob.valid() && mNavJob.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+	{
+		mNavJob.get();
+		mPvsStale = !mPendingNavEdits.empty();
+	}
 
-	XMStoreFloat4x4(&torusRitem->World, XMMatrixScaling(2.0f, 1.0f, 2.0f) * XMMatrixRotationRollPitchYaw(0.0f, 1.5708f, 0.0f) * XMMatrixTranslation(0.0f, 17.5f, 0.0f));
+	if (!mNavJob.valid() && !mPendingNavEdits.empty())
+	{
+		std::vector<TileEdit> edits;
+		edits.swap(mPendingNavEdits);
 
-	torusRitem->ObjCBIndex = 31;
+		mNavJob = std::async(std::launch::async, [this, edits]()
+		{
+			// One cell at a time; the repairs expect a single change per call.
+			for (const TileEdit& e : edits)
+			{
+				mNavMap.Set(e.Row, e.Col, e.Tile);
+				mNavFields.OnTileChanged(mNavMap, e.Row, e.Col);
+				mPathfinder.OnTileChanged(mNavMap, e.Row, e.Col);
+			}
 
-	torusRitem->Geo = mGeometries["shapeGeo"].get();
-	torusRitem->Mat = mMaterials["Torus0"].get();
-	torusRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+			// Visibility has no incremental update; one edit can open a long view.
+			mPvs.Build(mNavMap);
+		});
+	}
+}
 
-	torusRitem->IndexCount = torusRitem->Geo->DrawArgs["torus"].IndexCount;
+void CastleDesign::SetTile(int row, int col, TileMap::Tile tile)
+{
+	if (!mTileMap.InBounds(row, col) || mTileMap.Get(row, col) == tile)
+		return;
 
-	torusRitem->StartIndexLocation = torusRitem->Geo->DrawArgs["torus"].StartIndexLocation;
+	mTileMap.Set(row, col, tile);
 
-	torusRitem->BaseVertexLocation = torusRitem->Geo->DrawArgs["torus"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(torusRitem.get());
-	mAllRitems.push_back(std::move(torusRitem));
+	// Only the loaded chunks that see the cell are re-meshed.  Their current mesh
+	// and collision boxes stay in use until UploadTileChunks swaps in the new ones.
+	mChunkStreamer.Invalidate(mTileMap, row, col);
 
+	TileEdit edit;
+	edit.Row = row;
+	edit.Col = col;
+	edit.Tile = tile;
+	mPendingNavEdits.push_back(edit);
 
-	auto diamondRitem5 = std::make_unique<RenderItem>();
+	mPvsStale = true;
+	mPortals.OnTileChanged(mTileMap, row, col);
+}
 
-	XMStoreFloat4x4(&diamondRitem5->World, XMMatrixScaling(0.5f, 1.0f, 0.5f) * XMMatrixTranslation(0.0f, 18.0f, 0.0f));
+void CastleDesign::UpdateTileChunkVisibility()
+{
+	// The sets only hold while the camera stands in an open maze cell below the
+	// top of the walls.
+	XMFLOAT3 pos = mCamera.GetPosition3f();
+
+	int row, col;
+	int set = -1;
+	if (mFrustumCullingEnabled && !mPvsStale && pos.y < mTileMap.WallHeight() &&
+		mTileMap.WorldToCell(pos.x, pos.z, row, col))
+	{
+		set = mPvs.SetOf(row, col);
+	}
 
-	diamondRitem5->ObjCBIndex = 32;
+	mPvsActive = set >= 0;
+	if (mPvsActive && set != mPvsSet)
+		mPvs.Expand(set, mPvsBits);
+	mPvsSet = set;
 
-	diamondRitem5->Geo = mGeometries["shapeGeo"].get();
-	diamondRitem5->Mat = mMaterials["glass0"].get();
-	diamondRitem5->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	
-	diamondRitem5->IndexCount = diamondRitem5->Geo->DrawArgs["diamond"].IndexCount;
+	// The portal walk needs the frustum's horizontal spread around the look
+	// direction.  Pitching widens it, so measure it from the frustum's corner rays.
+	mPortalsActive = false;
+	if (mFrustumCullingEnabled && pos.y < mTileMap.WallHeight())
+	{
+		XMFLOAT3 right = mCamera.GetRight3f();
+		XMFLOAT3 up = mCamera.GetUp3f();
+		XMFLOAT3 look = mCamera.GetLook3f();
 
-	diamondRitem5->StartIndexLocation = diamondRitem5->Geo->DrawArgs["diamond"].StartIndexLocation;
+		float forwardLength = sqrtf(look.x * look.x + look.z * look.z);
+		float halfX = tanf(0.5f * mCamera.GetFovX());
+		float halfY = tanf(0.5f * mCamera.GetFovY());
 
-	diamondRitem5->BaseVertexLocation = diamondRitem5->Geo->DrawArgs["diamond"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(diamondRitem5.get());
+		float halfAngle = 0.0f;
+		bool inFront = forwardLength > 1e-3f;
+		for (int i = 0; i < 4 && inFront; ++i)
+		{
+			float sx = (i & 1) ? halfX : -halfX;
+			float sy = (i & 2) ? halfY : -halfY;
+			float dx = right.x * sx + up.x * sy + look.x;
+			float dz = right.z * sx + up.z * sy + look.z;
+
+			float along = (dx * look.x + dz * look.z) / forwardLength;
+			float across = (dz * look.x - dx * look.z) / forwardLength;
+			inFront = along > 0.0f;
+			halfAngle = std::max(halfAngle, fabsf(atan2f(across, along)));
+		}
 
-	mAllRitems.push_back(std::move(diamondRitem5));
+		if (inFront)
+			mPortalsActive = mPortals.Collect(mTileMap, pos.x, pos.z, look.x, look.z, halfAngle, mPortalBits);
+	}
 
-	
-	UINT objCBIndex = 33;
-	for (float i = -6.0f; i <= 6.0f; i += 2.0f)
+	for (auto& chunk : mStreamedChunks)
 	{
-		auto smallboxRitem = std::make_unique<RenderItem>();
-
-		XMStoreFloat4x4(&smallboxRitem->World, XMMatrixTranslation(12.0f, 5.5f, i));
+		TileChunkStreamer::Key key;
+		key.Row = (int)(chunk.first >> 32);
+		key.Col = (int)(chunk.first & 0xffffffff);
+		chunk.second.Ritem->Visible = TileChunkVisible(key);
+	}
+}
 
-		smallboxRitem->ObjCBIndex = objCBIndex++;
+bool CastleDesign::TileChunkVisible(const TileChunkStreamer::Key& chunk)const
+{
+	if (!mPvsActive && !mPortalsActive)
+		return true;
 
-		smallboxRitem->Geo = mGeometries["shapeGeo"].get();
-		smallboxRitem->Mat = mMaterials["bricks0"].get();
-		smallboxRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	// A cell counts when every active test lets it through.
+	TileMapMesher::Region region = mChunkStreamer.ChunkRegion(mTileMap, chunk);
+	for (int r = region.Row0; r < region.Row0 + region.Rows; ++r)
+	{
+		for (int c = region.Col0; c < region.Col0 + region.Cols; ++c)
+		{
+			int index = r * mTileMap.ColumnCount() + c;
+			if ((!mPvsActive || TileMapPvs::Test(mPvsBits, index)) &&
+				(!mPortalsActive || TileMapPvs::Test(mPortalBits, index)))
+				return true;
+		}
+	}
 
-		smallboxRitem->IndexCount = smallboxRitem->Geo->DrawArgs["box"].IndexCount;
+	return false;
+}
 
-		smallboxRitem->StartIndexLocation = smallboxRitem->Geo->DrawArgs["box"].StartIndexLocation;
+void CastleDesign::UploadTileChunks()
+{
+	// Needs mCommandList open; the copies run with the rest of the frame.
+	std::vector<std::unique_ptr<TileChunkStreamer::ChunkMesh>> ready;
+	mChunkStreamer.TakeReady(ready);
 
-		smallboxRitem->BaseVertexLocation = smallboxRitem->Geo->DrawArgs["box"].BaseVertexLocation;
-		mRitemLayer[(int)RenderLayer::AlphaTested].push_back(smallboxRitem.get());
-		mAllRitems.push_back(std::move(smallboxRitem));
-	}
-	objCBIndex = 40;
-	for (float i = -6.0f; i <= 6.0f; i += 2.0f)
+	for (auto& chunk : ready)
 	{
-		auto smallboxRitem2 = std::make_unique<RenderItem>();
+		const std::uint64_t key = TileChunkStreamer::Pack(chunk->Chunk);
+		ReleaseTileChunk(key);
 
-		XMStoreFloat4x4(&smallboxRitem2->World, XMMatrixScaling(1.0f, 1.0f, 1.0f) * XMMatrixRotationRollPitchYaw(0.0f, 1.0472f, 0.0f) * XMMatrixTranslation(6.0f + (i * sinf(1.0472f)), 5.5f, -11.0f + (i * cosf(1.0472f))));
+		TileMapMesher::Output& walls = chunk->Mesh;
+		if (walls.Mesh.Indices32.empty())
+			continue;
 
-		smallboxRitem2->ObjCBIndex = objCBIndex++;
-
-		smallboxRitem2->Geo = mGeometries["shapeGeo"].get();
-		smallboxRitem2->Mat = mMaterials["bricks0"].get();
-		smallboxRitem2->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-
-		smallboxRitem2->IndexCount = smallboxRitem2->Geo->DrawArgs["box"].IndexCount;
+		std::vector<Vertex> vertices(walls.Mesh.Vertices.size());
+		for (size_t i = 0; i < walls.Mesh.Vertices.size(); ++i)
+		{
+			vertices[i].Pos = walls.Mesh.Vertices[i].Position;
+			vertices[i].Normal = walls.Mesh.Vertices[i].Normal;
+			vertices[i].TexC = walls.Mesh.Vertices[i].TexC;
+		}
 
-		smallboxRitem2->StartIndexLocation = smallboxRitem2->Geo->DrawArgs["box"].StartIndexLocation;
+		// Big chunks can pass 64K vertices, so these buffers use 32-bit indices.
+		std::vector<std::uint32_t>& indices = walls.Mesh.Indices32;
+
+		const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
+		const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint32_t);
+
+		StreamedChunk streamed;
+		auto chunkGeo = std::make_unique<MeshGeometry>();
+		MeshGeometry* geo = chunkGeo.get();
+		geo->Name = "tileChunk" + std::to_string(chunk->Chunk.Row) + "_" + std::to_string(chunk->Chunk.Col);
+
+		geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+			mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
+
+		geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+			mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+
+		geo->VertexByteStride = sizeof(Vertex);
+		geo->VertexBufferByteSize = vbByteSize;
+		geo->IndexFormat = DXGI_FORMAT_R32_UINT;
+		geo->IndexBufferByteSize = ibByteSize;
+
+		SubmeshGeometry submesh;
+		submesh.IndexCount = (UINT)indices.size();
+		submesh.StartIndexLocation = 0;
+		submesh.BaseVertexLocation = 0;
+		submesh.Bounds = walls.Bounds;
+
+		geo->DrawArgs["walls"] = submesh;
+
+		// Chunks are drawn whole, so their draw range is not registered.
+		streamed.Geo = mGeometries.Add(geo->Name, std::move(chunkGeo));
+
+		streamed.Ritem = NewRenderItem();
+		RenderItem* ritem = streamed.Ritem.get();
+		ritem->ObjCBIndex = mChunkBaseRitem->ObjCBIndex;
+		mScene.Geometry(ritem->Node) = streamed.Geo.Index;
+		mScene.Material(ritem->Node) = mScene.Material(mChunkBaseRitem->Node);
+		ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		ritem->IndexCount = submesh.IndexCount;
+		ritem->StartIndexLocation = submesh.StartIndexLocation;
+		ritem->BaseVertexLocation = submesh.BaseVertexLocation;
+		// Identity world, so the local bounds are the world bounds.
+		mScene.Bounds(ritem->Node) = submesh.Bounds;
+		mScene.WorldBounds(ritem->Node) = submesh.Bounds;
+		ritem->Visible = TileChunkVisible(chunk->Chunk);
+		mRitemLayer[(int)RenderLayer::AlphaTested].push_back(ritem);
+
+		ritem->CullSlot = mCuller.Add(submesh.Bounds, (int)RenderLayer::AlphaTested);
+		if (ritem->CullSlot >= (int)mCullRitems.size())
+			mCullRitems.resize(ritem->CullSlot + 1, nullptr);
+		mCullRitems[ritem->CullSlot] = ritem;
+
+		// The boxes are owned by the chunk's cull slot, so its own walls never hide it.
+		for (auto& box : walls.Boxes)
+		{
+			streamed.CollisionBoxes.push_back(mCollisionGrid.Insert(box));
+			streamed.Occluders.push_back(mOcclusion.AddOccluder(box, ritem->CullSlot));
+		}
 
-		smallboxRitem2->BaseVertexLocation = smallboxRitem2->Geo->DrawArgs["box"].BaseVertexLocation;
-		mRitemLayer[(int)RenderLayer::AlphaTested].push_back(smallboxRitem2.get());
-		mAllRitems.push_back(std::move(smallboxRitem2));
+		mStreamedChunks[key] = std::move(streamed);
 	}
-	objCBIndex = 41;
-	for (float i = -6.0f; i <= 6.0f; i += 2.0f)
-	{
-		auto smallboxRitem2 = std::make_unique<RenderItem>();
+}
 
-		XMStoreFloat4x4(&smallboxRitem2->World, XMMatrixScaling(1.0f, 1.0f, 1.0f) * XMMatrixRotationRollPitchYaw(0.0f, -1.0472f, 0.0f) * XMMatrixTranslation(-6.0f + (i * sinf(-1.0472f)), 5.5f, -11.0f + (i * cosf(-1.0472f))));
+void CastleDesign::ReleaseTileChunk(std::uint64_t key)
+{
+	auto it = mStreamedChunks.find(key);
+	if (it == mStreamedChunks.end())
+		return;
 
-		smallboxRitem2->ObjCBIndex = objCBIndex++;
+	auto& layer = mRitemLayer[(int)RenderLayer::AlphaTested];
+	layer.erase(std::remove(layer.begin(), layer.end(), it->second.Ritem.get()), layer.end());
 
-		smallboxRitem2->Geo = mGeometries["shapeGeo"].get();
-		smallboxRitem2->Mat = mMaterials["bricks0"].get();
-		smallboxRitem2->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	mCuller.Remove(it->second.Ritem->CullSlot);
+	mCullRitems[it->second.Ritem->CullSlot] = nullptr;
+	mScene.Destroy(it->second.Ritem->Node);
 
-		smallboxRitem2->IndexCount = smallboxRitem2->Geo->DrawArgs["box"].IndexCount;
+	for (int box : it->second.CollisionBoxes)
+		mCollisionGrid.Remove(box);
+	for (int occluder : it->second.Occluders)
+		mOcclusion.RemoveOccluder(occluder);
 
-		smallboxRitem2->StartIndexLocation = smallboxRitem2->Geo->DrawArgs["box"].StartIndexLocation;
+	// Frames up to mCurrentFence may still draw from these buffers.
+	mRetiredChunkGeos.push_back(std::make_pair(mCurrentFence, mGeometries.Remove(it->second.Geo)));
+	mStreamedChunks.erase(it);
+}
 
-		smallboxRitem2->BaseVertexLocation = smallboxRitem2->Geo->DrawArgs["box"].BaseVertexLocation;
-		mRitemLayer[(int)RenderLayer::AlphaTested].push_back(smallboxRitem2.get());
-		mAllRitems.push_back(std::move(smallboxRitem2));
-	}
-	objCBIndex = 48;
-	for (float i = -6.0f; i <= 6.0f; i += 2.0f)
+void CastleDesign::QueueRenderItems()
+{
+	// Passes in draw order; a pass is a DrawQueue pipeline.  Blended items go
+	// last and farthest first.
+	static const RenderLayer passLayers[] =
 	{
-		auto smallboxRitem2 = std::make_unique<RenderItem>();
-
-		XMStoreFloat4x4(&smallboxRitem2->World, XMMatrixScaling(1.0f, 1.0f, 1.0f) * XMMatrixTranslation(-12.0f, 5.5f, i));
-
-		smallboxRitem2->ObjCBIndex = objCBIndex++;
-
-		smallboxRitem2->Geo = mGeometries["shapeGeo"].get();
-		smallboxRitem2->Mat = mMaterials["bricks0"].get();
-		smallboxRitem2->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		RenderLayer::Opaque,
+		RenderLayer::InstancedOpaque,
+		RenderLayer::AlphaTested,
+		RenderLayer::InstancedAlphaTested,
+		RenderLayer::AlphaTestedTreeSprites,
+		RenderLayer::Transparent
+	};
+	const int passCount = _countof(passLayers);
 
-		smallboxRitem2->IndexCount = smallboxRitem2->Geo->DrawArgs["box"].IndexCount;
+	XMFLOAT3 eye = mCamera.GetPosition3f();
+	XMFLOAT3 look = mCamera.GetLook3f();
 
-		smallboxRitem2->StartIndexLocation = smallboxRitem2->Geo->DrawArgs["box"].StartIndexLocation;
+	mDrawQueue.SetBackToFront(passCount - 1, true);
+	mDrawQueue.Clear();
+	mDrawItems.clear();
 
-		smallboxRitem2->BaseVertexLocation = smallboxRitem2->Geo->DrawArgs["box"].BaseVertexLocation;
-		mRitemLayer[(int)RenderLayer::AlphaTested].push_back(smallboxRitem2.get());
-		mAllRitems.push_back(std::move(smallboxRitem2));
-	}
-	objCBIndex = 55;
-	for (float i = -6.0f; i <= 6.0f; i += 2.0f)
+	for (int pass = 0; pass < passCount; ++pass)
 	{
-		auto smallboxRitem2 = std::make_unique<RenderItem>();
-
-		XMStoreFloat4x4(&smallboxRitem2->World, XMMatrixScaling(1.0f, 1.0f, 1.0f) * XMMatrixRotationRollPitchYaw(0.0f, 1.0472f, 0.0f) * XMMatrixTranslation(-6.0f + (i * sinf(1.0472f)), 5.5f, 11.0f + (i * cosf(1.0472f))));
-
-		smallboxRitem2->ObjCBIndex = objCBIndex++;
+		for (auto ri : mVisibleRitems[(int)passLayers[pass]])
+		{
+			// Hidden chunks, and instanced items with every copy culled.
+			if (!ri->Visible || (!ri->Instances.empty() && ri->InstanceCount == 0))
+				continue;
 
-		smallboxRitem2->Geo = mGeometries["shapeGeo"].get();
-		smallboxRitem2->Mat = mMaterials["bricks0"].get();
-		smallboxRitem2->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+			const std::uint32_t node = mScene.Index(ri->Node);
 
-		smallboxRitem2->IndexCount = smallboxRitem2->Geo->DrawArgs["box"].IndexCount;
+			DrawQueue::State state;
+			state.Pipeline = pass;
+			state.Geometry = (int)mScene.Geometries()[node];
+			state.Material = (int)mScene.Materials()[node];
+			state.Topology = (int)ri->PrimitiveType;
 
-		smallboxRitem2->StartIndexLocation = smallboxRitem2->Geo->DrawArgs["box"].StartIndexLocation;
+			// Distance along the view direction to the middle of the item.
+			XMFLOAT3 center;
+			XMStoreFloat3(&center, XMVector3TransformCoord(XMLoadFloat3(&mScene.BoundsArray()[node].Center), XMLoadFloat4x4(&mScene.Worlds()[node])));
+			float depth = (center.x - eye.x) * look.x + (center.y - eye.y) * look.y + (center.z - eye.z) * look.z;
 
-		smallboxRitem2->BaseVertexLocation = smallboxRitem2->Geo->DrawArgs["box"].BaseVertexLocation;
-		mRitemLayer[(int)RenderLayer::AlphaTested].push_back(smallboxRitem2.get());
-		mAllRitems.push_back(std::move(smallboxRitem2));
+			mDrawQueue.Add(state, depth, (std::uint32_t)mDrawItems.size());
+			mDrawItems.push_back(ri);
+		}
 	}
-	objCBIndex = 62;
-	for (float i = -6.0f; i <= 6.0f; i += 2.0f)
-	{
-		auto smallboxRitem2 = std::make_unique<RenderItem>();
-
-		XMStoreFloat4x4(&smallboxRitem2->World, XMMatrixScaling(1.0f, 1.0f, 1.0f) * XMMatrixRotationRollPitchYaw(0.0f, -1.0472f, 0.0f) * XMMatrixTranslation(6.0f + (i * sinf(-1.0472f)), 5.5f, 11.0f + (i * cosf(-1.0472f))));
-
-		smallboxRitem2->ObjCBIndex = objCBIndex++;
 
-		smallboxRitem2->Geo = mGeometries["shapeGeo"].get();
-		smallboxRitem2->Mat = mMaterials["bricks0"].get();
-		smallboxRitem2->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	mDrawQueue.Sort();
+}
 
-		smallboxRitem2->IndexCount = smallboxRitem2->Geo->DrawArgs["box"].IndexCount;
+void CastleDesign::Begin(int list)
+{
+	auto& cmdListAlloc = mCurrFrameResource->RecordAllocs[list];
+	auto& cmdList = mCurrFrameResource->RecordLists[list];
 
-		smallboxRitem2->StartIndexLocation = smallboxRitem2->Geo->DrawArgs["box"].StartIndexLocation;
+	// The frame resource's fence has passed, so its lists are free to reuse.
+	ThrowIfFailed(cmdListAlloc->Reset());
+	ThrowIfFailed(cmdList->Reset(cmdListAlloc.Get(), mPassPSOs[0]));
 
-		smallboxRitem2->BaseVertexLocation = smallboxRitem2->Geo->DrawArgs["box"].BaseVertexLocation;
-		mRitemLayer[(int)RenderLayer::AlphaTested].push_back(smallboxRitem2.get());
-		mAllRitems.push_back(std::move(smallboxRitem2));
-	}
+	// A command list starts with no state; every list sets up the pass again.
+	cmdList->RSSetViewports(1, &mScreenViewport);
+	cmdList->RSSetScissorRects(1, &mScissorRect);
 
+	cmdList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, &DepthStencilView());
 
-	++objCBIndex;
-	auto wavesRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&wavesRitem->World, XMMatrixScaling(2.5f, 0.6f, 2.5f)* XMMatrixTranslation(20.0f, -3.0f, 0.0f));
+	ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvDescriptorHeap.Get() };
+	cmdList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
 
-	XMStoreFloat4x4(&wavesRitem->TexTransform, XMMatrixScaling(7.0f, 7.0f, 1.0f));
-	wavesRitem->ObjCBIndex = objCBIndex;
-	wavesRitem->Mat = mMaterials["water"].get();
-	wavesRitem->Geo = mGeometries["waterGeo"].get();
-	wavesRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	wavesRitem->IndexCount = wavesRitem->Geo->DrawArgs["grid"].IndexCount;
-	wavesRitem->StartIndexLocation = wavesRitem->Geo->DrawArgs["grid"].StartIndexLocation;
-	wavesRitem->BaseVertexLocation = wavesRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
+	cmdList->SetGraphicsRootSignature(mRootSignature.Get());
 
-	mWavesRitem = wavesRitem.get();
+	cmdList->SetGraphicsRootConstantBufferView(2, mCurrFrameResource->PassCBAddress);
 
+	// Draws find their object, material and instances through the object index.
+	cmdList->SetGraphicsRootShaderResourceView(3, mCurrFrameResource->MaterialBuffer->Resource()->GetGPUVirtualAddress());
+	if (mCurrFrameResource->InstanceAddress != 0)
+		cmdList->SetGraphicsRootShaderResourceView(4, mCurrFrameResource->InstanceAddress);
+	cmdList->SetGraphicsRootShaderResourceView(5, mCurrFrameResource->ObjectBuffer->Resource()->GetGPUVirtualAddress());
+}
 
-	mRitemLayer[(int)RenderLayer::Transparent].push_back(wavesRitem.get());
+void CastleDesign::Record(int list, std::uint32_t item, const DrawQueue::State& state, unsigned changes)
+{
+	ID3D12GraphicsCommandList* cmdList = mCurrFrameResource->RecordLists[list].Get();
+	RenderItem* ri = mDrawItems[item];
 
-	++objCBIndex;
-	auto treeSpritesRitem = std::make_unique<RenderItem>();
-	treeSpritesRitem->World = MathHelper::Identity4x4();
-	treeSpritesRitem->ObjCBIndex = objCBIndex;
-	treeSpritesRitem->Mat = mMaterials["treeSprites"].get();
-	treeSpritesRitem->Geo = mGeometries["treeSpritesGeo"].get();
-	//step2
-	treeSpritesRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_POINTLIST;
-	treeSpritesRitem->IndexCount = treeSpritesRitem->Geo->DrawArgs["points"].IndexCount;
-	treeSpritesRitem->StartIndexLocation = treeSpritesRitem->Geo->DrawArgs["points"].StartIndexLocation;
-	treeSpritesRitem->BaseVertexLocation = treeSpritesRitem->Geo->DrawArgs["points"].BaseVertexLocation;
+	BindDrawState(cmdList, ri, state, changes);
 
-	mRitemLayer[(int)RenderLayer::AlphaTestedTreeSprites].push_back(treeSpritesRitem.get());
-	mAllRitems.push_back(std::move(wavesRitem));
-	mAllRitems.push_back(std::move(treeSpritesRitem));
-	
-	++objCBIndex;
-	auto coneRitem2 = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&coneRitem2->World, XMMatrixScaling(0.7f, 7.5f, 2.5f)* XMMatrixRotationRollPitchYaw(0.0f, 1.5708f, 0.0f)* XMMatrixTranslation(0.0f, 15.5f, -3.0f));
-	coneRitem2->ObjCBIndex = objCBIndex;
-	coneRitem2->Geo = mGeometries["shapeGeo"].get();
-	coneRitem2->Mat = mMaterials["roof0"].get();
-	coneRitem2->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	coneRitem2->IndexCount = coneRitem2->Geo->DrawArgs["cone"].IndexCount;
-	coneRitem2->StartIndexLocation = coneRitem2->Geo->DrawArgs["cone"].StartIndexLocation;
-	coneRitem2->BaseVertexLocation = coneRitem2->Geo->DrawArgs["cone"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(coneRitem2.get());
-	mAllRitems.push_back(std::move(coneRitem2));
-
-
-	// Catsle wall top boxies
-	++objCBIndex;
-	for (auto i = 0; i < 4; ++i)
-	{
-		auto outsideBox = std::make_unique<RenderItem>();
-		switch (i)
-		{
-		case 0:
-			XMStoreFloat4x4(&outsideBox->World, XMMatrixScaling(1.0f, 6.0f, 80.0f) * XMMatrixTranslation(-20.0f, -3.01f, 0.0f));
-			XMStoreFloat4x4(&outsideBox->TexTransform, XMMatrixScaling(15.0f, 1.0f, 1.0f));
-			break;
-		case 1:
-			XMStoreFloat4x4(&outsideBox->World, XMMatrixScaling(95.0f, 6.0f, 10.0f) * XMMatrixTranslation(65.0f, -3.01f, 0.0f));
-			XMStoreFloat4x4(&outsideBox->TexTransform, XMMatrixScaling(15.0f, 1.0f, 1.0f));
-			break;
-		case 2:
-			XMStoreFloat4x4(&outsideBox->World, XMMatrixScaling(100.0f, 7.5f, 1.0f) * XMMatrixTranslation(66.0f, -3.01f, 5.0f));
-			XMStoreFloat4x4(&outsideBox->TexTransform, XMMatrixScaling(15.0f, 0.5f, 1.0f));
-			break;
-		case 3:
-			XMStoreFloat4x4(&outsideBox->World, XMMatrixScaling(100.0f, 7.5f, 1.0f) * XMMatrixTranslation(66.0f, -3.01f, -5.0f));
-			XMStoreFloat4x4(&outsideBox->TexTransform, XMMatrixScaling(15.0f, 0.5f, 1.0f));
-			break;
-		}
-		
-		
-		outsideBox->ObjCBIndex = objCBIndex++;
+	cmdList->SetGraphicsRoot32BitConstant(1, ri->ObjCBIndex, 0);
 
-		outsideBox->Geo = mGeometries["shapeGeo"].get();
-		outsideBox->Mat = mMaterials["bricks0"].get();
-		outsideBox->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		outsideBox->IndexCount = outsideBox->Geo->DrawArgs["box"].IndexCount;
-		
-		outsideBox->Bounds = outsideBox->Geo->DrawArgs["box"].Bounds;
-		XMMATRIX temp = XMLoadFloat4x4(&outsideBox->World);
-		outsideBox->Bounds.Transform(outsideBox->Bounds, temp);
-		
-		outsideBox->StartIndexLocation = outsideBox->Geo->DrawArgs["box"].StartIndexLocation;
-		outsideBox->BaseVertexLocation = outsideBox->Geo->DrawArgs["box"].BaseVertexLocation;
-		mRitemLayer[(int)RenderLayer::AlphaTested].push_back(outsideBox.get());
-		mAllRitems.push_back(std::move(outsideBox));
+	if (!ri->Instances.empty())
+	{
+		cmdList->DrawIndexedInstanced(ri->IndexCount, ri->InstanceCount, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+		return;
 	}
 
+	cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+}
 
+void CastleDesign::BindDrawState(ID3D12GraphicsCommandList* cmdList, const RenderItem* ri, const DrawQueue::State& state, unsigned changes)
+{
+	// Only what differs from the previous draw in this list is bound again.
+	if (changes & DrawQueue::PipelineChange)
+		cmdList->SetPipelineState(mPassPSOs[state.Pipeline]);
 
-	XMMatrixRotationRollPitchYaw(0.0f, 1.0472f, 0.0f);
-
-	auto door = std::make_unique<RenderItem>();
-
-	XMStoreFloat4x4(&door->World, XMMatrixScaling(3.0f, 0.5f, 2.5f)* XMMatrixTranslation(13.5f, 0.0f, 0.0f));
-
-	door->ObjCBIndex = objCBIndex;
+	if (changes & DrawQueue::GeometryChange)
+	{
+		// The waves vertices are rewritten into the upload ring every frame.
+		MeshGeometry* geo = mGeometries[GeometryHandle((std::uint32_t)state.Geometry)].get();
+		D3D12_VERTEX_BUFFER_VIEW vbv = state.Geometry == (int)mWavesGeo.Index ?
+			mCurrFrameResource->WavesVBView : geo->VertexBufferView();
+		cmdList->IASetVertexBuffers(0, 1, &vbv);
+		cmdList->IASetIndexBuffer(&geo->IndexBufferView());
+	}
 
-	door->Geo = mGeometries["shapeGeo"].get();
-	door->Mat = mMaterials["wirefence"].get();
-	door->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	if (changes & DrawQueue::TopologyChange)
+		cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
 
-	door->IndexCount = door->Geo->DrawArgs["box"].IndexCount;
+	if (changes & DrawQueue::MaterialChange)
+	{
+		CD3DX12_GPU_DESCRIPTOR_HANDLE tex(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+		tex.Offset(mMaterials[MaterialHandle((std::uint32_t)state.Material)]->DiffuseSrvHeapIndex, mCbvSrvDescriptorSize);
 
-	door->StartIndexLocation = door->Geo->DrawArgs["box"].StartIndexLocation;
+		cmdList->SetGraphicsRootDescriptorTable(0, tex);
+	}
+}
 
-	door->BaseVertexLocation = door->Geo->DrawArgs["box"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(door.get());
-	mAllRitems.push_back(std::move(door));
+void CastleDesign::End(int list)
+{
+	auto& cmdList = mCurrFrameResource->RecordLists[list];
 
-    
-	for (auto row = 0; row < tileMapWidth; ++row)
+	// The last list runs last on the GPU, so it hands the back buffer back.
+	if (list == mRecordListCount - 1)
 	{
-		for (auto col = 0; col < tileMapHeight; ++col)
-		{
-			if(tilemap[row][col] != '0')
-				++objCBIndex;
-			TileMapDrawing(tilemap[row][col], row*4, 0, col*4, objCBIndex);
-			if (row == 39 && col == 1)
-			{
-				mCamera.SetPosition(124.0f + row * 4, 1, col * 4 - 34.0f);
-				mCamera.RotateY(-1.5708);
-			}
-		}
+		cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
+			D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
 	}
-	
 
+	ThrowIfFailed(cmdList->Close());
 }
 
-void CastleDesign::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
+void CastleDesign::DrawRenderItemsIndirect()
 {
-    UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
-    UINT matCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
-
-	auto objectCB = mCurrFrameResource->ObjectCB->Resource();
-	auto matCB = mCurrFrameResource->MaterialCB->Resource();
-
-    // For each render item...
-    for(size_t i = 0; i < ritems.size(); ++i)
-    {
-        auto ri = ritems[i];
-
-        cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
-        cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
-		//step3
-        cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
-
-		CD3DX12_GPU_DESCRIPTOR_HANDLE tex(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-		tex.Offset(ri->Mat->DiffuseSrvHeapIndex, mCbvSrvDescriptorSize);
+	const std::uint32_t drawCount = (std::uint32_t)mDrawQueue.Count();
+
+	// The commands are built straight into the mapped upload heap, which stays
+	// in GENERIC_READ and so can be read as indirect arguments.
+	UploadRing::Allocation commands = mUploadRing->Allocate(
+		std::max<std::uint64_t>(drawCount, 1) * sizeof(IndirectDrawCommand), sizeof(IndirectDrawCommand));
+	mIndirectBuilder.Build(mDrawQueue, *this, static_cast<IndirectDrawCommand*>(commands.Cpu),
+		gNumRecordLists, gMinDrawsPerRecordList);
+	ID3D12Resource* commandBuffer = mUploadHeaps[commands.Heap].Get();
+
+	// One list; Begin binds the pass, each batch its own state.
+	mRecordListCount = 1;
+	Begin(0);
+	ID3D12GraphicsCommandList* cmdList = mCurrFrameResource->RecordLists[0].Get();
+
+	mDrawStats = DrawQueue::Stats();
+	mDrawStats.Draws = (int)drawCount;
+	const DrawQueue::State* prev = nullptr;
+	for (const IndirectDrawBatch& batch : mIndirectBuilder.Batches())
+	{
+		// Batches break on every state change, so this is never zero after
+		// the first.
+		const DrawQueue::State& state = batch.State;
+		unsigned changes = DrawQueue::AllChanges;
+		if (prev != nullptr)
+		{
+			changes = 0;
+			if (state.Pipeline != prev->Pipeline) changes |= DrawQueue::PipelineChange;
+			if (state.Geometry != prev->Geometry) changes |= DrawQueue::GeometryChange;
+			if (state.Material != prev->Material) changes |= DrawQueue::MaterialChange;
+			if (state.Topology != prev->Topology) changes |= DrawQueue::TopologyChange;
+		}
+		prev = &state;
 
-        D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB->GetGPUVirtualAddress() + ri->ObjCBIndex*objCBByteSize;
-		D3D12_GPU_VIRTUAL_ADDRESS matCBAddress = matCB->GetGPUVirtualAddress() + ri->Mat->MatCBIndex*matCBByteSize;
+		if (changes & DrawQueue::PipelineChange) ++mDrawStats.PipelineChanges;
+		if (changes & DrawQueue::GeometryChange) ++mDrawStats.GeometryChanges;
+		if (changes & DrawQueue::MaterialChange) ++mDrawStats.MaterialChanges;
+		if (changes & DrawQueue::TopologyChange) ++mDrawStats.TopologyChanges;
 
-		cmdList->SetGraphicsRootDescriptorTable(0, tex);
-        cmdList->SetGraphicsRootConstantBufferView(1, objCBAddress);
-        cmdList->SetGraphicsRootConstantBufferView(3, matCBAddress);
+		BindDrawState(cmdList, mDrawItems[batch.FirstItem], state, changes);
+		cmdList->ExecuteIndirect(mDrawCommandSignature.Get(), batch.CommandCount, commandBuffer,
+			commands.Offset + (UINT64)batch.FirstCommand * sizeof(IndirectDrawCommand), nullptr, 0);
+	}
 
-        cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
-    }
+	End(0);
 }
 
-void CastleDesign::TileMapDrawing(char key, float offsetX, float offsetY, float offsetZ, int index)
+void CastleDesign::Fill(std::uint32_t item, const DrawQueue::State& /*state*/, IndirectDrawCommand& command)const
 {
-	
-	char a = key;
-	switch (a)
-	{
-	case '0':
-		break;
-	case '1':
-		auto boxRitem = std::make_unique<RenderItem>();
-
-		XMStoreFloat4x4(&boxRitem->World, XMMatrixScaling(4.0f, 10.0f, 4.0f) *
-			XMMatrixTranslation(114.0f + offsetX, 5.0f + offsetY, offsetZ -34.0f));
-
-		boxRitem->ObjCBIndex = index;
-
-		boxRitem->Geo = mGeometries["shapeGeo"].get();
-		boxRitem->Mat = mMaterials["bricks0"].get();
-		boxRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		boxRitem->IndexCount = boxRitem->Geo->DrawArgs["box"].IndexCount;
-		boxRitem->Bounds = boxRitem->Geo->DrawArgs["box"].Bounds;
-		XMMATRIX temp = XMLoadFloat4x4(&boxRitem->World);
-		boxRitem->Bounds.Transform(boxRitem->Bounds, temp);
-		boxRitem->StartIndexLocation = boxRitem->Geo->DrawArgs["box"].StartIndexLocation;
-
-		boxRitem->BaseVertexLocation = boxRitem->Geo->DrawArgs["box"].BaseVertexLocation;
-		mRitemLayer[(int)RenderLayer::AlphaTested].push_back(boxRitem.get());
-		mAllRitems.push_back(std::move(boxRitem));
-		break;
-	}
+	const RenderItem* ri = mDrawItems[item];
+
+	command.ObjectIndex = ri->ObjCBIndex;
+	command.IndexCountPerInstance = ri->IndexCount;
+	command.InstanceCount = ri->Instances.empty() ? 1 : ri->InstanceCount;
+	command.StartIndexLocation = ri->StartIndexLocation;
+	command.BaseVertexLocation = ri->BaseVertexLocation;
+	command.StartInstanceLocation = 0;
 }
 
 std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> CastleDesign::GetStaticSamplers()
@@ -0,0 +1,675 @@
+//***************************************************************************************
+// OcclusionBuffer.cpp
+//***************************************************************************************
+
+#include "OcclusionBuffer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <future>
+#include <thread>
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define OCCLUSION_BUFFER_SSE 1
+#include <emmintrin.h>
+#endif
+
+using namespace DirectX;
+
+namespace
+{
+	struct ClipVertex
+	{
+		float X, Y, Z, W;
+	};
+
+	// Corners are numbered like BoundingBox::GetCorners: bit 0 picks +x, bit 1
+	// +y and bit 2 +z.  Each face is listed clockwise as seen from outside.
+	const int BoxFaces[6][4] =
+	{
+		{ 0, 2, 3, 1 },	// -z
+		{ 5, 7, 6, 4 },	// +z
+		{ 4, 6, 2, 0 },	// -x
+		{ 1, 3, 7, 5 },	// +x
+		{ 1, 5, 4, 0 },	// -y
+		{ 2, 6, 7, 3 },	// +y
+	};
+
+	void BoxCorners(const BoundingBox& box, const XMFLOAT4X4& m, ClipVertex corners[8])
+	{
+		for(int i = 0; i < 8; ++i)
+		{
+			const float x = box.Center.x + ((i & 1) ? box.Extents.x : -box.Extents.x);
+			const float y = box.Center.y + ((i & 2) ? box.Extents.y : -box.Extents.y);
+			const float z = box.Center.z + ((i & 4) ? box.Extents.z : -box.Extents.z);
+
+			corners[i].X = x * m._11 + y * m._21 + z * m._31 + m._41;
+			corners[i].Y = x * m._12 + y * m._22 + z * m._32 + m._42;
+			corners[i].Z = x * m._13 + y * m._23 + z * m._33 + m._43;
+			corners[i].W = x * m._14 + y * m._24 + z * m._34 + m._44;
+		}
+	}
+
+	// Narrows [first, last] to the pixels of one row whose centres may pass all
+	// three edge tests, e = row + a * (x - ex) >= 0.  'first' must not be
+	// negative.  Rounding is generous; the per-pixel test settles the ends.
+	bool RowSpan(const float row[3], const float a[3], const float ex[3], int& first, int& last)
+	{
+		float lo = (float)first;
+		float hi = (float)last + 1.0f;
+		for(int k = 0; k < 3; ++k)
+		{
+			if(a[k] > 0.0f)
+				lo = std::max(lo, ex[k] - row[k] / a[k] - 0.5f);
+			else if(a[k] < 0.0f)
+				hi = std::min(hi, ex[k] - row[k] / a[k] - 0.5f);
+			else if(row[k] < 0.0f)
+				return false;
+		}
+
+		if(lo > hi)
+			return false;
+
+		// Both are at least 'first', so truncating rounds down.
+		first = (int)lo;
+		last = std::min(last, (int)hi + 1);
+		return first <= last;
+	}
+}
+
+const int OcclusionBuffer::TileWidth;
+const int OcclusionBuffer::TileHeight;
+
+OcclusionBuffer::OcclusionBuffer(int width, int height, int threadCount)
+	: mViewProj(1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f)
+{
+	mTilesX = std::max(1, (width + TileWidth - 1) / TileWidth);
+	mTilesY = std::max(1, (height + TileHeight - 1) / TileHeight);
+	mWidth = mTilesX * TileWidth;
+	mHeight = mTilesY * TileHeight;
+
+	int w = mWidth;
+	int h = mHeight;
+	for(;;)
+	{
+		Level level;
+		level.Width = w;
+		level.Height = h;
+		level.Depth.assign(w * h, 1.0f);
+		mLevels.push_back(std::move(level));
+
+		if(w == 1 && h == 1)
+			break;
+		w = (w + 1) / 2;
+		h = (h + 1) / 2;
+	}
+
+	mOwners.assign(mWidth * mHeight, -1);
+
+	SetThreadCount(threadCount);
+}
+
+void OcclusionBuffer::SetThreadCount(int threadCount)
+{
+	if(threadCount <= 0)
+		threadCount = (int)std::thread::hardware_concurrency();
+	mThreadCount = std::max(1, threadCount);
+
+	mBins.resize(mThreadCount);
+	for(auto& bins : mBins)
+		bins.Tiles.resize(mTilesX * mTilesY);
+}
+
+int OcclusionBuffer::AddOccluder(const BoundingBox& worldBounds, int owner)
+{
+	int slot;
+	if(!mFreeOccluders.empty())
+	{
+		slot = mFreeOccluders.back();
+		mFreeOccluders.pop_back();
+	}
+	else
+	{
+		slot = (int)mOccluders.size();
+		mOccluders.push_back(Occluder());
+	}
+
+	mOccluders[slot].Bounds = worldBounds;
+	mOccluders[slot].Owner = owner;
+	mOccluders[slot].Alive = true;
+
+	return slot;
+}
+
+void OcclusionBuffer::RemoveOccluder(int slot)
+{
+	mOccluders[slot].Alive = false;
+	mFreeOccluders.push_back(slot);
+}
+
+void OcclusionBuffer::ClearOccluders()
+{
+	mOccluders.clear();
+	mFreeOccluders.clear();
+}
+
+template<typename F>
+void OcclusionBuffer::RunWorkers(F f)
+{
+	std::vector<std::future<void>> jobs;
+	for(int worker = 1; worker < mThreadCount; ++worker)
+		jobs.push_back(std::async(std::launch::async, f, worker));
+
+	f(0);
+
+	for(auto& job : jobs)
+		job.wait();
+}
+
+void OcclusionBuffer::Render(const XMFLOAT4X4& viewProj)
+{
+	mViewProj = viewProj;
+
+	for(auto& bins : mBins)
+	{
+		bins.Triangles.clear();
+		for(auto& tile : bins.Tiles)
+			tile.clear();
+	}
+
+	// Occluders go out in small batches so a few big ones don't leave the
+	// other workers idle.
+	const int occluderCount = (int)mOccluders.size();
+	const int batchSize = 16;
+	std::atomic<int> nextOccluder(0);
+
+	RunWorkers([&](int worker)
+	{
+		WorkerBins& bins = mBins[worker];
+		for(;;)
+		{
+			const int first = nextOccluder.fetch_add(batchSize);
+			if(first >= occluderCount)
+				break;
+
+			const int last = std::min(first + batchSize, occluderCount);
+			for(int i = first; i < last; ++i)
+			{
+				if(mOccluders[i].Alive)
+					SetupOccluder(mOccluders[i], viewProj, bins);
+			}
+		}
+	});
+
+	mLastTriangles = 0;
+	mLastBinned = 0;
+	for(const auto& bins : mBins)
+	{
+		mLastTriangles += (int)bins.Triangles.size();
+		for(const auto& tile : bins.Tiles)
+			mLastBinned += (int)tile.size();
+	}
+
+	// Tiles don't overlap, so workers write the depth buffer without locking.
+	const int tileCount = mTilesX * mTilesY;
+	std::atomic<int> nextTile(0);
+
+	RunWorkers([&](int worker)
+	{
+		for(;;)
+		{
+			const int tile = nextTile.fetch_add(1);
+			if(tile >= tileCount)
+				break;
+
+			RasterizeTile(tile, worker);
+		}
+	});
+
+	BuildPyramid();
+}
+
+void OcclusionBuffer::SetupOccluder(const Occluder& occluder, const XMFLOAT4X4& viewProj, WorkerBins& bins)const
+{
+	ClipVertex corners[8];
+	BoxCorners(occluder.Bounds, viewProj, corners);
+
+	// Skip the box when all corners are outside the same clip plane.
+	unsigned outsideAll = 0x3f;
+	for(int i = 0; i < 8; ++i)
+	{
+		const ClipVertex& v = corners[i];
+		unsigned outside = 0;
+		if(v.X < -v.W) outside |= 1;
+		if(v.X > v.W) outside |= 2;
+		if(v.Y < -v.W) outside |= 4;
+		if(v.Y > v.W) outside |= 8;
+		if(v.Z < 0.0f) outside |= 16;
+		if(v.Z > v.W) outside |= 32;
+		outsideAll &= outside;
+	}
+	if(outsideAll != 0)
+		return;
+
+	for(int f = 0; f < 6; ++f)
+	{
+		// Clip the face against the near plane (z >= 0); a quad can gain a corner.
+		ClipVertex poly[5];
+		int count = 0;
+		for(int i = 0; i < 4; ++i)
+		{
+			const ClipVertex& a = corners[BoxFaces[f][i]];
+			const ClipVertex& b = corners[BoxFaces[f][(i + 1) % 4]];
+
+			if(a.Z >= 0.0f)
+				poly[count++] = a;
+
+			if((a.Z >= 0.0f) != (b.Z >= 0.0f))
+			{
+				const float t = a.Z / (a.Z - b.Z);
+				ClipVertex v;
+				v.X = a.X + (b.X - a.X) * t;
+				v.Y = a.Y + (b.Y - a.Y) * t;
+				v.Z = 0.0f;
+				v.W = a.W + (b.W - a.W) * t;
+				poly[count++] = v;
+			}
+		}
+
+		if(count < 3)
+			continue;
+
+		float sx[5], sy[5], sz[5];
+		bool valid = true;
+		for(int i = 0; i < count; ++i)
+		{
+			if(poly[i].W <= 0.0f)
+			{
+				valid = false;
+				break;
+			}
+
+			const float invW = 1.0f / poly[i].W;
+			sx[i] = (poly[i].X * invW * 0.5f + 0.5f) * mWidth;
+			sy[i] = (0.5f - poly[i].Y * invW * 0.5f) * mHeight;
+			sz[i] = poly[i].Z * invW;
+		}
+		if(!valid)
+			continue;
+
+		for(int i = 1; i + 1 < count; ++i)
+		{
+			Triangle tri;
+			tri.Owner = occluder.Owner;
+			const int index[3] = { 0, i, i + 1 };
+			for(int k = 0; k < 3; ++k)
+			{
+				tri.X[k] = sx[index[k]];
+				tri.Y[k] = sy[index[k]];
+				tri.Z[k] = sz[index[k]];
+			}
+
+			// Front faces come out clockwise on screen, which is a positive area
+			// with y pointing down.  Back faces are hidden by the front ones.
+			const float area = (tri.X[1] - tri.X[0]) * (tri.Y[2] - tri.Y[0]) - (tri.X[2] - tri.X[0]) * (tri.Y[1] - tri.Y[0]);
+			if(area <= 0.0f)
+				continue;
+
+			BinTriangle(tri, bins);
+		}
+	}
+}
+
+void OcclusionBuffer::BinTriangle(const Triangle& tri, WorkerBins& bins)const
+{
+	const float minX = std::min(tri.X[0], std::min(tri.X[1], tri.X[2]));
+	const float maxX = std::max(tri.X[0], std::max(tri.X[1], tri.X[2]));
+	const float minY = std::min(tri.Y[0], std::min(tri.Y[1], tri.Y[2]));
+	const float maxY = std::max(tri.Y[0], std::max(tri.Y[1], tri.Y[2]));
+
+	if(maxX < 0.0f || maxY < 0.0f || minX >= (float)mWidth || minY >= (float)mHeight)
+		return;
+
+	const int tx0 = (int)std::max(minX, 0.0f) / TileWidth;
+	const int ty0 = (int)std::max(minY, 0.0f) / TileHeight;
+	const int tx1 = std::min(mTilesX - 1, (int)std::min(maxX, (float)mWidth) / TileWidth);
+	const int ty1 = std::min(mTilesY - 1, (int)std::min(maxY, (float)mHeight) / TileHeight);
+
+	const int index = (int)bins.Triangles.size();
+	bins.Triangles.push_back(tri);
+
+	for(int ty = ty0; ty <= ty1; ++ty)
+	{
+		for(int tx = tx0; tx <= tx1; ++tx)
+			bins.Tiles[ty * mTilesX + tx].push_back(index);
+	}
+}
+
+void OcclusionBuffer::RasterizeTile(int tile, int worker)
+{
+	const int tileX0 = (tile % mTilesX) * TileWidth;
+	const int tileY0 = (tile / mTilesX) * TileHeight;
+
+	float* depth = mLevels[0].Depth.data();
+	int* owners = mOwners.data();
+	for(int y = tileY0; y < tileY0 + TileHeight; ++y)
+	{
+		std::fill(depth + y * mWidth + tileX0, depth + y * mWidth + tileX0 + TileWidth, 1.0f);
+		std::fill(owners + y * mWidth + tileX0, owners + y * mWidth + tileX0 + TileWidth, -1);
+	}
+
+	// Nearest triangles first.  Once one covers the whole tile, the tile is no
+	// farther than that triangle, and any triangle starting behind it changes
+	// nothing; sorted, that means every one left.
+	auto& order = mBins[worker].Order;
+	order.clear();
+	for(const auto& bins : mBins)
+	{
+		for(int index : bins.Tiles[tile])
+		{
+			const Triangle& tri = bins.Triangles[index];
+			order.push_back(std::make_pair(std::min(tri.Z[0], std::min(tri.Z[1], tri.Z[2])), &tri));
+		}
+	}
+
+	std::sort(order.begin(), order.end(),
+		[](const std::pair<float, const Triangle*>& a, const std::pair<float, const Triangle*>& b) { return a.first < b.first; });
+
+	float tileFarthest = 1.0f;
+	for(const auto& entry : order)
+	{
+		if(entry.first >= tileFarthest)
+			break;
+
+		tileFarthest = std::min(tileFarthest, RasterizeTriangle(*entry.second, tileX0, tileY0));
+	}
+}
+
+float OcclusionBuffer::RasterizeTriangle(const Triangle& tri, int tileX0, int tileY0)
+{
+	const float area = (tri.X[1] - tri.X[0]) * (tri.Y[2] - tri.Y[0]) - (tri.X[2] - tri.X[0]) * (tri.Y[1] - tri.Y[0]);
+
+	// Pixels whose centres fall inside the triangle and the tile.
+	const float minX = std::min(tri.X[0], std::min(tri.X[1], tri.X[2]));
+	const float maxX = std::max(tri.X[0], std::max(tri.X[1], tri.X[2]));
+	const float minY = std::min(tri.Y[0], std::min(tri.Y[1], tri.Y[2]));
+	const float maxY = std::max(tri.Y[0], std::max(tri.Y[1], tri.Y[2]));
+
+	// Clamp before converting; clipped triangles can reach far off screen.  The
+	// values are then never negative, so truncating rounds down, which at worst
+	// takes in one pixel too many.
+	const int x0 = (int)std::max(minX - 0.5f, (float)tileX0);
+	const int x1 = (int)std::min(maxX - 0.5f, (float)(tileX0 + TileWidth - 1));
+	const int y0 = (int)std::max(minY - 0.5f, (float)tileY0);
+	const int y1 = (int)std::min(maxY - 0.5f, (float)(tileY0 + TileHeight - 1));
+	if(x0 > x1 || y0 > y1)
+		return 1.0f;
+
+	// Edge k runs from vertex k to vertex k + 1 and is >= 0 on the inner side:
+	// e = A * (x - ax) + B * (y - ay).
+	float edgeA[3], edgeB[3], edgeX[3], edgeY[3];
+	for(int k = 0; k < 3; ++k)
+	{
+		const int n = (k + 1) % 3;
+		edgeA[k] = -(tri.Y[n] - tri.Y[k]);
+		edgeB[k] = tri.X[n] - tri.X[k];
+		edgeX[k] = tri.X[k];
+		edgeY[k] = tri.Y[k];
+	}
+
+	// Depth is affine in screen space: z = z0 + dzdx * (x - x0) + dzdy * (y - y0).
+	const float dzdx = ((tri.Z[1] - tri.Z[0]) * (tri.Y[2] - tri.Y[0]) - (tri.Z[2] - tri.Z[0]) * (tri.Y[1] - tri.Y[0])) / area;
+	const float dzdy = ((tri.Z[2] - tri.Z[0]) * (tri.X[1] - tri.X[0]) - (tri.Z[1] - tri.Z[0]) * (tri.X[2] - tri.X[0])) / area;
+	const float zMin = std::min(tri.Z[0], std::min(tri.Z[1], tri.Z[2]));
+	const float zMax = std::max(tri.Z[0], std::max(tri.Z[1], tri.Z[2]));
+
+	// The triangle is convex, so it covers the tile when it covers the centres
+	// of the tile's corner pixels.  Depth is affine, so the farthest depth it
+	// leaves in the tile is at one of those corners too.
+	float tileFarthest = 0.0f;
+	for(int corner = 0; corner < 4 && tileFarthest < 1.0f; ++corner)
+	{
+		const float cx = (float)tileX0 + ((corner & 1) ? TileWidth - 0.5f : 0.5f);
+		const float cy = (float)tileY0 + ((corner & 2) ? TileHeight - 0.5f : 0.5f);
+
+		for(int k = 0; k < 3; ++k)
+		{
+			if(edgeA[k] * (cx - edgeX[k]) + edgeB[k] * (cy - edgeY[k]) < 0.0f)
+				tileFarthest = 1.0f;
+		}
+
+		const float z = tri.Z[0] + dzdx * (cx - tri.X[0]) + dzdy * (cy - tri.Y[0]);
+		tileFarthest = std::max(tileFarthest, std::min(std::max(z, zMin), zMax));
+	}
+
+	float* depth = mLevels[0].Depth.data();
+	int* owners = mOwners.data();
+
+#if defined(OCCLUSION_BUFFER_SSE)
+	const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 zLo = _mm_set1_ps(zMin);
+	const __m128 zHi = _mm_set1_ps(zMax);
+	const __m128 zStep = _mm_set1_ps(dzdx);
+	const __m128 zX = _mm_set1_ps(tri.X[0]);
+	const __m128i owner = _mm_set1_epi32(tri.Owner);
+
+	__m128 a[3], x[3];
+	for(int k = 0; k < 3; ++k)
+	{
+		a[k] = _mm_set1_ps(edgeA[k]);
+		x[k] = _mm_set1_ps(edgeX[k]);
+	}
+
+	for(int y = y0; y <= y1; ++y)
+	{
+		const float py = (float)y + 0.5f;
+
+		float rowEdge[3];
+		for(int k = 0; k < 3; ++k)
+			rowEdge[k] = edgeB[k] * (py - edgeY[k]);
+
+		int first = x0;
+		int last = x1;
+		if(!RowSpan(rowEdge, edgeA, edgeX, first, last))
+			continue;
+
+		__m128 row[3];
+		for(int k = 0; k < 3; ++k)
+			row[k] = _mm_set1_ps(rowEdge[k]);
+		const __m128 zRow = _mm_set1_ps(tri.Z[0] + dzdy * (py - tri.Y[0]));
+
+		// Groups of four start on a multiple of four; the tile is a whole number
+		// of groups, so the last group never leaves it.
+		float* line = depth + y * mWidth;
+		int* lineOwners = owners + y * mWidth;
+		for(int px = first & ~3; px <= last; px += 4)
+		{
+			const __m128 pxv = _mm_add_ps(_mm_set1_ps((float)px), laneOffsets);
+
+			__m128 inside = _mm_cmpge_ps(_mm_add_ps(row[0], _mm_mul_ps(a[0], _mm_sub_ps(pxv, x[0]))), zero);
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(row[1], _mm_mul_ps(a[1], _mm_sub_ps(pxv, x[1]))), zero));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(row[2], _mm_mul_ps(a[2], _mm_sub_ps(pxv, x[2]))), zero));
+			if(_mm_movemask_ps(inside) == 0)
+				continue;
+
+			__m128 z = _mm_add_ps(zRow, _mm_mul_ps(zStep, _mm_sub_ps(pxv, zX)));
+			z = _mm_min_ps(_mm_max_ps(z, zLo), zHi);
+
+			const __m128 old = _mm_loadu_ps(line + px);
+			const __m128 nearer = _mm_and_ps(inside, _mm_cmplt_ps(z, old));
+			_mm_storeu_ps(line + px, _mm_or_ps(_mm_and_ps(nearer, z), _mm_andnot_ps(nearer, old)));
+
+			__m128i* ownerLanes = (__m128i*)(lineOwners + px);
+			const __m128i ownerMask = _mm_castps_si128(nearer);
+			_mm_storeu_si128(ownerLanes, _mm_or_si128(_mm_and_si128(ownerMask, owner), _mm_andnot_si128(ownerMask, _mm_loadu_si128(ownerLanes))));
+		}
+	}
+#else
+	for(int y = y0; y <= y1; ++y)
+	{
+		const float py = (float)y + 0.5f;
+
+		float row[3];
+		for(int k = 0; k < 3; ++k)
+			row[k] = edgeB[k] * (py - edgeY[k]);
+
+		int first = x0;
+		int last = x1;
+		if(!RowSpan(row, edgeA, edgeX, first, last))
+			continue;
+
+		const float zRow = tri.Z[0] + dzdy * (py - tri.Y[0]);
+
+		float* line = depth + y * mWidth;
+		int* lineOwners = owners + y * mWidth;
+		for(int px = first & ~3; px < (last | 3) + 1; ++px)
+		{
+			const float pxc = (float)px + 0.5f;
+
+			bool inside = true;
+			for(int k = 0; k < 3 && inside; ++k)
+				inside = row[k] + edgeA[k] * (pxc - edgeX[k]) >= 0.0f;
+			if(!inside)
+				continue;
+
+			const float z = std::min(std::max(zRow + dzdx * (pxc - tri.X[0]), zMin), zMax);
+			if(z < line[px])
+			{
+				line[px] = z;
+				lineOwners[px] = tri.Owner;
+			}
+		}
+	}
+#endif
+
+	return tileFarthest;
+}
+
+void OcclusionBuffer::BuildPyramid()
+{
+	for(size_t l = 1; l < mLevels.size(); ++l)
+	{
+		const Level& below = mLevels[l - 1];
+		Level& level = mLevels[l];
+
+		for(int y = 0; y < level.Height; ++y)
+		{
+			const int by0 = 2 * y;
+			const int by1 = std::min(by0 + 1, below.Height - 1);
+
+			for(int x = 0; x < level.Width; ++x)
+			{
+				const int bx0 = 2 * x;
+				const int bx1 = std::min(bx0 + 1, below.Width - 1);
+
+				const float d0 = std::max(below.Depth[by0 * below.Width + bx0], below.Depth[by0 * below.Width + bx1]);
+				const float d1 = std::max(below.Depth[by1 * below.Width + bx0], below.Depth[by1 * below.Width + bx1]);
+				level.Depth[y * level.Width + x] = std::max(d0, d1);
+			}
+		}
+	}
+}
+
+bool OcclusionBuffer::IsVisible(const BoundingBox& worldBounds, int owner)const
+{
+	ClipVertex corners[8];
+	BoxCorners(worldBounds, mViewProj, corners);
+
+	// Screen rectangle and nearest depth of the box.
+	float minX = FLT_MAX, minY = FLT_MAX, minZ = FLT_MAX;
+	float maxX = -FLT_MAX, maxY = -FLT_MAX;
+	for(int i = 0; i < 8; ++i)
+	{
+		const ClipVertex& v = corners[i];
+		if(v.Z < 0.0f || v.W <= 0.0f)
+			return true;
+
+		const float invW = 1.0f / v.W;
+		const float sx = (v.X * invW * 0.5f + 0.5f) * mWidth;
+		const float sy = (0.5f - v.Y * invW * 0.5f) * mHeight;
+
+		minX = std::min(minX, sx);
+		maxX = std::max(maxX, sx);
+		minY = std::min(minY, sy);
+		maxY = std::max(maxY, sy);
+		minZ = std::min(minZ, v.Z * invW);
+	}
+
+	if(maxX < 0.0f || maxY < 0.0f || minX >= (float)mWidth || minY >= (float)mHeight || minZ > 1.0f)
+		return true;
+
+	// Every pixel the rectangle touches, not just those whose centres it covers.
+	int x0 = (int)std::max(minX, 0.0f);
+	int y0 = (int)std::max(minY, 0.0f);
+	int x1 = std::min(mWidth - 1, (int)std::min(maxX, (float)mWidth));
+	int y1 = std::min(mHeight - 1, (int)std::min(maxY, (float)mHeight));
+
+	// Climb until the rectangle spans at most four texels each way.
+	int level = 0;
+	while(level + 1 < (int)mLevels.size() && ((x1 >> level) - (x0 >> level) > 3 || (y1 >> level) - (y0 >> level) > 3))
+		++level;
+
+	const Level& l = mLevels[level];
+	for(int y = y0 >> level; y <= y1 >> level; ++y)
+	{
+		for(int x = x0 >> level; x <= x1 >> level; ++x)
+		{
+			if(minZ <= l.Depth[y * l.Width + x])
+				return true;
+		}
+	}
+
+	// Hidden by the depths; unless some of it is the box's own walls.
+	if(owner < 0)
+		return false;
+
+	for(int y = y0; y <= y1; ++y)
+	{
+		const int* line = mOwners.data() + y * mWidth;
+		if(std::find(line + x0, line + x1 + 1, owner) != line + x1 + 1)
+			return true;
+	}
+
+	return false;
+}
+
+bool OcclusionBuffer::WriteDepthImage(const char* path, int level)const
+{
+	if(level < 0 || level >= (int)mLevels.size())
+		return false;
+
+	const Level& l = mLevels[level];
+
+	float nearest = 1.0f;
+	float farthest = 0.0f;
+	for(float d : l.Depth)
+	{
+		if(d < 1.0f)
+		{
+			nearest = std::min(nearest, d);
+			farthest = std::max(farthest, d);
+		}
+	}
+	const float range = farthest > nearest ? farthest - nearest : 1.0f;
+
+	std::vector<unsigned char> pixels(l.Depth.size());
+	for(size_t i = 0; i < l.Depth.size(); ++i)
+	{
+		const float d = l.Depth[i];
+		pixels[i] = d < 1.0f ? (unsigned char)(255.0f - 223.0f * (d - nearest) / range) : 0;
+	}
+
+	FILE* file = std::fopen(path, "wb");
+	if(file == nullptr)
+		return false;
+
+	std::fprintf(file, "P5\n%d %d\n255\n", l.Width, l.Height);
+	const bool ok = std::fwrite(pixels.data(), 1, pixels.size(), file) == pixels.size();
+	std::fclose(file);
+
+	return ok;
+}
@@ -0,0 +1,153 @@
+//***************************************************************************************
+// OcclusionBuffer.h
+//
+// Coarse CPU depth buffer for occlusion culling.  A handful of large, solid boxes
+// (merged maze walls, castle walls) are rasterized at low resolution, and item
+// bounds are then tested against a max-depth pyramid built over the result; an
+// item whose nearest point is behind every occluder depth it covers is hidden.
+//
+// Rendering runs in two passes over worker threads.  The first transforms and
+// clips the occluders and bins their triangles into screen tiles, each worker
+// into its own bins.  The second hands out tiles, and the worker owning a tile
+// rasterizes every triangle binned to it, four pixels at a time with SSE.
+//
+// Depth follows D3D: 0 at the near plane, 1 at the far plane, cleared to 1.
+//
+// Occluders may name the item they belong to.  Each pixel remembers the owner of
+// its nearest occluder, so an item is never hidden by its own walls: where they
+// are the nearest thing on screen, the item itself is what shows.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+
+class OcclusionBuffer
+{
+public:
+	static const int TileWidth = 32;
+	static const int TileHeight = 16;
+
+	// The size is rounded up to whole tiles.  threadCount 0 picks one per core.
+	OcclusionBuffer(int width = 320, int height = 192, int threadCount = 0);
+
+	void SetThreadCount(int threadCount);
+
+	// Occluders must be solid over the whole box.  'owner' is any non-negative
+	// id of the item the box belongs to, or -1.  Slots of removed boxes are
+	// reused.
+	int AddOccluder(const DirectX::BoundingBox& worldBounds, int owner = -1);
+	void RemoveOccluder(int slot);
+	void ClearOccluders();
+
+	///<summary>
+	/// Clears the buffer, rasterizes every occluder seen through 'viewProj' and
+	/// rebuilds the depth pyramid.
+	///</summary>
+	void Render(const DirectX::XMFLOAT4X4& viewProj);
+
+	///<summary>
+	/// False when 'worldBounds' is hidden behind the occluders of the last Render.
+	/// Boxes crossing the near plane or off screen are always reported visible;
+	/// leaving them out is the frustum test's job.  Safe to call from several
+	/// threads at once.  With an 'owner', the box is also visible wherever an
+	/// occluder of that owner is the nearest one.
+	///</summary>
+	bool IsVisible(const DirectX::BoundingBox& worldBounds, int owner = -1)const;
+
+	///<summary>
+	/// Writes a level of the depth pyramid as a binary PGM, near bright and far
+	/// dark, stretched over the depths actually present.  Cleared texels are
+	/// black.
+	///</summary>
+	bool WriteDepthImage(const char* path, int level = 0)const;
+
+	int Width()const { return mWidth; }
+	int Height()const { return mHeight; }
+	int LevelCount()const { return (int)mLevels.size(); }
+	int OccluderCount()const { return (int)mOccluders.size() - (int)mFreeOccluders.size(); }
+
+	// Depth of texel (x, y) of a pyramid level; level 0 is the full buffer.
+	float Depth(int level, int x, int y)const { return mLevels[level].Depth[y * mLevels[level].Width + x]; }
+	// Owner of the nearest occluder at pixel (x, y), or -1.
+	int Owner(int x, int y)const { return mOwners[y * mWidth + x]; }
+
+	// Counters from the last Render.
+	int LastTriangleCount()const { return mLastTriangles; }
+	int LastBinnedCount()const { return mLastBinned; }
+
+private:
+	struct Occluder
+	{
+		DirectX::BoundingBox Bounds;
+		int Owner = -1;
+		bool Alive = false;
+	};
+
+	// Screen-space triangle: pixel x and y, depth z.
+	struct Triangle
+	{
+		float X[3];
+		float Y[3];
+		float Z[3];
+		int Owner;
+	};
+
+	// What one worker produced in the setup pass.
+	struct WorkerBins
+	{
+		std::vector<Triangle> Triangles;
+		// Per tile, indices into Triangles.
+		std::vector<std::vector<int>> Tiles;
+
+		// Scratch for the tiles this worker rasterizes: nearest depth and
+		// triangle.
+		std::vector<std::pair<float, const Triangle*>> Order;
+	};
+
+	struct Level
+	{
+		int Width = 0;
+		int Height = 0;
+		std::vector<float> Depth;
+	};
+
+	template<typename F>
+	void RunWorkers(F f);
+
+	void SetupOccluder(const Occluder& occluder, const DirectX::XMFLOAT4X4& viewProj, WorkerBins& bins)const;
+	void BinTriangle(const Triangle& tri, WorkerBins& bins)const;
+	void RasterizeTile(int tile, int worker);
+
+	// Returns the farthest depth left in the tile when the triangle covers all
+	// of it, otherwise 1.
+	float RasterizeTriangle(const Triangle& tri, int tileX0, int tileY0);
+	void BuildPyramid();
+
+private:
+	int mWidth = 0;
+	int mHeight = 0;
+	int mTilesX = 0;
+	int mTilesY = 0;
+	int mThreadCount = 1;
+
+	DirectX::XMFLOAT4X4 mViewProj;
+
+	std::vector<Occluder> mOccluders;
+	std::vector<int> mFreeOccluders;
+
+	std::vector<WorkerBins> mBins;
+
+	// Level 0 is the depth buffer itself; each level above keeps the farthest
+	// depth of the 2x2 texels below it.
+	std::vector<Level> mLevels;
+	// Per level 0 pixel, the owner of the nearest occluder.
+	std::vector<int> mOwners;
+
+	int mLastTriangles = 0;
+	int mLastBinned = 0;
+};
@@ -0,0 +1,61 @@
+//***************************************************************************************
+// PackedDataBuffer.cpp
+//***************************************************************************************
+
+#include "PackedDataBuffer.h"
+
+DirtyRanges::DirtyRanges(std::uint32_t mergeGap)
+	: mMergeGap(mergeGap)
+{
+}
+
+void DirtyRanges::Add(std::uint32_t first, std::uint32_t count)
+{
+	if(count == 0)
+		return;
+
+	Range range = { first, first + count };
+
+	// Items are usually updated in index order, which only ever appends to or
+	// extends the last range.
+	if(mRanges.empty() || range.First > mRanges.back().Last + mMergeGap)
+	{
+		mRanges.push_back(range);
+		return;
+	}
+	if(range.First >= mRanges.back().First)
+	{
+		mRanges.back().Last = std::max(mRanges.back().Last, range.Last);
+		return;
+	}
+
+	// Otherwise merge with every range within the gap of the new one.
+	auto begin = std::lower_bound(mRanges.begin(), mRanges.end(), range.First,
+		[this](const Range& r, std::uint32_t value) { return r.Last + mMergeGap < value; });
+	auto end = begin;
+	while(end != mRanges.end() && end->First <= range.Last + mMergeGap)
+	{
+		range.First = std::min(range.First, end->First);
+		range.Last = std::max(range.Last, end->Last);
+		++end;
+	}
+
+	begin = mRanges.erase(begin, end);
+	mRanges.insert(begin, range);
+}
+
+void DirtyRanges::Truncate(std::uint32_t count)
+{
+	while(!mRanges.empty() && mRanges.back().First >= count)
+		mRanges.pop_back();
+	if(!mRanges.empty())
+		mRanges.back().Last = std::min(mRanges.back().Last, count);
+}
+
+std::uint32_t DirtyRanges::ElementCount()const
+{
+	std::uint32_t count = 0;
+	for(const Range& range : mRanges)
+		count += range.Last - range.First;
+	return count;
+}
@@ -0,0 +1,114 @@
+//***************************************************************************************
+// PackedDataBuffer.h
+//
+// Per-object and per-material shader data, packed back to back for a
+// StructuredBuffer instead of one 256 byte constant buffer slot per element.
+//
+// PackedDataBuffer keeps the CPU copy of the elements and, for every frame
+// resource, the element ranges that changed since that frame's buffer was last
+// written.  Set marks an element in all of them at once, so callers no longer
+// count NumFramesDirty down themselves; Upload hands one frame's ranges to a
+// writer and forgets them.  Ranges closer together than the merge gap are
+// joined, trading a few clean elements for fewer copies.
+//***************************************************************************************
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Sorted, non-overlapping [First, Last) element ranges.
+class DirtyRanges
+{
+public:
+	struct Range
+	{
+		std::uint32_t First;
+		std::uint32_t Last;
+	};
+
+	explicit DirtyRanges(std::uint32_t mergeGap = 4);
+
+	// Marks [first, first + count).  Adding in increasing order is O(1).
+	void Add(std::uint32_t first, std::uint32_t count = 1);
+	void Clear() { mRanges.clear(); }
+	// Drops everything at or past 'count'.
+	void Truncate(std::uint32_t count);
+
+	const std::vector<Range>& Ranges()const { return mRanges; }
+	bool Empty()const { return mRanges.empty(); }
+	// Elements covered, including the clean ones merged in.
+	std::uint32_t ElementCount()const;
+
+private:
+	std::uint32_t mMergeGap;
+	std::vector<Range> mRanges;
+};
+
+template<typename T>
+class PackedDataBuffer
+{
+public:
+	static_assert(sizeof(T) % 4 == 0, "structured buffer elements are made of 32 bit values");
+
+	explicit PackedDataBuffer(int frameCount, std::uint32_t mergeGap = 4)
+		: mDirty((std::size_t)std::max(frameCount, 1), DirtyRanges(mergeGap))
+	{
+	}
+
+	// New elements are value-initialized and dirty in every frame; dropped ones
+	// are no longer uploaded.
+	void Resize(std::uint32_t count)
+	{
+		const std::uint32_t old = Count();
+		mElements.resize(count);
+		if(count > old)
+			MarkDirty(old, count - old);
+		else
+			for(auto& frame : mDirty)
+				frame.Truncate(count);
+	}
+
+	void Set(std::uint32_t index, const T& value)
+	{
+		mElements[index] = value;
+		MarkDirty(index, 1);
+	}
+
+	void MarkDirty(std::uint32_t first, std::uint32_t count)
+	{
+		for(auto& frame : mDirty)
+			frame.Add(first, count);
+	}
+
+	const T& operator[](std::uint32_t index)const { return mElements[index]; }
+	std::uint32_t Count()const { return (std::uint32_t)mElements.size(); }
+	std::uint32_t Stride()const { return (std::uint32_t)sizeof(T); }
+	const DirtyRanges& Dirty(int frame)const { return mDirty[frame]; }
+
+	///<summary>
+	/// Calls write(first, elements, count) for each range that changed since
+	/// frame 'frame' was last uploaded, then clears them.  Returns the number of
+	/// elements written.
+	///</summary>
+	template<typename F>
+	std::uint32_t Upload(int frame, F write)
+	{
+		DirtyRanges& dirty = mDirty[frame];
+
+		std::uint32_t written = 0;
+		for(const DirtyRanges::Range& range : dirty.Ranges())
+		{
+			write(range.First, &mElements[range.First], range.Last - range.First);
+			written += range.Last - range.First;
+		}
+
+		dirty.Clear();
+		return written;
+	}
+
+private:
+	std::vector<T> mElements;
+	std::vector<DirtyRanges> mDirty;
+};
@@ -0,0 +1,217 @@
+//***************************************************************************************
+// RenderDevice.cpp
+//***************************************************************************************
+
+#include "RenderDevice.h"
+
+#include "IndirectDrawArgs.h"
+
+#include <cassert>
+#include <cstring>
+
+NullRenderDevice::Stats& NullRenderDevice::Stats::operator+=(const Stats& rhs)
+{
+	Frames += rhs.Frames;
+	BuffersCreated += rhs.BuffersCreated;
+	BuffersReleased += rhs.BuffersReleased;
+	BufferWrites += rhs.BufferWrites;
+	BytesWritten += rhs.BytesWritten;
+	ListsExecuted += rhs.ListsExecuted;
+	Draws += rhs.Draws;
+	Instances += rhs.Instances;
+	Indices += rhs.Indices;
+	Binds += rhs.Binds;
+	IndirectCalls += rhs.IndirectCalls;
+	return *this;
+}
+
+NullRenderDevice::NullRenderDevice(int maxLists)
+	: mLists(maxLists > 0 ? maxLists : 1)
+{
+}
+
+void NullRenderDevice::CreatePipeline(int /*pipeline*/, const PipelineDesc& /*desc*/)
+{
+}
+
+bool NullRenderDevice::CreateTexture(int /*texture*/, const std::string& /*path*/)
+{
+	return true;
+}
+
+bool NullRenderDevice::ValidBuffer(int buffer)const
+{
+	return buffer >= 0 && buffer < (int)mBuffers.size() && mBuffers[buffer].Live;
+}
+
+int NullRenderDevice::CreateBuffer(BufferType type, std::uint32_t stride, std::uint32_t count)
+{
+	int buffer;
+	if(!mFreeBuffers.empty())
+	{
+		buffer = mFreeBuffers.back();
+		mFreeBuffers.pop_back();
+	}
+	else
+	{
+		buffer = (int)mBuffers.size();
+		mBuffers.emplace_back();
+	}
+
+	Buffer& b = mBuffers[buffer];
+	b.Type = type;
+	b.Stride = stride;
+	b.Count = count;
+	b.Data.assign((std::size_t)stride * count, 0);
+	b.Live = true;
+
+	++mFrame.BuffersCreated;
+	return buffer;
+}
+
+void NullRenderDevice::ReleaseBuffer(int buffer)
+{
+	assert(ValidBuffer(buffer));
+
+	Buffer& b = mBuffers[buffer];
+	b.Live = false;
+	std::vector<unsigned char>().swap(b.Data);
+	mFreeBuffers.push_back(buffer);
+
+	++mFrame.BuffersReleased;
+}
+
+void NullRenderDevice::WriteBuffer(int buffer, std::uint32_t first, const void* data, std::uint32_t count)
+{
+	assert(ValidBuffer(buffer));
+
+	Buffer& b = mBuffers[buffer];
+	assert((std::uint64_t)first + count <= b.Count);
+
+	// Copied like a write into a mapped upload heap would be.
+	const std::size_t bytes = (std::size_t)b.Stride * count;
+	std::memcpy(&b.Data[(std::size_t)b.Stride * first], data, bytes);
+
+	++mFrame.BufferWrites;
+	mFrame.BytesWritten += bytes;
+}
+
+std::uint64_t NullRenderDevice::LiveBufferBytes()const
+{
+	std::uint64_t bytes = 0;
+	for(const auto& b : mBuffers)
+		bytes += b.Data.size();
+	return bytes;
+}
+
+void NullRenderDevice::BeginList(int list)
+{
+	List& l = mLists[list];
+	assert(!l.Open && !l.Ended);
+
+	l.Open = true;
+	l.Counts = Stats();
+	l.IndirectCalls.clear();
+}
+
+void NullRenderDevice::SetPipeline(int list, int /*pipeline*/)
+{
+	assert(mLists[list].Open);
+	++mLists[list].Counts.Binds;
+}
+
+void NullRenderDevice::SetGeometry(int list, int vertexBuffer, int indexBuffer, Topology /*topology*/)
+{
+	assert(mLists[list].Open);
+	assert(ValidBuffer(vertexBuffer) && mBuffers[vertexBuffer].Type == BufferType::Vertex);
+	assert(ValidBuffer(indexBuffer) && mBuffers[indexBuffer].Type == BufferType::Index);
+	++mLists[list].Counts.Binds;
+}
+
+void NullRenderDevice::SetTexture(int list, int /*slot*/, int /*texture*/)
+{
+	assert(mLists[list].Open);
+	++mLists[list].Counts.Binds;
+}
+
+void NullRenderDevice::SetBuffer(int list, int /*slot*/, int buffer, std::uint32_t element)
+{
+	assert(mLists[list].Open);
+	assert(ValidBuffer(buffer) && element < mBuffers[buffer].Count);
+	++mLists[list].Counts.Binds;
+}
+
+void NullRenderDevice::SetConstant(int list, int /*slot*/, std::uint32_t /*value*/)
+{
+	assert(mLists[list].Open);
+	++mLists[list].Counts.Binds;
+}
+
+void NullRenderDevice::DrawIndexed(int list, std::uint32_t indexCount, std::uint32_t instanceCount,
+	std::uint32_t /*startIndex*/, int /*baseVertex*/)
+{
+	List& l = mLists[list];
+	assert(l.Open);
+
+	++l.Counts.Draws;
+	l.Counts.Instances += instanceCount;
+	l.Counts.Indices += (std::uint64_t)indexCount * instanceCount;
+}
+
+void NullRenderDevice::DrawIndirect(int list, int argBuffer, std::uint32_t first, std::uint32_t count)
+{
+	List& l = mLists[list];
+	assert(l.Open);
+	assert(ValidBuffer(argBuffer) && mBuffers[argBuffer].Stride == sizeof(IndirectDrawCommand));
+	assert((std::uint64_t)first + count <= mBuffers[argBuffer].Count);
+
+	++l.Counts.IndirectCalls;
+	l.IndirectCalls.push_back({ argBuffer, first, count });
+}
+
+void NullRenderDevice::EndList(int list)
+{
+	List& l = mLists[list];
+	assert(l.Open);
+
+	l.Open = false;
+	l.Ended = true;
+}
+
+void NullRenderDevice::Execute(int count)
+{
+	assert(count <= (int)mLists.size());
+
+	for(int i = 0; i < count; ++i)
+	{
+		List& l = mLists[i];
+		assert(l.Ended);
+
+		mFrame += l.Counts;
+		++mFrame.ListsExecuted;
+
+		for(const IndirectCall& call : l.IndirectCalls)
+		{
+			const Buffer& b = mBuffers[call.Buffer];
+			for(std::uint32_t c = call.First; c < call.First + call.Count; ++c)
+			{
+				IndirectDrawCommand command;
+				std::memcpy(&command, &b.Data[(std::size_t)c * sizeof(command)], sizeof(command));
+
+				++mFrame.Draws;
+				mFrame.Instances += command.InstanceCount;
+				mFrame.Indices += (std::uint64_t)command.IndexCountPerInstance * command.InstanceCount;
+			}
+		}
+		l.Ended = false;
+	}
+}
+
+void NullRenderDevice::Present()
+{
+	++mFrame.Frames;
+
+	mLastFrame = mFrame;
+	mTotal += mFrame;
+	mFrame = Stats();
+}
@@ -0,0 +1,194 @@
+//***************************************************************************************
+// RenderDevice.h
+//
+// The part of a graphics API the per-frame code uses: buffers it fills from the
+// CPU, and draw commands recorded into lists.  Buffers are plain ids; pipelines
+// and textures are ids the caller picks.  Commands name the list they go into,
+// so several lists can be recorded on different threads at once (see
+// RecordDraws); Execute runs lists in order.
+//
+// NullRenderDevice keeps the buffers in memory and only counts the commands, so
+// the frame loop can run, and be timed, without a GPU or a window.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class IRenderDevice
+{
+public:
+	enum class BufferType
+	{
+		Vertex,
+		Index,
+		Constant,
+		Structured,
+		Indirect	// IndirectDrawCommand arguments
+	};
+
+	// Same values as D3D_PRIMITIVE_TOPOLOGY.
+	enum Topology
+	{
+		PointList = 1,
+		TriangleList = 4
+	};
+
+	// The app's shader programs.
+	enum class Shader
+	{
+		Default,	// Default.hlsl
+		Instanced,	// Default.hlsl with INSTANCED
+		TreeSprite	// TreeSprite.hlsl; points are expanded into quads facing the eye
+	};
+
+	// The parts of a PSO that differ between the app's pipelines.
+	struct PipelineDesc
+	{
+		Shader Program = Shader::Default;
+		bool AlphaTest = false;	// ALPHA_TEST
+		bool Fog = true;		// FOG
+		bool Blend = false;		// source alpha over the target
+		bool CullBack = true;	// otherwise both faces are drawn
+	};
+
+	virtual ~IRenderDevice() {}
+
+	// 'pipeline' is the id SetPipeline takes.
+	virtual void CreatePipeline(int pipeline, const PipelineDesc& desc) = 0;
+
+	///<summary>
+	/// Loads a DDS file as 'texture', the id SetTexture takes.  Returns false when
+	/// the file cannot be read or its format is not supported.
+	///</summary>
+	virtual bool CreateTexture(int texture, const std::string& path) = 0;
+
+	// 'stride' is the size of one element in bytes.  Ids of released buffers are
+	// reused.
+	virtual int CreateBuffer(BufferType type, std::uint32_t stride, std::uint32_t count) = 0;
+	virtual void ReleaseBuffer(int buffer) = 0;
+
+	// Copies 'count' elements into 'buffer' starting at element 'first'.
+	virtual void WriteBuffer(int buffer, std::uint32_t first, const void* data, std::uint32_t count) = 0;
+
+	virtual void BeginList(int list) = 0;
+	virtual void SetPipeline(int list, int pipeline) = 0;
+	virtual void SetGeometry(int list, int vertexBuffer, int indexBuffer, Topology topology) = 0;
+	virtual void SetTexture(int list, int slot, int texture) = 0;
+	// Binds 'buffer' from element 'element' on to root parameter 'slot'.
+	virtual void SetBuffer(int list, int slot, int buffer, std::uint32_t element) = 0;
+	// Sets the 32 bit root constant of root parameter 'slot'.
+	virtual void SetConstant(int list, int slot, std::uint32_t value) = 0;
+	virtual void DrawIndexed(int list, std::uint32_t indexCount, std::uint32_t instanceCount,
+		std::uint32_t startIndex, int baseVertex) = 0;
+
+	///<summary>
+	/// ExecuteIndirect over the IndirectDrawCommands [first, first + count) of
+	/// 'argBuffer'.  Each one draws with the bound state, except that its object
+	/// index is the root constant of slot 1.  Like on the GPU, the arguments are
+	/// read when the list runs, not when it is recorded.
+	///</summary>
+	virtual void DrawIndirect(int list, int argBuffer, std::uint32_t first, std::uint32_t count) = 0;
+
+	virtual void EndList(int list) = 0;
+
+	// Runs lists [0, count), which must all be ended, in order.
+	virtual void Execute(int count) = 0;
+
+	// Ends the frame.
+	virtual void Present() = 0;
+};
+
+class NullRenderDevice : public IRenderDevice
+{
+public:
+	struct Stats
+	{
+		int Frames = 0;
+		int BuffersCreated = 0;
+		int BuffersReleased = 0;
+		int BufferWrites = 0;
+		std::uint64_t BytesWritten = 0;
+		int ListsExecuted = 0;
+		int Draws = 0;
+		std::uint64_t Instances = 0;
+		std::uint64_t Indices = 0;
+		int Binds = 0;
+		// DrawIndirect calls; their commands count as draws.
+		int IndirectCalls = 0;
+
+		Stats& operator+=(const Stats& rhs);
+	};
+
+	explicit NullRenderDevice(int maxLists);
+
+	virtual void CreatePipeline(int pipeline, const PipelineDesc& desc)override;
+	// Never opens the file.
+	virtual bool CreateTexture(int texture, const std::string& path)override;
+	virtual int CreateBuffer(BufferType type, std::uint32_t stride, std::uint32_t count)override;
+	virtual void ReleaseBuffer(int buffer)override;
+	virtual void WriteBuffer(int buffer, std::uint32_t first, const void* data, std::uint32_t count)override;
+
+	virtual void BeginList(int list)override;
+	virtual void SetPipeline(int list, int pipeline)override;
+	virtual void SetGeometry(int list, int vertexBuffer, int indexBuffer, Topology topology)override;
+	virtual void SetTexture(int list, int slot, int texture)override;
+	virtual void SetBuffer(int list, int slot, int buffer, std::uint32_t element)override;
+	virtual void SetConstant(int list, int slot, std::uint32_t value)override;
+	virtual void DrawIndexed(int list, std::uint32_t indexCount, std::uint32_t instanceCount,
+		std::uint32_t startIndex, int baseVertex)override;
+	virtual void DrawIndirect(int list, int argBuffer, std::uint32_t first, std::uint32_t count)override;
+	virtual void EndList(int list)override;
+
+	virtual void Execute(int count)override;
+	virtual void Present()override;
+
+	int LiveBufferCount()const { return (int)mBuffers.size() - (int)mFreeBuffers.size(); }
+	std::uint64_t LiveBufferBytes()const;
+
+	// Contents of a buffer, for checking what the frame loop wrote.
+	const std::vector<unsigned char>& BufferData(int buffer)const { return mBuffers[buffer].Data; }
+
+	// Counts of the last presented frame, and of every frame so far.
+	const Stats& LastFrame()const { return mLastFrame; }
+	const Stats& Total()const { return mTotal; }
+
+private:
+	struct Buffer
+	{
+		BufferType Type = BufferType::Vertex;
+		std::uint32_t Stride = 0;
+		std::uint32_t Count = 0;
+		std::vector<unsigned char> Data;
+		bool Live = false;
+	};
+
+	struct IndirectCall
+	{
+		int Buffer;
+		std::uint32_t First;
+		std::uint32_t Count;
+	};
+
+	// Written by one recording thread each; folded into the frame on Execute.
+	struct List
+	{
+		bool Open = false;
+		bool Ended = false;
+		Stats Counts;
+		std::vector<IndirectCall> IndirectCalls;
+	};
+
+	bool ValidBuffer(int buffer)const;
+
+private:
+	std::vector<Buffer> mBuffers;
+	std::vector<int> mFreeBuffers;
+	std::vector<List> mLists;
+
+	Stats mFrame;
+	Stats mLastFrame;
+	Stats mTotal;
+};
@@ -0,0 +1,137 @@
+//***************************************************************************************
+// ResourceRegistry.h
+//
+// Named resources (geometry, materials, textures, pipeline states, submeshes)
+// addressed by small typed handles instead of strings.  A name is hashed once,
+// when the resource is added or looked up at load; from then on the handle is
+// just an index into a vector, so per-frame code never touches a string.
+//
+// Handles are dense and typed by the resource they name, so a material handle
+// cannot be passed where a geometry is expected.  Removed entries free their
+// index for the next Add; indices therefore stay small enough to serve as the
+// geometry and material ids of a DrawQueue.  A registry has no generations; a
+// handle must not be used after its entry is removed.
+//
+// Value defaults to std::unique_ptr<Tag>; resources held some other way (COM
+// pointers, plain structs) name the holder explicitly.
+//***************************************************************************************
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+template<typename Tag>
+struct ResourceHandle
+{
+	static const std::uint32_t InvalidIndex = 0xffffffff;
+
+	ResourceHandle() = default;
+	explicit ResourceHandle(std::uint32_t index) : Index(index) {}
+
+	bool IsValid()const { return Index != InvalidIndex; }
+	bool operator==(const ResourceHandle& rhs)const { return Index == rhs.Index; }
+	bool operator!=(const ResourceHandle& rhs)const { return Index != rhs.Index; }
+
+	std::uint32_t Index = InvalidIndex;
+};
+
+template<typename Tag>
+const std::uint32_t ResourceHandle<Tag>::InvalidIndex;
+
+template<typename Tag, typename Value = std::unique_ptr<Tag>>
+class ResourceRegistry
+{
+public:
+	typedef ResourceHandle<Tag> Handle;
+
+	///<summary>
+	/// Adds 'value' under 'name' and returns its handle.  A name that is already
+	/// registered keeps its handle and has its value replaced.
+	///</summary>
+	Handle Add(const std::string& name, Value value)
+	{
+		assert(!name.empty());
+
+		auto found = mIndices.find(name);
+		if(found != mIndices.end())
+		{
+			mValues[found->second] = std::move(value);
+			return Handle(found->second);
+		}
+
+		std::uint32_t index;
+		if(!mFree.empty())
+		{
+			index = mFree.back();
+			mFree.pop_back();
+			mValues[index] = std::move(value);
+			mNames[index] = name;
+		}
+		else
+		{
+			index = (std::uint32_t)mValues.size();
+			mValues.push_back(std::move(value));
+			mNames.push_back(name);
+		}
+
+		mIndices[name] = index;
+		return Handle(index);
+	}
+
+	// Returns the value so the caller can keep it alive past the entry, as the
+	// GPU may still be reading a removed buffer.
+	Value Remove(Handle handle)
+	{
+		assert(IsValid(handle));
+
+		Value value = std::move(mValues[handle.Index]);
+		mValues[handle.Index] = Value();
+		mIndices.erase(mNames[handle.Index]);
+		mNames[handle.Index].clear();
+		mFree.push_back(handle.Index);
+		return value;
+	}
+
+	// Load-time lookup; returns an invalid handle for unknown names.
+	Handle Find(const std::string& name)const
+	{
+		auto found = mIndices.find(name);
+		return found == mIndices.end() ? Handle() : Handle(found->second);
+	}
+
+	bool IsValid(Handle handle)const
+	{
+		return handle.Index < mValues.size() && !mNames[handle.Index].empty();
+	}
+
+	Value& operator[](Handle handle) { return mValues[handle.Index]; }
+	const Value& operator[](Handle handle)const { return mValues[handle.Index]; }
+	const std::string& Name(Handle handle)const { return mNames[handle.Index]; }
+
+	// Live entries, and one past the highest index handed out.
+	std::uint32_t Count()const { return (std::uint32_t)(mValues.size() - mFree.size()); }
+	std::uint32_t IndexLimit()const { return (std::uint32_t)mValues.size(); }
+
+	// Calls f(handle, value) for every live entry in index order.
+	template<typename F>
+	void ForEach(F f)
+	{
+		for(std::uint32_t i = 0; i < mValues.size(); ++i)
+		{
+			if(!mNames[i].empty())
+				f(Handle(i), mValues[i]);
+		}
+	}
+
+private:
+	std::vector<Value> mValues;
+	std::vector<std::string> mNames;
+	std::vector<std::uint32_t> mFree;
+	std::unordered_map<std::string, std::uint32_t> mIndices;
+};
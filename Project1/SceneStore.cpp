@@ -0,0 +1,130 @@
+//***************************************************************************************
+// SceneStore.cpp
+//***************************************************************************************
+
+#include "SceneStore.h"
+
+using namespace DirectX;
+
+SceneHandle SceneStore::Create()
+{
+	std::uint32_t slot = mFreeSlot;
+	if(slot != 0xffffffff)
+	{
+		mFreeSlot = mSlots[slot].Index;
+	}
+	else
+	{
+		slot = (std::uint32_t)mSlots.size();
+		mSlots.push_back(Slot());
+	}
+
+	mSlots[slot].Index = Count();
+	mSlots[slot].Live = true;
+
+	XMFLOAT4X4 identity;
+	XMStoreFloat4x4(&identity, XMMatrixIdentity());
+
+	// BoundingBox defaults to a unit box; an entry starts with none.
+	BoundingBox empty(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, 0.0f));
+
+	mSlotOf.push_back(slot);
+	mWorld.push_back(identity);
+	mTexTransform.push_back(identity);
+	mBounds.push_back(empty);
+	mWorldBounds.push_back(empty);
+	mMaterial.push_back(0);
+	mGeometry.push_back(0);
+	mDirty.push_back(0);
+
+	SceneHandle handle;
+	handle.Slot = slot;
+	handle.Generation = mSlots[slot].Generation;
+	return handle;
+}
+
+void SceneStore::Destroy(SceneHandle handle)
+{
+	if(!IsValid(handle))
+		return;
+
+	// Move the last entry into the hole.
+	const std::uint32_t index = Index(handle);
+	const std::uint32_t last = Count() - 1;
+	if(index != last)
+	{
+		mSlotOf[index] = mSlotOf[last];
+		mWorld[index] = mWorld[last];
+		mTexTransform[index] = mTexTransform[last];
+		mBounds[index] = mBounds[last];
+		mWorldBounds[index] = mWorldBounds[last];
+		mMaterial[index] = mMaterial[last];
+		mGeometry[index] = mGeometry[last];
+		mDirty[index] = mDirty[last];
+		mSlots[mSlotOf[index]].Index = index;
+	}
+
+	mSlotOf.pop_back();
+	mWorld.pop_back();
+	mTexTransform.pop_back();
+	mBounds.pop_back();
+	mWorldBounds.pop_back();
+	mMaterial.pop_back();
+	mGeometry.pop_back();
+	mDirty.pop_back();
+
+	Slot& slot = mSlots[handle.Slot];
+	slot.Live = false;
+	++slot.Generation;
+	slot.Index = mFreeSlot;
+	mFreeSlot = handle.Slot;
+}
+
+void SceneStore::Clear()
+{
+	// Keep the generations so that handles from before stay invalid.
+	mFreeSlot = 0xffffffff;
+	for(std::uint32_t i = (std::uint32_t)mSlots.size(); i-- > 0; )
+	{
+		if(mSlots[i].Live)
+		{
+			mSlots[i].Live = false;
+			++mSlots[i].Generation;
+		}
+		mSlots[i].Index = mFreeSlot;
+		mFreeSlot = i;
+	}
+
+	mSlotOf.clear();
+	mWorld.clear();
+	mTexTransform.clear();
+	mBounds.clear();
+	mWorldBounds.clear();
+	mMaterial.clear();
+	mGeometry.clear();
+	mDirty.clear();
+}
+
+bool SceneStore::IsValid(SceneHandle handle)const
+{
+	return handle.Slot < mSlots.size() && mSlots[handle.Slot].Live &&
+		mSlots[handle.Slot].Generation == handle.Generation;
+}
+
+SceneHandle SceneStore::Handle(std::uint32_t index)const
+{
+	SceneHandle handle;
+	handle.Slot = mSlotOf[index];
+	handle.Generation = mSlots[handle.Slot].Generation;
+	return handle;
+}
+
+bool SceneStore::MarkDirty(SceneHandle handle)
+{
+	std::uint8_t& dirty = mDirty[Index(handle)];
+	if(dirty)
+		return false;
+
+	dirty = 1;
+	return true;
+}
@@ -0,0 +1,95 @@
+//***************************************************************************************
+// SceneStore.h
+//
+// The per-item data that is read every frame, kept as a structure of arrays:
+// world and texture transforms, local and world bounds, material and geometry
+// index and dirty flag each sit in their own contiguous array.  Loops that only
+// need one or two of them (packing object data, refitting cull bounds, sorting
+// by depth) walk dense memory instead of chasing a pointer to every item.
+//
+// Entries are addressed by generational handles.  A handle names a slot, and the
+// slot maps to the entry's position in the arrays.  Destroying an entry moves the
+// last one into its place, so the arrays stay dense, and bumps the slot's
+// generation, so old handles to it stop being valid instead of reaching whatever
+// takes the slot next.  Positions change on Destroy; handles never do.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+
+struct SceneHandle
+{
+	std::uint32_t Slot = 0xffffffff;
+	std::uint32_t Generation = 0;
+
+	bool operator==(const SceneHandle& rhs)const { return Slot == rhs.Slot && Generation == rhs.Generation; }
+	bool operator!=(const SceneHandle& rhs)const { return !(*this == rhs); }
+};
+
+class SceneStore
+{
+public:
+	// New entries have identity transforms, empty bounds, material and geometry
+	// 0, and are not dirty.
+	SceneHandle Create();
+	void Destroy(SceneHandle handle);
+	void Clear();
+
+	bool IsValid(SceneHandle handle)const;
+	std::uint32_t Count()const { return (std::uint32_t)mWorld.size(); }
+
+	// Position of a live entry in the arrays below.
+	std::uint32_t Index(SceneHandle handle)const { return mSlots[handle.Slot].Index; }
+	SceneHandle Handle(std::uint32_t index)const;
+
+	DirectX::XMFLOAT4X4& World(SceneHandle handle) { return mWorld[Index(handle)]; }
+	DirectX::XMFLOAT4X4& TexTransform(SceneHandle handle) { return mTexTransform[Index(handle)]; }
+	DirectX::BoundingBox& Bounds(SceneHandle handle) { return mBounds[Index(handle)]; }
+	DirectX::BoundingBox& WorldBounds(SceneHandle handle) { return mWorldBounds[Index(handle)]; }
+	std::uint32_t& Material(SceneHandle handle) { return mMaterial[Index(handle)]; }
+	std::uint32_t& Geometry(SceneHandle handle) { return mGeometry[Index(handle)]; }
+	const DirectX::XMFLOAT4X4& World(SceneHandle handle)const { return mWorld[Index(handle)]; }
+	const DirectX::XMFLOAT4X4& TexTransform(SceneHandle handle)const { return mTexTransform[Index(handle)]; }
+	const DirectX::BoundingBox& Bounds(SceneHandle handle)const { return mBounds[Index(handle)]; }
+	const DirectX::BoundingBox& WorldBounds(SceneHandle handle)const { return mWorldBounds[Index(handle)]; }
+	std::uint32_t Material(SceneHandle handle)const { return mMaterial[Index(handle)]; }
+	std::uint32_t Geometry(SceneHandle handle)const { return mGeometry[Index(handle)]; }
+
+	// Whole arrays, Count() long, for loops over every entry.
+	const DirectX::XMFLOAT4X4* Worlds()const { return mWorld.data(); }
+	const DirectX::BoundingBox* BoundsArray()const { return mBounds.data(); }
+	const DirectX::BoundingBox* WorldBoundsArray()const { return mWorldBounds.data(); }
+	const std::uint32_t* Materials()const { return mMaterial.data(); }
+	const std::uint32_t* Geometries()const { return mGeometry.data(); }
+
+	// Returns true if the entry was clean, so the caller can queue it once.
+	bool MarkDirty(SceneHandle handle);
+	void ClearDirty(SceneHandle handle) { mDirty[Index(handle)] = 0; }
+	bool IsDirty(SceneHandle handle)const { return mDirty[Index(handle)] != 0; }
+
+private:
+	struct Slot
+	{
+		// Position in the arrays while live, next free slot otherwise.
+		std::uint32_t Index = 0;
+		std::uint32_t Generation = 0;
+		bool Live = false;
+	};
+
+	std::vector<Slot> mSlots;
+	std::uint32_t mFreeSlot = 0xffffffff;
+
+	// One element per live entry.
+	std::vector<std::uint32_t> mSlotOf;
+	std::vector<DirectX::XMFLOAT4X4> mWorld;
+	std::vector<DirectX::XMFLOAT4X4> mTexTransform;
+	std::vector<DirectX::BoundingBox> mBounds;
+	std::vector<DirectX::BoundingBox> mWorldBounds;
+	std::vector<std::uint32_t> mMaterial;
+	std::vector<std::uint32_t> mGeometry;
+	std::vector<std::uint8_t> mDirty;
+};
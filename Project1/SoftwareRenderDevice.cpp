@@ -0,0 +1,1274 @@
+//***************************************************************************************
+// SoftwareRenderDevice.cpp
+//***************************************************************************************
+
+#include "SoftwareRenderDevice.h"
+
+#include "IndirectDrawArgs.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <future>
+#include <thread>
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define SOFTWARE_RENDER_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	// The buffer layouts of Default.hlsl and TreeSprite.hlsl, which
+	// FrameResource.h mirrors.  Matrices are stored transposed.
+	const int MaxLights = 16;
+
+	struct Light
+	{
+		float Strength[3];
+		float FalloffStart;
+		float Direction[3];
+		float FalloffEnd;
+		float Position[3];
+		float SpotPower;
+	};
+
+	struct ObjectData
+	{
+		float World[16];
+		float TexTransform[16];
+		std::uint32_t MaterialIndex;
+		std::uint32_t InstanceOffset;
+		std::uint32_t ObjPad0;
+		std::uint32_t ObjPad1;
+	};
+
+	struct PassConstants
+	{
+		float View[16];
+		float InvView[16];
+		float Proj[16];
+		float InvProj[16];
+		float ViewProj[16];
+		float InvViewProj[16];
+		float EyePosW[3];
+		float cbPerObjectPad1;
+		float RenderTargetSize[2];
+		float InvRenderTargetSize[2];
+		float NearZ;
+		float FarZ;
+		float TotalTime;
+		float DeltaTime;
+		float AmbientLight[4];
+		float FogColor[4];
+		float FogStart;
+		float FogRange;
+		float cbPerObjectPad2[2];
+		Light Lights[MaxLights];
+	};
+
+	struct MaterialData
+	{
+		float DiffuseAlbedo[4];
+		float FresnelR0[3];
+		float Roughness;
+		float MatTransform[16];
+	};
+
+	struct InstanceData
+	{
+		float World[16];
+		float TexTransform[16];
+	};
+
+	// Attribute offsets in a vertex.
+	const int PosW = 0;
+	const int NormalW = 3;
+	const int TexC = 6;
+
+	// Input layout offsets, in bytes: the app's Vertex, and TreeSpriteVertex.
+	const int VertexPosition = 0;
+	const int VertexNormal = 12;
+	const int VertexTexC = 24;
+	const int SpriteSize = 12;
+
+	// Light counts the shaders are compiled with.
+	const int DefaultDirLights = 1;
+	const int DefaultPointLights = 11;
+	const int TreeSpriteDirLights = 3;
+
+	// Primitives per unit of setup work.
+	const std::uint32_t RunLength = 256;
+
+	struct Float3
+	{
+		float x, y, z;
+	};
+
+	Float3 Make(const float* v) { return { v[0], v[1], v[2] }; }
+	Float3 operator+(const Float3& a, const Float3& b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+	Float3 operator-(const Float3& a, const Float3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+	Float3 operator*(const Float3& a, const Float3& b) { return { a.x * b.x, a.y * b.y, a.z * b.z }; }
+	Float3 operator*(const Float3& a, float s) { return { a.x * s, a.y * s, a.z * s }; }
+	float Dot(const Float3& a, const Float3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+	float Length(const Float3& a) { return std::sqrt(Dot(a, a)); }
+	Float3 Normalize(const Float3& a) { return a * (1.0f / Length(a)); }
+	float Saturate(float x) { return std::min(std::max(x, 0.0f), 1.0f); }
+
+	Float3 Cross(const Float3& a, const Float3& b)
+	{
+		return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+	}
+
+	// mul(v, M) for an HLSL matrix 'm' stored transposed.
+	void Transform(const float* m, const float v[4], float out[4])
+	{
+		for(int j = 0; j < 4; ++j)
+			out[j] = v[0] * m[j * 4 + 0] + v[1] * m[j * 4 + 1] + v[2] * m[j * 4 + 2] + v[3] * m[j * 4 + 3];
+	}
+
+	// mul(n, (float3x3)M).
+	Float3 TransformNormal(const float* m, const Float3& n)
+	{
+		return
+		{
+			n.x * m[0] + n.y * m[1] + n.z * m[2],
+			n.x * m[4] + n.y * m[5] + n.z * m[6],
+			n.x * m[8] + n.y * m[9] + n.z * m[10],
+		};
+	}
+
+	// LightingUtil.hlsl.
+	struct Material
+	{
+		float DiffuseAlbedo[4];
+		Float3 FresnelR0;
+		float Shininess;
+	};
+
+	float CalcAttenuation(float d, float falloffStart, float falloffEnd)
+	{
+		return Saturate((falloffEnd - d) / (falloffEnd - falloffStart));
+	}
+
+	Float3 SchlickFresnel(const Float3& r0, const Float3& normal, const Float3& lightVec)
+	{
+		const float cosIncidentAngle = Saturate(Dot(normal, lightVec));
+
+		const float f0 = 1.0f - cosIncidentAngle;
+		const float f5 = f0 * f0 * f0 * f0 * f0;
+		return r0 + (Float3{ 1.0f, 1.0f, 1.0f } - r0) * f5;
+	}
+
+	Float3 BlinnPhong(const Float3& lightStrength, const Float3& lightVec, const Float3& normal, const Float3& toEye, const Material& mat)
+	{
+		const float m = mat.Shininess * 256.0f;
+		const Float3 halfVec = Normalize(toEye + lightVec);
+
+		const float roughnessFactor = (m + 8.0f) * std::pow(std::max(Dot(halfVec, normal), 0.0f), m) / 8.0f;
+		const Float3 fresnelFactor = SchlickFresnel(mat.FresnelR0, halfVec, lightVec);
+
+		Float3 specAlbedo = fresnelFactor * roughnessFactor;
+
+		// As in the shader: scaled down for LDR.
+		specAlbedo = { specAlbedo.x / (specAlbedo.x + 1.0f), specAlbedo.y / (specAlbedo.y + 1.0f), specAlbedo.z / (specAlbedo.z + 1.0f) };
+
+		return (Make(mat.DiffuseAlbedo) + specAlbedo) * lightStrength;
+	}
+
+	Float3 ComputeDirectionalLight(const Light& L, const Material& mat, const Float3& normal, const Float3& toEye)
+	{
+		const Float3 lightVec = Make(L.Direction) * -1.0f;
+
+		const float ndotl = std::max(Dot(lightVec, normal), 0.0f);
+		const Float3 lightStrength = Make(L.Strength) * ndotl;
+
+		return BlinnPhong(lightStrength, lightVec, normal, toEye, mat);
+	}
+
+	Float3 ComputePointLight(const Light& L, const Material& mat, const Float3& pos, const Float3& normal, const Float3& toEye)
+	{
+		Float3 lightVec = Make(L.Position) - pos;
+
+		const float d = Length(lightVec);
+		if(d > L.FalloffEnd)
+			return { 0.0f, 0.0f, 0.0f };
+
+		lightVec = lightVec * (1.0f / d);
+
+		const float ndotl = std::max(Dot(lightVec, normal), 0.0f);
+		Float3 lightStrength = Make(L.Strength) * ndotl;
+		lightStrength = lightStrength * CalcAttenuation(d, L.FalloffStart, L.FalloffEnd);
+
+		return BlinnPhong(lightStrength, lightVec, normal, toEye, mat);
+	}
+
+	// UNORM conversion; NaN goes to 0 like on the GPU.
+	std::uint32_t ToUnorm(float x)
+	{
+		if(!(x > 0.0f))
+			return 0;
+		if(x >= 1.0f)
+			return 255;
+		return (std::uint32_t)(x * 255.0f + 0.5f);
+	}
+
+	std::uint32_t PackColor(const float rgba[4])
+	{
+		return ToUnorm(rgba[0]) | (ToUnorm(rgba[1]) << 8) | (ToUnorm(rgba[2]) << 16) | (ToUnorm(rgba[3]) << 24);
+	}
+
+	// Signed distance of a clip-space position to frustum plane 'plane'; >= 0
+	// inside.  D3D keeps 0 <= z <= w.
+	float PlaneDistance(const float pos[4], int plane)
+	{
+		switch(plane)
+		{
+		case 0: return pos[2];
+		case 1: return pos[3] - pos[2];
+		case 2: return pos[3] + pos[0];
+		case 3: return pos[3] - pos[0];
+		case 4: return pos[3] + pos[1];
+		default: return pos[3] - pos[1];
+		}
+	}
+}
+
+const int SoftwareRenderDevice::TileWidth;
+const int SoftwareRenderDevice::TileHeight;
+
+SoftwareRenderDevice::SoftwareRenderDevice(int width, int height, int maxLists, int threadCount)
+	: mLists(maxLists > 0 ? maxLists : 1)
+{
+	mWidth = std::min(std::max(width, 1), 4096);
+	mHeight = std::min(std::max(height, 1), 4096);
+	mTilesX = (mWidth + TileWidth - 1) / TileWidth;
+	mTilesY = (mHeight + TileHeight - 1) / TileHeight;
+	mPitch = mTilesX * TileWidth;
+
+	mColor.resize((std::size_t)mPitch * mTilesY * TileHeight);
+	mDepth.resize(mColor.size());
+
+	mFrontBuffer.Width = mWidth;
+	mFrontBuffer.Height = mHeight;
+	mFrontBuffer.Pixels.assign((std::size_t)mWidth * mHeight, 0);
+
+	SetThreadCount(threadCount);
+}
+
+SoftwareRenderDevice::~SoftwareRenderDevice()
+{
+}
+
+void SoftwareRenderDevice::SetThreadCount(int threadCount)
+{
+	if(threadCount <= 0)
+		threadCount = (int)std::thread::hardware_concurrency();
+	mThreadCount = std::max(1, threadCount);
+
+	mBins.resize(mThreadCount);
+	for(auto& bins : mBins)
+		bins.Tiles.resize(mTilesX * mTilesY);
+}
+
+void SoftwareRenderDevice::SetClearColor(float r, float g, float b, float a)
+{
+	mClearColor[0] = r;
+	mClearColor[1] = g;
+	mClearColor[2] = b;
+	mClearColor[3] = a;
+}
+
+void SoftwareRenderDevice::CreatePipeline(int pipeline, const PipelineDesc& desc)
+{
+	assert(pipeline >= 0);
+
+	if(pipeline >= (int)mPipelines.size())
+		mPipelines.resize(pipeline + 1);
+	mPipelines[pipeline] = std::make_unique<PipelineDesc>(desc);
+}
+
+bool SoftwareRenderDevice::CreateTexture(int texture, const std::string& path)
+{
+	assert(texture >= 0);
+
+	if(texture >= (int)mTextures.size())
+		mTextures.resize(texture + 1);
+
+	auto loaded = std::make_unique<SoftwareTexture>();
+	const bool ok = loaded->LoadDds(path, &mLastError);
+	mTextures[texture] = std::move(loaded);
+	return ok;
+}
+
+bool SoftwareRenderDevice::ValidBuffer(int buffer)const
+{
+	return buffer >= 0 && buffer < (int)mBuffers.size() && mBuffers[buffer].Live;
+}
+
+int SoftwareRenderDevice::CreateBuffer(BufferType type, std::uint32_t stride, std::uint32_t count)
+{
+	int buffer;
+	if(!mFreeBuffers.empty())
+	{
+		buffer = mFreeBuffers.back();
+		mFreeBuffers.pop_back();
+	}
+	else
+	{
+		buffer = (int)mBuffers.size();
+		mBuffers.emplace_back();
+	}
+
+	Buffer& b = mBuffers[buffer];
+	b.Type = type;
+	b.Stride = stride;
+	b.Count = count;
+	b.Data.assign((std::size_t)stride * count, 0);
+	b.Live = true;
+
+	return buffer;
+}
+
+void SoftwareRenderDevice::ReleaseBuffer(int buffer)
+{
+	assert(ValidBuffer(buffer));
+
+	Buffer& b = mBuffers[buffer];
+	b.Live = false;
+	std::vector<unsigned char>().swap(b.Data);
+	mFreeBuffers.push_back(buffer);
+}
+
+void SoftwareRenderDevice::WriteBuffer(int buffer, std::uint32_t first, const void* data, std::uint32_t count)
+{
+	assert(ValidBuffer(buffer));
+
+	Buffer& b = mBuffers[buffer];
+	assert((std::uint64_t)first + count <= b.Count);
+
+	std::memcpy(&b.Data[(std::size_t)b.Stride * first], data, (std::size_t)b.Stride * count);
+}
+
+void SoftwareRenderDevice::BeginList(int list)
+{
+	List& l = mLists[list];
+	assert(!l.Open && !l.Ended);
+
+	// Command lists start with nothing bound.
+	l.Open = true;
+	l.State = BoundState();
+	l.Draws.clear();
+}
+
+void SoftwareRenderDevice::SetPipeline(int list, int pipeline)
+{
+	assert(mLists[list].Open);
+	mLists[list].State.Pipeline = pipeline;
+}
+
+void SoftwareRenderDevice::SetGeometry(int list, int vertexBuffer, int indexBuffer, Topology topology)
+{
+	BoundState& state = mLists[list].State;
+	assert(mLists[list].Open);
+
+	state.VertexBuffer = vertexBuffer;
+	state.IndexBuffer = indexBuffer;
+	state.PrimitiveTopology = topology;
+}
+
+void SoftwareRenderDevice::SetTexture(int list, int slot, int texture)
+{
+	assert(mLists[list].Open);
+	if(slot == 0)
+		mLists[list].State.Texture = texture;
+}
+
+void SoftwareRenderDevice::SetBuffer(int list, int slot, int buffer, std::uint32_t element)
+{
+	assert(mLists[list].Open);
+	assert(slot >= 0 && slot < SlotCount);
+
+	mLists[list].State.Slots[slot].Buffer = buffer;
+	mLists[list].State.Slots[slot].Element = element;
+}
+
+void SoftwareRenderDevice::SetConstant(int list, int slot, std::uint32_t value)
+{
+	assert(mLists[list].Open);
+	assert(slot >= 0 && slot < SlotCount);
+
+	mLists[list].State.Slots[slot].Constant = value;
+}
+
+void SoftwareRenderDevice::DrawIndexed(int list, std::uint32_t indexCount, std::uint32_t instanceCount,
+	std::uint32_t startIndex, int baseVertex)
+{
+	List& l = mLists[list];
+	assert(l.Open);
+
+	Draw draw;
+	draw.State = l.State;
+	draw.IndexCount = indexCount;
+	draw.InstanceCount = instanceCount;
+	draw.StartIndex = startIndex;
+	draw.BaseVertex = baseVertex;
+	l.Draws.push_back(draw);
+}
+
+void SoftwareRenderDevice::DrawIndirect(int list, int argBuffer, std::uint32_t first, std::uint32_t count)
+{
+	List& l = mLists[list];
+	assert(l.Open);
+	assert(ValidBuffer(argBuffer) && mBuffers[argBuffer].Stride == sizeof(IndirectDrawCommand));
+	assert((std::uint64_t)first + count <= mBuffers[argBuffer].Count);
+
+	Draw draw;
+	draw.State = l.State;
+	draw.ArgBuffer = argBuffer;
+	draw.FirstArg = first;
+	draw.ArgCount = count;
+	l.Draws.push_back(draw);
+}
+
+void SoftwareRenderDevice::EndList(int list)
+{
+	List& l = mLists[list];
+	assert(l.Open);
+
+	l.Open = false;
+	l.Ended = true;
+}
+
+bool SoftwareRenderDevice::Resolve(const Draw& draw, ResolvedDraw& resolved)const
+{
+	const BoundState& state = draw.State;
+	if(state.Pipeline < 0 || state.Pipeline >= (int)mPipelines.size() || !mPipelines[state.Pipeline])
+		return false;
+	if(!ValidBuffer(state.VertexBuffer) || !ValidBuffer(state.IndexBuffer))
+		return false;
+
+	const PipelineDesc& pipeline = *mPipelines[state.Pipeline];
+	const Buffer& vb = mBuffers[state.VertexBuffer];
+	const Buffer& ib = mBuffers[state.IndexBuffer];
+
+	const std::uint32_t minStride = pipeline.Program == Shader::TreeSprite ? SpriteSize + 8 : VertexTexC + 8;
+	if(vb.Stride < minStride || ib.Stride != sizeof(std::uint32_t))
+		return false;
+	if((std::uint64_t)draw.StartIndex + draw.IndexCount > ib.Count)
+		return false;
+
+	// Element 'index' of the buffer bound to 'slot', when 'count' elements of
+	// 'size' bytes fit from there.
+	auto element = [&](int slot, std::size_t size, std::uint64_t index, std::uint32_t count) -> const unsigned char*
+	{
+		const Binding& binding = state.Slots[slot];
+		if(!ValidBuffer(binding.Buffer))
+			return nullptr;
+
+		const Buffer& b = mBuffers[binding.Buffer];
+		index += binding.Element;
+		if(b.Stride < size || index + count > b.Count)
+			return nullptr;
+
+		return &b.Data[(std::size_t)(b.Stride * index)];
+	};
+
+	// The slot 1 root constant picks the object, and the object its material and
+	// instances.
+	const unsigned char* object = element(5, sizeof(ObjectData), state.Slots[1].Constant, 1);
+	if(!object)
+		return false;
+	ObjectData objectData;
+	std::memcpy(&objectData, object, sizeof(objectData));
+
+	const unsigned char* pass = element(2, sizeof(PassConstants), 0, 1);
+	const unsigned char* material = element(3, sizeof(MaterialData), objectData.MaterialIndex, 1);
+	if(!pass || !material)
+		return false;
+
+	const unsigned char* instances = nullptr;
+	if(pipeline.Program == Shader::Instanced && draw.InstanceCount > 0)
+	{
+		instances = element(4, sizeof(InstanceData), objectData.InstanceOffset, draw.InstanceCount);
+		if(!instances)
+			return false;
+	}
+
+	resolved.Pipeline = &pipeline;
+	resolved.Texture = &mWhite;
+	if(state.Texture >= 0 && state.Texture < (int)mTextures.size() && mTextures[state.Texture])
+		resolved.Texture = mTextures[state.Texture].get();
+	resolved.Vertices = vb.Data.data();
+	resolved.VertexStride = vb.Stride;
+	resolved.VertexCount = vb.Count;
+	resolved.Indices = reinterpret_cast<const std::uint32_t*>(ib.Data.data());
+	resolved.Object = object;
+	resolved.Pass = pass;
+	resolved.Material = material;
+	resolved.Instances = instances;
+	resolved.PrimitiveTopology = state.PrimitiveTopology;
+	resolved.StartIndex = draw.StartIndex;
+	resolved.BaseVertex = draw.BaseVertex;
+	return true;
+}
+
+void SoftwareRenderDevice::AddDraw(const Draw& draw)
+{
+	ResolvedDraw resolved;
+	if(!Resolve(draw, resolved))
+	{
+		assert(!"draw with missing or undersized bindings");
+		return;
+	}
+
+	++mFrame.Draws;
+
+	// Points only go through the tree sprite geometry shader.
+	const bool points = resolved.PrimitiveTopology == PointList;
+	if(points != (resolved.Pipeline->Program == Shader::TreeSprite))
+		return;
+
+	const std::uint32_t primitives = points ? draw.IndexCount : draw.IndexCount / 3;
+	const int drawIndex = (int)mDraws.size();
+	mDraws.push_back(resolved);
+
+	for(std::uint32_t instance = 0; instance < draw.InstanceCount; ++instance)
+	{
+		for(std::uint32_t first = 0; first < primitives; first += RunLength)
+		{
+			PrimitiveRun run;
+			run.Draw = drawIndex;
+			run.Instance = instance;
+			run.First = first;
+			run.Count = std::min(RunLength, primitives - first);
+			mRuns.push_back(run);
+		}
+	}
+}
+
+template<typename F>
+void SoftwareRenderDevice::RunWorkers(F f)
+{
+	std::vector<std::future<void>> jobs;
+	for(int worker = 1; worker < mThreadCount; ++worker)
+		jobs.push_back(std::async(std::launch::async, f, worker));
+
+	f(0);
+
+	for(auto& job : jobs)
+		job.wait();
+}
+
+void SoftwareRenderDevice::ClearTargets()
+{
+	std::fill(mColor.begin(), mColor.end(), PackColor(mClearColor));
+	std::fill(mDepth.begin(), mDepth.end(), 1.0f);
+	mCleared = true;
+}
+
+void SoftwareRenderDevice::Execute(int count)
+{
+	assert(count <= (int)mLists.size());
+
+	if(!mCleared)
+		ClearTargets();
+
+	mDraws.clear();
+	mRuns.clear();
+	for(int i = 0; i < count; ++i)
+	{
+		List& l = mLists[i];
+		assert(l.Ended);
+
+		for(const Draw& draw : l.Draws)
+		{
+			if(draw.ArgBuffer < 0)
+			{
+				AddDraw(draw);
+				continue;
+			}
+
+			// The arguments as they are now, when the list runs.
+			const Buffer& args = mBuffers[draw.ArgBuffer];
+			for(std::uint32_t c = draw.FirstArg; c < draw.FirstArg + draw.ArgCount; ++c)
+			{
+				IndirectDrawCommand command;
+				std::memcpy(&command, &args.Data[(std::size_t)c * sizeof(command)], sizeof(command));
+
+				Draw direct = draw;
+				direct.ArgBuffer = -1;
+				direct.State.Slots[1].Constant = command.ObjectIndex;
+				direct.IndexCount = command.IndexCountPerInstance;
+				direct.InstanceCount = command.InstanceCount;
+				direct.StartIndex = command.StartIndexLocation;
+				direct.BaseVertex = command.BaseVertexLocation;
+				AddDraw(direct);
+			}
+		}
+
+		l.Draws.clear();
+		l.Ended = false;
+	}
+
+	if(mRuns.empty())
+		return;
+
+	for(auto& bins : mBins)
+	{
+		bins.Triangles.clear();
+		for(auto& tile : bins.Tiles)
+			tile.clear();
+	}
+
+	// Contiguous runs per worker, so the bins read in worker order are in
+	// submission order.
+	const int runCount = (int)mRuns.size();
+	RunWorkers([&](int worker)
+	{
+		const int first = (int)((long long)runCount * worker / mThreadCount);
+		const int last = (int)((long long)runCount * (worker + 1) / mThreadCount);
+		for(int i = first; i < last; ++i)
+			SetupRun(mRuns[i], mBins[worker]);
+	});
+
+	for(auto& bins : mBins)
+	{
+		mFrame.Triangles += (int)bins.Triangles.size();
+		bins.PixelsShaded = 0;
+	}
+
+	// Tiles don't overlap, so workers write the targets without locking.
+	const int tileCount = mTilesX * mTilesY;
+	std::atomic<int> nextTile(0);
+
+	RunWorkers([&](int worker)
+	{
+		for(;;)
+		{
+			const int tile = nextTile.fetch_add(1);
+			if(tile >= tileCount)
+				break;
+
+			RasterizeTile(tile, worker);
+		}
+	});
+
+	for(const auto& bins : mBins)
+		mFrame.PixelsShaded += bins.PixelsShaded;
+}
+
+void SoftwareRenderDevice::Present()
+{
+	if(!mCleared)
+		ClearTargets();
+
+	for(int y = 0; y < mHeight; ++y)
+		std::copy(mColor.begin() + (std::size_t)y * mPitch, mColor.begin() + (std::size_t)y * mPitch + mWidth,
+			mFrontBuffer.Pixels.begin() + (std::size_t)y * mWidth);
+
+	mCleared = false;
+	mLastFrame = mFrame;
+	mFrame = Stats();
+}
+
+void SoftwareRenderDevice::SetupRun(const PrimitiveRun& run, WorkerBins& bins)const
+{
+	const ResolvedDraw& draw = mDraws[run.Draw];
+	const PassConstants& pass = *reinterpret_cast<const PassConstants*>(draw.Pass);
+	const MaterialData& material = *reinterpret_cast<const MaterialData*>(draw.Material);
+
+	const std::uint32_t* indices = draw.Indices + draw.StartIndex;
+	auto vertexAt = [&](std::uint32_t i) -> const unsigned char*
+	{
+		const std::int64_t index = (std::int64_t)indices[i] + draw.BaseVertex;
+		if(index < 0 || index >= draw.VertexCount)
+			return nullptr;
+		return draw.Vertices + (std::size_t)index * draw.VertexStride;
+	};
+
+	if(draw.Pipeline->Program == Shader::TreeSprite)
+	{
+		// TreeSprite.hlsl's GS: a quad standing on the y axis, turned to the eye,
+		// as a strip of two triangles.
+		const Float3 eye = Make(pass.EyePosW);
+		for(std::uint32_t prim = run.First; prim < run.First + run.Count; ++prim)
+		{
+			const unsigned char* vertex = vertexAt(prim);
+			if(vertex == nullptr)
+				continue;
+
+			Float3 center;
+			float size[2];
+			std::memcpy(&center, vertex + VertexPosition, sizeof(center));
+			std::memcpy(size, vertex + SpriteSize, sizeof(size));
+
+			const Float3 up = { 0.0f, 1.0f, 0.0f };
+			Float3 look = eye - center;
+			look.y = 0.0f;
+			look = Normalize(look);
+			const Float3 right = Cross(up, look);
+
+			const float halfWidth = 0.5f * size[0];
+			const float halfHeight = 0.5f * size[1];
+
+			const Float3 corners[4] =
+			{
+				center + right * halfWidth - up * halfHeight,
+				center + right * halfWidth + up * halfHeight,
+				center - right * halfWidth - up * halfHeight,
+				center - right * halfWidth + up * halfHeight,
+			};
+			const float texC[4][2] = { { 0.0f, 1.0f }, { 0.0f, 0.0f }, { 1.0f, 1.0f }, { 1.0f, 0.0f } };
+
+			ClipVertex quad[4];
+			for(int i = 0; i < 4; ++i)
+			{
+				const float posW[4] = { corners[i].x, corners[i].y, corners[i].z, 1.0f };
+				Transform(pass.ViewProj, posW, quad[i].Pos);
+
+				float* a = quad[i].Attributes;
+				a[PosW + 0] = corners[i].x; a[PosW + 1] = corners[i].y; a[PosW + 2] = corners[i].z;
+				a[NormalW + 0] = look.x; a[NormalW + 1] = look.y; a[NormalW + 2] = look.z;
+				a[TexC + 0] = texC[i][0]; a[TexC + 1] = texC[i][1];
+			}
+
+			const ClipVertex first[3] = { quad[0], quad[1], quad[2] };
+			const ClipVertex second[3] = { quad[2], quad[1], quad[3] };
+			SetupTriangle(run.Draw, first, prim, bins);
+			SetupTriangle(run.Draw, second, prim, bins);
+		}
+		return;
+	}
+
+	const float* world;
+	const float* texTransform;
+	if(draw.Pipeline->Program == Shader::Instanced)
+	{
+		const InstanceData& instance = reinterpret_cast<const InstanceData*>(draw.Instances)[run.Instance];
+		world = instance.World;
+		texTransform = instance.TexTransform;
+	}
+	else
+	{
+		const ObjectData& object = *reinterpret_cast<const ObjectData*>(draw.Object);
+		world = object.World;
+		texTransform = object.TexTransform;
+	}
+
+	// Default.hlsl's VS.
+	auto shade = [&](const unsigned char* vertex, ClipVertex& out)
+	{
+		float posL[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+		Float3 normalL;
+		float texIn[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+		std::memcpy(posL, vertex + VertexPosition, 3 * sizeof(float));
+		std::memcpy(&normalL, vertex + VertexNormal, sizeof(normalL));
+		std::memcpy(texIn, vertex + VertexTexC, 2 * sizeof(float));
+
+		float posW[4];
+		Transform(world, posL, posW);
+		Transform(pass.ViewProj, posW, out.Pos);
+
+		const Float3 normalW = TransformNormal(world, normalL);
+
+		float texC[4], texOut[4];
+		Transform(texTransform, texIn, texC);
+		Transform(material.MatTransform, texC, texOut);
+
+		float* a = out.Attributes;
+		a[PosW + 0] = posW[0]; a[PosW + 1] = posW[1]; a[PosW + 2] = posW[2];
+		a[NormalW + 0] = normalW.x; a[NormalW + 1] = normalW.y; a[NormalW + 2] = normalW.z;
+		a[TexC + 0] = texOut[0]; a[TexC + 1] = texOut[1];
+	};
+
+	for(std::uint32_t prim = run.First; prim < run.First + run.Count; ++prim)
+	{
+		ClipVertex v[3];
+		bool valid = true;
+		for(int k = 0; k < 3 && valid; ++k)
+		{
+			const unsigned char* vertex = vertexAt(prim * 3 + k);
+			if(vertex == nullptr)
+				valid = false;
+			else
+				shade(vertex, v[k]);
+		}
+
+		if(valid)
+			SetupTriangle(run.Draw, v, prim, bins);
+	}
+}
+
+void SoftwareRenderDevice::SetupTriangle(int draw, const ClipVertex v[3], std::uint32_t primitiveId, WorkerBins& bins)const
+{
+	// Outcodes first: most triangles are wholly inside or wholly outside.
+	unsigned outsideAll = 0x3f;
+	unsigned outsideAny = 0;
+	for(int k = 0; k < 3; ++k)
+	{
+		unsigned outside = 0;
+		for(int plane = 0; plane < 6; ++plane)
+		{
+			if(PlaneDistance(v[k].Pos, plane) < 0.0f)
+				outside |= 1u << plane;
+		}
+		outsideAll &= outside;
+		outsideAny |= outside;
+	}
+	if(outsideAll != 0)
+		return;
+
+	// Clipping against six planes adds at most six corners.
+	ClipVertex polys[2][9];
+	int count = 3;
+	std::copy(v, v + 3, polys[0]);
+	int current = 0;
+
+	for(int plane = 0; plane < 6 && count >= 3; ++plane)
+	{
+		if(!(outsideAny & (1u << plane)))
+			continue;
+
+		const ClipVertex* in = polys[current];
+		ClipVertex* out = polys[current ^ 1];
+		int outCount = 0;
+
+		for(int i = 0; i < count; ++i)
+		{
+			const ClipVertex& a = in[i];
+			const ClipVertex& b = in[(i + 1) % count];
+			const float da = PlaneDistance(a.Pos, plane);
+			const float db = PlaneDistance(b.Pos, plane);
+
+			if(da >= 0.0f)
+				out[outCount++] = a;
+
+			if((da >= 0.0f) != (db >= 0.0f))
+			{
+				// Always from the inside corner, so both triangles on a shared
+				// edge get the same new corner.
+				const ClipVertex& inside = da >= 0.0f ? a : b;
+				const ClipVertex& outside = da >= 0.0f ? b : a;
+				const float di = da >= 0.0f ? da : db;
+				const float dout = da >= 0.0f ? db : da;
+				const float t = di / (di - dout);
+
+				ClipVertex& c = out[outCount++];
+				for(int j = 0; j < 4; ++j)
+					c.Pos[j] = inside.Pos[j] + (outside.Pos[j] - inside.Pos[j]) * t;
+				for(int j = 0; j < AttributeCount; ++j)
+					c.Attributes[j] = inside.Attributes[j] + (outside.Attributes[j] - inside.Attributes[j]) * t;
+			}
+		}
+
+		count = outCount;
+		current ^= 1;
+	}
+
+	if(count < 3)
+		return;
+
+	const ClipVertex* poly = polys[current];
+	const PipelineDesc& pipeline = *mDraws[draw].Pipeline;
+
+	// Viewport transform, snapped to 1/16 pixel.
+	int sx[9], sy[9];
+	float sz[9], invW[9];
+	for(int i = 0; i < count; ++i)
+	{
+		if(poly[i].Pos[3] <= 0.0f)
+			return;
+
+		invW[i] = 1.0f / poly[i].Pos[3];
+		const float x = (poly[i].Pos[0] * invW[i] * 0.5f + 0.5f) * mWidth;
+		const float y = (0.5f - poly[i].Pos[1] * invW[i] * 0.5f) * mHeight;
+		sx[i] = std::min(std::max((int)std::lround(x * 16.0f), 0), mWidth * 16);
+		sy[i] = std::min(std::max((int)std::lround(y * 16.0f), 0), mHeight * 16);
+		sz[i] = poly[i].Pos[2] * invW[i];
+	}
+
+	for(int i = 1; i + 1 < count; ++i)
+	{
+		int index[3] = { 0, i, i + 1 };
+
+		// Front faces come out clockwise on screen, which is a positive area
+		// with y pointing down.
+		const std::int64_t area = (std::int64_t)(sx[index[1]] - sx[index[0]]) * (sy[index[2]] - sy[index[0]]) -
+			(std::int64_t)(sx[index[2]] - sx[index[0]]) * (sy[index[1]] - sy[index[0]]);
+		if(area == 0)
+			continue;
+		if(area < 0)
+		{
+			if(pipeline.CullBack)
+				continue;
+			std::swap(index[1], index[2]);
+		}
+
+		Triangle tri;
+		for(int k = 0; k < 3; ++k)
+		{
+			const int p = index[k];
+			tri.X[k] = sx[p];
+			tri.Y[k] = sy[p];
+			tri.Z[k] = sz[p];
+			tri.InvW[k] = invW[p];
+			std::copy(poly[p].Attributes, poly[p].Attributes + AttributeCount, tri.Attributes[k]);
+		}
+		tri.Draw = draw;
+		tri.PrimitiveId = primitiveId;
+
+		BinTriangle(tri, bins);
+	}
+}
+
+void SoftwareRenderDevice::BinTriangle(const Triangle& tri, WorkerBins& bins)const
+{
+	// Pixels whose centres, at 16 * p + 8, lie within the triangle's bounds.
+	const int minX = std::min(tri.X[0], std::min(tri.X[1], tri.X[2]));
+	const int maxX = std::max(tri.X[0], std::max(tri.X[1], tri.X[2]));
+	const int minY = std::min(tri.Y[0], std::min(tri.Y[1], tri.Y[2]));
+	const int maxY = std::max(tri.Y[0], std::max(tri.Y[1], tri.Y[2]));
+
+	const int x0 = (minX + 7) / 16;
+	const int x1 = std::min((maxX + 8) / 16 - 1, mWidth - 1);
+	const int y0 = (minY + 7) / 16;
+	const int y1 = std::min((maxY + 8) / 16 - 1, mHeight - 1);
+	if(x0 > x1 || y0 > y1)
+		return;
+
+	const int index = (int)bins.Triangles.size();
+	bins.Triangles.push_back(tri);
+
+	for(int ty = y0 / TileHeight; ty <= y1 / TileHeight; ++ty)
+	{
+		for(int tx = x0 / TileWidth; tx <= x1 / TileWidth; ++tx)
+			bins.Tiles[ty * mTilesX + tx].push_back(index);
+	}
+}
+
+void SoftwareRenderDevice::RasterizeTile(int tile, int worker)
+{
+	const int tileX0 = (tile % mTilesX) * TileWidth;
+	const int tileY0 = (tile / mTilesX) * TileHeight;
+
+	for(const auto& bins : mBins)
+	{
+		for(int index : bins.Tiles[tile])
+			RasterizeTriangle(bins.Triangles[index], tileX0, tileY0, mBins[worker]);
+	}
+}
+
+void SoftwareRenderDevice::RasterizeTriangle(const Triangle& tri, int tileX0, int tileY0, WorkerBins& bins)
+{
+	const int minX = std::min(tri.X[0], std::min(tri.X[1], tri.X[2]));
+	const int maxX = std::max(tri.X[0], std::max(tri.X[1], tri.X[2]));
+	const int minY = std::min(tri.Y[0], std::min(tri.Y[1], tri.Y[2]));
+	const int maxY = std::max(tri.Y[0], std::max(tri.Y[1], tri.Y[2]));
+
+	// The pixels of the tile the triangle's bounds reach; x in groups of four.
+	const int x0 = std::max((minX + 7) / 16, tileX0);
+	const int x1 = std::min(std::min((maxX + 8) / 16 - 1, tileX0 + TileWidth - 1), mWidth - 1);
+	const int y0 = std::max((minY + 7) / 16, tileY0);
+	const int y1 = std::min(std::min((maxY + 8) / 16 - 1, tileY0 + TileHeight - 1), mHeight - 1);
+	if(x0 > x1 || y0 > y1)
+		return;
+
+	const int groupX0 = x0 & ~3;
+	const int groupX1 = x1 | 3;
+
+	// Edge k runs from vertex k to vertex k + 1: e = A * x + B * y + C, >= 0
+	// inside.  Pixels exactly on an edge belong to it only if it is a top or a
+	// left edge, which the bias of -1 on the others takes care of.
+	std::int64_t edgeA[3], edgeB[3], edgeC[3];
+	int rowEdge[3], stepA[3], stepB[3];
+	for(int k = 0; k < 3; ++k)
+	{
+		const int n = (k + 1) % 3;
+		edgeA[k] = tri.Y[k] - tri.Y[n];
+		edgeB[k] = tri.X[n] - tri.X[k];
+		const bool topLeft = edgeA[k] > 0 || (edgeA[k] == 0 && edgeB[k] > 0);
+		edgeC[k] = -(edgeA[k] * tri.X[k] + edgeB[k] * tri.Y[k]) + (topLeft ? 0 : -1);
+
+		// Over the block of pixels, an edge that passes everywhere is dropped;
+		// one that fails everywhere drops the triangle.  What is left is small
+		// enough to step in 32 bits.
+		const std::int64_t px0 = 16 * groupX0 + 8, px1 = 16 * groupX1 + 8;
+		const std::int64_t py0 = 16 * y0 + 8, py1 = 16 * y1 + 8;
+		const std::int64_t e00 = edgeA[k] * px0 + edgeB[k] * py0 + edgeC[k];
+		const std::int64_t e10 = edgeA[k] * px1 + edgeB[k] * py0 + edgeC[k];
+		const std::int64_t e01 = edgeA[k] * px0 + edgeB[k] * py1 + edgeC[k];
+		const std::int64_t e11 = edgeA[k] * px1 + edgeB[k] * py1 + edgeC[k];
+		const std::int64_t lo = std::min(std::min(e00, e10), std::min(e01, e11));
+		const std::int64_t hi = std::max(std::max(e00, e10), std::max(e01, e11));
+
+		if(hi < 0)
+			return;
+
+		if(lo >= 0)
+		{
+			rowEdge[k] = 0;
+			stepA[k] = 0;
+			stepB[k] = 0;
+		}
+		else
+		{
+			rowEdge[k] = (int)e00;
+			stepA[k] = (int)(16 * edgeA[k]);
+			stepB[k] = (int)(16 * edgeB[k]);
+		}
+	}
+
+	// Screen-space barycentrics of vertices 1 and 2, from the edges opposite
+	// them, relative to a vertex on each edge to keep float precision.
+	const double area = (double)(tri.X[1] - tri.X[0]) * (tri.Y[2] - tri.Y[0]) - (double)(tri.X[2] - tri.X[0]) * (tri.Y[1] - tri.Y[0]);
+	Gradients g;
+	g.B1Dx = (float)(16.0 * edgeA[2] / area);
+	g.B1Dy = (float)(16.0 * edgeB[2] / area);
+	g.B2Dx = (float)(16.0 * edgeA[0] / area);
+	g.B2Dy = (float)(16.0 * edgeB[0] / area);
+
+	auto b1At = [&](int x, int y)
+	{
+		return (float)(((double)edgeA[2] * (16 * x + 8 - tri.X[2]) + (double)edgeB[2] * (16 * y + 8 - tri.Y[2])) / area);
+	};
+	auto b2At = [&](int x, int y)
+	{
+		return (float)(((double)edgeA[0] * (16 * x + 8 - tri.X[0]) + (double)edgeB[0] * (16 * y + 8 - tri.Y[0])) / area);
+	};
+
+	const PipelineDesc& pipeline = *mDraws[tri.Draw].Pipeline;
+	const float dz1 = tri.Z[1] - tri.Z[0];
+	const float dz2 = tri.Z[2] - tri.Z[0];
+
+	std::uint64_t shaded = 0;
+
+	// Shades the pixels of a group of four that passed coverage and depth.
+	auto shadeGroup = [&](int px, int y, unsigned mask, float b1Row, float b2Row, const float z[4])
+	{
+		std::uint32_t* color = mColor.data() + (std::size_t)y * mPitch;
+		float* depth = mDepth.data() + (std::size_t)y * mPitch;
+
+		for(int lane = 0; lane < 4; ++lane)
+		{
+			if(!(mask & (1u << lane)))
+				continue;
+
+			const int x = px + lane;
+			const float b1 = b1Row + g.B1Dx * (float)(x - groupX0);
+			const float b2 = b2Row + g.B2Dx * (float)(x - groupX0);
+
+			float src[4];
+			if(!ShadePixel(tri, g, b1, b2, src))
+				continue;
+			++shaded;
+
+			if(pipeline.Blend)
+			{
+				const std::uint32_t dst = color[x];
+				for(int c = 0; c < 3; ++c)
+				{
+					const float d = (float)((dst >> (8 * c)) & 255) * (1.0f / 255.0f);
+					src[c] = src[c] * src[3] + d * (1.0f - src[3]);
+				}
+			}
+
+			color[x] = PackColor(src);
+			depth[x] = z[lane];
+		}
+	};
+
+#if defined(SOFTWARE_RENDER_SSE)
+	const __m128i laneSteps = _mm_setr_epi32(0, 1, 2, 3);
+	const __m128 laneOffsets = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+
+	__m128i laneA[3], groupStep[3];
+	for(int k = 0; k < 3; ++k)
+	{
+		// 16 * A * lane, without a 32 bit multiply (SSE4.1).
+		const __m128i a = _mm_set1_epi32(stepA[k]);
+		laneA[k] = _mm_add_epi32(_mm_and_si128(_mm_cmpgt_epi32(laneSteps, _mm_setzero_si128()), a),
+			_mm_add_epi32(_mm_and_si128(_mm_cmpgt_epi32(laneSteps, _mm_set1_epi32(1)), a),
+				_mm_and_si128(_mm_cmpgt_epi32(laneSteps, _mm_set1_epi32(2)), a)));
+		groupStep[k] = _mm_set1_epi32(4 * stepA[k]);
+	}
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 b1StepX = _mm_set1_ps(g.B1Dx);
+	const __m128 b2StepX = _mm_set1_ps(g.B2Dx);
+	const __m128 z0 = _mm_set1_ps(tri.Z[0]);
+	const __m128 z1 = _mm_set1_ps(dz1);
+	const __m128 z2 = _mm_set1_ps(dz2);
+
+	for(int y = y0; y <= y1; ++y)
+	{
+		const int dy = y - y0;
+		__m128i e[3];
+		for(int k = 0; k < 3; ++k)
+			e[k] = _mm_add_epi32(_mm_set1_epi32(rowEdge[k] + stepB[k] * dy), laneA[k]);
+
+		const float b1Row = b1At(groupX0, y);
+		const float b2Row = b2At(groupX0, y);
+		float* depthRow = mDepth.data() + (std::size_t)y * mPitch;
+
+		for(int px = groupX0; px <= groupX1; px += 4)
+		{
+			// A lane is outside when any edge value is negative.
+			const __m128i outside = _mm_or_si128(e[0], _mm_or_si128(e[1], e[2]));
+			unsigned mask = ~(unsigned)_mm_movemask_ps(_mm_castsi128_ps(outside)) & 15u;
+			for(int k = 0; k < 3; ++k)
+				e[k] = _mm_add_epi32(e[k], groupStep[k]);
+
+			if(px < x0)
+				mask &= 15u << (x0 - px);
+			if(px + 3 > x1)
+				mask &= 15u >> (px + 3 - x1);
+			if(mask == 0)
+				continue;
+
+			const __m128 lanes = _mm_add_ps(_mm_set1_ps((float)(px - groupX0)), laneOffsets);
+			const __m128 b1 = _mm_add_ps(_mm_set1_ps(b1Row), _mm_mul_ps(b1StepX, lanes));
+			const __m128 b2 = _mm_add_ps(_mm_set1_ps(b2Row), _mm_mul_ps(b2StepX, lanes));
+			__m128 z = _mm_add_ps(z0, _mm_add_ps(_mm_mul_ps(b1, z1), _mm_mul_ps(b2, z2)));
+			z = _mm_min_ps(_mm_max_ps(z, zero), one);
+
+			// Depth test: less.
+			mask &= (unsigned)_mm_movemask_ps(_mm_cmplt_ps(z, _mm_loadu_ps(depthRow + px)));
+			if(mask == 0)
+				continue;
+
+			float zs[4];
+			_mm_storeu_ps(zs, z);
+			shadeGroup(px, y, mask, b1Row, b2Row, zs);
+		}
+	}
+#else
+	for(int y = y0; y <= y1; ++y)
+	{
+		const int dy = y - y0;
+		const float b1Row = b1At(groupX0, y);
+		const float b2Row = b2At(groupX0, y);
+		const float* depthRow = mDepth.data() + (std::size_t)y * mPitch;
+
+		for(int px = groupX0; px <= groupX1; px += 4)
+		{
+			unsigned mask = 0;
+			float zs[4];
+			for(int lane = 0; lane < 4; ++lane)
+			{
+				const int x = px + lane;
+				if(x < x0 || x > x1)
+					continue;
+
+				bool inside = true;
+				for(int k = 0; k < 3 && inside; ++k)
+					inside = rowEdge[k] + stepB[k] * dy + stepA[k] * (x - groupX0) >= 0;
+				if(!inside)
+					continue;
+
+				const float b1 = b1Row + g.B1Dx * (float)(x - groupX0);
+				const float b2 = b2Row + g.B2Dx * (float)(x - groupX0);
+				zs[lane] = Saturate(tri.Z[0] + b1 * dz1 + b2 * dz2);
+				if(zs[lane] < depthRow[x])
+					mask |= 1u << lane;
+			}
+
+			if(mask != 0)
+				shadeGroup(px, y, mask, b1Row, b2Row, zs);
+		}
+	}
+#endif
+
+	bins.PixelsShaded += shaded;
+}
+
+bool SoftwareRenderDevice::ShadePixel(const Triangle& tri, const Gradients& g, float b1, float b2, float rgba[4])const
+{
+	const ResolvedDraw& draw = mDraws[tri.Draw];
+	const PipelineDesc& pipeline = *draw.Pipeline;
+	const PassConstants& pass = *reinterpret_cast<const PassConstants*>(draw.Pass);
+	const MaterialData& material = *reinterpret_cast<const MaterialData*>(draw.Material);
+
+	// Perspective-correct weights of vertices 1 and 2.
+	auto weights = [&](float s1, float s2, float& w1, float& w2)
+	{
+		const float q0 = (1.0f - s1 - s2) * tri.InvW[0];
+		const float q1 = s1 * tri.InvW[1];
+		const float q2 = s2 * tri.InvW[2];
+		const float inv = 1.0f / (q0 + q1 + q2);
+		w1 = q1 * inv;
+		w2 = q2 * inv;
+	};
+	auto attribute = [&](int a, float w1, float w2)
+	{
+		const float a0 = tri.Attributes[0][a];
+		return a0 + w1 * (tri.Attributes[1][a] - a0) + w2 * (tri.Attributes[2][a] - a0);
+	};
+
+	float w1, w2;
+	weights(b1, b2, w1, w2);
+
+	const float u = attribute(TexC + 0, w1, w2);
+	const float v = attribute(TexC + 1, w1, w2);
+
+	// Texture coordinates one pixel right and one down give the footprint.
+	float rx1, rx2, dy1, dy2;
+	weights(b1 + g.B1Dx, b2 + g.B2Dx, rx1, rx2);
+	weights(b1 + g.B1Dy, b2 + g.B2Dy, dy1, dy2);
+
+	const SoftwareTexture& texture = *draw.Texture;
+	const float dudx = (attribute(TexC + 0, rx1, rx2) - u) * texture.Width();
+	const float dvdx = (attribute(TexC + 1, rx1, rx2) - v) * texture.Height();
+	const float dudy = (attribute(TexC + 0, dy1, dy2) - u) * texture.Width();
+	const float dvdy = (attribute(TexC + 1, dy1, dy2) - v) * texture.Height();
+	const float footprint = std::max(dudx * dudx + dvdx * dvdx, dudy * dudy + dvdy * dvdy);
+	const float lod = footprint > 0.0f ? 0.5f * std::log2(footprint) : 0.0f;
+
+	// Tree sprites pick one of the array's slices by primitive.
+	const int slice = pipeline.Program == Shader::TreeSprite ? (int)(tri.PrimitiveId % 3) : 0;
+
+	float texel[4];
+	texture.Sample(u, v, slice, lod, texel);
+
+	Material mat;
+	for(int c = 0; c < 4; ++c)
+		mat.DiffuseAlbedo[c] = texel[c] * material.DiffuseAlbedo[c];
+
+	if(pipeline.AlphaTest && mat.DiffuseAlbedo[3] - 0.1f < 0.0f)
+		return false;
+
+	mat.FresnelR0 = Make(material.FresnelR0);
+	mat.Shininess = 1.0f - material.Roughness;
+
+	const Float3 posW = { attribute(PosW + 0, w1, w2), attribute(PosW + 1, w1, w2), attribute(PosW + 2, w1, w2) };
+	const Float3 normalW = Normalize({ attribute(NormalW + 0, w1, w2), attribute(NormalW + 1, w1, w2), attribute(NormalW + 2, w1, w2) });
+
+	Float3 toEyeW = Make(pass.EyePosW) - posW;
+	const float distToEye = Length(toEyeW);
+	toEyeW = toEyeW * (1.0f / distToEye);
+
+	const int dirLights = pipeline.Program == Shader::TreeSprite ? TreeSpriteDirLights : DefaultDirLights;
+	const int pointLights = pipeline.Program == Shader::TreeSprite ? 0 : DefaultPointLights;
+
+	Float3 directLight = { 0.0f, 0.0f, 0.0f };
+	for(int i = 0; i < dirLights; ++i)
+		directLight = directLight + ComputeDirectionalLight(pass.Lights[i], mat, normalW, toEyeW);
+	for(int i = dirLights; i < dirLights + pointLights; ++i)
+		directLight = directLight + ComputePointLight(pass.Lights[i], mat, posW, normalW, toEyeW);
+
+	for(int c = 0; c < 3; ++c)
+		rgba[c] = pass.AmbientLight[c] * mat.DiffuseAlbedo[c] + (&directLight.x)[c];
+
+	if(pipeline.Fog)
+	{
+		const float fogAmount = Saturate((distToEye - pass.FogStart) / pass.FogRange);
+		for(int c = 0; c < 3; ++c)
+			rgba[c] += (pass.FogColor[c] - rgba[c]) * fogAmount;
+	}
+
+	rgba[3] = mat.DiffuseAlbedo[3];
+	return true;
+}
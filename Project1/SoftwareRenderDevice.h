@@ -0,0 +1,259 @@
+//***************************************************************************************
+// SoftwareRenderDevice.h
+//
+// Reference renderer: an IRenderDevice that draws on the CPU, following the
+// app's shaders (Default.hlsl, TreeSprite.hlsl and the lighting in
+// LightingUtil.hlsl), alpha test, fog and blending.  Frames come out as images,
+// so the scene can be checked against golden images and timed without a GPU.
+//
+// Bindings follow the app's root signature.  SetTexture slot 0 is the diffuse
+// map; SetConstant slot 1 is the object index; SetBuffer slots 2, 3, 4 and 5 are
+// the pass constants and the material, instance and object data.  The object
+// names its material and where its instances start.  Buffers hold the same bytes the GPU would see, with
+// matrices transposed as FrameResource writes them.  Vertices are the app's
+// Vertex (position, normal, texture coordinates) or, for tree sprites, a centre
+// and a size.
+//
+// Execute renders its lists in two passes over worker threads, like
+// OcclusionBuffer.  The first runs the vertex stage, clips against the frustum
+// and bins triangles into screen tiles; each worker takes a contiguous run of
+// the primitives and keeps its own bins, so reading them worker by worker keeps
+// the submission order.  The second hands out tiles; the worker owning a tile
+// tests coverage four pixels at a time (exact, on a 1/16 pixel grid with the
+// top-left rule), depth tests them with SSE, and shades what is left with
+// perspective-correct attributes.
+//
+// The target is RGBA8 UNORM with a 32 bit float depth buffer, cleared at the
+// first Execute of each frame.
+//***************************************************************************************
+
+#pragma once
+
+#include "RenderDevice.h"
+#include "SoftwareTexture.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class SoftwareRenderDevice : public IRenderDevice
+{
+public:
+	static const int TileWidth = 64;
+	static const int TileHeight = 32;
+
+	// Sizes up to 4096 pixels a side.  threadCount 0 picks one per core.
+	SoftwareRenderDevice(int width, int height, int maxLists, int threadCount = 0);
+	~SoftwareRenderDevice();
+
+	void SetThreadCount(int threadCount);
+	void SetClearColor(float r, float g, float b, float a);
+
+	virtual void CreatePipeline(int pipeline, const PipelineDesc& desc)override;
+	// A texture that fails to load samples as white.
+	virtual bool CreateTexture(int texture, const std::string& path)override;
+
+	virtual int CreateBuffer(BufferType type, std::uint32_t stride, std::uint32_t count)override;
+	virtual void ReleaseBuffer(int buffer)override;
+	virtual void WriteBuffer(int buffer, std::uint32_t first, const void* data, std::uint32_t count)override;
+
+	virtual void BeginList(int list)override;
+	virtual void SetPipeline(int list, int pipeline)override;
+	virtual void SetGeometry(int list, int vertexBuffer, int indexBuffer, Topology topology)override;
+	virtual void SetTexture(int list, int slot, int texture)override;
+	virtual void SetBuffer(int list, int slot, int buffer, std::uint32_t element)override;
+	virtual void SetConstant(int list, int slot, std::uint32_t value)override;
+	virtual void DrawIndexed(int list, std::uint32_t indexCount, std::uint32_t instanceCount,
+		std::uint32_t startIndex, int baseVertex)override;
+	virtual void DrawIndirect(int list, int argBuffer, std::uint32_t first, std::uint32_t count)override;
+	virtual void EndList(int list)override;
+
+	virtual void Execute(int count)override;
+	virtual void Present()override;
+
+	int Width()const { return mWidth; }
+	int Height()const { return mHeight; }
+
+	// The last presented frame.
+	const Image& FrontBuffer()const { return mFrontBuffer; }
+
+	// Reason the last CreateTexture failed.
+	const std::string& LastError()const { return mLastError; }
+
+	struct Stats
+	{
+		int Draws = 0;
+		// Triangles that reached the binner, after clipping and culling.
+		int Triangles = 0;
+		std::uint64_t PixelsShaded = 0;
+	};
+
+	const Stats& LastFrame()const { return mLastFrame; }
+
+private:
+	static const int SlotCount = 6;
+	static const int AttributeCount = 8;	// PosW, NormalW, TexC
+
+	struct Buffer
+	{
+		BufferType Type = BufferType::Vertex;
+		std::uint32_t Stride = 0;
+		std::uint32_t Count = 0;
+		std::vector<unsigned char> Data;
+		bool Live = false;
+	};
+
+	struct Binding
+	{
+		int Buffer = -1;
+		std::uint32_t Element = 0;
+		std::uint32_t Constant = 0;
+	};
+
+	// Everything a draw reads, as bound when it was recorded.
+	struct BoundState
+	{
+		int Pipeline = -1;
+		int VertexBuffer = -1;
+		int IndexBuffer = -1;
+		Topology PrimitiveTopology = TriangleList;
+		int Texture = -1;
+		Binding Slots[SlotCount];
+	};
+
+	// A DrawIndexed, or with ArgBuffer set a DrawIndirect whose commands are
+	// expanded into draws by Execute.
+	struct Draw
+	{
+		BoundState State;
+		std::uint32_t IndexCount = 0;
+		std::uint32_t InstanceCount = 0;
+		std::uint32_t StartIndex = 0;
+		int BaseVertex = 0;
+
+		int ArgBuffer = -1;
+		std::uint32_t FirstArg = 0;
+		std::uint32_t ArgCount = 0;
+	};
+
+	struct List
+	{
+		bool Open = false;
+		bool Ended = false;
+		BoundState State;
+		std::vector<Draw> Draws;
+	};
+
+	// A draw with its bindings looked up, ready for Execute.  The constants
+	// point at the elements the draw reads.
+	struct ResolvedDraw
+	{
+		const PipelineDesc* Pipeline = nullptr;
+		const SoftwareTexture* Texture = nullptr;
+		const unsigned char* Vertices = nullptr;
+		std::uint32_t VertexStride = 0;
+		std::uint32_t VertexCount = 0;
+		const std::uint32_t* Indices = nullptr;
+		const unsigned char* Object = nullptr;
+		const unsigned char* Pass = nullptr;
+		const unsigned char* Material = nullptr;
+		const unsigned char* Instances = nullptr;
+		Topology PrimitiveTopology = TriangleList;
+		std::uint32_t StartIndex = 0;
+		int BaseVertex = 0;
+	};
+
+	// A run of one instance's primitives, the unit the setup pass hands out.
+	struct PrimitiveRun
+	{
+		int Draw = 0;
+		std::uint32_t Instance = 0;
+		std::uint32_t First = 0;
+		std::uint32_t Count = 0;
+	};
+
+	// Screen-space triangle.  X and Y are on a 1/16 pixel grid, wound so the
+	// edge functions are >= 0 inside.
+	struct Triangle
+	{
+		int X[3];
+		int Y[3];
+		float Z[3];
+		float InvW[3];
+		float Attributes[3][AttributeCount];
+		int Draw;
+		std::uint32_t PrimitiveId;
+	};
+
+	// Screen-space barycentrics of vertices 1 and 2 at a pixel centre, and
+	// their steps to the next pixel right and down.
+	struct Gradients
+	{
+		float B1Dx, B1Dy;
+		float B2Dx, B2Dy;
+	};
+
+	struct WorkerBins
+	{
+		std::vector<Triangle> Triangles;
+		// Per tile, indices into Triangles.
+		std::vector<std::vector<int>> Tiles;
+		std::uint64_t PixelsShaded = 0;
+	};
+
+	struct ClipVertex
+	{
+		float Pos[4];
+		float Attributes[AttributeCount];
+	};
+
+	template<typename F>
+	void RunWorkers(F f);
+
+	bool ValidBuffer(int buffer)const;
+	// Looks up the buffers 'draw' reads; false when one is missing or too small.
+	bool Resolve(const Draw& draw, ResolvedDraw& resolved)const;
+	void AddDraw(const Draw& draw);
+
+	void ClearTargets();
+	void SetupRun(const PrimitiveRun& run, WorkerBins& bins)const;
+	// Clips, culls and bins a clip-space triangle of draw 'draw'.
+	void SetupTriangle(int draw, const ClipVertex v[3], std::uint32_t primitiveId, WorkerBins& bins)const;
+	void BinTriangle(const Triangle& tri, WorkerBins& bins)const;
+	void RasterizeTile(int tile, int worker);
+	void RasterizeTriangle(const Triangle& tri, int tileX0, int tileY0, WorkerBins& bins);
+	// Runs the pixel shader; false when it discards the pixel.
+	bool ShadePixel(const Triangle& tri, const Gradients& g, float b1, float b2, float rgba[4])const;
+
+private:
+	int mWidth = 0;
+	int mHeight = 0;
+	// Padded to whole tiles.
+	int mPitch = 0;
+	int mTilesX = 0;
+	int mTilesY = 0;
+	int mThreadCount = 1;
+
+	std::vector<Buffer> mBuffers;
+	std::vector<int> mFreeBuffers;
+	std::vector<List> mLists;
+	std::vector<std::unique_ptr<PipelineDesc>> mPipelines;
+	std::vector<std::unique_ptr<SoftwareTexture>> mTextures;
+	SoftwareTexture mWhite;
+	std::string mLastError;
+
+	// Per Execute.
+	std::vector<ResolvedDraw> mDraws;
+	std::vector<PrimitiveRun> mRuns;
+	std::vector<WorkerBins> mBins;
+
+	float mClearColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+	bool mCleared = false;
+	std::vector<std::uint32_t> mColor;
+	std::vector<float> mDepth;
+	Image mFrontBuffer;
+
+	Stats mFrame;
+	Stats mLastFrame;
+};
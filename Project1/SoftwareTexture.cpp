@@ -0,0 +1,569 @@
+//***************************************************************************************
+// SoftwareTexture.cpp
+//***************************************************************************************
+
+#include "SoftwareTexture.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace
+{
+	const std::uint32_t DdsMagic = 0x20534444;	// "DDS "
+
+	// DDS_PIXELFORMAT flags.
+	const std::uint32_t DdpfAlphaPixels = 0x1;
+	const std::uint32_t DdpfAlpha = 0x2;
+	const std::uint32_t DdpfFourCC = 0x4;
+	const std::uint32_t DdpfRgb = 0x40;
+	const std::uint32_t DdpfLuminance = 0x20000;
+
+	const std::uint32_t DdsdMipMapCount = 0x20000;
+	const std::uint32_t Ddscaps2Cubemap = 0x200;
+
+	std::uint32_t FourCC(char a, char b, char c, char d)
+	{
+		return (std::uint32_t)(unsigned char)a | ((std::uint32_t)(unsigned char)b << 8) |
+			((std::uint32_t)(unsigned char)c << 16) | ((std::uint32_t)(unsigned char)d << 24);
+	}
+
+	std::uint32_t Read32(const unsigned char* p)
+	{
+		return (std::uint32_t)p[0] | ((std::uint32_t)p[1] << 8) | ((std::uint32_t)p[2] << 16) | ((std::uint32_t)p[3] << 24);
+	}
+
+	std::uint32_t Pack(unsigned r, unsigned g, unsigned b, unsigned a)
+	{
+		return r | (g << 8) | (b << 16) | (a << 24);
+	}
+
+	enum class Format
+	{
+		Unsupported,
+		Masked,
+		BC1,
+		BC2,
+		BC3
+	};
+
+	// What the top level of each slice needs to be decoded.
+	struct Layout
+	{
+		Format Kind = Format::Unsupported;
+		int BitCount = 0;
+		std::uint32_t Masks[4] = { 0, 0, 0, 0 };
+		// Luminance: the red mask goes to red, green and blue.
+		bool Luminance = false;
+	};
+
+	// DXGI_FORMAT values of the DX10 header that map on to the layouts above.
+	bool DxgiLayout(std::uint32_t format, Layout& layout)
+	{
+		switch(format)
+		{
+		case 28: case 29:	// R8G8B8A8_UNORM(_SRGB)
+			layout.Kind = Format::Masked;
+			layout.BitCount = 32;
+			layout.Masks[0] = 0x000000ff; layout.Masks[1] = 0x0000ff00; layout.Masks[2] = 0x00ff0000; layout.Masks[3] = 0xff000000;
+			return true;
+		case 87: case 91:	// B8G8R8A8_UNORM(_SRGB)
+			layout.Kind = Format::Masked;
+			layout.BitCount = 32;
+			layout.Masks[0] = 0x00ff0000; layout.Masks[1] = 0x0000ff00; layout.Masks[2] = 0x000000ff; layout.Masks[3] = 0xff000000;
+			return true;
+		case 88:			// B8G8R8X8_UNORM
+			layout.Kind = Format::Masked;
+			layout.BitCount = 32;
+			layout.Masks[0] = 0x00ff0000; layout.Masks[1] = 0x0000ff00; layout.Masks[2] = 0x000000ff;
+			return true;
+		case 61:			// R8_UNORM
+			layout.Kind = Format::Masked;
+			layout.BitCount = 8;
+			layout.Masks[0] = 0xff;
+			layout.Luminance = true;
+			return true;
+		case 71: case 72:	layout.Kind = Format::BC1; return true;
+		case 74: case 75:	layout.Kind = Format::BC2; return true;
+		case 77: case 78:	layout.Kind = Format::BC3; return true;
+		default:
+			return false;
+		}
+	}
+
+	std::size_t LevelBytes(const Layout& layout, int width, int height)
+	{
+		if(layout.Kind == Format::Masked)
+			return ((std::size_t)width * layout.BitCount + 7) / 8 * height;
+
+		const std::size_t blocks = (std::size_t)std::max(1, (width + 3) / 4) * std::max(1, (height + 3) / 4);
+		return blocks * (layout.Kind == Format::BC1 ? 8 : 16);
+	}
+
+	// Scales the bits under 'mask' to 0-255; 'fallback' when the mask is empty.
+	unsigned Channel(std::uint32_t pixel, std::uint32_t mask, unsigned fallback)
+	{
+		if(mask == 0)
+			return fallback;
+
+		int shift = 0;
+		while(((mask >> shift) & 1) == 0)
+			++shift;
+		const std::uint32_t max = mask >> shift;
+		return (unsigned)(((pixel & mask) >> shift) * 255 / max);
+	}
+
+	void DecodeMasked(const unsigned char* src, const Layout& layout, Image& image)
+	{
+		const int bytes = layout.BitCount / 8;
+		const std::size_t pitch = ((std::size_t)image.Width * layout.BitCount + 7) / 8;
+
+		for(int y = 0; y < image.Height; ++y)
+		{
+			const unsigned char* row = src + pitch * y;
+			for(int x = 0; x < image.Width; ++x)
+			{
+				std::uint32_t pixel = 0;
+				for(int b = 0; b < bytes; ++b)
+					pixel |= (std::uint32_t)row[x * bytes + b] << (8 * b);
+
+				const unsigned r = Channel(pixel, layout.Masks[0], 0);
+				const unsigned g = layout.Luminance ? r : Channel(pixel, layout.Masks[1], 0);
+				const unsigned b = layout.Luminance ? r : Channel(pixel, layout.Masks[2], 0);
+				const unsigned a = Channel(pixel, layout.Masks[3], 255);
+				image.Pixels[(std::size_t)y * image.Width + x] = Pack(r, g, b, a);
+			}
+		}
+	}
+
+	// Colour part of a BC1/2/3 block.  BC2 and BC3 always use four colours.
+	void DecodeColorBlock(const unsigned char* block, bool allowTransparent, std::uint32_t out[16])
+	{
+		const unsigned c0 = block[0] | (block[1] << 8);
+		const unsigned c1 = block[2] | (block[3] << 8);
+
+		unsigned rgb[4][3];
+		const unsigned ends[2] = { c0, c1 };
+		for(int i = 0; i < 2; ++i)
+		{
+			rgb[i][0] = ((ends[i] >> 11) & 31) * 255 / 31;
+			rgb[i][1] = ((ends[i] >> 5) & 63) * 255 / 63;
+			rgb[i][2] = (ends[i] & 31) * 255 / 31;
+		}
+
+		unsigned alpha3 = 255;
+		for(int k = 0; k < 3; ++k)
+		{
+			if(c0 > c1 || !allowTransparent)
+			{
+				rgb[2][k] = (2 * rgb[0][k] + rgb[1][k]) / 3;
+				rgb[3][k] = (rgb[0][k] + 2 * rgb[1][k]) / 3;
+			}
+			else
+			{
+				rgb[2][k] = (rgb[0][k] + rgb[1][k]) / 2;
+				rgb[3][k] = 0;
+				alpha3 = 0;
+			}
+		}
+
+		const std::uint32_t indices = Read32(block + 4);
+		for(int i = 0; i < 16; ++i)
+		{
+			const unsigned index = (indices >> (2 * i)) & 3;
+			out[i] = Pack(rgb[index][0], rgb[index][1], rgb[index][2], index == 3 ? alpha3 : 255);
+		}
+	}
+
+	void DecodeBC3Alpha(const unsigned char* block, unsigned out[16])
+	{
+		unsigned a[8];
+		a[0] = block[0];
+		a[1] = block[1];
+		if(a[0] > a[1])
+		{
+			for(int i = 1; i < 7; ++i)
+				a[i + 1] = ((7 - i) * a[0] + i * a[1]) / 7;
+		}
+		else
+		{
+			for(int i = 1; i < 5; ++i)
+				a[i + 1] = ((5 - i) * a[0] + i * a[1]) / 5;
+			a[6] = 0;
+			a[7] = 255;
+		}
+
+		std::uint64_t bits = 0;
+		for(int i = 0; i < 6; ++i)
+			bits |= (std::uint64_t)block[2 + i] << (8 * i);
+
+		for(int i = 0; i < 16; ++i)
+			out[i] = a[(bits >> (3 * i)) & 7];
+	}
+
+	void DecodeBlocks(const unsigned char* src, Format kind, Image& image)
+	{
+		const int blocksX = std::max(1, (image.Width + 3) / 4);
+		const int blocksY = std::max(1, (image.Height + 3) / 4);
+		const int blockBytes = kind == Format::BC1 ? 8 : 16;
+
+		for(int by = 0; by < blocksY; ++by)
+		{
+			for(int bx = 0; bx < blocksX; ++bx)
+			{
+				const unsigned char* block = src + ((std::size_t)by * blocksX + bx) * blockBytes;
+
+				std::uint32_t texels[16];
+				if(kind == Format::BC1)
+				{
+					DecodeColorBlock(block, true, texels);
+				}
+				else
+				{
+					DecodeColorBlock(block + 8, false, texels);
+
+					unsigned alpha[16];
+					if(kind == Format::BC2)
+					{
+						for(int i = 0; i < 16; ++i)
+							alpha[i] = ((block[i / 2] >> (4 * (i & 1))) & 15) * 17;
+					}
+					else
+					{
+						DecodeBC3Alpha(block, alpha);
+					}
+
+					for(int i = 0; i < 16; ++i)
+						texels[i] = (texels[i] & 0x00ffffff) | (alpha[i] << 24);
+				}
+
+				for(int i = 0; i < 16; ++i)
+				{
+					const int x = bx * 4 + (i & 3);
+					const int y = by * 4 + (i >> 2);
+					if(x < image.Width && y < image.Height)
+						image.Pixels[(std::size_t)y * image.Width + x] = texels[i];
+				}
+			}
+		}
+	}
+
+	std::uint32_t Average(std::uint32_t a, std::uint32_t b, std::uint32_t c, std::uint32_t d)
+	{
+		std::uint32_t result = 0;
+		for(int shift = 0; shift < 32; shift += 8)
+		{
+			const unsigned sum = ((a >> shift) & 255) + ((b >> shift) & 255) + ((c >> shift) & 255) + ((d >> shift) & 255);
+			result |= ((sum + 2) / 4) << shift;
+		}
+		return result;
+	}
+
+	int Wrap(int i, int size)
+	{
+		i %= size;
+		return i < 0 ? i + size : i;
+	}
+}
+
+bool SaveTga(const Image& image, const std::string& path)
+{
+	if(image.Width <= 0 || image.Height <= 0 || image.Width > 0xffff || image.Height > 0xffff)
+		return false;
+
+	std::ofstream file(path, std::ios::binary);
+	if(!file)
+		return false;
+
+	// Uncompressed true colour, 8 alpha bits, origin at the top left.
+	unsigned char header[18] = {};
+	header[2] = 2;
+	header[12] = (unsigned char)(image.Width & 0xff);
+	header[13] = (unsigned char)(image.Width >> 8);
+	header[14] = (unsigned char)(image.Height & 0xff);
+	header[15] = (unsigned char)(image.Height >> 8);
+	header[16] = 32;
+	header[17] = 0x28;
+	file.write((const char*)header, sizeof(header));
+
+	std::vector<unsigned char> bgra(image.Pixels.size() * 4);
+	for(std::size_t i = 0; i < image.Pixels.size(); ++i)
+	{
+		const std::uint32_t p = image.Pixels[i];
+		bgra[i * 4 + 0] = (unsigned char)(p >> 16);
+		bgra[i * 4 + 1] = (unsigned char)(p >> 8);
+		bgra[i * 4 + 2] = (unsigned char)p;
+		bgra[i * 4 + 3] = (unsigned char)(p >> 24);
+	}
+	file.write((const char*)bgra.data(), bgra.size());
+
+	return (bool)file;
+}
+
+bool LoadTga(const std::string& path, Image& image)
+{
+	std::ifstream file(path, std::ios::binary);
+	if(!file)
+		return false;
+
+	unsigned char header[18];
+	if(!file.read((char*)header, sizeof(header)))
+		return false;
+
+	const int width = header[12] | (header[13] << 8);
+	const int height = header[14] | (header[15] << 8);
+	const int bpp = header[16];
+	if(header[1] != 0 || header[2] != 2 || (bpp != 24 && bpp != 32) || width == 0 || height == 0)
+		return false;
+
+	file.ignore(header[0]);
+
+	const int bytes = bpp / 8;
+	std::vector<unsigned char> data((std::size_t)width * height * bytes);
+	if(!file.read((char*)data.data(), data.size()))
+		return false;
+
+	const bool topDown = (header[17] & 0x20) != 0;
+
+	image.Width = width;
+	image.Height = height;
+	image.Pixels.resize((std::size_t)width * height);
+	for(int y = 0; y < height; ++y)
+	{
+		const unsigned char* row = data.data() + (std::size_t)(topDown ? y : height - 1 - y) * width * bytes;
+		for(int x = 0; x < width; ++x)
+		{
+			const unsigned char* p = row + x * bytes;
+			image.Pixels[(std::size_t)y * width + x] = Pack(p[2], p[1], p[0], bytes == 4 ? p[3] : 255);
+		}
+	}
+
+	return true;
+}
+
+ImageDiff CompareImages(const Image& a, const Image& b, int tolerance)
+{
+	ImageDiff diff;
+	if(a.Width != b.Width || a.Height != b.Height)
+	{
+		diff.DifferentPixels = std::max(a.Width * a.Height, b.Width * b.Height);
+		diff.MaxChannelDiff = 255;
+		return diff;
+	}
+
+	for(std::size_t i = 0; i < a.Pixels.size(); ++i)
+	{
+		int worst = 0;
+		for(int shift = 0; shift < 32; shift += 8)
+		{
+			const int ca = (a.Pixels[i] >> shift) & 255;
+			const int cb = (b.Pixels[i] >> shift) & 255;
+			worst = std::max(worst, std::abs(ca - cb));
+		}
+
+		diff.MaxChannelDiff = std::max(diff.MaxChannelDiff, worst);
+		if(worst > tolerance)
+			++diff.DifferentPixels;
+	}
+
+	return diff;
+}
+
+SoftwareTexture::SoftwareTexture()
+{
+	SetSolid(0xffffffff);
+}
+
+void SoftwareTexture::SetSolid(std::uint32_t rgba)
+{
+	Image texel;
+	texel.Width = 1;
+	texel.Height = 1;
+	texel.Pixels.assign(1, rgba);
+
+	mSlices.assign(1, std::vector<Image>(1, texel));
+}
+
+bool SoftwareTexture::LoadDds(const std::string& path, std::string* error)
+{
+	auto fail = [&](const char* why)
+	{
+		if(error != nullptr)
+			*error = path + ": " + why;
+		return false;
+	};
+
+	std::ifstream file(path, std::ios::binary);
+	if(!file)
+		return fail("cannot open the file");
+
+	const std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	if(data.size() < 128 || Read32(&data[0]) != DdsMagic || Read32(&data[4]) != 124)
+		return fail("not a DDS file");
+
+	const unsigned char* header = &data[4];
+	const int height = (int)Read32(header + 8);
+	const int width = (int)Read32(header + 12);
+	const int levels = (Read32(header + 4) & DdsdMipMapCount) ? std::max(1, (int)Read32(header + 24)) : 1;
+	const std::uint32_t pfFlags = Read32(header + 76);
+	const std::uint32_t fourCC = Read32(header + 80);
+
+	if(Read32(header + 108) & Ddscaps2Cubemap)
+		return fail("cube maps are not supported");
+	if(width <= 0 || height <= 0)
+		return fail("bad size");
+
+	Layout layout;
+	int sliceCount = 1;
+	std::size_t offset = 128;
+
+	if(pfFlags & DdpfFourCC)
+	{
+		if(fourCC == FourCC('D', 'X', '1', '0'))
+		{
+			if(data.size() < 148)
+				return fail("truncated header");
+
+			sliceCount = std::max(1, (int)Read32(&data[128 + 12]));
+			offset = 148;
+			if(!DxgiLayout(Read32(&data[128]), layout))
+				return fail("unsupported DXGI format");
+		}
+		else if(fourCC == FourCC('D', 'X', 'T', '1'))
+			layout.Kind = Format::BC1;
+		else if(fourCC == FourCC('D', 'X', 'T', '2') || fourCC == FourCC('D', 'X', 'T', '3'))
+			layout.Kind = Format::BC2;
+		else if(fourCC == FourCC('D', 'X', 'T', '4') || fourCC == FourCC('D', 'X', 'T', '5'))
+			layout.Kind = Format::BC3;
+		else
+			return fail("unsupported four character code");
+	}
+	else if(pfFlags & (DdpfRgb | DdpfLuminance | DdpfAlpha))
+	{
+		layout.Kind = Format::Masked;
+		layout.BitCount = (int)Read32(header + 84);
+		for(int i = 0; i < 4; ++i)
+			layout.Masks[i] = Read32(header + 88 + 4 * i);
+		if(!(pfFlags & (DdpfAlphaPixels | DdpfAlpha)))
+			layout.Masks[3] = 0;
+		layout.Luminance = (pfFlags & DdpfLuminance) != 0;
+
+		if(layout.BitCount != 8 && layout.BitCount != 16 && layout.BitCount != 24 && layout.BitCount != 32)
+			return fail("unsupported bit count");
+	}
+	else
+	{
+		return fail("unsupported pixel format");
+	}
+
+	// Slices follow one another, each with its whole mip chain.
+	std::size_t sliceBytes = 0;
+	for(int level = 0; level < levels; ++level)
+		sliceBytes += LevelBytes(layout, std::max(1, width >> level), std::max(1, height >> level));
+
+	if(offset + sliceBytes * sliceCount > data.size())
+		return fail("truncated data");
+
+	std::vector<std::vector<Image>> slices(sliceCount);
+	for(int slice = 0; slice < sliceCount; ++slice)
+	{
+		Image top;
+		top.Width = width;
+		top.Height = height;
+		top.Pixels.resize((std::size_t)width * height);
+
+		const unsigned char* src = &data[offset + sliceBytes * slice];
+		if(layout.Kind == Format::Masked)
+			DecodeMasked(src, layout, top);
+		else
+			DecodeBlocks(src, layout.Kind, top);
+
+		slices[slice].push_back(std::move(top));
+		BuildMips(slices[slice]);
+	}
+
+	mSlices = std::move(slices);
+	return true;
+}
+
+void SoftwareTexture::BuildMips(std::vector<Image>& levels)
+{
+	while(levels.back().Width > 1 || levels.back().Height > 1)
+	{
+		const Image& src = levels.back();
+
+		Image dst;
+		dst.Width = std::max(1, src.Width / 2);
+		dst.Height = std::max(1, src.Height / 2);
+		dst.Pixels.resize((std::size_t)dst.Width * dst.Height);
+
+		for(int y = 0; y < dst.Height; ++y)
+		{
+			const int y0 = std::min(2 * y, src.Height - 1);
+			const int y1 = std::min(2 * y + 1, src.Height - 1);
+			for(int x = 0; x < dst.Width; ++x)
+			{
+				const int x0 = std::min(2 * x, src.Width - 1);
+				const int x1 = std::min(2 * x + 1, src.Width - 1);
+				dst.Pixels[(std::size_t)y * dst.Width + x] = Average(
+					src.Pixels[(std::size_t)y0 * src.Width + x0], src.Pixels[(std::size_t)y0 * src.Width + x1],
+					src.Pixels[(std::size_t)y1 * src.Width + x0], src.Pixels[(std::size_t)y1 * src.Width + x1]);
+			}
+		}
+
+		levels.push_back(std::move(dst));
+	}
+}
+
+void SoftwareTexture::SampleLevel(const Image& level, float u, float v, float rgba[4])const
+{
+	const float x = u * level.Width - 0.5f;
+	const float y = v * level.Height - 0.5f;
+	const float fx0 = std::floor(x);
+	const float fy0 = std::floor(y);
+	const float fx = x - fx0;
+	const float fy = y - fy0;
+
+	// Texture coordinates can run far past 1 (the land tiles its texture), so
+	// wrap in float before converting.
+	const int x0 = Wrap((int)std::fmod(fx0, (float)level.Width), level.Width);
+	const int y0 = Wrap((int)std::fmod(fy0, (float)level.Height), level.Height);
+	const int x1 = x0 + 1 < level.Width ? x0 + 1 : 0;
+	const int y1 = y0 + 1 < level.Height ? y0 + 1 : 0;
+
+	const std::uint32_t t00 = level.Pixels[(std::size_t)y0 * level.Width + x0];
+	const std::uint32_t t10 = level.Pixels[(std::size_t)y0 * level.Width + x1];
+	const std::uint32_t t01 = level.Pixels[(std::size_t)y1 * level.Width + x0];
+	const std::uint32_t t11 = level.Pixels[(std::size_t)y1 * level.Width + x1];
+
+	for(int c = 0; c < 4; ++c)
+	{
+		const int shift = 8 * c;
+		const float top = (float)((t00 >> shift) & 255) * (1.0f - fx) + (float)((t10 >> shift) & 255) * fx;
+		const float bottom = (float)((t01 >> shift) & 255) * (1.0f - fx) + (float)((t11 >> shift) & 255) * fx;
+		rgba[c] = (top * (1.0f - fy) + bottom * fy) * (1.0f / 255.0f);
+	}
+}
+
+void SoftwareTexture::Sample(float u, float v, int slice, float lod, float rgba[4])const
+{
+	const std::vector<Image>& levels = mSlices[Wrap(slice, (int)mSlices.size())];
+
+	const float maxLod = (float)(levels.size() - 1);
+	lod = std::min(std::max(lod, 0.0f), maxLod);
+
+	const int level = (int)lod;
+	const float t = lod - (float)level;
+
+	SampleLevel(levels[level], u, v, rgba);
+	if(t > 0.0f && level + 1 < (int)levels.size())
+	{
+		float next[4];
+		SampleLevel(levels[level + 1], u, v, next);
+		for(int c = 0; c < 4; ++c)
+			rgba[c] += (next[c] - rgba[c]) * t;
+	}
+}
@@ -0,0 +1,79 @@
+//***************************************************************************************
+// SoftwareTexture.h
+//
+// Images and textures for SoftwareRenderDevice.  Texels are RGBA8 and sampled
+// like gsamAnisotropicWrap is on the GPU, except that filtering stops at
+// trilinear; renders are close to the GPU's but not texel exact.
+//
+// LoadDds reads the formats the app's textures use: 8, 16, 24 and 32 bit
+// uncompressed (luminance or RGB masks, with or without alpha), BC1, BC2 and
+// BC3, with or without the DX10 header, including texture arrays.  Only the top
+// level of each slice is read; the mip chain is rebuilt with a box filter.
+//
+// Images also serve as golden images: SaveTga and LoadTga round-trip them
+// exactly, and CompareImages counts the pixels that moved.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct Image
+{
+	int Width = 0;
+	int Height = 0;
+
+	// RGBA8 with red in the low byte, rows top to bottom.
+	std::vector<std::uint32_t> Pixels;
+};
+
+// Uncompressed 32 bit TGA.
+bool SaveTga(const Image& image, const std::string& path);
+bool LoadTga(const std::string& path, Image& image);
+
+struct ImageDiff
+{
+	// Pixels with a channel off by more than the tolerance.  Images of different
+	// sizes differ everywhere.
+	int DifferentPixels = 0;
+	int MaxChannelDiff = 0;
+};
+
+ImageDiff CompareImages(const Image& a, const Image& b, int tolerance);
+
+class SoftwareTexture
+{
+public:
+	SoftwareTexture();
+
+	///<summary>
+	/// Replaces the texture with the file's contents.  On failure the texture is
+	/// left as it was and 'error' says why.
+	///</summary>
+	bool LoadDds(const std::string& path, std::string* error = nullptr);
+
+	// One slice, one texel.
+	void SetSolid(std::uint32_t rgba);
+
+	int Width()const { return mSlices[0][0].Width; }
+	int Height()const { return mSlices[0][0].Height; }
+	int SliceCount()const { return (int)mSlices.size(); }
+	int LevelCount()const { return (int)mSlices[0].size(); }
+
+	///<summary>
+	/// Trilinear sample at (u, v), wrapping, from 'slice' (wrapped into range).
+	/// 'lod' is log2 of the texels per pixel at the top level.  Writes RGBA in
+	/// [0, 1].
+	///</summary>
+	void Sample(float u, float v, int slice, float lod, float rgba[4])const;
+
+private:
+	void BuildMips(std::vector<Image>& levels);
+	void SampleLevel(const Image& level, float u, float v, float rgba[4])const;
+
+private:
+	// [slice][level]
+	std::vector<std::vector<Image>> mSlices;
+};
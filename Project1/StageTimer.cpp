@@ -0,0 +1,84 @@
+//***************************************************************************************
+// StageTimer.cpp
+//***************************************************************************************
+
+#include "StageTimer.h"
+
+#include <algorithm>
+#include <cstdio>
+
+int StageTimer::AddStage(const std::string& name)
+{
+	Stage stage;
+	stage.Name = name;
+	mStages.push_back(stage);
+	return (int)mStages.size() - 1;
+}
+
+void StageTimer::Begin(int stage)
+{
+	mStages[stage].Start = Clock::now();
+}
+
+void StageTimer::End(int stage)
+{
+	Stage& s = mStages[stage];
+	s.Samples.push_back(std::chrono::duration<float, std::milli>(Clock::now() - s.Start).count());
+}
+
+void StageTimer::Reset()
+{
+	for(auto& s : mStages)
+		s.Samples.clear();
+}
+
+double StageTimer::TotalMs(int stage)const
+{
+	double total = 0.0;
+	for(float sample : mStages[stage].Samples)
+		total += sample;
+	return total;
+}
+
+double StageTimer::MeanMs(int stage)const
+{
+	const auto& samples = mStages[stage].Samples;
+	return samples.empty() ? 0.0 : TotalMs(stage) / samples.size();
+}
+
+double StageTimer::MaxMs(int stage)const
+{
+	const auto& samples = mStages[stage].Samples;
+	return samples.empty() ? 0.0 : *std::max_element(samples.begin(), samples.end());
+}
+
+double StageTimer::PercentileMs(int stage, double fraction)const
+{
+	std::vector<float> samples = mStages[stage].Samples;
+	if(samples.empty())
+		return 0.0;
+
+	fraction = std::min(std::max(fraction, 0.0), 1.0);
+	auto nth = samples.begin() + (std::size_t)(fraction * (samples.size() - 1) + 0.5);
+	std::nth_element(samples.begin(), nth, samples.end());
+	return *nth;
+}
+
+std::string StageTimer::Report()const
+{
+	std::string report;
+
+	char line[160];
+	std::snprintf(line, sizeof(line), "%-20s %8s %10s %10s %10s %10s\n",
+		"stage (ms)", "samples", "mean", "median", "p95", "max");
+	report += line;
+
+	for(int i = 0; i < StageCount(); ++i)
+	{
+		std::snprintf(line, sizeof(line), "%-20s %8d %10.4f %10.4f %10.4f %10.4f\n",
+			Name(i).c_str(), SampleCount(i), MeanMs(i), PercentileMs(i, 0.5), PercentileMs(i, 0.95), MaxMs(i));
+		report += line;
+	}
+
+	return report;
+}
@@ -0,0 +1,66 @@
+//***************************************************************************************
+// StageTimer.h
+//
+// Wall clock timings of the named stages of a frame.  Every Begin/End pair adds a
+// sample to its stage; Report prints the mean, spread and worst case of each.
+//***************************************************************************************
+
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+class StageTimer
+{
+public:
+	// Times a stage for the life of the object.
+	class Scope
+	{
+	public:
+		Scope(StageTimer& timer, int stage) : mTimer(timer), mStage(stage) { mTimer.Begin(mStage); }
+		~Scope() { mTimer.End(mStage); }
+
+		Scope(const Scope& rhs) = delete;
+		Scope& operator=(const Scope& rhs) = delete;
+
+	private:
+		StageTimer& mTimer;
+		int mStage;
+	};
+
+	// Returns the id of a new stage.
+	int AddStage(const std::string& name);
+
+	void Begin(int stage);
+	void End(int stage);
+
+	// Drops every sample; the stages stay.
+	void Reset();
+
+	int StageCount()const { return (int)mStages.size(); }
+	const std::string& Name(int stage)const { return mStages[stage].Name; }
+	int SampleCount(int stage)const { return (int)mStages[stage].Samples.size(); }
+
+	double TotalMs(int stage)const;
+	double MeanMs(int stage)const;
+	double MaxMs(int stage)const;
+	// 'fraction' in [0, 1]; 0.5 is the median.
+	double PercentileMs(int stage, double fraction)const;
+
+	// One line per stage: samples, mean, median, 95th percentile and max in
+	// milliseconds.
+	std::string Report()const;
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Stage
+	{
+		std::string Name;
+		Clock::time_point Start;
+		std::vector<float> Samples;
+	};
+
+	std::vector<Stage> mStages;
+};
@@ -0,0 +1,193 @@
+//***************************************************************************************
+// StaticBatcher.h
+//
+// Merges render items that never move into a few large meshes.  World (and texture)
+// transforms are baked into the vertices and items sharing a render layer and a
+// material end up in one vertex/index buffer, so each group is a single draw call.
+// The index range of every source item is kept so a group can still be culled or
+// drawn in pieces.
+//
+// VertexT needs Pos and Normal (XMFLOAT3) and TexC (XMFLOAT2) members.
+//***************************************************************************************
+
+#pragma once
+
+#include <cfloat>
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+
+template<typename VertexT>
+class StaticBatcher
+{
+public:
+
+	struct Item
+	{
+		// Group key.
+		int Layer = 0;
+		int MaterialIndex = 0;
+
+		// Source geometry, addressed the same way as DrawIndexedInstanced.  Exactly
+		// one of Indices16/Indices32 is set.
+		const VertexT* Vertices = nullptr;
+		const std::uint16_t* Indices16 = nullptr;
+		const std::uint32_t* Indices32 = nullptr;
+		std::uint32_t IndexCount = 0;
+		std::uint32_t StartIndexLocation = 0;
+		int BaseVertexLocation = 0;
+
+		DirectX::XMFLOAT4X4 World;
+		DirectX::XMFLOAT4X4 TexTransform;
+
+		// Handed back in the matching Range.
+		void* UserData = nullptr;
+	};
+
+	struct Range
+	{
+		std::uint32_t IndexCount = 0;
+		std::uint32_t StartIndexLocation = 0;
+		DirectX::BoundingBox Bounds;
+		void* UserData = nullptr;
+	};
+
+	struct Batch
+	{
+		int Layer = 0;
+		int MaterialIndex = 0;
+
+		// World-space vertices; draw with identity world and texture transforms.
+		std::vector<VertexT> Vertices;
+		std::vector<std::uint32_t> Indices;
+
+		// One range per source item, contiguous and in the order they were added.
+		std::vector<Range> Ranges;
+		DirectX::BoundingBox Bounds;
+	};
+
+	void Add(const Item& item)
+	{
+		mItems.push_back(item);
+	}
+
+	std::size_t ItemCount()const { return mItems.size(); }
+
+	///<summary>
+	/// Builds one batch per (layer, material) pair, ordered by layer then material.
+	///</summary>
+	void Build(std::vector<Batch>& batches)const
+	{
+		using namespace DirectX;
+
+		batches.clear();
+
+		std::map<std::pair<int, int>, std::vector<const Item*>> groups;
+		for(const auto& item : mItems)
+			groups[std::make_pair(item.Layer, item.MaterialIndex)].push_back(&item);
+
+		for(const auto& group : groups)
+		{
+			Batch batch;
+			batch.Layer = group.first.first;
+			batch.MaterialIndex = group.first.second;
+
+			for(const Item* item : group.second)
+				Append(*item, batch);
+
+			if(!batch.Ranges.empty())
+			{
+				batch.Bounds = batch.Ranges[0].Bounds;
+				for(const auto& range : batch.Ranges)
+					BoundingBox::CreateMerged(batch.Bounds, batch.Bounds, range.Bounds);
+			}
+
+			batches.push_back(std::move(batch));
+		}
+	}
+
+private:
+	std::uint32_t ReadIndex(const Item& item, std::uint32_t i)const
+	{
+		return item.Indices16 != nullptr ? item.Indices16[i] : item.Indices32[i];
+	}
+
+	void Append(const Item& item, Batch& batch)const
+	{
+		using namespace DirectX;
+
+		if(item.IndexCount == 0)
+			return;
+
+		// Only copy the vertices this item's indices actually reference.
+		std::uint32_t first = UINT32_MAX;
+		std::uint32_t last = 0;
+		for(std::uint32_t i = 0; i < item.IndexCount; ++i)
+		{
+			std::uint32_t index = ReadIndex(item, item.StartIndexLocation + i);
+			first = (index < first) ? index : first;
+			last = (index > last) ? index : last;
+		}
+
+		XMMATRIX world = XMLoadFloat4x4(&item.World);
+		XMMATRIX texTransform = XMLoadFloat4x4(&item.TexTransform);
+
+		// Normals go through the inverse-transpose so nonuniform scale is handled.
+		XMMATRIX A = world;
+		A.r[3] = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+		XMVECTOR det = XMMatrixDeterminant(A);
+		XMMATRIX normalMatrix = XMMatrixTranspose(XMMatrixInverse(&det, A));
+
+		// A mirroring transform flips the winding, so swap two indices per triangle.
+		const bool flip = XMVectorGetX(det) < 0.0f;
+
+		XMVECTOR vMin = XMVectorReplicate(+FLT_MAX);
+		XMVECTOR vMax = XMVectorReplicate(-FLT_MAX);
+
+		const std::uint32_t baseVertex = (std::uint32_t)batch.Vertices.size();
+		const VertexT* src = item.Vertices + item.BaseVertexLocation;
+		for(std::uint32_t i = first; i <= last; ++i)
+		{
+			VertexT v = src[i];
+
+			XMVECTOR P = XMVector3TransformCoord(XMLoadFloat3(&v.Pos), world);
+			XMVECTOR N = XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&v.Normal), normalMatrix));
+			XMVECTOR T = XMVector4Transform(XMVectorSet(v.TexC.x, v.TexC.y, 0.0f, 1.0f), texTransform);
+
+			XMStoreFloat3(&v.Pos, P);
+			XMStoreFloat3(&v.Normal, N);
+			XMStoreFloat2(&v.TexC, T);
+
+			vMin = XMVectorMin(vMin, P);
+			vMax = XMVectorMax(vMax, P);
+
+			batch.Vertices.push_back(v);
+		}
+
+		Range range;
+		range.StartIndexLocation = (std::uint32_t)batch.Indices.size();
+		range.UserData = item.UserData;
+		XMStoreFloat3(&range.Bounds.Center, 0.5f * (vMin + vMax));
+		XMStoreFloat3(&range.Bounds.Extents, 0.5f * (vMax - vMin));
+
+		for(std::uint32_t i = 0; i + 2 < item.IndexCount; i += 3)
+		{
+			std::uint32_t i0 = ReadIndex(item, item.StartIndexLocation + i + 0) - first + baseVertex;
+			std::uint32_t i1 = ReadIndex(item, item.StartIndexLocation + i + 1) - first + baseVertex;
+			std::uint32_t i2 = ReadIndex(item, item.StartIndexLocation + i + 2) - first + baseVertex;
+
+			batch.Indices.push_back(i0);
+			batch.Indices.push_back(flip ? i2 : i1);
+			batch.Indices.push_back(flip ? i1 : i2);
+		}
+
+		range.IndexCount = (std::uint32_t)batch.Indices.size() - range.StartIndexLocation;
+		batch.Ranges.push_back(range);
+	}
+
+private:
+	std::vector<Item> mItems;
+};
@@ -0,0 +1,107 @@
+//***************************************************************************************
+// CollisionGridTest.cpp
+//
+// Random boxes inserted into and removed from the grid, some spanning many cells
+// and some on the negative side of the origin, with every Query and Intersects
+// checked against testing all live boxes one by one.
+//***************************************************************************************
+
+#include "CollisionGrid.h"
+#include "TestCheck.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	BoundingBox RandomBox(std::mt19937& rng, float maxExtent)
+	{
+		std::uniform_real_distribution<float> pos(-40.0f, 40.0f);
+		std::uniform_real_distribution<float> size(0.05f, maxExtent);
+		return BoundingBox(XMFLOAT3(pos(rng), pos(rng) * 0.25f, pos(rng)), XMFLOAT3(size(rng), size(rng), size(rng)));
+	}
+
+	std::vector<int> BruteForce(const std::vector<BoundingBox>& boxes, const std::vector<bool>& live, const BoundingBox& box)
+	{
+		std::vector<int> hits;
+		for(int i = 0; i < (int)boxes.size(); ++i)
+		{
+			if(live[i] && boxes[i].Intersects(box))
+				hits.push_back(i);
+		}
+		return hits;
+	}
+
+	void TestAgainstBruteForce(float cellSize)
+	{
+		std::mt19937 rng(55);
+		CollisionGrid grid(cellSize, -3.5f, 7.25f);
+
+		std::vector<BoundingBox> boxes;
+		std::vector<bool> live;
+		std::vector<int> hits;
+
+		for(int step = 0; step < 4000; ++step)
+		{
+			const int pick = (int)(rng() % 10);
+			if(pick < 4 || grid.BoxCount() == 0)
+			{
+				// Mostly wall-sized boxes, now and then one across many cells.
+				const BoundingBox box = RandomBox(rng, rng() % 8 == 0 ? 12.0f : 2.0f);
+				const int index = grid.Insert(box);
+				CHECK(index >= 0 && index <= (int)boxes.size());
+				if(index == (int)boxes.size())
+				{
+					boxes.push_back(box);
+					live.push_back(true);
+				}
+				else
+				{
+					// Only a removed index may come back.
+					CHECK(!live[index]);
+					boxes[index] = box;
+					live[index] = true;
+				}
+			}
+			else if(pick < 6)
+			{
+				int index = (int)(rng() % boxes.size());
+				while(!live[index])
+					index = (index + 1) % (int)boxes.size();
+				grid.Remove(index);
+				live[index] = false;
+			}
+			else
+			{
+				const BoundingBox query = RandomBox(rng, 3.0f);
+				const std::vector<int> expected = BruteForce(boxes, live, query);
+
+				hits.clear();
+				grid.Query(query, hits);
+				std::sort(hits.begin(), hits.end());
+				CHECK(hits == expected);
+				CHECK(grid.Intersects(query) == !expected.empty());
+			}
+
+			CHECK(grid.BoxCount() == (int)std::count(live.begin(), live.end(), true));
+		}
+
+		for(int i = 0; i < (int)boxes.size(); ++i)
+		{
+			if(live[i])
+				grid.Remove(i);
+		}
+		CHECK(grid.BoxCount() == 0 && grid.CellCount() == 0);
+	}
+}
+
+int main()
+{
+	TestAgainstBruteForce(1.0f);
+	TestAgainstBruteForce(5.0f);
+
+	return TestResult("CollisionGrid");
+}
@@ -0,0 +1,195 @@
+//***************************************************************************************
+// CommandRecorderTest.cpp
+//
+// RecordDraws on several threads: the lists split the sorted draws evenly and
+// in order, each starts with every bind changed, they really are recorded at
+// the same time, and an exception from one list waits for the others.
+//***************************************************************************************
+
+#include "CommandRecorder.h"
+#include "TestCheck.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	// Holds every list in Begin until all of them have begun, or a second has
+	// gone by, so the lists only all get through at once if they run at once.
+	class MeetingRecorder : public ICommandRecorder
+	{
+	public:
+		MeetingRecorder(int lists, int throwingList = -1)
+			: mLists(lists), mThrowingList(throwingList), mFirstChanges(lists, 0), mThreads(lists)
+		{
+		}
+
+		virtual void Begin(int list)override
+		{
+			mThreads[list] = std::this_thread::get_id();
+
+			std::unique_lock<std::mutex> lock(mMutex);
+			++mBegun;
+			mMet.notify_all();
+			if(!mMet.wait_for(lock, std::chrono::seconds(1), [this] { return mBegun == mLists; }))
+				mAllMet = false;
+		}
+
+		virtual void Record(int list, std::uint32_t, const DrawQueue::State&, unsigned changes)override
+		{
+			if(mFirstChanges[list] == 0)
+				mFirstChanges[list] = changes;
+			if(list == mThrowingList)
+				throw std::runtime_error("recording failed");
+		}
+
+		virtual void End(int)override
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			++mEnded;
+		}
+
+		bool AllMet()const { return mAllMet; }
+		int Ended()const { return mEnded; }
+		unsigned FirstChanges(int list)const { return mFirstChanges[list]; }
+		std::thread::id Thread(int list)const { return mThreads[list]; }
+
+	private:
+		const int mLists;
+		const int mThrowingList;
+		std::mutex mMutex;
+		std::condition_variable mMet;
+		int mBegun = 0;
+		int mEnded = 0;
+		bool mAllMet = true;
+		std::vector<unsigned> mFirstChanges;
+		std::vector<std::thread::id> mThreads;
+	};
+
+	void FillQueue(DrawQueue& queue, int draws, unsigned seed)
+	{
+		std::mt19937 random(seed);
+		queue.Clear();
+		for(int i = 0; i < draws; ++i)
+		{
+			DrawQueue::State state;
+			state.Pipeline = random() % 3;
+			state.Geometry = random() % 8;
+			state.Material = random() % 8;
+			state.Topology = 4;
+			queue.Add(state, (float)(random() % 1000), (std::uint32_t)i);
+		}
+		queue.Sort();
+	}
+
+	void TestListCount()
+	{
+		CHECK(RecordListCount(0, 4, 16) == 1);
+		CHECK(RecordListCount(15, 4, 16) == 1);
+		CHECK(RecordListCount(32, 4, 16) == 2);
+		CHECK(RecordListCount(1000, 4, 16) == 4);
+		CHECK(RecordListCount(10, 4, 0) == 4);
+		CHECK(RecordListCount(10, 0, 1) == 1);
+	}
+
+	void TestSlices()
+	{
+		const int maxLists = 6;
+		NullCommandRecorder recorder(maxLists);
+
+		for(int draws : { 0, 1, 5, 97, 1000, 4099 })
+		{
+			DrawQueue queue;
+			FillQueue(queue, draws, (unsigned)draws);
+
+			std::vector<std::uint32_t> sorted;
+			DrawQueue::Stats whole = queue.SubmitRange(0, queue.Count(),
+				[&](std::uint32_t item, const DrawQueue::State&, unsigned) { sorted.push_back(item); });
+
+			recorder.Reset();
+			DrawQueue::Stats stats;
+			const int lists = RecordDraws(queue, recorder, maxLists, 8, &stats);
+			CHECK(lists == RecordListCount(draws, maxLists, 8));
+			CHECK(recorder.ListsBegun() == lists && recorder.ListsEnded() == lists);
+			CHECK(recorder.Draws() == draws && stats.Draws == draws);
+
+			// In list order the lists hold the sorted draws, split to within one.
+			std::vector<std::uint32_t> joined;
+			std::size_t smallest = (std::size_t)-1;
+			std::size_t largest = 0;
+			for(int list = 0; list < lists; ++list)
+			{
+				const std::vector<std::uint32_t>& items = recorder.Items(list);
+				joined.insert(joined.end(), items.begin(), items.end());
+				smallest = std::min(smallest, items.size());
+				largest = std::max(largest, items.size());
+			}
+			CHECK(joined == sorted);
+			CHECK(largest - smallest <= 1);
+
+			// Each list rebinds everything once, so never fewer binds than one list.
+			CHECK(recorder.Binds() == stats.Issued());
+			CHECK(stats.Issued() >= whole.Issued());
+			CHECK(stats.Issued() <= whole.Issued() + 4 * (lists - 1));
+		}
+	}
+
+	void TestThreads()
+	{
+		const int lists = 4;
+		DrawQueue queue;
+		FillQueue(queue, 400, 1);
+
+		MeetingRecorder recorder(lists);
+		CHECK(RecordDraws(queue, recorder, lists, 1) == lists);
+		CHECK(recorder.AllMet());
+		CHECK(recorder.Ended() == lists);
+		CHECK(recorder.Thread(0) == std::this_thread::get_id());
+		for(int list = 0; list < lists; ++list)
+		{
+			CHECK(recorder.FirstChanges(list) == DrawQueue::AllChanges);
+			for(int other = 0; other < list; ++other)
+				CHECK(recorder.Thread(list) != recorder.Thread(other));
+		}
+	}
+
+	void TestException()
+	{
+		const int lists = 4;
+		DrawQueue queue;
+		FillQueue(queue, 400, 2);
+
+		for(int throwing = 0; throwing < lists; ++throwing)
+		{
+			MeetingRecorder recorder(lists, throwing);
+			bool caught = false;
+			try
+			{
+				RecordDraws(queue, recorder, lists, 1);
+			}
+			catch(const std::runtime_error&)
+			{
+				caught = true;
+			}
+			CHECK(caught);
+			// Every list but the failed one got to the end first.
+			CHECK(recorder.Ended() == lists - 1);
+		}
+	}
+}
+
+int main()
+{
+	TestListCount();
+	TestSlices();
+	TestThreads();
+	TestException();
+	return TestResult("CommandRecorder");
+}
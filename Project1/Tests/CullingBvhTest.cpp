@@ -0,0 +1,178 @@
+//***************************************************************************************
+// CullingBvhTest.cpp
+//
+// The tree must cull exactly like FrustumCuller's flat test.  Both get the same
+// random layered boxes, some with the FLT_MAX extents of never-culled items, and
+// the same edits: boxes moved with SetBounds (refits), removed and added again in
+// reused slots.  A camera flies through them, so the cached rejecting planes are
+// exercised, and every frame the per-layer lists must be identical, with layers
+// culled on this thread and on their own threads.
+//***************************************************************************************
+
+#include "CullingBvh.h"
+#include "FrustumCuller.h"
+#include "TestCheck.h"
+
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	const int LayerCount = 3;
+
+	BoundingBox RandomBox(std::mt19937& rng)
+	{
+		std::uniform_real_distribution<float> pos(-80.0f, 80.0f);
+		std::uniform_real_distribution<float> size(0.05f, 6.0f);
+
+		BoundingBox box(XMFLOAT3(pos(rng), pos(rng) * 0.25f, pos(rng)), XMFLOAT3(size(rng), size(rng), size(rng)));
+		if(rng() % 50 == 0)
+			box.Extents = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+		return box;
+	}
+
+	// Circling the middle of the boxes, looking a little ahead along the path.
+	void FramePlanes(int frame, XMFLOAT4 planes[6])
+	{
+		const float angle = 0.05f * frame;
+		const XMVECTOR eye = XMVectorSet(60.0f * std::cos(angle), 5.0f + 3.0f * std::sin(0.3f * frame), 60.0f * std::sin(angle), 1.0f);
+		const XMVECTOR target = XMVectorSet(40.0f * std::cos(angle + 1.2f), 0.0f, 40.0f * std::sin(angle + 1.2f), 1.0f);
+
+		const XMMATRIX view = XMMatrixLookAtLH(eye, target, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+		const XMMATRIX proj = XMMatrixPerspectiveFovLH(0.8f, 1.6f, 1.0f, 20.0f + 3.0f * (frame % 40));
+
+		XMFLOAT4X4 viewProj;
+		XMStoreFloat4x4(&viewProj, XMMatrixMultiply(view, proj));
+		FrustumCuller::ExtractPlanes(viewProj, planes);
+	}
+
+	void TestMatchesFlatCuller()
+	{
+		std::mt19937 rng(63);
+
+		CullingBvh bvh(LayerCount);
+		FrustumCuller flat;
+		std::vector<BoundingBox> boxes;
+		std::vector<bool> live;
+
+		auto add = [&]()
+		{
+			const BoundingBox box = RandomBox(rng);
+			const int layer = (int)(rng() % LayerCount);
+
+			// Both reuse freed slots in the same order.
+			const int slot = bvh.Add(box, layer);
+			CHECK(flat.Add(box, layer) == slot);
+			if(slot == (int)live.size())
+			{
+				boxes.push_back(box);
+				live.push_back(true);
+			}
+			else
+			{
+				CHECK(!live[slot]);
+				boxes[slot] = box;
+				live[slot] = true;
+			}
+		};
+
+		for(int i = 0; i < 700; ++i)
+			add();
+
+		std::vector<std::uint32_t> tree[LayerCount];
+		std::vector<std::uint32_t> expected[LayerCount];
+
+		for(int frame = 0; frame < 240; ++frame)
+		{
+			XMFLOAT4 planes[6];
+			FramePlanes(frame, planes);
+
+			// Every other frame the big layers run on their own threads.
+			bvh.Cull(planes, tree, frame % 2 == 0 ? 1024 : 64);
+			flat.Cull(planes, expected, LayerCount);
+
+			int seen = 0;
+			for(int layer = 0; layer < LayerCount; ++layer)
+			{
+				CHECK(tree[layer] == expected[layer]);
+				seen += (int)expected[layer].size();
+			}
+			CHECK(seen > 0);
+			CHECK(bvh.Count() == flat.Count());
+
+			// Small moves refit the tree; now and then a box jumps far away.
+			for(int edit = 0; edit < 12; ++edit)
+			{
+				const int slot = (int)(rng() % live.size());
+				if(!live[slot])
+					continue;
+
+				BoundingBox& box = boxes[slot];
+				if(edit % 4 != 0)
+				{
+					std::uniform_real_distribution<float> nudge(-1.5f, 1.5f);
+					box.Center.x += nudge(rng);
+					box.Center.y += nudge(rng);
+					box.Center.z += nudge(rng);
+				}
+				else
+					box = RandomBox(rng);
+				bvh.SetBounds(slot, box);
+				flat.SetBounds(slot, box);
+			}
+
+			// Every few frames some boxes go, and new ones take their slots.
+			if(frame % 5 == 0)
+			{
+				for(int i = 0; i < 8; ++i)
+				{
+					const int slot = (int)(rng() % live.size());
+					if(!live[slot])
+						continue;
+					bvh.Remove(slot);
+					flat.Remove(slot);
+					live[slot] = false;
+				}
+			}
+			if(frame % 5 == 2)
+			{
+				for(int i = 0; i < 6; ++i)
+					add();
+			}
+		}
+	}
+
+	void TestClear()
+	{
+		std::mt19937 rng(163);
+		CullingBvh bvh(LayerCount);
+		for(int i = 0; i < 50; ++i)
+			bvh.Add(RandomBox(rng), i % LayerCount);
+
+		bvh.Clear();
+		CHECK(bvh.Count() == 0);
+
+		XMFLOAT4 planes[6];
+		FramePlanes(0, planes);
+		std::vector<std::uint32_t> visible[LayerCount];
+		bvh.Cull(planes, visible);
+		for(int layer = 0; layer < LayerCount; ++layer)
+			CHECK(visible[layer].empty());
+
+		// Slots start over after a Clear.
+		CHECK(bvh.Add(RandomBox(rng), 0) == 0);
+	}
+}
+
+int main()
+{
+	TestMatchesFlatCuller();
+	TestClear();
+
+	return TestResult("CullingBvh");
+}
@@ -0,0 +1,179 @@
+//***************************************************************************************
+// DrawQueueTest.cpp
+//
+// The radix sort against a stable comparison sort of the same keys, what the
+// key orders by, back-to-front pipelines, and the binds reported as changed.
+//***************************************************************************************
+
+#include "DrawQueue.h"
+#include "TestCheck.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace
+{
+	DrawQueue::State MakeState(int pipeline, int geometry, int material, int topology = 4)
+	{
+		DrawQueue::State state;
+		state.Pipeline = pipeline;
+		state.Geometry = geometry;
+		state.Material = material;
+		state.Topology = topology;
+		return state;
+	}
+
+	std::vector<std::uint32_t> SubmittedItems(DrawQueue& queue)
+	{
+		std::vector<std::uint32_t> items;
+		queue.Submit([&](std::uint32_t item, const DrawQueue::State&, unsigned) { items.push_back(item); });
+		return items;
+	}
+
+	void TestSortMatchesStableSort()
+	{
+		std::mt19937 random(11);
+		std::uniform_real_distribution<float> depth(-5.0f, 500.0f);
+
+		bool same = true;
+		for(int trial = 0; trial < 50; ++trial)
+		{
+			DrawQueue queue;
+			queue.SetBackToFront(2, true);
+
+			struct Draw
+			{
+				std::uint64_t Key;
+				std::uint32_t Item;
+			};
+			std::vector<Draw> expected;
+
+			// Few distinct values, so equal keys are common and stability shows.
+			const int count = (int)(random() % 2000);
+			for(int i = 0; i < count; ++i)
+			{
+				const DrawQueue::State state = MakeState(random() % 3, random() % 6, random() % 5, random() % 2);
+				const float d = (random() % 4 == 0) ? 10.0f : depth(random);
+				queue.Add(state, d, (std::uint32_t)i);
+				expected.push_back({ DrawQueue::MakeKey(state, d, state.Pipeline == 2), (std::uint32_t)i });
+			}
+
+			queue.Sort();
+			std::stable_sort(expected.begin(), expected.end(), [](const Draw& a, const Draw& b) { return a.Key < b.Key; });
+
+			const std::vector<std::uint32_t> items = SubmittedItems(queue);
+			if((int)items.size() != count)
+				same = false;
+			for(int i = 0; i < count && i < (int)items.size(); ++i)
+			{
+				if(items[i] != expected[i].Item)
+					same = false;
+			}
+		}
+		CHECK(same);
+	}
+
+	void TestKeyOrder()
+	{
+		DrawQueue queue;
+		queue.Add(MakeState(1, 0, 0), 1.0f, 0);
+		queue.Add(MakeState(0, 1, 0), 1.0f, 1);
+		queue.Add(MakeState(0, 0, 1), 1.0f, 2);
+		queue.Add(MakeState(0, 0, 0, 5), 1.0f, 3);
+		queue.Add(MakeState(0, 0, 0), 9.0f, 4);
+		queue.Add(MakeState(0, 0, 0), 2.0f, 5);
+		// Ids are masked to their field: pipeline 256 is pipeline 0.
+		queue.Add(MakeState(256, 0, 0), 3.0f, 6);
+		queue.Sort();
+
+		// Pipeline, then geometry, material, topology and depth, nearest first.
+		const std::vector<std::uint32_t> items = SubmittedItems(queue);
+		CHECK(items == std::vector<std::uint32_t>({ 5, 6, 4, 3, 2, 1, 0 }));
+
+		// Negative and NaN depths count as 0 and keep their order.
+		queue.Clear();
+		CHECK(queue.Count() == 0);
+		queue.Add(MakeState(0, 0, 0), 1.0f, 0);
+		queue.Add(MakeState(0, 0, 0), -3.0f, 1);
+		queue.Add(MakeState(0, 0, 0), std::nanf(""), 2);
+		queue.Add(MakeState(0, 0, 0), 0.0f, 3);
+		queue.Sort();
+		CHECK(SubmittedItems(queue) == std::vector<std::uint32_t>({ 1, 2, 3, 0 }));
+	}
+
+	void TestBackToFront()
+	{
+		DrawQueue queue;
+		queue.SetBackToFront(1, true);
+
+		queue.Add(MakeState(1, 0, 0), 5.0f, 0);
+		queue.Add(MakeState(1, 3, 2), 50.0f, 1);
+		queue.Add(MakeState(1, 1, 1), 20.0f, 2);
+		queue.Add(MakeState(0, 0, 0), 50.0f, 3);
+		queue.Add(MakeState(0, 0, 0), 5.0f, 4);
+		queue.Sort();
+
+		// Pipeline 0 still goes first and nearest first; pipeline 1 farthest
+		// first, whatever it binds.
+		CHECK(SubmittedItems(queue) == std::vector<std::uint32_t>({ 4, 3, 1, 2, 0 }));
+
+		queue.SetBackToFront(1, false);
+		queue.Clear();
+		queue.Add(MakeState(1, 0, 0), 50.0f, 0);
+		queue.Add(MakeState(1, 0, 0), 5.0f, 1);
+		queue.Sort();
+		CHECK(SubmittedItems(queue) == std::vector<std::uint32_t>({ 1, 0 }));
+	}
+
+	void TestChanges()
+	{
+		DrawQueue queue;
+		queue.Add(MakeState(0, 0, 0), 1.0f, 0);
+		queue.Add(MakeState(0, 0, 0), 2.0f, 1);
+		queue.Add(MakeState(0, 0, 1), 1.0f, 2);
+		queue.Add(MakeState(0, 1, 1), 1.0f, 3);
+		queue.Add(MakeState(1, 1, 1, 5), 1.0f, 4);
+		queue.Sort();
+
+		std::vector<unsigned> changes;
+		queue.Submit([&](std::uint32_t, const DrawQueue::State&, unsigned c) { changes.push_back(c); });
+
+		const std::vector<unsigned> expected =
+		{
+			DrawQueue::AllChanges,
+			0,
+			DrawQueue::MaterialChange,
+			DrawQueue::GeometryChange,
+			DrawQueue::PipelineChange | DrawQueue::TopologyChange,
+		};
+		CHECK(changes == expected);
+
+		const DrawQueue::Stats& stats = queue.LastStats();
+		CHECK(stats.Draws == 5);
+		CHECK(stats.PipelineChanges == 2 && stats.GeometryChanges == 2 && stats.MaterialChanges == 2 && stats.TopologyChanges == 2);
+		CHECK(stats.Issued() == 8 && stats.Avoided() == 12);
+
+		// A range starts from nothing bound, and leaves LastStats alone.
+		changes.clear();
+		const DrawQueue::Stats range = queue.SubmitRange(2, 4, [&](std::uint32_t, const DrawQueue::State&, unsigned c) { changes.push_back(c); });
+		CHECK(changes == std::vector<unsigned>({ DrawQueue::AllChanges, DrawQueue::GeometryChange }));
+		CHECK(range.Draws == 2 && range.Issued() == 5);
+		CHECK(queue.LastStats().Draws == 5);
+
+		DrawQueue::Stats sum = stats;
+		sum += range;
+		CHECK(sum.Draws == 7 && sum.Issued() == 13);
+	}
+}
+
+int main()
+{
+	TestSortMatchesStableSort();
+	TestKeyOrder();
+	TestBackToFront();
+	TestChanges();
+	return TestResult("DrawQueue");
+}
@@ -0,0 +1,222 @@
+//***************************************************************************************
+// FlowFieldTest.cpp
+//
+// Random mazes with tiles knocked down and put back one at a time.  After every
+// OnTileChanged the repaired field must match a fresh Build cell for cell, costs
+// and directions, and both must match a plain Dijkstra over the same moves.  A
+// FlowFieldSet repairs its fields on worker threads and is checked the same way.
+//***************************************************************************************
+
+#include "FlowField.h"
+#include "TestCheck.h"
+
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace
+{
+	const int StepRow[8] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+	const int StepCol[8] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+
+	TileMap RandomMap(std::mt19937& rng, int rows, int cols, int wallPercent)
+	{
+		TileMap map(rows, cols);
+		for(int r = 0; r < rows; ++r)
+		{
+			for(int c = 0; c < cols; ++c)
+			{
+				if((int)(rng() % 100) < wallPercent)
+					map.Set(r, c, TileMap::Wall);
+			}
+		}
+		return map;
+	}
+
+	std::vector<FlowField::Cell> RandomGoals(std::mt19937& rng, const TileMap& map, int count)
+	{
+		std::vector<FlowField::Cell> goals;
+		for(int i = 0; i < count; ++i)
+		{
+			FlowField::Cell goal;
+			goal.Row = (int)(rng() % map.RowCount());
+			goal.Col = (int)(rng() % map.ColumnCount());
+			goals.push_back(goal);
+		}
+		return goals;
+	}
+
+	bool IsOpen(const TileMap& map, int row, int col)
+	{
+		return map.InBounds(row, col) && !map.IsWall(row, col);
+	}
+
+	// Dijkstra with the field's moves: 10 straight, 14 diagonal, and no diagonal
+	// past a wall on either side.
+	std::vector<std::uint32_t> ReferenceCosts(const TileMap& map, const std::vector<FlowField::Cell>& goals)
+	{
+		std::vector<std::uint32_t> cost(map.CellCount(), FlowField::Unreachable);
+
+		typedef std::pair<std::uint32_t, int> Entry;
+		std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+		for(const auto& goal : goals)
+		{
+			if(IsOpen(map, goal.Row, goal.Col))
+			{
+				cost[map.Index(goal.Row, goal.Col)] = 0;
+				open.push(Entry(0, map.Index(goal.Row, goal.Col)));
+			}
+		}
+
+		while(!open.empty())
+		{
+			const Entry top = open.top();
+			open.pop();
+			if(top.first != cost[top.second])
+				continue;
+
+			const int row = top.second / map.ColumnCount();
+			const int col = top.second % map.ColumnCount();
+			for(int d = 0; d < 8; ++d)
+			{
+				const int r = row + StepRow[d];
+				const int c = col + StepCol[d];
+				if(!IsOpen(map, r, c))
+					continue;
+				if((d & 1) && !(IsOpen(map, r, col) && IsOpen(map, row, c)))
+					continue;
+
+				const std::uint32_t next = top.first + ((d & 1) ? 14 : 10);
+				if(next < cost[map.Index(r, c)])
+				{
+					cost[map.Index(r, c)] = next;
+					open.push(Entry(next, map.Index(r, c)));
+				}
+			}
+		}
+
+		return cost;
+	}
+
+	bool SameField(const FlowField& a, const FlowField& b)
+	{
+		if(a.RowCount() != b.RowCount() || a.ColumnCount() != b.ColumnCount())
+			return false;
+
+		for(int r = 0; r < a.RowCount(); ++r)
+		{
+			for(int c = 0; c < a.ColumnCount(); ++c)
+			{
+				if(a.Cost(r, c) != b.Cost(r, c) || a.At(r, c) != b.At(r, c))
+					return false;
+			}
+		}
+		return true;
+	}
+
+	bool MatchesReference(const FlowField& field, const TileMap& map)
+	{
+		const std::vector<std::uint32_t> expected = ReferenceCosts(map, field.Goals());
+		for(int r = 0; r < map.RowCount(); ++r)
+		{
+			for(int c = 0; c < map.ColumnCount(); ++c)
+			{
+				if(field.Cost(r, c) != expected[map.Index(r, c)])
+					return false;
+
+				// Every direction leads one step downhill by exactly the step cost.
+				const FlowField::Direction d = field.At(r, c);
+				if(d == FlowField::Goal || d == FlowField::None)
+					continue;
+
+				int dRow, dCol;
+				FlowField::Step(d, dRow, dCol);
+				const std::uint32_t step = (dRow != 0 && dCol != 0) ? 14 : 10;
+				if(field.Cost(r + dRow, c + dCol) + step != field.Cost(r, c))
+					return false;
+			}
+		}
+		return true;
+	}
+
+	void TestRepairMatchesBuild()
+	{
+		std::mt19937 rng(56);
+
+		for(int run = 0; run < 6; ++run)
+		{
+			TileMap map = RandomMap(rng, 20 + run * 7, 24 + run * 5, 20 + run * 5);
+
+			FlowField repaired;
+			repaired.SetGoals(RandomGoals(rng, map, 1 + run % 3));
+			repaired.Build(map);
+			CHECK(MatchesReference(repaired, map));
+
+			for(int edit = 0; edit < 150; ++edit)
+			{
+				// Goal cells are edited too, so goals come and go.
+				int row, col;
+				if(edit % 10 == 0)
+				{
+					const FlowField::Cell& goal = repaired.Goals()[rng() % repaired.Goals().size()];
+					row = goal.Row;
+					col = goal.Col;
+				}
+				else
+				{
+					row = (int)(rng() % map.RowCount());
+					col = (int)(rng() % map.ColumnCount());
+				}
+
+				map.Set(row, col, map.IsWall(row, col) ? TileMap::Empty : TileMap::Wall);
+				repaired.OnTileChanged(map, row, col);
+
+				FlowField fresh;
+				fresh.SetGoals(repaired.Goals());
+				fresh.Build(map);
+
+				CHECK(SameField(repaired, fresh));
+				if(edit % 25 == 0)
+					CHECK(MatchesReference(fresh, map));
+			}
+		}
+	}
+
+	void TestSetOnThreads()
+	{
+		std::mt19937 rng(156);
+		TileMap map = RandomMap(rng, 40, 40, 30);
+
+		FlowFieldSet set;
+		for(int i = 0; i < 4; ++i)
+			set.Add(RandomGoals(rng, map, 1 + i));
+		set.Build(map);
+
+		for(int edit = 0; edit < 60; ++edit)
+		{
+			const int row = (int)(rng() % map.RowCount());
+			const int col = (int)(rng() % map.ColumnCount());
+			map.Set(row, col, map.IsWall(row, col) ? TileMap::Empty : TileMap::Wall);
+			set.OnTileChanged(map, row, col);
+		}
+
+		for(int i = 0; i < set.FieldCount(); ++i)
+		{
+			FlowField fresh;
+			fresh.SetGoals(set.Field(i).Goals());
+			fresh.Build(map);
+			CHECK(SameField(set.Field(i), fresh));
+		}
+	}
+}
+
+int main()
+{
+	TestRepairMatchesBuild();
+	TestSetOnThreads();
+
+	return TestResult("FlowField");
+}
@@ -0,0 +1,286 @@
+//***************************************************************************************
+// FrustumCullerTest.cpp
+//
+// Random boxes on several layers, culled against moving frusta by the scalar loop
+// and, where the CPU has it, the AVX loop.  The two must give identical lists,
+// also for boxes placed to just touch a plane, and both must agree with testing
+// all eight corners of every box in double precision wherever a box is not within
+// rounding of a plane.  Box counts that are not a multiple of eight exercise the
+// padded tail, removes and adds exercise slot reuse, and some boxes have the
+// FLT_MAX extents of items that are never culled.
+//***************************************************************************************
+
+#include "FrustumCuller.h"
+#include "TestCheck.h"
+
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	const int LayerCount = 4;
+
+	struct Entry
+	{
+		BoundingBox Box;
+		int Layer = -1;
+		bool Live = false;
+	};
+
+	BoundingBox RandomBox(std::mt19937& rng)
+	{
+		std::uniform_real_distribution<float> pos(-60.0f, 60.0f);
+		std::uniform_real_distribution<float> size(0.01f, 8.0f);
+
+		BoundingBox box(XMFLOAT3(pos(rng), pos(rng), pos(rng)), XMFLOAT3(size(rng), size(rng), size(rng)));
+		if(rng() % 40 == 0)
+			box.Extents = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+		return box;
+	}
+
+	// Layers past LayerCount are culled by nobody.
+	int RandomLayer(std::mt19937& rng)
+	{
+		return (int)(rng() % (LayerCount + 1));
+	}
+
+	XMFLOAT4X4 RandomViewProj(std::mt19937& rng)
+	{
+		std::uniform_real_distribution<float> pos(-50.0f, 50.0f);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+		XMVECTOR eye, target;
+		do
+		{
+			eye = XMVectorSet(pos(rng), pos(rng), pos(rng), 1.0f);
+			target = XMVectorSet(pos(rng), pos(rng), pos(rng), 1.0f);
+		}
+		// Keep away from looking straight up or down.
+		while(std::fabs(XMVectorGetY(target) - XMVectorGetY(eye)) > 0.9f * XMVectorGetX(XMVector3Length(target - eye)));
+
+		const XMMATRIX view = XMMatrixLookAtLH(eye, target, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+		const XMMATRIX proj = XMMatrixPerspectiveFovLH(0.5f + unit(rng), 0.75f + unit(rng), 0.5f + unit(rng), 40.0f + 80.0f * unit(rng));
+
+		XMFLOAT4X4 viewProj;
+		XMStoreFloat4x4(&viewProj, XMMatrixMultiply(view, proj));
+		return viewProj;
+	}
+
+	// Farthest any corner gets in front of the plane, in double.
+	double MaxCornerDistance(const XMFLOAT4& plane, const BoundingBox& box)
+	{
+		double best = -DBL_MAX;
+		for(int corner = 0; corner < 8; ++corner)
+		{
+			const double x = (double)box.Center.x + ((corner & 1) ? 1.0 : -1.0) * box.Extents.x;
+			const double y = (double)box.Center.y + ((corner & 2) ? 1.0 : -1.0) * box.Extents.y;
+			const double z = (double)box.Center.z + ((corner & 4) ? 1.0 : -1.0) * box.Extents.z;
+			const double d = (double)plane.x * x + (double)plane.y * y + (double)plane.z * z + (double)plane.w;
+			if(d > best)
+				best = d;
+		}
+		return best;
+	}
+
+	// 1 inside, 0 outside, -1 within rounding of a plane.
+	int BruteForce(const XMFLOAT4 planes[6], const BoundingBox& box)
+	{
+		const double tolerance = 1e-3 * (1.0 + std::fabs(box.Center.x) + std::fabs(box.Center.y) + std::fabs(box.Center.z));
+
+		bool unsure = false;
+		for(int p = 0; p < 6; ++p)
+		{
+			const double d = MaxCornerDistance(planes[p], box);
+			if(d < -tolerance)
+				return 0;
+			if(d < tolerance)
+				unsure = true;
+		}
+		return unsure ? -1 : 1;
+	}
+
+	void Cull(FrustumCuller& culler, bool avx, const XMFLOAT4X4& viewProj, std::vector<std::uint32_t>* visible)
+	{
+		culler.SetAvxEnabled(avx);
+		culler.Cull(viewProj, visible, LayerCount);
+	}
+
+	void CheckFrustum(FrustumCuller& culler, const std::vector<Entry>& entries, const XMFLOAT4X4& viewProj)
+	{
+		std::vector<std::uint32_t> scalar[LayerCount];
+		Cull(culler, false, viewProj, scalar);
+
+		if(culler.AvxAvailable())
+		{
+			std::vector<std::uint32_t> avx[LayerCount];
+			Cull(culler, true, viewProj, avx);
+			for(int layer = 0; layer < LayerCount; ++layer)
+				CHECK(avx[layer] == scalar[layer]);
+		}
+
+		XMFLOAT4 planes[6];
+		FrustumCuller::ExtractPlanes(viewProj, planes);
+
+		// Every listed slot is live, on that layer and not clearly outside; every
+		// box clearly inside is listed.
+		std::vector<int> listedLayer(entries.size(), -1);
+		for(int layer = 0; layer < LayerCount; ++layer)
+		{
+			for(std::size_t i = 0; i < scalar[layer].size(); ++i)
+			{
+				const std::uint32_t slot = scalar[layer][i];
+				CHECK(i == 0 || scalar[layer][i - 1] < slot);
+				CHECK(slot < entries.size() && entries[slot].Live && entries[slot].Layer == layer);
+				if(slot < entries.size())
+					listedLayer[slot] = layer;
+			}
+		}
+
+		for(std::size_t slot = 0; slot < entries.size(); ++slot)
+		{
+			const Entry& e = entries[slot];
+			if(!e.Live || e.Layer >= LayerCount)
+			{
+				CHECK(listedLayer[slot] < 0);
+				continue;
+			}
+
+			const int expected = BruteForce(planes, e.Box);
+			if(expected >= 0)
+				CHECK((listedLayer[slot] >= 0) == (expected == 1));
+		}
+	}
+
+	void TestAgainstBruteForce()
+	{
+		std::mt19937 rng(62);
+
+		// Tails of every length, and one larger set.
+		const int counts[] = { 1, 5, 8, 9, 15, 16, 17, 300 };
+		for(int count : counts)
+		{
+			FrustumCuller culler;
+			std::vector<Entry> entries;
+
+			for(int i = 0; i < count; ++i)
+			{
+				Entry e;
+				e.Box = RandomBox(rng);
+				e.Layer = RandomLayer(rng);
+				e.Live = true;
+
+				const int slot = culler.Add(e.Box, e.Layer);
+				CHECK(slot == (int)entries.size());
+				entries.push_back(e);
+			}
+
+			for(int frame = 0; frame < 30; ++frame)
+			{
+				CheckFrustum(culler, entries, RandomViewProj(rng));
+
+				// Move some boxes, and remove and add others.
+				for(int edit = 0; edit < 1 + count / 10; ++edit)
+				{
+					const int slot = (int)(rng() % entries.size());
+					Entry& e = entries[slot];
+					switch(rng() % 3)
+					{
+					case 0:
+						if(e.Live)
+						{
+							e.Box = RandomBox(rng);
+							culler.SetBounds(slot, e.Box);
+						}
+						break;
+					case 1:
+						if(e.Live)
+						{
+							culler.Remove(slot);
+							e.Live = false;
+						}
+						break;
+					default:
+					{
+						Entry added;
+						added.Box = RandomBox(rng);
+						added.Layer = RandomLayer(rng);
+						added.Live = true;
+
+						// A freed slot comes back before the arrays grow.
+						const int freed = (int)entries.size() - culler.Count();
+						const int newSlot = culler.Add(added.Box, added.Layer);
+						CHECK(newSlot >= 0 && newSlot <= (int)entries.size());
+						CHECK((newSlot < (int)entries.size()) == (freed > 0));
+						if(newSlot == (int)entries.size())
+							entries.push_back(added);
+						else
+						{
+							CHECK(!entries[newSlot].Live);
+							entries[newSlot] = added;
+						}
+						break;
+					}
+					}
+				}
+
+				int live = 0;
+				for(const Entry& e : entries)
+					live += e.Live ? 1 : 0;
+				CHECK(culler.Count() == live);
+			}
+		}
+	}
+
+	void TestTouchingPlanes()
+	{
+		// Boxes pushed against each plane of a frustum until d + r is about zero,
+		// where summing in another order could flip the answer.
+		std::mt19937 rng(162);
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+		for(int frame = 0; frame < 20; ++frame)
+		{
+			const XMFLOAT4X4 viewProj = RandomViewProj(rng);
+			XMFLOAT4 planes[6];
+			FrustumCuller::ExtractPlanes(viewProj, planes);
+
+			FrustumCuller culler;
+			std::vector<Entry> entries;
+			for(int i = 0; i < 203; ++i)
+			{
+				const XMFLOAT4& pl = planes[i % 6];
+				Entry e;
+				e.Box.Extents = XMFLOAT3(1.0f + unit(rng) * 0.5f, 1.0f + unit(rng) * 0.5f, 1.0f + unit(rng) * 0.5f);
+
+				// A point on the plane, then back along the normal by the reach.
+				const float reach = std::fabs(pl.x) * e.Box.Extents.x + std::fabs(pl.y) * e.Box.Extents.y + std::fabs(pl.z) * e.Box.Extents.z;
+				XMFLOAT3 p(unit(rng) * 30.0f, unit(rng) * 30.0f, unit(rng) * 30.0f);
+				const float onPlane = pl.x * p.x + pl.y * p.y + pl.z * p.z + pl.w;
+				const float back = onPlane + reach + unit(rng) * 1e-5f;
+				e.Box.Center = XMFLOAT3(p.x - pl.x * back, p.y - pl.y * back, p.z - pl.z * back);
+				e.Layer = i % LayerCount;
+				e.Live = true;
+
+				culler.Add(e.Box, e.Layer);
+				entries.push_back(e);
+			}
+
+			CheckFrustum(culler, entries, viewProj);
+		}
+	}
+}
+
+int main()
+{
+	TestAgainstBruteForce();
+	TestTouchingPlanes();
+
+	std::printf("FrustumCuller: AVX %s\n", FrustumCuller().AvxAvailable() ? "compared" : "not available, scalar only");
+	return TestResult("FrustumCuller");
+}
@@ -0,0 +1,172 @@
+//***************************************************************************************
+// HpaPathfinderTest.cpp
+//
+// Random mazes queried between random cells.  HPA* must find a path exactly when
+// grid A* does, never cheaper than it, and its refined cells must be a legal walk
+// from start to goal costing what FindPath reported.  After tile edits the
+// repaired hierarchy must give the same answers as one built from scratch.
+//***************************************************************************************
+
+#include "HpaPathfinder.h"
+#include "TestCheck.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace
+{
+	typedef HpaPathfinder::Cell Cell;
+
+	TileMap RandomMap(std::mt19937& rng, int rows, int cols, int wallPercent)
+	{
+		TileMap map(rows, cols);
+		for(int r = 0; r < rows; ++r)
+		{
+			for(int c = 0; c < cols; ++c)
+			{
+				if((int)(rng() % 100) < wallPercent)
+					map.Set(r, c, TileMap::Wall);
+			}
+		}
+		return map;
+	}
+
+	Cell RandomCell(std::mt19937& rng, const TileMap& map)
+	{
+		Cell c;
+		c.Row = (int)(rng() % map.RowCount());
+		c.Col = (int)(rng() % map.ColumnCount());
+		return c;
+	}
+
+	bool IsOpen(const TileMap& map, int row, int col)
+	{
+		return map.InBounds(row, col) && !map.IsWall(row, col);
+	}
+
+	// True if 'cells' walks from start to goal through open cells with the
+	// pathfinder's moves; 'cost' receives what the walk costs.
+	bool IsLegalWalk(const TileMap& map, const std::vector<Cell>& cells, Cell start, Cell goal, std::uint32_t& cost)
+	{
+		cost = 0;
+		if(cells.empty())
+			return false;
+		if(cells.front().Row != start.Row || cells.front().Col != start.Col)
+			return false;
+		if(cells.back().Row != goal.Row || cells.back().Col != goal.Col)
+			return false;
+
+		for(std::size_t i = 0; i < cells.size(); ++i)
+		{
+			if(!IsOpen(map, cells[i].Row, cells[i].Col))
+				return false;
+			if(i == 0)
+				continue;
+
+			const int dRow = cells[i].Row - cells[i - 1].Row;
+			const int dCol = cells[i].Col - cells[i - 1].Col;
+			if(std::abs(dRow) > 1 || std::abs(dCol) > 1 || (dRow == 0 && dCol == 0))
+				return false;
+
+			if(dRow != 0 && dCol != 0)
+			{
+				// No cutting past a wall corner.
+				if(!IsOpen(map, cells[i - 1].Row + dRow, cells[i - 1].Col) || !IsOpen(map, cells[i - 1].Row, cells[i - 1].Col + dCol))
+					return false;
+				cost += 14;
+			}
+			else
+				cost += 10;
+		}
+		return true;
+	}
+
+	// Checks one query against grid A*, and returns the HPA* cost (or
+	// Unreachable) so callers can compare hierarchies.
+	std::uint32_t CheckQuery(HpaPathfinder& hpa, const TileMap& map, Cell start, Cell goal)
+	{
+		std::vector<Cell> gridCells;
+		std::uint32_t gridCost = 0;
+		const bool gridFound = hpa.FindGridPath(map, start, goal, gridCells, gridCost);
+
+		HpaPathfinder::Path path;
+		const bool found = hpa.FindPath(map, start, goal, path);
+		CHECK(found == gridFound);
+		if(!found || !gridFound)
+			return HpaPathfinder::Unreachable;
+
+		std::uint32_t walked = 0;
+		CHECK(IsLegalWalk(map, gridCells, start, goal, walked) && walked == gridCost);
+
+		CHECK(path.Cost >= gridCost);
+		CHECK(hpa.RefineAll(map, path));
+		CHECK(path.Complete());
+		CHECK(IsLegalWalk(map, path.Cells, start, goal, walked));
+		CHECK(walked == path.Cost);
+
+		return path.Cost;
+	}
+
+	void TestAgainstGridAStar()
+	{
+		std::mt19937 rng(57);
+
+		for(int run = 0; run < 8; ++run)
+		{
+			// Sizes that are and are not multiples of the cluster size.
+			const TileMap map = RandomMap(rng, 17 + run * 6, 23 + run * 4, 15 + run * 4);
+			HpaPathfinder hpa(run % 2 == 0 ? 10 : 7);
+			hpa.Build(map);
+
+			for(int query = 0; query < 60; ++query)
+				CheckQuery(hpa, map, RandomCell(rng, map), RandomCell(rng, map));
+
+			// Start and goal in the same cell and in the same cluster.
+			const Cell same = RandomCell(rng, map);
+			CheckQuery(hpa, map, same, same);
+			Cell near = same;
+			near.Col = near.Col + 1 < map.ColumnCount() ? near.Col + 1 : near.Col - 1;
+			CheckQuery(hpa, map, same, near);
+		}
+	}
+
+	void TestRepairMatchesBuild()
+	{
+		std::mt19937 rng(157);
+		TileMap map = RandomMap(rng, 40, 36, 25);
+
+		HpaPathfinder repaired(8);
+		repaired.Build(map);
+
+		for(int edit = 0; edit < 120; ++edit)
+		{
+			const Cell cell = RandomCell(rng, map);
+			map.Set(cell.Row, cell.Col, map.IsWall(cell.Row, cell.Col) ? TileMap::Empty : TileMap::Wall);
+			repaired.OnTileChanged(map, cell.Row, cell.Col);
+
+			if(edit % 4 != 0)
+				continue;
+
+			HpaPathfinder fresh(8);
+			fresh.Build(map);
+			CHECK(repaired.NodeCount() == fresh.NodeCount());
+
+			for(int query = 0; query < 10; ++query)
+			{
+				const Cell start = RandomCell(rng, map);
+				const Cell goal = RandomCell(rng, map);
+				CHECK(CheckQuery(repaired, map, start, goal) == CheckQuery(fresh, map, start, goal));
+			}
+		}
+	}
+}
+
+int main()
+{
+	TestAgainstGridAStar();
+	TestRepairMatchesBuild();
+
+	return TestResult("HpaPathfinder");
+}
@@ -0,0 +1,190 @@
+//***************************************************************************************
+// IndirectDrawArgsTest.cpp
+//
+// The argument buffer byte by byte against the command signature, where batches
+// break, and the same commands and batches from any number of threads.
+//***************************************************************************************
+
+#include "IndirectDrawArgs.h"
+#include "TestCheck.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace
+{
+	// Every field of the command made from the item, so each can be found in the
+	// bytes.
+	class TestSource : public IIndirectDrawSource
+	{
+	public:
+		virtual void Fill(std::uint32_t item, const DrawQueue::State& state, IndirectDrawCommand& command)const override
+		{
+			command.ObjectIndex = item;
+			command.IndexCountPerInstance = 3 * item + 3;
+			command.InstanceCount = 1 + (std::uint32_t)state.Material;
+			command.StartIndexLocation = 100 + item;
+			command.BaseVertexLocation = -(std::int32_t)item;
+			command.StartInstanceLocation = 7 * item;
+		}
+	};
+
+	DrawQueue::State MakeState(int pipeline, int geometry, int material, int topology = 4)
+	{
+		DrawQueue::State state;
+		state.Pipeline = pipeline;
+		state.Geometry = geometry;
+		state.Material = material;
+		state.Topology = topology;
+		return state;
+	}
+
+	void TestLayout()
+	{
+		// The root constant, then D3D12_DRAW_INDEXED_ARGUMENTS, 32 bits each.
+		CHECK(sizeof(IndirectDrawCommand) == 4 * (IndirectDrawCommand::RootConstantCount + 5));
+		CHECK(offsetof(IndirectDrawCommand, ObjectIndex) == 0);
+		CHECK(offsetof(IndirectDrawCommand, IndexCountPerInstance) == 4);
+		CHECK(offsetof(IndirectDrawCommand, InstanceCount) == 8);
+		CHECK(offsetof(IndirectDrawCommand, StartIndexLocation) == 12);
+		CHECK(offsetof(IndirectDrawCommand, BaseVertexLocation) == 16);
+		CHECK(offsetof(IndirectDrawCommand, StartInstanceLocation) == 20);
+
+		DrawQueue queue;
+		for(std::uint32_t item = 0; item < 5; ++item)
+			queue.Add(MakeState(0, 0, (int)item % 2), (float)item, item);
+		queue.Sort();
+
+		// Written straight into raw memory, as into a mapped upload buffer.
+		std::vector<std::uint32_t> words(5 * sizeof(IndirectDrawCommand) / 4, 0xcdcdcdcd);
+		TestSource source;
+		IndirectDrawBuilder builder;
+		CHECK(builder.Build(queue, source, reinterpret_cast<IndirectDrawCommand*>(words.data()), 1, 1) == 5);
+
+		// Materials sort before depth: items 0, 2, 4, then 1, 3.
+		const std::uint32_t order[5] = { 0, 2, 4, 1, 3 };
+		for(int i = 0; i < 5; ++i)
+		{
+			const std::uint32_t item = order[i];
+			const std::uint32_t* command = &words[i * 6];
+			CHECK(command[0] == item);
+			CHECK(command[1] == 3 * item + 3);
+			CHECK(command[2] == 1 + item % 2);
+			CHECK(command[3] == 100 + item);
+
+			std::int32_t baseVertex;
+			std::memcpy(&baseVertex, &command[4], sizeof(baseVertex));
+			CHECK(baseVertex == -(std::int32_t)item);
+			CHECK(command[5] == 7 * item);
+		}
+	}
+
+	void TestBatches()
+	{
+		DrawQueue queue;
+		// Pipeline 0: geometry 0 with materials 0, 0, 1, then geometry 1.
+		// Pipeline 1: one draw, another topology in the same pipeline.
+		queue.Add(MakeState(0, 0, 0), 1.0f, 0);
+		queue.Add(MakeState(0, 0, 0), 2.0f, 1);
+		queue.Add(MakeState(0, 0, 1), 1.0f, 2);
+		queue.Add(MakeState(0, 1, 1), 1.0f, 3);
+		queue.Add(MakeState(1, 0, 0), 1.0f, 4);
+		queue.Add(MakeState(1, 0, 0, 5), 1.0f, 5);
+		queue.Sort();
+
+		TestSource source;
+		std::vector<IndirectDrawCommand> commands(queue.Count());
+
+		IndirectDrawBuilder builder;
+		CHECK(builder.BatchBreaks() == IndirectDrawBuilder::DefaultBatchBreaks);
+		builder.Build(queue, source, commands.data(), 1, 1);
+
+		const std::vector<IndirectDrawBatch>& batches = builder.Batches();
+		const std::uint32_t firsts[5] = { 0, 2, 3, 4, 5 };
+		const std::uint32_t counts[5] = { 2, 1, 1, 1, 1 };
+		CHECK(batches.size() == 5);
+		for(std::size_t i = 0; i < batches.size() && i < 5; ++i)
+		{
+			CHECK(batches[i].FirstCommand == firsts[i]);
+			CHECK(batches[i].CommandCount == counts[i]);
+			CHECK(batches[i].FirstItem == commands[firsts[i]].ObjectIndex);
+		}
+		CHECK(batches.size() == 5 && batches[3].State.Pipeline == 1 && batches[4].State.Topology == 5);
+
+		// Pipeline, geometry and topology still break with only the pipeline
+		// asked for; materials no longer do.
+		builder.SetBatchBreaks(DrawQueue::PipelineChange);
+		CHECK(builder.BatchBreaks() == (DrawQueue::PipelineChange | DrawQueue::GeometryChange | DrawQueue::TopologyChange));
+		builder.Build(queue, source, commands.data(), 1, 1);
+		CHECK(builder.Batches().size() == 4);
+		CHECK(!builder.Batches().empty() && builder.Batches()[0].CommandCount == 3);
+
+		// Nothing to draw, no batches.
+		DrawQueue empty;
+		CHECK(builder.Build(empty, source, commands.data(), 4, 1) == 0);
+		CHECK(builder.Batches().empty());
+	}
+
+	void TestThreads()
+	{
+		std::mt19937 random(3);
+		TestSource source;
+		IndirectDrawBuilder single;
+		IndirectDrawBuilder threaded;
+
+		bool sameCommands = true;
+		bool sameBatches = true;
+		bool allCovered = true;
+		for(int trial = 0; trial < 100; ++trial)
+		{
+			DrawQueue queue;
+			const int draws = (int)(random() % 500);
+			for(int i = 0; i < draws; ++i)
+				queue.Add(MakeState(random() % 3, random() % 4, random() % 3), (float)(random() % 100), (std::uint32_t)i);
+			queue.Sort();
+
+			std::vector<IndirectDrawCommand> a(draws);
+			std::vector<IndirectDrawCommand> b(draws);
+			single.Build(queue, source, a.data(), 1, 1);
+			threaded.Build(queue, source, b.data(), 7, 3);
+
+			if(draws > 0 && std::memcmp(a.data(), b.data(), draws * sizeof(IndirectDrawCommand)) != 0)
+				sameCommands = false;
+
+			const std::vector<IndirectDrawBatch>& x = single.Batches();
+			const std::vector<IndirectDrawBatch>& y = threaded.Batches();
+			if(x.size() != y.size())
+				sameBatches = false;
+			for(std::size_t k = 0; k < x.size() && k < y.size(); ++k)
+			{
+				if(x[k].FirstCommand != y[k].FirstCommand || x[k].CommandCount != y[k].CommandCount || x[k].FirstItem != y[k].FirstItem)
+					sameBatches = false;
+			}
+
+			// Batches follow each other with no gaps.
+			std::uint32_t next = 0;
+			for(const IndirectDrawBatch& batch : y)
+			{
+				if(batch.FirstCommand != next || batch.CommandCount == 0)
+					allCovered = false;
+				next += batch.CommandCount;
+			}
+			if((int)next != draws)
+				allCovered = false;
+		}
+		CHECK(sameCommands);
+		CHECK(sameBatches);
+		CHECK(allCovered);
+	}
+}
+
+int main()
+{
+	TestLayout();
+	TestBatches();
+	TestThreads();
+	return TestResult("IndirectDrawArgs");
+}
@@ -0,0 +1,169 @@
+//***************************************************************************************
+// OcclusionBufferTest.cpp
+//
+// One wall in front of the camera: what it hides and what it does not, items
+// never hidden by their own walls, the same depths from any number of workers,
+// and the depth image read back from disk.  The image goes to the path given on
+// the command line, or OcclusionBufferTest.pgm in the working directory, and is
+// left there to look at.
+//***************************************************************************************
+
+#include "OcclusionBuffer.h"
+#include "TestCheck.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	const int Width = 320;
+	const int Height = 192;
+
+	// Looking down +z from the origin.
+	XMFLOAT4X4 ViewProj()
+	{
+		const XMMATRIX view = XMMatrixLookAtLH(XMVectorZero(), XMVectorSet(0.0f, 0.0f, 1.0f, 1.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+		const XMMATRIX proj = XMMatrixPerspectiveFovLH(XM_PIDIV2, (float)Width / Height, 1.0f, 100.0f);
+
+		XMFLOAT4X4 viewProj;
+		XMStoreFloat4x4(&viewProj, XMMatrixMultiply(view, proj));
+		return viewProj;
+	}
+
+	BoundingBox Box(float x, float y, float z, float ex, float ey, float ez)
+	{
+		return BoundingBox(XMFLOAT3(x, y, z), XMFLOAT3(ex, ey, ez));
+	}
+
+	const BoundingBox Wall = Box(0.0f, 0.0f, 10.0f, 2.0f, 2.0f, 0.5f);
+
+	void TestHiding()
+	{
+		OcclusionBuffer buffer(Width, Height, 1);
+		const int slot = buffer.AddOccluder(Wall);
+		CHECK(buffer.OccluderCount() == 1);
+		buffer.Render(ViewProj());
+
+		// Only the front face is left: two triangles, each in a few tiles.
+		CHECK(buffer.LastTriangleCount() == 2);
+		CHECK(buffer.LastBinnedCount() >= 2);
+		CHECK(buffer.Depth(0, Width / 2, Height / 2) < 1.0f);
+		CHECK(buffer.Depth(0, 0, 0) == 1.0f);
+		CHECK(buffer.Depth(buffer.LevelCount() - 1, 0, 0) == 1.0f);
+
+		CHECK(!buffer.IsVisible(Box(0.0f, 0.0f, 20.0f, 0.5f, 0.5f, 0.5f)));
+		CHECK(buffer.IsVisible(Box(0.0f, 0.0f, 5.0f, 0.5f, 0.5f, 0.5f)));
+		// Beside the wall, partly behind it, and off screen.
+		CHECK(buffer.IsVisible(Box(8.0f, 0.0f, 20.0f, 0.5f, 0.5f, 0.5f)));
+		CHECK(buffer.IsVisible(Box(0.0f, 0.0f, 20.0f, 8.0f, 0.5f, 0.5f)));
+		CHECK(buffer.IsVisible(Box(0.0f, 0.0f, -20.0f, 0.5f, 0.5f, 0.5f)));
+		// Crossing the near plane.
+		CHECK(buffer.IsVisible(Box(0.0f, 0.0f, 1.0f, 0.5f, 0.5f, 2.0f)));
+		// The box that made the depths is not behind them.
+		CHECK(buffer.IsVisible(Wall));
+
+		buffer.RemoveOccluder(slot);
+		CHECK(buffer.OccluderCount() == 0);
+		buffer.Render(ViewProj());
+		CHECK(buffer.LastTriangleCount() == 0);
+		CHECK(buffer.IsVisible(Box(0.0f, 0.0f, 20.0f, 0.5f, 0.5f, 0.5f)));
+	}
+
+	void TestOwners()
+	{
+		OcclusionBuffer buffer(Width, Height, 1);
+		buffer.AddOccluder(Wall, 5);
+		buffer.Render(ViewProj());
+
+		CHECK(buffer.Owner(Width / 2, Height / 2) == 5);
+		CHECK(buffer.Owner(0, 0) == -1);
+
+		// A box just behind the wall is hidden by it, unless the wall is its own:
+		// then the wall is the part of it that shows.
+		const BoundingBox behind = Box(0.0f, 0.0f, 10.75f, 0.5f, 0.5f, 0.25f);
+		CHECK(!buffer.IsVisible(behind));
+		CHECK(!buffer.IsVisible(behind, 6));
+		CHECK(buffer.IsVisible(behind, 5));
+
+		// A nearer wall of another owner takes the pixels over.
+		buffer.AddOccluder(Box(0.0f, 0.0f, 8.0f, 3.0f, 3.0f, 0.5f), 6);
+		buffer.Render(ViewProj());
+		CHECK(buffer.Owner(Width / 2, Height / 2) == 6);
+		CHECK(!buffer.IsVisible(behind, 5));
+	}
+
+	void TestThreads()
+	{
+		OcclusionBuffer one(Width, Height, 1);
+		OcclusionBuffer four(Width, Height, 4);
+		for(int i = 0; i < 40; ++i)
+		{
+			const BoundingBox box = Box(-12.0f + 0.6f * i, (i % 5) - 2.0f, 6.0f + (i % 7), 0.4f + 0.1f * (i % 3), 1.0f, 0.3f);
+			one.AddOccluder(box, i);
+			four.AddOccluder(box, i);
+		}
+		one.Render(ViewProj());
+		four.Render(ViewProj());
+
+		bool same = true;
+		for(int y = 0; y < one.Height(); ++y)
+		{
+			for(int x = 0; x < one.Width(); ++x)
+			{
+				if(one.Depth(0, x, y) != four.Depth(0, x, y) || one.Owner(x, y) != four.Owner(x, y))
+					same = false;
+			}
+		}
+		CHECK(same);
+		CHECK(one.LastTriangleCount() == four.LastTriangleCount());
+	}
+
+	void TestDepthImage(const std::string& path)
+	{
+		OcclusionBuffer buffer(Width, Height, 1);
+		buffer.AddOccluder(Wall);
+		buffer.AddOccluder(Box(-6.0f, 0.0f, 30.0f, 2.0f, 2.0f, 0.5f));
+		buffer.Render(ViewProj());
+
+		CHECK(!buffer.WriteDepthImage(path.c_str(), buffer.LevelCount()));
+		CHECK(buffer.WriteDepthImage(path.c_str()));
+
+		FILE* file = std::fopen(path.c_str(), "rb");
+		CHECK(file != nullptr);
+		if(file == nullptr)
+			return;
+
+		int width = 0, height = 0, maxValue = 0;
+		const bool header = std::fscanf(file, "P5 %d %d %d", &width, &height, &maxValue) == 3 && std::fgetc(file) == '\n';
+		CHECK(header && width == buffer.Width() && height == buffer.Height() && maxValue == 255);
+
+		std::vector<unsigned char> pixels(width * height);
+		CHECK(std::fread(pixels.data(), 1, pixels.size(), file) == pixels.size());
+		std::fclose(file);
+
+		// Nearest white, farthest dark grey, nothing black.
+		const XMFLOAT4X4 viewProj = ViewProj();
+		auto pixel = [&](const XMFLOAT3& p)
+		{
+			const XMVECTOR clip = XMVector3TransformCoord(XMLoadFloat3(&p), XMLoadFloat4x4(&viewProj));
+			const int x = (int)((XMVectorGetX(clip) * 0.5f + 0.5f) * width);
+			const int y = (int)((0.5f - XMVectorGetY(clip) * 0.5f) * height);
+			return pixels[y * width + x];
+		};
+		CHECK(pixel(XMFLOAT3(0.0f, 0.0f, 9.5f)) == 255);
+		CHECK(pixel(XMFLOAT3(-7.5f, 0.0f, 29.5f)) == 32);
+		CHECK(pixel(XMFLOAT3(15.0f, 0.0f, 30.0f)) == 0);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	TestHiding();
+	TestOwners();
+	TestThreads();
+	TestDepthImage(argc > 1 ? argv[1] : "OcclusionBufferTest.pgm");
+	return TestResult("OcclusionBuffer");
+}
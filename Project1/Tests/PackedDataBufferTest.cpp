@@ -0,0 +1,190 @@
+//***************************************************************************************
+// PackedDataBufferTest.cpp
+//
+// DirtyRanges merging, and PackedDataBuffer keeping every frame resource's copy
+// up to date: a change made while one frame uploads must still reach the
+// others on their turn.
+//***************************************************************************************
+
+#include "PackedDataBuffer.h"
+#include "TestCheck.h"
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace
+{
+	struct Element
+	{
+		std::uint32_t Value;
+		float Weight;
+	};
+
+	bool SameRanges(const DirtyRanges& dirty, const std::vector<DirtyRanges::Range>& expected)
+	{
+		const std::vector<DirtyRanges::Range>& ranges = dirty.Ranges();
+		if(ranges.size() != expected.size())
+			return false;
+		for(std::size_t i = 0; i < ranges.size(); ++i)
+		{
+			if(ranges[i].First != expected[i].First || ranges[i].Last != expected[i].Last)
+				return false;
+		}
+		return true;
+	}
+
+	void TestMerging()
+	{
+		DirtyRanges dirty(4);
+		CHECK(dirty.Empty());
+
+		// In order: extends the last range while within the gap.
+		dirty.Add(0);
+		dirty.Add(1);
+		dirty.Add(5);
+		CHECK(SameRanges(dirty, { { 0, 6 } }));
+		dirty.Add(11, 2);
+		CHECK(SameRanges(dirty, { { 0, 6 }, { 11, 13 } }));
+		CHECK(dirty.ElementCount() == 8);
+
+		// Out of order: a lone range lands between its neighbours...
+		dirty.Add(30);
+		dirty.Add(20);
+		CHECK(SameRanges(dirty, { { 0, 6 }, { 11, 13 }, { 20, 21 }, { 30, 31 } }));
+
+		// ...and one reaching several ranges joins them.
+		dirty.Add(14, 4);
+		CHECK(SameRanges(dirty, { { 0, 6 }, { 11, 21 }, { 30, 31 } }));
+		dirty.Add(2, 25);
+		CHECK(SameRanges(dirty, { { 0, 31 } }));
+
+		// Nothing to add changes nothing.
+		dirty.Add(50, 0);
+		CHECK(SameRanges(dirty, { { 0, 31 } }));
+
+		dirty.Clear();
+		CHECK(dirty.Empty() && dirty.ElementCount() == 0);
+
+		// With no gap only touching ranges merge.
+		DirtyRanges exact(0);
+		exact.Add(0);
+		exact.Add(1);
+		exact.Add(3);
+		exact.Add(6);
+		exact.Add(2);
+		CHECK(SameRanges(exact, { { 0, 4 }, { 6, 7 } }));
+
+		exact.Truncate(6);
+		CHECK(SameRanges(exact, { { 0, 4 } }));
+		exact.Truncate(2);
+		CHECK(SameRanges(exact, { { 0, 2 } }));
+	}
+
+	void TestSetAndResize()
+	{
+		PackedDataBuffer<Element> buffer(3);
+		CHECK(buffer.Count() == 0 && buffer.Stride() == sizeof(Element));
+
+		// New elements start zeroed and dirty in every frame.
+		buffer.Resize(8);
+		CHECK(buffer.Count() == 8);
+		CHECK(buffer[7].Value == 0 && buffer[7].Weight == 0.0f);
+		for(int frame = 0; frame < 3; ++frame)
+			CHECK(SameRanges(buffer.Dirty(frame), { { 0, 8 } }));
+
+		std::uint32_t calls = 0;
+		CHECK(buffer.Upload(0, [&](std::uint32_t first, const Element*, std::uint32_t count)
+		{
+			CHECK(first == 0 && count == 8);
+			++calls;
+		}) == 8);
+		CHECK(calls == 1);
+		CHECK(buffer.Dirty(0).Empty());
+
+		// Set marks the element in every frame, including the one just uploaded.
+		buffer.Set(3, { 33, 0.5f });
+		CHECK(buffer[3].Value == 33);
+		CHECK(SameRanges(buffer.Dirty(0), { { 3, 4 } }));
+		CHECK(SameRanges(buffer.Dirty(1), { { 0, 8 } }));
+
+		std::uint32_t uploaded = buffer.Upload(0, [&](std::uint32_t first, const Element* elements, std::uint32_t count)
+		{
+			CHECK(first == 3 && count == 1 && elements[0].Value == 33);
+		});
+		CHECK(uploaded == 1);
+
+		// Growing marks only the new elements.
+		buffer.Resize(20);
+		CHECK(SameRanges(buffer.Dirty(0), { { 8, 20 } }));
+		CHECK(SameRanges(buffer.Dirty(1), { { 0, 20 } }));
+
+		// Shrinking drops ranges past the end, so nothing is read out of bounds.
+		buffer.Set(2, { 2, 0.0f });
+		buffer.Resize(5);
+		CHECK(buffer.Count() == 5);
+		CHECK(SameRanges(buffer.Dirty(0), { { 2, 3 } }));
+		CHECK(SameRanges(buffer.Dirty(1), { { 0, 5 } }));
+		buffer.Resize(0);
+		CHECK(buffer.Dirty(2).Empty());
+		CHECK(buffer.Upload(2, [](std::uint32_t, const Element*, std::uint32_t) {}) == 0);
+	}
+
+	// Frames take their turn as the app's frame resources do; after each
+	// upload that frame's copy must match the CPU copy exactly.
+	void TestFrameCatchUp()
+	{
+		const int frameCount = 3;
+		const std::uint32_t elementCount = 200;
+
+		PackedDataBuffer<Element> buffer(frameCount);
+		buffer.Resize(elementCount);
+		std::vector<std::vector<Element>> gpu(frameCount, std::vector<Element>(elementCount, Element{ 0xdeadbeef, -1.0f }));
+
+		std::mt19937 random(7);
+		std::uniform_int_distribution<std::uint32_t> index(0, elementCount - 1);
+		std::uniform_int_distribution<int> changes(0, 12);
+
+		bool converged = true;
+		for(int n = 0; n < 600; ++n)
+		{
+			const int frame = n % frameCount;
+
+			// Some frames change nothing; the others a few scattered elements.
+			const int count = changes(random);
+			for(int i = 0; i < count; ++i)
+			{
+				const std::uint32_t at = index(random);
+				buffer.Set(at, { (std::uint32_t)n * 1000 + at, (float)i });
+			}
+
+			buffer.Upload(frame, [&](std::uint32_t first, const Element* elements, std::uint32_t count)
+			{
+				CHECK(first + count <= elementCount);
+				for(std::uint32_t i = 0; i < count; ++i)
+					gpu[frame][first + i] = elements[i];
+			});
+
+			for(std::uint32_t i = 0; i < elementCount; ++i)
+			{
+				if(gpu[frame][i].Value != buffer[i].Value || gpu[frame][i].Weight != buffer[i].Weight)
+					converged = false;
+			}
+		}
+		CHECK(converged);
+
+		// A frame that has caught up writes nothing more until something changes.
+		for(int frame = 0; frame < frameCount; ++frame)
+			buffer.Upload(frame, [](std::uint32_t, const Element*, std::uint32_t) {});
+		for(int frame = 0; frame < frameCount; ++frame)
+			CHECK(buffer.Upload(frame, [](std::uint32_t, const Element*, std::uint32_t) {}) == 0);
+	}
+}
+
+int main()
+{
+	TestMerging();
+	TestSetAndResize();
+	TestFrameCatchUp();
+	return TestResult("PackedDataBuffer");
+}
@@ -0,0 +1,164 @@
+//***************************************************************************************
+// SceneStoreTest.cpp
+//
+// Random creates and destroys checked against a plain list of the live handles
+// and what was written through each: destroyed handles stop validating, a reused
+// slot is never reachable through an old handle, the swap on Destroy leaves every
+// other handle on its own data (dirty flag included), and Clear invalidates all
+// of them.
+//***************************************************************************************
+
+#include "SceneStore.h"
+#include "TestCheck.h"
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	struct Live
+	{
+		SceneHandle Handle;
+		std::uint32_t Tag;
+		bool Dirty;
+	};
+
+	// Writes 'tag' into every array the entry has.
+	void Stamp(SceneStore& store, SceneHandle h, std::uint32_t tag)
+	{
+		store.Material(h) = tag;
+		store.Geometry(h) = tag * 3;
+		store.World(h)._41 = (float)tag;
+		store.TexTransform(h)._42 = (float)tag;
+		store.Bounds(h).Center.x = (float)tag;
+		store.WorldBounds(h).Center.y = (float)tag;
+	}
+
+	bool HasTag(const SceneStore& store, SceneHandle h, std::uint32_t tag)
+	{
+		const std::uint32_t index = store.Index(h);
+		return store.Material(h) == tag && store.Geometry(h) == tag * 3 &&
+			store.World(h)._41 == (float)tag && store.TexTransform(h)._42 == (float)tag &&
+			store.Bounds(h).Center.x == (float)tag && store.WorldBounds(h).Center.y == (float)tag &&
+			store.Materials()[index] == tag && store.Geometries()[index] == tag * 3 &&
+			store.Worlds()[index]._41 == (float)tag && store.BoundsArray()[index].Center.x == (float)tag &&
+			store.WorldBoundsArray()[index].Center.y == (float)tag;
+	}
+
+	void CheckAll(const SceneStore& store, const std::vector<Live>& live, const std::vector<SceneHandle>& dead)
+	{
+		CHECK(store.Count() == live.size());
+
+		for(const Live& e : live)
+		{
+			CHECK(store.IsValid(e.Handle));
+			CHECK(store.Index(e.Handle) < store.Count());
+			CHECK(store.Handle(store.Index(e.Handle)) == e.Handle);
+			CHECK(HasTag(store, e.Handle, e.Tag));
+			CHECK(store.IsDirty(e.Handle) == e.Dirty);
+		}
+
+		for(const SceneHandle& h : dead)
+			CHECK(!store.IsValid(h));
+	}
+
+	void TestHandles()
+	{
+		std::mt19937 rng(73);
+		SceneStore store;
+		std::vector<Live> live;
+		std::vector<SceneHandle> dead;
+		std::uint32_t nextTag = 1;
+
+		CHECK(!store.IsValid(SceneHandle()));
+
+		for(int step = 0; step < 5000; ++step)
+		{
+			const int pick = (int)(rng() % 10);
+			if(pick < 5 || live.empty())
+			{
+				const SceneHandle h = store.Create();
+				CHECK(store.IsValid(h));
+
+				// A new entry starts clean, and no old handle names it.
+				CHECK(!store.IsDirty(h) && store.Material(h) == 0);
+				for(const SceneHandle& old : dead)
+					CHECK(old != h);
+
+				Live e;
+				e.Handle = h;
+				e.Tag = nextTag++;
+				e.Dirty = false;
+				Stamp(store, h, e.Tag);
+				live.push_back(e);
+			}
+			else if(pick < 8)
+			{
+				const std::size_t i = rng() % live.size();
+				const SceneHandle h = live[i].Handle;
+				store.Destroy(h);
+				dead.push_back(h);
+				live[i] = live.back();
+				live.pop_back();
+
+				// A second Destroy through the stale handle does nothing.
+				store.Destroy(h);
+				CHECK(!store.IsValid(h));
+			}
+			else
+			{
+				Live& e = live[rng() % live.size()];
+				if(e.Dirty)
+				{
+					CHECK(!store.MarkDirty(e.Handle));
+					store.ClearDirty(e.Handle);
+					e.Dirty = false;
+				}
+				else
+				{
+					CHECK(store.MarkDirty(e.Handle));
+					e.Dirty = true;
+				}
+			}
+
+			if(step % 50 == 0)
+				CheckAll(store, live, dead);
+		}
+		CheckAll(store, live, dead);
+
+		// Slots are reused, so many dead handles share a slot with a live one.
+		int sharedSlots = 0;
+		for(const SceneHandle& old : dead)
+		{
+			for(const Live& e : live)
+				sharedSlots += old.Slot == e.Handle.Slot ? 1 : 0;
+		}
+		CHECK(sharedSlots > 0);
+
+		// Clear invalidates everything, and nothing made after it matches a
+		// handle from before.
+		store.Clear();
+		for(const Live& e : live)
+			dead.push_back(e.Handle);
+		live.clear();
+		CheckAll(store, live, dead);
+
+		for(int i = 0; i < 100; ++i)
+		{
+			const SceneHandle h = store.Create();
+			for(const SceneHandle& old : dead)
+				CHECK(old != h);
+		}
+		CHECK(store.Count() == 100);
+	}
+}
+
+int main()
+{
+	TestHandles();
+
+	return TestResult("SceneStore");
+}
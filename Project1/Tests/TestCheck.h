@@ -0,0 +1,36 @@
+//***************************************************************************************
+// TestCheck.h
+//
+// What the module tests share: CHECK reports a failed condition with its line
+// and carries on, so one run shows every failure, and TestResult turns the count
+// into the exit code CTest looks at.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdio>
+
+inline int& TestFailureCount()
+{
+	static int failures = 0;
+	return failures;
+}
+
+#define CHECK(condition) \
+	do { \
+		if(!(condition)) { \
+			std::fprintf(stderr, "%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+			++TestFailureCount(); \
+		} \
+	} while(0)
+
+inline int TestResult(const char* name)
+{
+	if(TestFailureCount() == 0)
+	{
+		std::printf("%s: passed\n", name);
+		return 0;
+	}
+	std::printf("%s: %d checks failed\n", name, TestFailureCount());
+	return 1;
+}
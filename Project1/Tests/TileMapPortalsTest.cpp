@@ -0,0 +1,117 @@
+//***************************************************************************************
+// TileMapPortalsTest.cpp
+//
+// Random maps edited one tile at a time, walls knocked down and put back.  After
+// every OnTileChanged the repaired graph must have the sectors and portals of a
+// fresh Build, and Collect must mark the same cells as a fresh graph for random
+// cameras.  Block sizes that do and do not divide the map are covered.
+//***************************************************************************************
+
+#include "TileMapPortals.h"
+#include "TestCheck.h"
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace
+{
+	TileMap RandomMap(std::mt19937& rng, int rows, int cols, int wallPercent)
+	{
+		TileMap map(rows, cols);
+		map.SetPlacement(-10.0f, 5.0f, 2.0f, 10.0f);
+		for(int r = 0; r < rows; ++r)
+		{
+			for(int c = 0; c < cols; ++c)
+			{
+				if((int)(rng() % 100) < wallPercent)
+					map.Set(r, c, TileMap::Wall);
+			}
+		}
+		return map;
+	}
+
+	// Compares what both graphs collect for a few random cameras.
+	bool SameVisibility(std::mt19937& rng, const TileMap& map, TileMapPortals& a, TileMapPortals& b)
+	{
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		std::vector<std::uint64_t> bitsA;
+		std::vector<std::uint64_t> bitsB;
+
+		for(int camera = 0; camera < 8; ++camera)
+		{
+			const float x = map.OriginX() + unit(rng) * map.RowCount() * map.CellSize();
+			const float z = map.OriginZ() + unit(rng) * map.ColumnCount() * map.CellSize();
+			const float angle = unit(rng) * 6.2831853f;
+			const float halfAngle = 0.3f + unit(rng) * 0.9f;
+
+			const bool inA = a.Collect(map, x, z, std::cos(angle), std::sin(angle), halfAngle, bitsA);
+			const bool inB = b.Collect(map, x, z, std::cos(angle), std::sin(angle), halfAngle, bitsB);
+			if(inA != inB || (inA && bitsA != bitsB))
+				return false;
+		}
+		return true;
+	}
+
+	void TestRepairMatchesBuild(int blockSize, unsigned seed)
+	{
+		std::mt19937 rng(seed);
+		TileMap map = RandomMap(rng, 30, 27, 30);
+
+		TileMapPortals repaired(blockSize);
+		repaired.Build(map);
+
+		for(int edit = 0; edit < 300; ++edit)
+		{
+			const int row = (int)(rng() % map.RowCount());
+			const int col = (int)(rng() % map.ColumnCount());
+			map.Set(row, col, map.IsWall(row, col) ? TileMap::Empty : TileMap::Wall);
+			repaired.OnTileChanged(map, row, col);
+
+			TileMapPortals fresh(blockSize);
+			fresh.Build(map);
+
+			CHECK(repaired.SectorCount() == fresh.SectorCount());
+			CHECK(repaired.PortalCount() == fresh.PortalCount());
+			CHECK(SameVisibility(rng, map, repaired, fresh));
+		}
+
+		// Edits off the map are ignored.
+		const int portals = repaired.PortalCount();
+		repaired.OnTileChanged(map, -1, 0);
+		repaired.OnTileChanged(map, 0, map.ColumnCount());
+		CHECK(repaired.PortalCount() == portals);
+	}
+
+	void TestOpenRoom()
+	{
+		// One block, one sector, no portals; the whole room is seen.
+		TileMap map(6, 6);
+		map.SetPlacement(0.0f, 0.0f, 1.0f, 10.0f);
+
+		TileMapPortals portals(8);
+		portals.Build(map);
+		CHECK(portals.SectorCount() == 1 && portals.PortalCount() == 0);
+
+		std::vector<std::uint64_t> bits;
+		CHECK(portals.Collect(map, 3.0f, 3.0f, 1.0f, 0.0f, 0.5f, bits));
+		for(int i = 0; i < map.CellCount(); ++i)
+			CHECK((bits[i >> 6] >> (i & 63)) & 1);
+
+		// Inside a wall or off the map there is nothing to collect from.
+		map.Set(1, 1, TileMap::Wall);
+		portals.OnTileChanged(map, 1, 1);
+		CHECK(!portals.Collect(map, 1.5f, 1.5f, 1.0f, 0.0f, 0.5f, bits));
+		CHECK(!portals.Collect(map, -1.0f, 3.0f, 1.0f, 0.0f, 0.5f, bits));
+	}
+}
+
+int main()
+{
+	TestRepairMatchesBuild(8, 61);
+	TestRepairMatchesBuild(5, 161);
+	TestOpenRoom();
+
+	return TestResult("TileMapPortals");
+}
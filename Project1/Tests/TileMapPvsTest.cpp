@@ -0,0 +1,261 @@
+//***************************************************************************************
+// TileMapPvsTest.cpp
+//
+// The sets must be conservative, so a dense fan of rays is marched from the
+// centre and from random points of every open cell, in small steps and without
+// the builder's shadowcast, and every cell a ray enters before a wall stops it
+// (that wall included) must be in the source cell's set.  Solid walls must still
+// hide what is behind them, and builds on one and on several threads must agree.
+//***************************************************************************************
+
+#include "TileMapPvs.h"
+#include "TestCheck.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace
+{
+	const float Pi = 3.14159265f;
+
+	struct Cell
+	{
+		int Row;
+		int Col;
+	};
+
+	TileMap RandomMap(std::mt19937& rng, int rows, int cols, int wallPercent)
+	{
+		TileMap map(rows, cols);
+		for(int r = 0; r < rows; ++r)
+		{
+			for(int c = 0; c < cols; ++c)
+			{
+				if((int)(rng() % 100) < wallPercent)
+					map.Set(r, c, TileMap::Wall);
+			}
+		}
+		return map;
+	}
+
+	// A maze-like map: walls on a lattice with random gaps, as the castle has.
+	TileMap LatticeMap(std::mt19937& rng, int rows, int cols)
+	{
+		TileMap map(rows, cols);
+		for(int r = 0; r < rows; ++r)
+		{
+			for(int c = 0; c < cols; ++c)
+			{
+				if((r % 4 == 0 || c % 4 == 0) && rng() % 3 != 0)
+					map.Set(r, c, TileMap::Wall);
+			}
+		}
+		return map;
+	}
+
+	// Marches rays at evenly spread angles from (r0, c0) and follows every cell
+	// each enters until it leaves the map or enters a wall.  Returns false as
+	// soon as one of those cells is missing from 'bits'.
+	bool FanCovered(const TileMap& map, const std::vector<std::uint64_t>& bits, float r0, float c0, int rayCount)
+	{
+		const float step = 1.0f / 32.0f;
+		const float length = (float)(map.RowCount() + map.ColumnCount());
+
+		for(int ray = 0; ray < rayCount; ++ray)
+		{
+			const float angle = 2.0f * Pi * ray / rayCount;
+			const float dr = std::sin(angle) * step;
+			const float dc = std::cos(angle) * step;
+
+			float r = r0;
+			float c = c0;
+			int row = (int)std::floor(r);
+			int col = (int)std::floor(c);
+			for(float t = 0.0f; t < length; t += step)
+			{
+				const float nextR = r + dr;
+				const float nextC = c + dc;
+				const int nextRow = (int)std::floor(nextR);
+				const int nextCol = (int)std::floor(nextC);
+
+				// A step that changes both row and column passes through the cell
+				// on whichever side of the corner it crosses first.
+				std::vector<Cell> entered;
+				if(nextRow != row && nextCol != col)
+				{
+					const float rowEdge = (float)std::max(row, nextRow);
+					const float colEdge = (float)std::max(col, nextCol);
+					if((rowEdge - r) / dr < (colEdge - c) / dc)
+						entered.push_back(Cell{ nextRow, col });
+					else
+						entered.push_back(Cell{ row, nextCol });
+				}
+				if(nextRow != row || nextCol != col)
+					entered.push_back(Cell{ nextRow, nextCol });
+
+				r = nextR;
+				c = nextC;
+				row = nextRow;
+				col = nextCol;
+
+				bool stopped = false;
+				for(const Cell& cell : entered)
+				{
+					if(!map.InBounds(cell.Row, cell.Col))
+					{
+						stopped = true;
+						break;
+					}
+
+					if(!TileMapPvs::Test(bits, cell.Row * map.ColumnCount() + cell.Col))
+						return false;
+
+					if(map.IsWall(cell.Row, cell.Col))
+					{
+						stopped = true;
+						break;
+					}
+				}
+				if(stopped)
+					break;
+			}
+		}
+		return true;
+	}
+
+	void CheckAgainstRayFan(const TileMap& map, const TileMapPvs& pvs, std::mt19937& rng)
+	{
+		std::uniform_real_distribution<float> offset(0.0f, 1.0f);
+		std::vector<std::uint64_t> bits;
+
+		for(int row = 0; row < map.RowCount(); ++row)
+		{
+			for(int col = 0; col < map.ColumnCount(); ++col)
+			{
+				if(map.IsWall(row, col))
+				{
+					CHECK(pvs.SetOf(row, col) == -1);
+					continue;
+				}
+
+				const int set = pvs.SetOf(row, col);
+				CHECK(set >= 0 && set < pvs.UniqueSetCount());
+				pvs.Expand(set, bits);
+				CHECK(TileMapPvs::Test(bits, row * map.ColumnCount() + col));
+
+				// The centre and a few random points anywhere in the cell.
+				CHECK(FanCovered(map, bits, row + 0.5f, col + 0.5f, 512));
+				for(int i = 0; i < 2; ++i)
+					CHECK(FanCovered(map, bits, row + offset(rng), col + offset(rng), 512));
+			}
+		}
+	}
+
+	bool SameSets(const TileMap& map, const TileMapPvs& a, const TileMapPvs& b)
+	{
+		std::vector<std::uint64_t> bitsA;
+		std::vector<std::uint64_t> bitsB;
+		for(int row = 0; row < map.RowCount(); ++row)
+		{
+			for(int col = 0; col < map.ColumnCount(); ++col)
+			{
+				a.Expand(a.SetOf(row, col), bitsA);
+				b.Expand(b.SetOf(row, col), bitsB);
+				if(bitsA != bitsB)
+					return false;
+			}
+		}
+		return true;
+	}
+
+	void TestConservative()
+	{
+		std::mt19937 rng(60);
+
+		const TileMap maps[] =
+		{
+			RandomMap(rng, 18, 22, 20),
+			RandomMap(rng, 21, 17, 35),
+			LatticeMap(rng, 25, 25),
+		};
+
+		for(const TileMap& map : maps)
+		{
+			TileMapPvs pvs;
+			pvs.Build(map, 1);
+			CheckAgainstRayFan(map, pvs, rng);
+
+			TileMapPvs threaded;
+			threaded.Build(map, 4);
+			CHECK(SameSets(map, pvs, threaded));
+			CHECK(pvs.UniqueSetCount() == threaded.UniqueSetCount());
+		}
+	}
+
+	void TestSolidWall()
+	{
+		// A full wall across column 4, and two walls that only touch at a corner.
+		TileMap map(9, 9);
+		for(int r = 0; r < 9; ++r)
+			map.Set(r, 4, TileMap::Wall);
+		map.Set(2, 1, TileMap::Wall);
+		map.Set(3, 2, TileMap::Wall);
+
+		TileMapPvs pvs;
+		pvs.Build(map, 1);
+
+		std::vector<std::uint64_t> bits;
+		for(int row = 0; row < 9; ++row)
+		{
+			for(int col = 0; col < 4; ++col)
+			{
+				if(map.IsWall(row, col))
+					continue;
+
+				// Nothing beyond the wall is seen, and below the corner walls
+				// nothing stands in front of it.
+				pvs.Expand(pvs.SetOf(row, col), bits);
+				if(row > 3)
+					CHECK(TileMapPvs::Test(bits, map.Index(row, 4)));
+				for(int r = 0; r < 9; ++r)
+				{
+					for(int c = 5; c < 9; ++c)
+						CHECK(!TileMapPvs::Test(bits, map.Index(r, c)));
+				}
+			}
+		}
+
+		// A line through the shared corner grazes both walls and gets through.
+		pvs.Expand(pvs.SetOf(2, 2), bits);
+		CHECK(TileMapPvs::Test(bits, map.Index(3, 1)));
+	}
+
+	void TestOutside()
+	{
+		TileMap map(4, 5);
+		TileMapPvs pvs;
+		pvs.Build(map, 1);
+
+		CHECK(pvs.SetOf(-1, 0) == -1 && pvs.SetOf(0, 5) == -1 && pvs.SetOf(4, 0) == -1);
+
+		// Nothing blocks an empty room; every cell sees every cell, and all of
+		// them share one set.
+		CHECK(pvs.UniqueSetCount() == 1);
+		std::vector<std::uint64_t> bits;
+		pvs.Expand(pvs.SetOf(2, 3), bits);
+		for(int i = 0; i < map.CellCount(); ++i)
+			CHECK(TileMapPvs::Test(bits, i));
+	}
+}
+
+int main()
+{
+	TestConservative();
+	TestSolidWall();
+	TestOutside();
+
+	return TestResult("TileMapPvs");
+}
@@ -0,0 +1,177 @@
+//***************************************************************************************
+// TransformHierarchyTest.cpp
+//
+// Random trees grown and edited over many updates, with levels split over worker
+// threads, checked against a brute-force walk up the parents: every world
+// matrix, and exactly the changed nodes reported, parents first.  Threads share
+// the level arrays, so this is the test to run under -DCASTLE_SANITIZER=thread
+// (and =address) after touching Update.
+//***************************************************************************************
+
+#include "TransformHierarchy.h"
+#include "TestCheck.h"
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	const std::uint32_t NoParent = TransformHierarchy::NoParent;
+
+	bool NearlyEqual(const XMFLOAT4X4& a, const XMFLOAT4X4& b)
+	{
+		for(int r = 0; r < 4; ++r)
+		{
+			for(int c = 0; c < 4; ++c)
+			{
+				if(std::fabs(a.m[r][c] - b.m[r][c]) > 1e-3f * (1.0f + std::fabs(a.m[r][c])))
+					return false;
+			}
+		}
+		return true;
+	}
+
+	XMFLOAT4X4 BruteForceWorld(const TransformHierarchy& tree, std::uint32_t id)
+	{
+		XMMATRIX world = XMLoadFloat4x4(&tree.Local(id));
+		for(std::uint32_t p = tree.Parent(id); p != NoParent; p = tree.Parent(p))
+			world = XMMatrixMultiply(world, XMLoadFloat4x4(&tree.Local(p)));
+
+		XMFLOAT4X4 result;
+		XMStoreFloat4x4(&result, world);
+		return result;
+	}
+
+	bool IsDirty(const TransformHierarchy& tree, const std::vector<std::uint8_t>& touched, std::uint32_t id)
+	{
+		for(std::uint32_t n = id; n != NoParent; n = tree.Parent(n))
+		{
+			if(touched[n])
+				return true;
+		}
+		return false;
+	}
+
+	void TestRandomTrees()
+	{
+		std::mt19937 random(5);
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+		auto randomLocal = [&]()
+		{
+			XMFLOAT4X4 m;
+			XMStoreFloat4x4(&m, XMMatrixMultiply(XMMatrixRotationRollPitchYaw(unit(random), unit(random), unit(random)),
+				XMMatrixTranslation(unit(random), unit(random), unit(random))));
+			return m;
+		};
+
+		bool worldsMatch = true;
+		bool changedMatch = true;
+		bool parentsFirst = true;
+
+		for(int trial = 0; trial < 4; ++trial)
+		{
+			// More workers than cores is fine, and makes sure there are some.
+			TransformHierarchy tree;
+			tree.SetThreadCount(4);
+			std::vector<std::uint8_t> touched;
+			std::vector<std::uint32_t> changed;
+
+			for(int round = 0; round < 60; ++round)
+			{
+				// A big first batch, then a few nodes a round, anywhere in the tree,
+				// so later adds also land above the deepest level.
+				const int adds = round == 0 ? 3000 : (int)(random() % 40);
+				for(int i = 0; i < adds; ++i)
+				{
+					const std::uint32_t parent = tree.Count() > 0 && random() % 16 != 0 ? random() % tree.Count() : NoParent;
+					CHECK(tree.Add(parent, randomLocal()) == tree.Count() - 1);
+					touched.push_back(1);
+				}
+
+				const int edits = (int)(random() % 30);
+				for(int i = 0; i < edits; ++i)
+				{
+					const std::uint32_t id = random() % tree.Count();
+					tree.SetLocal(id, randomLocal());
+					touched[id] = 1;
+				}
+
+				changed.clear();
+				tree.Update(changed, 64);
+				CHECK(tree.LastUpdated() == changed.size());
+
+				std::vector<std::uint8_t> reported(tree.Count(), 0);
+				for(std::uint32_t id : changed)
+				{
+					const std::uint32_t parent = tree.Parent(id);
+					if(parent != NoParent && IsDirty(tree, touched, parent) && !reported[parent])
+						parentsFirst = false;
+					reported[id] = 1;
+				}
+
+				for(std::uint32_t id = 0; id < tree.Count(); ++id)
+				{
+					if(reported[id] != (IsDirty(tree, touched, id) ? 1 : 0))
+						changedMatch = false;
+					if(!NearlyEqual(BruteForceWorld(tree, id), tree.World(id)))
+						worldsMatch = false;
+				}
+
+				std::fill(touched.begin(), touched.end(), 0);
+			}
+
+			// Nothing touched, nothing to do.
+			changed.clear();
+			tree.Update(changed, 64);
+			CHECK(changed.empty() && tree.LastUpdated() == 0);
+
+			tree.Clear();
+			CHECK(tree.Count() == 0 && tree.LevelCount() == 0);
+		}
+
+		CHECK(worldsMatch);
+		CHECK(changedMatch);
+		CHECK(parentsFirst);
+	}
+
+	void TestMovingParent()
+	{
+		TransformHierarchy tree;
+		XMFLOAT4X4 identity;
+		XMStoreFloat4x4(&identity, XMMatrixIdentity());
+		XMFLOAT4X4 up;
+		XMStoreFloat4x4(&up, XMMatrixTranslation(0.0f, 1.0f, 0.0f));
+
+		const std::uint32_t castle = tree.Add(NoParent, identity);
+		const std::uint32_t tower = tree.Add(castle, up);
+		const std::uint32_t roof = tree.Add(tower, up);
+		const std::uint32_t wall = tree.Add(castle, identity);
+		CHECK(tree.LevelCount() == 3);
+
+		std::vector<std::uint32_t> changed;
+		tree.Update(changed);
+		CHECK(changed.size() == 4);
+		CHECK(tree.World(roof)._42 == 2.0f);
+
+		// Moving the tower moves the roof, and nothing else.
+		XMFLOAT4X4 moved;
+		XMStoreFloat4x4(&moved, XMMatrixTranslation(5.0f, 1.0f, 0.0f));
+		tree.SetLocal(tower, moved);
+		changed.clear();
+		tree.Update(changed);
+		CHECK(changed == std::vector<std::uint32_t>({ tower, roof }));
+		CHECK(tree.World(roof)._41 == 5.0f && tree.World(roof)._42 == 2.0f);
+		CHECK(tree.World(wall)._41 == 0.0f);
+	}
+}
+
+int main()
+{
+	TestMovingParent();
+	TestRandomTrees();
+	return TestResult("TransformHierarchy");
+}
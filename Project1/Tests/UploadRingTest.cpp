@@ -0,0 +1,275 @@
+//***************************************************************************************
+// UploadRingTest.cpp
+//
+// UploadRing over heaps that are plain CPU memory: alignment, wrapping past the
+// end of the heap, growing while frames are in flight and when the source
+// fails, and a long random run that checks no frame's bytes are handed out
+// again, or a heap released, before its fence completes.
+//***************************************************************************************
+
+#include "UploadRing.h"
+#include "TestCheck.h"
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <random>
+#include <vector>
+
+namespace
+{
+	// Heap i starts at GPU address i << 40, so addresses tell heaps apart.
+	class FakeHeapSource : public IUploadHeapSource
+	{
+	public:
+		virtual bool CreateHeap(std::uint64_t size, UploadHeap& heap)override
+		{
+			if(Fail)
+				return false;
+
+			const int id = mNextId++;
+			std::vector<unsigned char>& memory = mHeaps[id];
+			memory.resize((std::size_t)size);
+
+			heap.Cpu = memory.data();
+			heap.Gpu = (std::uint64_t)id << 40;
+			heap.Size = size;
+			heap.Id = id;
+			++Created;
+			return true;
+		}
+
+		virtual void ReleaseHeap(const UploadHeap& heap)override
+		{
+			CHECK(mHeaps.count(heap.Id) == 1);
+			mHeaps.erase(heap.Id);
+			++Released;
+		}
+
+		int LiveHeaps()const { return (int)mHeaps.size(); }
+		bool IsLive(int id)const { return mHeaps.count(id) == 1; }
+
+		bool Fail = false;
+		int Created = 0;
+		int Released = 0;
+
+	private:
+		std::map<int, std::vector<unsigned char>> mHeaps;
+		int mNextId = 0;
+	};
+
+	const std::uint64_t KB = 1024;
+
+	// The fake heaps' addresses carry the heap id and offset, which must match
+	// the ones the ring reports.
+	std::uint64_t Offset(const UploadRing::Allocation& a)
+	{
+		CHECK(a.Offset == (a.Gpu & ((1ull << 40) - 1)));
+		return a.Offset;
+	}
+
+	int HeapOf(const UploadRing::Allocation& a)
+	{
+		CHECK(a.Heap == (int)(a.Gpu >> 40));
+		return a.Heap;
+	}
+
+	void TestAlignment()
+	{
+		FakeHeapSource source;
+		{
+			UploadRing ring(source, 1);
+			CHECK(source.Created == 0);
+
+			const UploadRing::Allocation a = ring.Allocate(3, 1);
+			CHECK(a.Cpu != nullptr && a.Size == 3 && Offset(a) == 0);
+			CHECK(source.Created == 1 && ring.GetStats().Capacity == 64 * KB);
+
+			const UploadRing::Allocation b = ring.Allocate(256, 256);
+			CHECK(Offset(b) == 256);
+			CHECK(static_cast<unsigned char*>(b.Cpu) - static_cast<unsigned char*>(a.Cpu) == 256);
+
+			ring.EndFrame(1);
+			const UploadRing::Stats& stats = ring.GetStats();
+			CHECK(stats.FrameBytes == 512 && stats.FramePaddingBytes == 253 && stats.FrameAllocations == 2);
+			CHECK(stats.InFlightBytes == 512);
+
+			ring.Release(1);
+			CHECK(ring.GetStats().InFlightBytes == 0);
+
+			// With nothing in flight the ring starts from the bottom again.
+			CHECK(Offset(ring.Allocate(16, 16)) == 0);
+		}
+		CHECK(source.LiveHeaps() == 0);
+	}
+
+	void TestWrap()
+	{
+		FakeHeapSource source;
+		UploadRing ring(source, 64 * KB);
+
+		// Three 20 KB frames fill the heap to 60 KB.
+		for(std::uint64_t frame = 1; frame <= 3; ++frame)
+		{
+			const UploadRing::Allocation a = ring.Allocate(20 * KB, 256);
+			CHECK(Offset(a) == (frame - 1) * 20 * KB);
+			ring.EndFrame(frame);
+		}
+
+		// Frame 4 does not fit in the last 4 KB, and frame 1 is done: it starts
+		// over at the bottom, paying for the skipped end.
+		ring.Release(1);
+		const UploadRing::Allocation wrapped = ring.Allocate(20 * KB, 256);
+		CHECK(Offset(wrapped) == 0 && HeapOf(wrapped) == 0);
+		ring.EndFrame(4);
+		CHECK(ring.GetStats().FramePaddingBytes == 4 * KB);
+		CHECK(ring.GetStats().FrameBytes == 24 * KB);
+		CHECK(ring.GetStats().InFlightBytes == 64 * KB);
+		CHECK(ring.GetStats().Grows == 0);
+
+		// Frame 2 ends where frame 5 may go, but not beyond frame 3's start.
+		ring.Release(2);
+		const UploadRing::Allocation fits = ring.Allocate(20 * KB, 256);
+		CHECK(Offset(fits) == 20 * KB && HeapOf(fits) == 0);
+		ring.EndFrame(5);
+		CHECK(ring.GetStats().Grows == 0 && source.Created == 1);
+	}
+
+	void TestGrow()
+	{
+		FakeHeapSource source;
+		UploadRing ring(source, 64 * KB);
+
+		ring.Allocate(40 * KB, 256);
+		ring.EndFrame(1);
+
+		// Frame 1 is still in flight: the next 40 KB need a new heap.
+		const UploadRing::Allocation a = ring.Allocate(40 * KB, 256);
+		CHECK(a.Cpu != nullptr && HeapOf(a) == 1 && Offset(a) == 0);
+		CHECK(ring.GetStats().Grows == 1);
+		CHECK(ring.GetStats().Capacity == 128 * KB);
+
+		// The old heap waits for the frame that outgrew it, not just frame 1.
+		ring.EndFrame(2);
+		ring.Release(1);
+		CHECK(source.IsLive(0));
+		ring.Release(2);
+		CHECK(!source.IsLive(0) && source.IsLive(1));
+
+		// An allocation larger than twice the heap grows past it at once.
+		ring.Allocate(100 * KB, 256);
+		ring.EndFrame(3);
+		const UploadRing::Allocation big = ring.Allocate(300 * KB, 4096);
+		CHECK(big.Cpu != nullptr && ring.GetStats().Capacity >= 300 * KB + 4096);
+		CHECK(ring.GetStats().Grows == 2);
+		ring.EndFrame(4);
+		CHECK(ring.GetStats().PeakFrameBytes == 300 * KB);
+
+		// When the source cannot make a heap, the allocation fails and the ring
+		// keeps what it has.
+		const std::uint64_t capacity = ring.GetStats().Capacity;
+		source.Fail = true;
+		const UploadRing::Allocation failed = ring.Allocate(4 * capacity, 256);
+		CHECK(failed.Cpu == nullptr && failed.Size == 0);
+		CHECK(ring.GetStats().Capacity == capacity && ring.GetStats().Grows == 2);
+		CHECK(ring.Allocate(16, 16).Cpu != nullptr);
+		ring.EndFrame(5);
+
+		FakeHeapSource broken;
+		broken.Fail = true;
+		UploadRing none(broken, 64 * KB);
+		CHECK(none.Allocate(16, 16).Cpu == nullptr);
+	}
+
+	// Frames as the app makes them, with the GPU up to three frames behind.
+	// Every allocation is filled with a tag and checked when its fence is
+	// released; overlapping live allocations or an early ReleaseHeap would
+	// change it.
+	void TestRandomFrames()
+	{
+		struct Live
+		{
+			unsigned char* Cpu;
+			std::uint64_t Size;
+			unsigned char Tag;
+			std::uint64_t Fence;
+		};
+
+		std::mt19937 random(5);
+		bool allocated = true;
+		bool intact = true;
+		bool aligned = true;
+		int grows = 0;
+
+		for(int trial = 0; trial < 10; ++trial)
+		{
+			FakeHeapSource source;
+			{
+				UploadRing ring(source, 1000);
+				std::vector<Live> live;
+				std::uint64_t fence = 0;
+				std::uint64_t completed = 0;
+
+				for(int frame = 0; frame < 2000; ++frame)
+				{
+					if(fence >= 3 && completed < fence - 2)
+						completed = fence - 2;
+					if(random() % 3 == 0 && completed < fence)
+						++completed;
+
+					// Checked before Release, which may free a heap they are in.
+					std::vector<Live> kept;
+					for(const Live& l : live)
+					{
+						for(std::uint64_t i = 0; i < l.Size; ++i)
+						{
+							if(l.Cpu[i] != l.Tag)
+								intact = false;
+						}
+						if(l.Fence > completed)
+							kept.push_back(l);
+					}
+					live.swap(kept);
+					ring.Release(completed);
+
+					// Small frames first, then ones that force the ring to grow.
+					const std::uint64_t scale = frame < 1000 ? 300 : 40000;
+					const int count = (int)(random() % 6);
+					for(int k = 0; k < count; ++k)
+					{
+						const std::uint64_t size = 1 + random() % scale;
+						const std::uint64_t alignment = 1ull << (random() % 9);
+						const UploadRing::Allocation a = ring.Allocate(size, alignment);
+						if(a.Cpu == nullptr)
+						{
+							allocated = false;
+							continue;
+						}
+						if((a.Gpu & (alignment - 1)) != 0)
+							aligned = false;
+
+						const unsigned char tag = (unsigned char)random();
+						std::memset(a.Cpu, tag, (std::size_t)size);
+						live.push_back({ static_cast<unsigned char*>(a.Cpu), size, tag, fence + 1 });
+					}
+					ring.EndFrame(++fence);
+				}
+				grows += ring.GetStats().Grows;
+			}
+			CHECK(source.LiveHeaps() == 0 && source.Created == source.Released);
+		}
+		CHECK(allocated);
+		CHECK(intact);
+		CHECK(aligned);
+		CHECK(grows > 0);
+	}
+}
+
+int main()
+{
+	TestAlignment();
+	TestWrap();
+	TestGrow();
+	TestRandomFrames();
+	return TestResult("UploadRing");
+}
@@ -0,0 +1,275 @@
+//***************************************************************************************
+// TileChunkStreamer.cpp
+//***************************************************************************************
+
+#include "TileChunkStreamer.h"
+
+#include <algorithm>
+#include <cmath>
+
+TileChunkStreamer::TileChunkStreamer(int chunkSize)
+	: mChunkSize(std::max(chunkSize, 1))
+{
+}
+
+TileChunkStreamer::~TileChunkStreamer()
+{
+	Stop();
+}
+
+void TileChunkStreamer::SetRadii(float loadRadius, float unloadRadius)
+{
+	mLoadRadius = loadRadius;
+	mUnloadRadius = std::max(unloadRadius, loadRadius);
+}
+
+void TileChunkStreamer::Start(int workerCount)
+{
+	if(!mWorkers.empty())
+		return;
+
+	mQuit = false;
+	for(int i = 0; i < std::max(workerCount, 1); ++i)
+		mWorkers.emplace_back(&TileChunkStreamer::WorkerMain, this);
+}
+
+void TileChunkStreamer::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+		mJobs.clear();
+	}
+	mWorkAvailable.notify_all();
+
+	for(auto& worker : mWorkers)
+		worker.join();
+	mWorkers.clear();
+}
+
+TileMapMesher::Region TileChunkStreamer::ChunkRegion(const TileMap& map, Key chunk)const
+{
+	TileMapMesher::Region region;
+	region.Row0 = chunk.Row * mChunkSize;
+	region.Col0 = chunk.Col * mChunkSize;
+	region.Rows = std::max(0, std::min(mChunkSize, map.RowCount() - region.Row0));
+	region.Cols = std::max(0, std::min(mChunkSize, map.ColumnCount() - region.Col0));
+	return region;
+}
+
+float TileChunkStreamer::Distance(const TileMap& map, Key chunk, float x, float z)const
+{
+	const TileMapMesher::Region region = ChunkRegion(map, chunk);
+
+	const float x0 = map.OriginX() + region.Row0 * map.CellSize();
+	const float z0 = map.OriginZ() + region.Col0 * map.CellSize();
+	const float x1 = x0 + region.Rows * map.CellSize();
+	const float z1 = z0 + region.Cols * map.CellSize();
+
+	const float dx = std::max(std::max(x0 - x, 0.0f), x - x1);
+	const float dz = std::max(std::max(z0 - z, 0.0f), z - z1);
+
+	return std::sqrt(dx * dx + dz * dz);
+}
+
+void TileChunkStreamer::Update(const TileMap& map, float x, float z, std::vector<Key>& evicted)
+{
+	// Drop what is now too far away.  Chunks still in the queue are simply
+	// forgotten; their meshes are thrown away when they come back.
+	for(auto it = mChunks.begin(); it != mChunks.end(); )
+	{
+		if(Distance(map, it->second.Chunk, x, z) > mUnloadRadius)
+		{
+			if(it->second.Status == State::Resident)
+				evicted.push_back(it->second.Chunk);
+			it = mChunks.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+
+	if(map.RowCount() == 0 || map.ColumnCount() == 0)
+		return;
+
+	// Only the window of chunks that can be within the load radius is visited.
+	const float chunkWorldSize = mChunkSize * map.CellSize();
+	const int reach = (int)std::ceil(mLoadRadius / chunkWorldSize);
+
+	const int chunkRows = (map.RowCount() + mChunkSize - 1) / mChunkSize;
+	const int chunkCols = (map.ColumnCount() + mChunkSize - 1) / mChunkSize;
+
+	const int centerRow = (int)std::floor((x - map.OriginX()) / chunkWorldSize);
+	const int centerCol = (int)std::floor((z - map.OriginZ()) / chunkWorldSize);
+
+	const int row0 = std::max(centerRow - reach, 0);
+	const int row1 = std::min(centerRow + reach, chunkRows - 1);
+	const int col0 = std::max(centerCol - reach, 0);
+	const int col1 = std::min(centerCol + reach, chunkCols - 1);
+
+	std::vector<std::pair<float, Key>> missing;
+	for(int r = row0; r <= row1; ++r)
+	{
+		for(int c = col0; c <= col1; ++c)
+		{
+			Key chunk;
+			chunk.Row = r;
+			chunk.Col = c;
+
+			if(mChunks.count(Pack(chunk)) != 0)
+				continue;
+
+			const float d = Distance(map, chunk, x, z);
+			if(d <= mLoadRadius)
+				missing.push_back(std::make_pair(d, chunk));
+		}
+	}
+
+	std::sort(missing.begin(), missing.end(),
+		[](const std::pair<float, Key>& a, const std::pair<float, Key>& b) { return a.first < b.first; });
+
+	for(const auto& m : missing)
+		Request(map, m.second);
+}
+
+int TileChunkStreamer::Invalidate(const TileMap& map, int row, int col)
+{
+	if(!map.InBounds(row, col))
+		return 0;
+
+	// Faces and wall boxes only depend on the four side neighbours, so an edit
+	// can reach at most the chunks of those cells.
+	const int stepRow[] = { 0, 1, -1, 0, 0 };
+	const int stepCol[] = { 0, 0, 0, 1, -1 };
+
+	std::uint64_t queued[5];
+	int count = 0;
+
+	for(int i = 0; i < 5; ++i)
+	{
+		const int r = row + stepRow[i];
+		const int c = col + stepCol[i];
+		if(!map.InBounds(r, c))
+			continue;
+
+		Key chunk;
+		chunk.Row = r / mChunkSize;
+		chunk.Col = c / mChunkSize;
+
+		const std::uint64_t key = Pack(chunk);
+		if(std::find(queued, queued + count, key) != queued + count)
+			continue;
+
+		// Chunks that are not loaded read the edited map when they are requested.
+		if(mChunks.count(key) == 0)
+			continue;
+
+		queued[count++] = key;
+		Request(map, chunk);
+	}
+
+	return count;
+}
+
+void TileChunkStreamer::Request(const TileMap& map, Key chunk)
+{
+	ChunkState& state = mChunks[Pack(chunk)];
+	state.Chunk = chunk;
+	state.Version = ++mNextVersion;
+	if(state.Status != State::Resident)
+		state.Status = State::Queued;
+
+	// The workers never touch the live map; they get a copy of the chunk plus a
+	// one cell border so faces against the neighbouring chunks come out right.
+	const TileMapMesher::Region region = ChunkRegion(map, chunk);
+
+	Job job;
+	job.Chunk = chunk;
+	job.Version = state.Version;
+	job.Cells = map.Extract(region.Row0 - 1, region.Col0 - 1, region.Rows + 2, region.Cols + 2);
+	job.Region.Row0 = 1;
+	job.Region.Col0 = 1;
+	job.Region.Rows = region.Rows;
+	job.Region.Cols = region.Cols;
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mJobs.push_back(std::move(job));
+	}
+	mWorkAvailable.notify_one();
+}
+
+void TileChunkStreamer::TakeReady(std::vector<std::unique_ptr<ChunkMesh>>& ready)
+{
+	std::vector<std::unique_ptr<ChunkMesh>> finished;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		finished.swap(mFinished);
+	}
+
+	for(auto& mesh : finished)
+	{
+		auto it = mChunks.find(Pack(mesh->Chunk));
+		if(it == mChunks.end() || it->second.Version != mesh->Version)
+			continue;
+
+		it->second.Status = State::Resident;
+		ready.push_back(std::move(mesh));
+	}
+}
+
+void TileChunkStreamer::Flush()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	mWorkDone.wait(lock, [this]() { return mJobs.empty() && mBusyWorkers == 0; });
+}
+
+int TileChunkStreamer::ResidentCount()const
+{
+	int count = 0;
+	for(const auto& c : mChunks)
+	{
+		if(c.second.Status == State::Resident)
+			++count;
+	}
+	return count;
+}
+
+int TileChunkStreamer::PendingCount()const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return (int)mJobs.size() + mBusyWorkers;
+}
+
+void TileChunkStreamer::WorkerMain()
+{
+	TileMapMesher mesher;
+
+	for(;;)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWorkAvailable.wait(lock, [this]() { return mQuit || !mJobs.empty(); });
+			if(mQuit)
+				return;
+
+			job = std::move(mJobs.front());
+			mJobs.pop_front();
+			++mBusyWorkers;
+		}
+
+		auto mesh = std::make_unique<ChunkMesh>();
+		mesh->Chunk = job.Chunk;
+		mesh->Version = job.Version;
+		mesher.Build(job.Cells, TileMap::Wall, job.Region, mesh->Mesh);
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mFinished.push_back(std::move(mesh));
+			--mBusyWorkers;
+		}
+		mWorkDone.notify_all();
+	}
+}
@@ -0,0 +1,145 @@
+//***************************************************************************************
+// TileChunkStreamer.h
+//
+// Splits a TileMap into square chunks and keeps the ones near the camera meshed.
+// Chunks inside the load radius are copied out of the map (with a one cell apron
+// so their side faces join up) and meshed with TileMapMesher on worker threads.
+// Chunks are only dropped once they are past the larger unload radius, so walking
+// back and forth over the edge does not thrash.
+//
+// The streamer does no GPU work.  The caller uploads finished meshes from
+// TakeReady and frees the chunks Update reports as evicted, so the number of live
+// chunks (and the work per frame) depends on the radii, not on the map size.
+//
+// After a map edit, Invalidate re-queues only the loaded chunks whose mesh can
+// change.  The old mesh stays valid until the new one comes out of TakeReady, so
+// the caller can swap them at a frame boundary.
+//***************************************************************************************
+
+#pragma once
+
+#include "TileMap.h"
+#include "TileMapMesher.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class TileChunkStreamer
+{
+public:
+	struct Key
+	{
+		int Row = 0;
+		int Col = 0;
+	};
+
+	struct ChunkMesh
+	{
+		Key Chunk;
+
+		// Bumped each time the chunk is queued; a mesh is only handed out if it
+		// is from the latest request.
+		std::uint32_t Version = 0;
+
+		TileMapMesher::Output Mesh;
+	};
+
+	explicit TileChunkStreamer(int chunkSize = 16);
+	TileChunkStreamer(const TileChunkStreamer& rhs) = delete;
+	TileChunkStreamer& operator=(const TileChunkStreamer& rhs) = delete;
+	~TileChunkStreamer();
+
+	// Radii are in world units measured on the xz plane from the camera.
+	void SetRadii(float loadRadius, float unloadRadius);
+
+	void Start(int workerCount = 1);
+	void Stop();
+
+	///<summary>
+	/// Main thread, once per frame.  Queues the missing chunks around (x, z),
+	/// nearest first, and appends the chunks that were evicted to 'evicted'.
+	///</summary>
+	void Update(const TileMap& map, float x, float z, std::vector<Key>& evicted);
+
+	// Main thread.  Moves the meshes finished since the last call into 'ready';
+	// those chunks count as resident from now on.
+	void TakeReady(std::vector<std::unique_ptr<ChunkMesh>>& ready);
+
+	///<summary>
+	/// Main thread, after map.Set(row, col, ...).  Re-queues the loaded chunks
+	/// that see the cell: its own, plus the one across the border when the cell
+	/// lies on a chunk edge.  Returns the number of chunks queued.
+	///</summary>
+	int Invalidate(const TileMap& map, int row, int col);
+
+	// Blocks until every queued chunk has been meshed.
+	void Flush();
+
+	int ChunkSize()const { return mChunkSize; }
+	int ResidentCount()const;
+	int PendingCount()const;
+
+	// Cells covered by a chunk, clipped to the map.
+	TileMapMesher::Region ChunkRegion(const TileMap& map, Key chunk)const;
+
+	static std::uint64_t Pack(Key k)
+	{
+		return ((std::uint64_t)(std::uint32_t)k.Row << 32) | (std::uint32_t)k.Col;
+	}
+
+private:
+	enum class State
+	{
+		Queued,
+		Resident
+	};
+
+	struct ChunkState
+	{
+		Key Chunk;
+		State Status = State::Queued;
+		std::uint32_t Version = 0;
+	};
+
+	struct Job
+	{
+		Key Chunk;
+		std::uint32_t Version = 0;
+		TileMap Cells;
+		TileMapMesher::Region Region;
+	};
+
+	// Queues (or re-queues) a chunk with a fresh snapshot of its cells.
+	void Request(const TileMap& map, Key chunk);
+
+	// Distance on the xz plane from (x, z) to the nearest point of the chunk.
+	float Distance(const TileMap& map, Key chunk, float x, float z)const;
+
+	void WorkerMain();
+
+private:
+	int mChunkSize = 16;
+	float mLoadRadius = 96.0f;
+	float mUnloadRadius = 128.0f;
+
+	// Main thread only.
+	std::unordered_map<std::uint64_t, ChunkState> mChunks;
+	std::uint32_t mNextVersion = 0;
+
+	// Shared with the workers.
+	mutable std::mutex mMutex;
+	std::condition_variable mWorkAvailable;
+	std::condition_variable mWorkDone;
+	std::deque<Job> mJobs;
+	std::vector<std::unique_ptr<ChunkMesh>> mFinished;
+	int mBusyWorkers = 0;
+	bool mQuit = false;
+
+	std::vector<std::thread> mWorkers;
+};
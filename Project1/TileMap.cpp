@@ -0,0 +1,310 @@
+//***************************************************************************************
+// TileMap.cpp
+//***************************************************************************************
+
+#include "TileMap.h"
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace DirectX;
+
+namespace
+{
+	const char BinaryMagic[4] = { 'T', 'M', 'A', 'P' };
+	const std::uint32_t BinaryVersion = 1;
+
+	struct BinaryHeader
+	{
+		char Magic[4];
+		std::uint32_t Version;
+		std::uint32_t Rows;
+		std::uint32_t Cols;
+	};
+
+	// Read-only view of a whole file.  The map is parsed straight out of the
+	// mapping so large files are never copied into an intermediate buffer.
+	class MappedFile
+	{
+	public:
+		explicit MappedFile(const std::string& filename)
+		{
+#if defined(_WIN32)
+			mFile = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+				OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+			if(mFile == INVALID_HANDLE_VALUE)
+				return;
+
+			LARGE_INTEGER size;
+			if(!GetFileSizeEx(mFile, &size) || size.QuadPart == 0)
+				return;
+
+			mMapping = CreateFileMappingA(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if(mMapping == nullptr)
+				return;
+
+			mData = static_cast<const char*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+			if(mData != nullptr)
+				mSize = static_cast<std::size_t>(size.QuadPart);
+#else
+			mFile = open(filename.c_str(), O_RDONLY);
+			if(mFile < 0)
+				return;
+
+			struct stat st;
+			if(fstat(mFile, &st) != 0 || st.st_size == 0)
+				return;
+
+			void* p = mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, mFile, 0);
+			if(p == MAP_FAILED)
+				return;
+
+			madvise(p, static_cast<std::size_t>(st.st_size), MADV_SEQUENTIAL);
+			mData = static_cast<const char*>(p);
+			mSize = static_cast<std::size_t>(st.st_size);
+#endif
+		}
+
+		MappedFile(const MappedFile& rhs) = delete;
+		MappedFile& operator=(const MappedFile& rhs) = delete;
+
+		~MappedFile()
+		{
+#if defined(_WIN32)
+			if(mData != nullptr)
+				UnmapViewOfFile(mData);
+			if(mMapping != nullptr)
+				CloseHandle(mMapping);
+			if(mFile != INVALID_HANDLE_VALUE)
+				CloseHandle(mFile);
+#else
+			if(mData != nullptr)
+				munmap(const_cast<char*>(mData), mSize);
+			if(mFile >= 0)
+				close(mFile);
+#endif
+		}
+
+		const char* Data()const { return mData; }
+		std::size_t Size()const { return mSize; }
+
+	private:
+#if defined(_WIN32)
+		HANDLE mFile = INVALID_HANDLE_VALUE;
+		HANDLE mMapping = nullptr;
+#else
+		int mFile = -1;
+#endif
+		const char* mData = nullptr;
+		std::size_t mSize = 0;
+	};
+}
+
+const TileMap::Tile TileMap::Empty;
+const TileMap::Tile TileMap::Wall;
+const TileMap::Tile TileMap::MaxTile;
+const int TileMap::MaxDimension;
+const int TileMap::MaxCells;
+
+TileMap::TileMap(int rows, int cols, Tile fill)
+	: mNumRows(rows), mNumCols(cols), mCells((std::size_t)rows * cols, fill)
+{
+}
+
+bool TileMap::LoadFromFile(const std::string& filename)
+{
+	MappedFile file(filename);
+	if(file.Data() == nullptr)
+		return Fail("cannot open or map '" + filename + "'");
+
+	if(file.Size() >= sizeof(BinaryMagic) && std::memcmp(file.Data(), BinaryMagic, sizeof(BinaryMagic)) == 0)
+		return ParseBinary(file.Data(), file.Size());
+
+	return ParseText(file.Data(), file.Size());
+}
+
+bool TileMap::ParseText(const char* data, std::size_t size)
+{
+	std::vector<Tile> cells;
+	cells.reserve(size);
+
+	int cols = -1;
+	int rows = 0;
+	int lineCount = 0;
+	std::size_t rowStart = 0;
+
+	// One pass over the buffer.  A row ends at '\n' (or the end of the data);
+	// blank lines are ignored so trailing newlines do not add rows.
+	for(std::size_t i = 0; i <= size; ++i)
+	{
+		const char c = (i < size) ? data[i] : '\n';
+
+		if(c >= '0' && c <= '9')
+		{
+			cells.push_back(static_cast<Tile>(c - '0'));
+			continue;
+		}
+
+		if(c == ' ' || c == '\t' || c == '\r')
+			continue;
+
+		if(c != '\n')
+			return Fail("unexpected character at line " + std::to_string(lineCount + 1));
+
+		++lineCount;
+
+		const std::size_t rowLength = cells.size() - rowStart;
+		if(rowLength == 0)
+			continue;
+
+		if(cols < 0)
+		{
+			if(rowLength > (std::size_t)MaxDimension)
+				return Fail("row too wide");
+			cols = static_cast<int>(rowLength);
+		}
+		else if(rowLength != (std::size_t)cols)
+		{
+			return Fail("line " + std::to_string(lineCount) + " has " + std::to_string(rowLength) +
+				" cells, expected " + std::to_string(cols));
+		}
+
+		if(++rows > MaxDimension)
+			return Fail("too many rows");
+		if((std::size_t)rows * cols > (std::size_t)MaxCells)
+			return Fail("too many cells");
+
+		rowStart = cells.size();
+	}
+
+	if(rows == 0)
+		return Fail("map is empty");
+
+	mNumRows = rows;
+	mNumCols = cols;
+	mCells = std::move(cells);
+	mLastError.clear();
+
+	return true;
+}
+
+bool TileMap::ParseBinary(const char* data, std::size_t size)
+{
+	BinaryHeader header;
+	if(size < sizeof(header))
+		return Fail("truncated header");
+
+	std::memcpy(&header, data, sizeof(header));
+
+	if(std::memcmp(header.Magic, BinaryMagic, sizeof(BinaryMagic)) != 0)
+		return Fail("bad magic");
+
+	if(header.Version != BinaryVersion)
+		return Fail("unsupported version " + std::to_string(header.Version));
+
+	if(header.Rows == 0 || header.Cols == 0 ||
+		header.Rows > (std::uint32_t)MaxDimension || header.Cols > (std::uint32_t)MaxDimension)
+		return Fail("invalid dimensions");
+
+	const std::size_t cellCount = (std::size_t)header.Rows * header.Cols;
+	if(cellCount > (std::size_t)MaxCells)
+		return Fail("too many cells");
+	if(size - sizeof(header) < cellCount)
+		return Fail("truncated cell data");
+
+	// Same tiles as the text parser accepts.
+	const char* cells = data + sizeof(header);
+	for(std::size_t i = 0; i < cellCount; ++i)
+	{
+		if(static_cast<Tile>(cells[i]) > MaxTile)
+			return Fail("invalid tile " + std::to_string(static_cast<Tile>(cells[i])) + " at cell " + std::to_string(i));
+	}
+
+	mNumRows = static_cast<int>(header.Rows);
+	mNumCols = static_cast<int>(header.Cols);
+	mCells.assign(cells, cells + cellCount);
+	mLastError.clear();
+
+	return true;
+}
+
+bool TileMap::SaveBinary(const std::string& filename)const
+{
+	std::ofstream outFile(filename, std::ios::binary);
+	if(!outFile.is_open())
+		return false;
+
+	BinaryHeader header;
+	std::memcpy(header.Magic, BinaryMagic, sizeof(BinaryMagic));
+	header.Version = BinaryVersion;
+	header.Rows = static_cast<std::uint32_t>(mNumRows);
+	header.Cols = static_cast<std::uint32_t>(mNumCols);
+
+	outFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	outFile.write(reinterpret_cast<const char*>(mCells.data()), mCells.size());
+
+	return outFile.good();
+}
+
+TileMap TileMap::Extract(int row0, int col0, int rows, int cols)const
+{
+	TileMap sub(rows, cols);
+	for(int r = 0; r < rows; ++r)
+	{
+		for(int c = 0; c < cols; ++c)
+			sub.mCells[sub.Index(r, c)] = Get(row0 + r, col0 + c);
+	}
+
+	sub.SetPlacement(mOriginX + row0 * mCellSize, mOriginZ + col0 * mCellSize, mCellSize, mWallHeight);
+
+	return sub;
+}
+
+void TileMap::Set(int row, int col, Tile tile)
+{
+	if(InBounds(row, col))
+		mCells[Index(row, col)] = tile;
+}
+
+void TileMap::SetPlacement(float originX, float originZ, float cellSize, float wallHeight)
+{
+	mOriginX = originX;
+	mOriginZ = originZ;
+	mCellSize = cellSize;
+	mWallHeight = wallHeight;
+}
+
+XMFLOAT3 TileMap::CellCenter(int row, int col)const
+{
+	return XMFLOAT3(
+		mOriginX + (row + 0.5f) * mCellSize,
+		0.5f * mWallHeight,
+		mOriginZ + (col + 0.5f) * mCellSize);
+}
+
+bool TileMap::WorldToCell(float x, float z, int& row, int& col)const
+{
+	const float fr = (x - mOriginX) / mCellSize;
+	const float fc = (z - mOriginZ) / mCellSize;
+
+	row = static_cast<int>(std::floor(fr));
+	col = static_cast<int>(std::floor(fc));
+
+	return InBounds(row, col);
+}
+
+bool TileMap::Fail(const std::string& msg)
+{
+	mLastError = msg;
+	return false;
+}
@@ -0,0 +1,105 @@
+//***************************************************************************************
+// TileMap.h
+//
+// Dense grid of maze tiles.  Maps of any size are parsed in a single pass from a
+// read-only memory mapping of the file, either as text (one row per line, one
+// digit per cell) or as a binary image written by SaveBinary.
+//
+// Rows run along world +x and columns along world +z; SetPlacement decides where
+// the grid sits in the world.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <climits>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <DirectXMath.h>
+
+class TileMap
+{
+public:
+	using Tile = std::uint8_t;
+
+	static const Tile Empty = 0;
+	static const Tile Wall = 1;
+
+	// Text maps hold one digit per cell, so no tile is above 9.
+	static const Tile MaxTile = 9;
+
+	// Hard limits on either dimension and on the cell count, which has to fit
+	// Index(); anything larger is treated as a corrupt file.
+	static const int MaxDimension = 1 << 16;
+	static const int MaxCells = INT_MAX;
+
+	TileMap() = default;
+	TileMap(int rows, int cols, Tile fill = Empty);
+
+	// Picks the text or binary parser by looking at the file header.
+	bool LoadFromFile(const std::string& filename);
+	bool ParseText(const char* data, std::size_t size);
+	bool ParseBinary(const char* data, std::size_t size);
+	bool SaveBinary(const std::string& filename)const;
+
+	// Returns a copy of the given rectangle.  Cells outside this map are Empty and
+	// the placement is shifted so the copy lines up with the source in world space.
+	TileMap Extract(int row0, int col0, int rows, int cols)const;
+
+	int RowCount()const { return mNumRows; }
+	int ColumnCount()const { return mNumCols; }
+	int CellCount()const { return mNumRows * mNumCols; }
+
+	bool InBounds(int row, int col)const
+	{
+		return row >= 0 && col >= 0 && row < mNumRows && col < mNumCols;
+	}
+
+	int Index(int row, int col)const { return row * mNumCols + col; }
+
+	// Out of range cells read as Empty.
+	Tile Get(int row, int col)const
+	{
+		return InBounds(row, col) ? mCells[Index(row, col)] : Empty;
+	}
+
+	bool IsWall(int row, int col)const { return Get(row, col) == Wall; }
+
+	void Set(int row, int col, Tile tile);
+
+	const Tile* Data()const { return mCells.data(); }
+
+	// World placement of the grid.  Cell (row, col) covers
+	// [originX + row*cellSize, originX + (row+1)*cellSize] along x and
+	// [originZ + col*cellSize, originZ + (col+1)*cellSize] along z.
+	void SetPlacement(float originX, float originZ, float cellSize, float wallHeight);
+
+	float OriginX()const { return mOriginX; }
+	float OriginZ()const { return mOriginZ; }
+	float CellSize()const { return mCellSize; }
+	float WallHeight()const { return mWallHeight; }
+
+	DirectX::XMFLOAT3 CellCenter(int row, int col)const;
+
+	// Returns false if (x, z) falls outside the grid; row/col are still written
+	// (unclamped) so callers can tell which side they are on.
+	bool WorldToCell(float x, float z, int& row, int& col)const;
+
+	const std::string& LastError()const { return mLastError; }
+
+private:
+	bool Fail(const std::string& msg);
+
+private:
+	int mNumRows = 0;
+	int mNumCols = 0;
+	std::vector<Tile> mCells;
+
+	float mOriginX = 0.0f;
+	float mOriginZ = 0.0f;
+	float mCellSize = 1.0f;
+	float mWallHeight = 1.0f;
+
+	std::string mLastError;
+};
@@ -0,0 +1,209 @@
+//***************************************************************************************
+// TileMapMesher.cpp
+//***************************************************************************************
+
+#include "TileMapMesher.h"
+
+#include <cfloat>
+
+using namespace DirectX;
+
+TileMapMesher::Region TileMapMesher::WholeMap(const TileMap& map)
+{
+	Region region;
+	region.Rows = map.RowCount();
+	region.Cols = map.ColumnCount();
+	return region;
+}
+
+void TileMapMesher::Build(const TileMap& map, TileMap::Tile tile, const Region& region, Output& out)
+{
+	out.Mesh.Vertices.clear();
+	out.Mesh.Indices32.clear();
+	out.Boxes.clear();
+	out.QuadCount = 0;
+
+	BuildTops(map, tile, region, out);
+	BuildSides(map, tile, region, out);
+
+	XMVECTOR vMin = XMVectorReplicate(+FLT_MAX);
+	XMVECTOR vMax = XMVectorReplicate(-FLT_MAX);
+	for(const auto& v : out.Mesh.Vertices)
+	{
+		XMVECTOR P = XMLoadFloat3(&v.Position);
+		vMin = XMVectorMin(vMin, P);
+		vMax = XMVectorMax(vMax, P);
+	}
+
+	if(out.Mesh.Vertices.empty())
+		vMin = vMax = XMVectorZero();
+
+	XMStoreFloat3(&out.Bounds.Center, 0.5f * (vMin + vMax));
+	XMStoreFloat3(&out.Bounds.Extents, 0.5f * (vMax - vMin));
+}
+
+void TileMapMesher::AddQuad(Output& out,
+	const XMFLOAT3& origin, const XMFLOAT3& a, const XMFLOAT3& b,
+	const XMFLOAT3& normal, float uScale, float vScale)
+{
+	// 'a' runs left to right and 'b' bottom to top when the quad is seen from the
+	// side its normal points to, which gives the clockwise winding D3D expects.
+	auto base = (GeometryGenerator::uint32)out.Mesh.Vertices.size();
+
+	XMFLOAT3 p[4] =
+	{
+		origin,
+		XMFLOAT3(origin.x + b.x, origin.y + b.y, origin.z + b.z),
+		XMFLOAT3(origin.x + a.x + b.x, origin.y + a.y + b.y, origin.z + a.z + b.z),
+		XMFLOAT3(origin.x + a.x, origin.y + a.y, origin.z + a.z),
+	};
+
+	XMFLOAT3 tangent;
+	XMStoreFloat3(&tangent, XMVector3Normalize(XMLoadFloat3(&a)));
+
+	out.Mesh.Vertices.push_back(GeometryGenerator::Vertex(p[0], normal, tangent, XMFLOAT2(0.0f, vScale)));
+	out.Mesh.Vertices.push_back(GeometryGenerator::Vertex(p[1], normal, tangent, XMFLOAT2(0.0f, 0.0f)));
+	out.Mesh.Vertices.push_back(GeometryGenerator::Vertex(p[2], normal, tangent, XMFLOAT2(uScale, 0.0f)));
+	out.Mesh.Vertices.push_back(GeometryGenerator::Vertex(p[3], normal, tangent, XMFLOAT2(uScale, vScale)));
+
+	GeometryGenerator::uint32 i[6] = { base, base + 1, base + 2, base, base + 2, base + 3 };
+	out.Mesh.Indices32.insert(out.Mesh.Indices32.end(), &i[0], &i[6]);
+
+	++out.QuadCount;
+}
+
+void TileMapMesher::BuildTops(const TileMap& map, TileMap::Tile tile, const Region& region, Output& out)
+{
+	const float cell = map.CellSize();
+	const float height = map.WallHeight();
+
+	mVisited.assign((size_t)region.Rows * region.Cols, 0);
+	auto visited = [&](int r, int c) -> std::uint8_t& { return mVisited[(size_t)r * region.Cols + c]; };
+	auto open = [&](int r, int c) { return !visited(r, c) && map.Get(region.Row0 + r, region.Col0 + c) == tile; };
+
+	for(int r = 0; r < region.Rows; ++r)
+	{
+		for(int c = 0; c < region.Cols; ++c)
+		{
+			if(!open(r, c))
+				continue;
+
+			// Grow along the columns first, then add rows while the whole span fits.
+			int c1 = c + 1;
+			while(c1 < region.Cols && open(r, c1))
+				++c1;
+
+			int r1 = r + 1;
+			for(; r1 < region.Rows; ++r1)
+			{
+				int k = c;
+				while(k < c1 && open(r1, k))
+					++k;
+				if(k != c1)
+					break;
+			}
+
+			for(int rr = r; rr < r1; ++rr)
+				for(int cc = c; cc < c1; ++cc)
+					visited(rr, cc) = 1;
+
+			const float x0 = map.OriginX() + (region.Row0 + r) * cell;
+			const float z0 = map.OriginZ() + (region.Col0 + c) * cell;
+			const float sizeX = (r1 - r) * cell;
+			const float sizeZ = (c1 - c) * cell;
+
+			AddQuad(out,
+				XMFLOAT3(x0, height, z0), XMFLOAT3(sizeX, 0.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, sizeZ),
+				XMFLOAT3(0.0f, 1.0f, 0.0f), (float)(r1 - r), (float)(c1 - c));
+
+			BoundingBox box;
+			box.Center = XMFLOAT3(x0 + 0.5f * sizeX, 0.5f * height, z0 + 0.5f * sizeZ);
+			box.Extents = XMFLOAT3(0.5f * sizeX, 0.5f * height, 0.5f * sizeZ);
+			out.Boxes.push_back(box);
+		}
+	}
+}
+
+void TileMapMesher::BuildSides(const TileMap& map, TileMap::Tile tile, const Region& region, Output& out)
+{
+	const float cell = map.CellSize();
+	const float height = map.WallHeight();
+
+	// A side is exposed when this cell is 'tile' and the neighbour is empty.
+	auto exposed = [&](int r, int c, int dr, int dc)
+	{
+		return map.Get(r, c) == tile && map.Get(r + dr, c + dc) == TileMap::Empty;
+	};
+
+	// Faces normal to x: one pass per row, merging runs along z.
+	for(int side = -1; side <= 1; side += 2)
+	{
+		for(int r = region.Row0; r < region.Row0 + region.Rows; ++r)
+		{
+			int c = region.Col0;
+			const int cEnd = region.Col0 + region.Cols;
+			while(c < cEnd)
+			{
+				if(!exposed(r, c, side, 0))
+				{
+					++c;
+					continue;
+				}
+
+				int c1 = c + 1;
+				while(c1 < cEnd && exposed(r, c1, side, 0))
+					++c1;
+
+				const float x = map.OriginX() + (side < 0 ? r : r + 1) * cell;
+				const float z0 = map.OriginZ() + c * cell;
+				const float z1 = map.OriginZ() + c1 * cell;
+				const float len = z1 - z0;
+
+				if(side < 0)
+					AddQuad(out, XMFLOAT3(x, 0.0f, z1), XMFLOAT3(0.0f, 0.0f, -len), XMFLOAT3(0.0f, height, 0.0f),
+						XMFLOAT3(-1.0f, 0.0f, 0.0f), (float)(c1 - c), 1.0f);
+				else
+					AddQuad(out, XMFLOAT3(x, 0.0f, z0), XMFLOAT3(0.0f, 0.0f, len), XMFLOAT3(0.0f, height, 0.0f),
+						XMFLOAT3(1.0f, 0.0f, 0.0f), (float)(c1 - c), 1.0f);
+
+				c = c1;
+			}
+		}
+	}
+
+	// Faces normal to z: one pass per column, merging runs along x.
+	for(int side = -1; side <= 1; side += 2)
+	{
+		for(int c = region.Col0; c < region.Col0 + region.Cols; ++c)
+		{
+			int r = region.Row0;
+			const int rEnd = region.Row0 + region.Rows;
+			while(r < rEnd)
+			{
+				if(!exposed(r, c, 0, side))
+				{
+					++r;
+					continue;
+				}
+
+				int r1 = r + 1;
+				while(r1 < rEnd && exposed(r1, c, 0, side))
+					++r1;
+
+				const float z = map.OriginZ() + (side < 0 ? c : c + 1) * cell;
+				const float x0 = map.OriginX() + r * cell;
+				const float x1 = map.OriginX() + r1 * cell;
+				const float len = x1 - x0;
+
+				if(side < 0)
+					AddQuad(out, XMFLOAT3(x0, 0.0f, z), XMFLOAT3(len, 0.0f, 0.0f), XMFLOAT3(0.0f, height, 0.0f),
+						XMFLOAT3(0.0f, 0.0f, -1.0f), (float)(r1 - r), 1.0f);
+				else
+					AddQuad(out, XMFLOAT3(x1, 0.0f, z), XMFLOAT3(-len, 0.0f, 0.0f), XMFLOAT3(0.0f, height, 0.0f),
+						XMFLOAT3(0.0f, 0.0f, 1.0f), (float)(r1 - r), 1.0f);
+
+				r = r1;
+			}
+		}
+	}
+}
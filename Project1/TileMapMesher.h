@@ -0,0 +1,60 @@
+//***************************************************************************************
+// TileMapMesher.h
+//
+// Turns the solid cells of a TileMap into a single static mesh.  Top faces are
+// greedily merged into maximal rectangles and side faces are merged into runs along
+// each wall, so a corridor wall of any length is one quad.  Faces shared by two
+// solid cells and the bottoms resting on the ground are never emitted.
+//***************************************************************************************
+
+#pragma once
+
+#include "GeometryGenerator.h"
+#include "TileMap.h"
+#include <DirectXCollision.h>
+
+class TileMapMesher
+{
+public:
+
+	struct Region
+	{
+		int Row0 = 0;
+		int Col0 = 0;
+		int Rows = 0;
+		int Cols = 0;
+	};
+
+	struct Output
+	{
+		// World-space vertices; draw with an identity world matrix.
+		GeometryGenerator::MeshData Mesh;
+
+		// One box per merged top rectangle.  Together they cover exactly the
+		// meshed cells, so they double as collision/occluder volumes.
+		std::vector<DirectX::BoundingBox> Boxes;
+
+		DirectX::BoundingBox Bounds;
+		int QuadCount = 0;
+	};
+
+	static Region WholeMap(const TileMap& map);
+
+	///<summary>
+	/// Meshes the cells equal to 'tile' inside 'region'.  Neighbours outside the
+	/// region are still read from the map (any non-empty tile hides a face), so
+	/// regions meshed separately join without seams or doubled faces.
+	///</summary>
+	void Build(const TileMap& map, TileMap::Tile tile, const Region& region, Output& out);
+
+private:
+	void AddQuad(Output& out,
+		const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b,
+		const DirectX::XMFLOAT3& normal, float uScale, float vScale);
+
+	void BuildTops(const TileMap& map, TileMap::Tile tile, const Region& region, Output& out);
+	void BuildSides(const TileMap& map, TileMap::Tile tile, const Region& region, Output& out);
+
+private:
+	std::vector<std::uint8_t> mVisited;
+};
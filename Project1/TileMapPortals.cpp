@@ -0,0 +1,363 @@
+//***************************************************************************************
+// TileMapPortals.cpp
+//***************************************************************************************
+
+#include "TileMapPortals.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	// Guards the recursion against pathological maps; a corridor this many
+	// sectors long is far past the far plane anyway.
+	const int MaxPortalDepth = 1024;
+}
+
+TileMapPortals::TileMapPortals(int blockSize)
+	: mBlockSize(std::max(blockSize, 1))
+{
+}
+
+void TileMapPortals::Build(const TileMap& map)
+{
+	mNumRows = map.RowCount();
+	mNumCols = map.ColumnCount();
+
+	mCellSector.assign(mNumRows * mNumCols, -1);
+	mSectors.clear();
+	mFreeSectors.clear();
+	mPortals.clear();
+	mFreePortals.clear();
+
+	// Blocks only link to blocks built before them, so every border gets its
+	// portals exactly once.
+	for(int br = 0; br * mBlockSize < mNumRows; ++br)
+	{
+		for(int bc = 0; bc * mBlockSize < mNumCols; ++bc)
+			RebuildBlock(map, br, bc);
+	}
+}
+
+void TileMapPortals::OnTileChanged(const TileMap& map, int row, int col)
+{
+	if(row < 0 || col < 0 || row >= mNumRows || col >= mNumCols)
+		return;
+
+	RebuildBlock(map, row / mBlockSize, col / mBlockSize);
+}
+
+void TileMapPortals::RebuildBlock(const TileMap& map, int blockRow, int blockCol)
+{
+	const int row0 = blockRow * mBlockSize;
+	const int col0 = blockCol * mBlockSize;
+	const int row1 = std::min(row0 + mBlockSize, mNumRows);
+	const int col1 = std::min(col0 + mBlockSize, mNumCols);
+
+	for(int r = row0; r < row1; ++r)
+	{
+		for(int c = col0; c < col1; ++c)
+		{
+			int& sector = mCellSector[r * mNumCols + c];
+			if(sector >= 0 && mSectors[sector].Alive)
+				RemoveSector(sector);
+			sector = -1;
+		}
+	}
+
+	// Greedy rectangles: run along the row as far as possible, then grow down
+	// while the whole run stays open.
+	std::vector<int> created;
+	for(int r = row0; r < row1; ++r)
+	{
+		for(int c = col0; c < col1; ++c)
+		{
+			if(map.IsWall(r, c) || mCellSector[r * mNumCols + c] >= 0)
+				continue;
+
+			int cols = 1;
+			while(c + cols < col1 && !map.IsWall(r, c + cols) && mCellSector[r * mNumCols + c + cols] < 0)
+				++cols;
+
+			int rows = 1;
+			for(; r + rows < row1; ++rows)
+			{
+				bool open = true;
+				for(int k = 0; k < cols && open; ++k)
+					open = !map.IsWall(r + rows, c + k) && mCellSector[(r + rows) * mNumCols + c + k] < 0;
+				if(!open)
+					break;
+			}
+
+			int id;
+			if(!mFreeSectors.empty())
+			{
+				id = mFreeSectors.back();
+				mFreeSectors.pop_back();
+			}
+			else
+			{
+				id = (int)mSectors.size();
+				mSectors.push_back(Sector());
+			}
+
+			Sector& s = mSectors[id];
+			s.Row0 = r;
+			s.Col0 = c;
+			s.Rows = rows;
+			s.Cols = cols;
+			s.Alive = true;
+			s.Portals.clear();
+
+			for(int i = r; i < r + rows; ++i)
+			{
+				for(int k = c; k < c + cols; ++k)
+					mCellSector[i * mNumCols + k] = id;
+			}
+
+			created.push_back(id);
+		}
+	}
+
+	for(int id : created)
+		LinkSector(id);
+}
+
+void TileMapPortals::RemoveSector(int id)
+{
+	Sector& s = mSectors[id];
+
+	for(int p : s.Portals)
+	{
+		Portal& portal = mPortals[p];
+		const int other = portal.A == id ? portal.B : portal.A;
+
+		auto& list = mSectors[other].Portals;
+		list.erase(std::remove(list.begin(), list.end(), p), list.end());
+
+		portal.Alive = false;
+		mFreePortals.push_back(p);
+	}
+
+	s.Portals.clear();
+	s.Alive = false;
+	mFreeSectors.push_back(id);
+}
+
+void TileMapPortals::AddPortal(int a, int b, Vec2 p0, Vec2 p1)
+{
+	int id;
+	if(!mFreePortals.empty())
+	{
+		id = mFreePortals.back();
+		mFreePortals.pop_back();
+	}
+	else
+	{
+		id = (int)mPortals.size();
+		mPortals.push_back(Portal());
+	}
+
+	Portal& portal = mPortals[id];
+	portal.A = a;
+	portal.B = b;
+	portal.P0 = p0;
+	portal.P1 = p1;
+	portal.Alive = true;
+
+	mSectors[a].Portals.push_back(id);
+	mSectors[b].Portals.push_back(id);
+}
+
+void TileMapPortals::LinkSector(int id)
+{
+	const Sector s = mSectors[id];
+	const int blockRow = s.Row0 / mBlockSize;
+	const int blockCol = s.Col0 / mBlockSize;
+
+	auto neighbour = [&](int r, int c)
+	{
+		if(r < 0 || c < 0 || r >= mNumRows || c >= mNumCols)
+			return -1;
+
+		const int n = mCellSector[r * mNumCols + c];
+		if(n < 0)
+			return -1;
+
+		const Sector& ns = mSectors[n];
+		if(ns.Row0 / mBlockSize == blockRow && ns.Col0 / mBlockSize == blockCol && n < id)
+			return -1;
+
+		return n;
+	};
+
+	// Walk each side; consecutive cells facing the same sector form one portal.
+	// side 0/1: the rows above/below, side 2/3: the columns left/right.
+	for(int side = 0; side < 4; ++side)
+	{
+		const bool alongRow = side < 2;
+		const int length = alongRow ? s.Cols : s.Rows;
+		const float line = side == 0 ? (float)s.Row0 : side == 1 ? (float)(s.Row0 + s.Rows) :
+			side == 2 ? (float)s.Col0 : (float)(s.Col0 + s.Cols);
+
+		int runStart = 0;
+		int runSector = -1;
+		for(int i = 0; i <= length; ++i)
+		{
+			int n = -1;
+			if(i < length)
+			{
+				switch(side)
+				{
+				case 0: n = neighbour(s.Row0 - 1, s.Col0 + i); break;
+				case 1: n = neighbour(s.Row0 + s.Rows, s.Col0 + i); break;
+				case 2: n = neighbour(s.Row0 + i, s.Col0 - 1); break;
+				default: n = neighbour(s.Row0 + i, s.Col0 + s.Cols); break;
+				}
+			}
+
+			if(n == runSector)
+				continue;
+
+			if(runSector >= 0)
+			{
+				Vec2 p0, p1;
+				if(alongRow)
+				{
+					p0.R = p1.R = line;
+					p0.C = (float)(s.Col0 + runStart);
+					p1.C = (float)(s.Col0 + i);
+				}
+				else
+				{
+					p0.C = p1.C = line;
+					p0.R = (float)(s.Row0 + runStart);
+					p1.R = (float)(s.Row0 + i);
+				}
+				AddPortal(id, runSector, p0, p1);
+			}
+
+			runStart = i;
+			runSector = n;
+		}
+	}
+}
+
+bool TileMapPortals::Collect(const TileMap& map, float x, float z, float dirX, float dirZ, float halfAngle,
+	std::vector<std::uint64_t>& bits)
+{
+	mLastVisited = 0;
+
+	if(mNumRows == 0 || map.CellSize() <= 0.0f)
+		return false;
+
+	Vec2 eye;
+	eye.R = (x - map.OriginX()) / map.CellSize();
+	eye.C = (z - map.OriginZ()) / map.CellSize();
+
+	const int row = (int)std::floor(eye.R);
+	const int col = (int)std::floor(eye.C);
+	if(row < 0 || col < 0 || row >= mNumRows || col >= mNumCols)
+		return false;
+
+	const int start = mCellSector[row * mNumCols + col];
+	if(start < 0)
+		return false;
+
+	const float length = std::sqrt(dirX * dirX + dirZ * dirZ);
+	if(length < 1e-4f)
+		return false;
+
+	// A wedge of 180 degrees or more cannot be clipped as two edges.
+	halfAngle = std::min(halfAngle, 1.57f);
+	const float cs = std::cos(halfAngle);
+	const float sn = std::sin(halfAngle);
+
+	Vec2 dir;
+	dir.R = dirX / length;
+	dir.C = dirZ / length;
+
+	Vec2 left, right;
+	left.R = dir.R * cs - dir.C * sn;
+	left.C = dir.R * sn + dir.C * cs;
+	right.R = dir.R * cs + dir.C * sn;
+	right.C = -dir.R * sn + dir.C * cs;
+
+	bits.assign((mNumRows * mNumCols + 63) / 64, 0);
+	Visit(start, -1, eye, right, left, 0, bits);
+
+	return true;
+}
+
+void TileMapPortals::Visit(int sector, int fromPortal, Vec2 eye, Vec2 right, Vec2 left, int depth,
+	std::vector<std::uint64_t>& bits)
+{
+	++mLastVisited;
+
+	const Sector& s = mSectors[sector];
+
+	// The sector and the ring of cells around it, which holds its walls.
+	const int r0 = std::max(s.Row0 - 1, 0);
+	const int c0 = std::max(s.Col0 - 1, 0);
+	const int r1 = std::min(s.Row0 + s.Rows, mNumRows - 1);
+	const int c1 = std::min(s.Col0 + s.Cols, mNumCols - 1);
+	for(int r = r0; r <= r1; ++r)
+	{
+		for(int c = c0; c <= c1; ++c)
+		{
+			const int index = r * mNumCols + c;
+			bits[index >> 6] |= std::uint64_t(1) << (index & 63);
+		}
+	}
+
+	if(depth >= MaxPortalDepth)
+		return;
+
+	const float eps = 1e-5f;
+	auto inside = [eps](Vec2 d, Vec2 r, Vec2 l)
+	{
+		return Cross(r, d) >= -eps && Cross(d, l) >= -eps;
+	};
+
+	for(int p : s.Portals)
+	{
+		if(p == fromPortal)
+			continue;
+
+		const Portal& portal = mPortals[p];
+		const int next = portal.A == sector ? portal.B : portal.A;
+
+		Vec2 e0, e1;
+		e0.R = portal.P0.R - eye.R;
+		e0.C = portal.P0.C - eye.C;
+		e1.R = portal.P1.R - eye.R;
+		e1.C = portal.P1.C - eye.C;
+
+		const float span = Cross(e0, e1);
+		if(std::fabs(span) < eps)
+		{
+			// The eye is on the portal's line.  Standing in the opening sees
+			// both sides; seeing it edge on sees nothing through it.
+			const bool onSegment = e0.R * e1.R + e0.C * e1.C <= 0.0f;
+			if(onSegment)
+				Visit(next, p, eye, right, left, depth + 1, bits);
+			continue;
+		}
+
+		if(span < 0.0f)
+			std::swap(e0, e1);
+
+		// Intersect the view wedge with the wedge through the portal.
+		const Vec2 newRight = Cross(right, e0) > 0.0f ? e0 : right;
+		const Vec2 newLeft = Cross(e1, left) > 0.0f ? e1 : left;
+
+		if(Cross(newRight, newLeft) <= 0.0f)
+			continue;
+
+		if(!inside(newRight, right, left) || !inside(newRight, e0, e1) ||
+			!inside(newLeft, right, left) || !inside(newLeft, e0, e1))
+			continue;
+
+		Visit(next, p, eye, newRight, newLeft, depth + 1, bits);
+	}
+}
@@ -0,0 +1,103 @@
+//***************************************************************************************
+// TileMapPortals.h
+//
+// Portal graph over the open cells of a TileMap, for visibility that follows the
+// camera's view and map edits without a precompute step.
+//
+// The map is cut into square blocks, and the open cells of each block are covered
+// with rectangles (sectors).  Every run of shared edge between two sectors is a
+// portal.  Sectors never cross a block border, so an edit only rebuilds the
+// sectors of one block and the portals along its edges.
+//
+// Each frame the horizontal view wedge starts in the camera's sector and is
+// narrowed through every portal it can see, recursively.  Rectangles are convex,
+// so whatever lies inside a sector the wedge reaches is potentially visible.
+//***************************************************************************************
+
+#pragma once
+
+#include "TileMap.h"
+
+#include <cstdint>
+#include <vector>
+
+class TileMapPortals
+{
+public:
+	explicit TileMapPortals(int blockSize = 8);
+
+	void Build(const TileMap& map);
+
+	// Call after map.Set(row, col, ...).  The map must keep its size.
+	void OnTileChanged(const TileMap& map, int row, int col);
+
+	///<summary>
+	/// Marks every cell that may be seen from world position (x, z) looking along
+	/// (dirX, dirZ) with the given horizontal half angle (radians, under 90
+	/// degrees).  The walls around each reached sector are included.  Returns
+	/// false, leaving 'bits' alone, when the camera is not in an open cell.
+	///</summary>
+	bool Collect(const TileMap& map, float x, float z, float dirX, float dirZ, float halfAngle,
+		std::vector<std::uint64_t>& bits);
+
+	int SectorCount()const { return (int)mSectors.size() - (int)mFreeSectors.size(); }
+	int PortalCount()const { return (int)mPortals.size() - (int)mFreePortals.size(); }
+
+	// Sectors entered by the last Collect call.
+	int LastVisitedCount()const { return mLastVisited; }
+
+private:
+	struct Vec2
+	{
+		float R = 0.0f;
+		float C = 0.0f;
+	};
+
+	struct Sector
+	{
+		int Row0 = 0;
+		int Col0 = 0;
+		int Rows = 0;
+		int Cols = 0;
+		bool Alive = false;
+		std::vector<int> Portals;
+	};
+
+	struct Portal
+	{
+		int A = -1;
+		int B = -1;
+		// Segment in cell units (row, col).
+		Vec2 P0;
+		Vec2 P1;
+		bool Alive = false;
+	};
+
+	void RebuildBlock(const TileMap& map, int blockRow, int blockCol);
+	void RemoveSector(int id);
+	void AddPortal(int a, int b, Vec2 p0, Vec2 p1);
+
+	// Makes portals from sector 'id' to the sectors along its four sides.  For a
+	// neighbour in the same block, only the lower id of the pair does this.
+	void LinkSector(int id);
+
+	void Visit(int sector, int fromPortal, Vec2 eye, Vec2 right, Vec2 left, int depth,
+		std::vector<std::uint64_t>& bits);
+
+	static float Cross(Vec2 a, Vec2 b) { return a.R * b.C - a.C * b.R; }
+
+private:
+	int mBlockSize = 8;
+	int mNumRows = 0;
+	int mNumCols = 0;
+
+	// Sector id per cell, -1 for walls.
+	std::vector<int> mCellSector;
+
+	std::vector<Sector> mSectors;
+	std::vector<int> mFreeSectors;
+	std::vector<Portal> mPortals;
+	std::vector<int> mFreePortals;
+
+	int mLastVisited = 0;
+};
@@ -0,0 +1,343 @@
+//***************************************************************************************
+// TileMapPvs.cpp
+//***************************************************************************************
+
+#include "TileMapPvs.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <list>
+#include <map>
+#include <thread>
+
+namespace
+{
+	struct Point
+	{
+		int X;
+		int Y;
+	};
+
+	// A line through two lattice points, oriented from Near to Far.  Points on
+	// its left are "above" it.  Views look into the +x +y quadrant, so a shallow
+	// line keeps its view on the left and a steep line keeps it on the right.
+	struct Line
+	{
+		Point Near;
+		Point Far;
+
+		// Positive if the point is left of the line, zero if on it.
+		int Side(Point p)const
+		{
+			return (Far.Y - Near.Y) * (Far.X - p.X) - (Far.Y - p.Y) * (Far.X - Near.X);
+		}
+
+		bool IsBelow(Point p)const { return Side(p) > 0; }
+		bool IsBelowOrContains(Point p)const { return Side(p) >= 0; }
+		bool IsAbove(Point p)const { return Side(p) < 0; }
+		bool IsAboveOrContains(Point p)const { return Side(p) <= 0; }
+		bool Contains(Point p)const { return Side(p) == 0; }
+	};
+
+	// Wall corners a view's lines have been bent around, newest first through
+	// Parent, so a line bent again can pivot on an older corner of the other side.
+	struct Bump
+	{
+		Point Location;
+		int Parent;
+	};
+
+	// Every line from the source cell between Shallow and Steep is still clear.
+	struct View
+	{
+		Line Shallow;
+		Line Steep;
+		int ShallowBump;
+		int SteepBump;
+	};
+
+	// Precise permissive field of view (Duerig) over one quadrant: a cell is
+	// visible if any line from any point of the source cell reaches any point of
+	// it without crossing the inside of a wall.  Squares are visited in order of
+	// distance, each against the list of views still open; a wall narrows the
+	// view it sits in, or splits it in two.
+	class QuadrantCaster
+	{
+	public:
+		QuadrantCaster(const TileMap& map, int row, int col, int dirRow, int dirCol, std::vector<std::uint64_t>& bits)
+			: mMap(map), mRow(row), mCol(col), mDirRow(dirRow), mDirCol(dirCol), mBits(bits)
+		{
+			mExtentX = dirCol > 0 ? map.ColumnCount() - 1 - col : col;
+			mExtentY = dirRow > 0 ? map.RowCount() - 1 - row : row;
+		}
+
+		void Cast()
+		{
+			if(mExtentX == 0 && mExtentY == 0)
+				return;
+
+			// Both lines start from the corners of the source cell; only their
+			// slopes matter, and these reach every square of the quadrant.
+			const int far = std::max(mExtentX, mExtentY) + 1;
+			View first;
+			first.Shallow = Line{ Point{ 0, 1 }, Point{ far, 0 } };
+			first.Steep = Line{ Point{ 1, 0 }, Point{ 0, far } };
+			first.ShallowBump = -1;
+			first.SteepBump = -1;
+			mViews.push_back(first);
+
+			for(int i = 1; i <= mExtentX + mExtentY && !mViews.empty(); ++i)
+			{
+				auto view = mViews.begin();
+				for(int y = std::max(0, i - mExtentX); y <= std::min(i, mExtentY) && view != mViews.end(); ++y)
+					VisitSquare(Point{ i - y, y }, view);
+			}
+		}
+
+	private:
+		typedef std::list<View>::iterator ViewIt;
+
+		void VisitSquare(Point square, ViewIt& view)
+		{
+			const Point topLeft{ square.X, square.Y + 1 };
+			const Point bottomRight{ square.X + 1, square.Y };
+
+			// Skip the views wholly below the square.
+			while(view != mViews.end() && view->Steep.IsBelowOrContains(bottomRight))
+				++view;
+
+			// Above every remaining view, or in a gap between two.
+			if(view == mViews.end() || view->Shallow.IsAboveOrContains(topLeft))
+				return;
+
+			const int row = mRow + mDirRow * square.Y;
+			const int col = mCol + mDirCol * square.X;
+			const int index = row * mMap.ColumnCount() + col;
+			mBits[index >> 6] |= std::uint64_t(1) << (index & 63);
+
+			if(!mMap.IsWall(row, col))
+				return;
+
+			const bool cutsShallow = view->Shallow.IsAbove(bottomRight);
+			const bool cutsSteep = view->Steep.IsBelow(topLeft);
+			if(cutsShallow && cutsSteep)
+			{
+				// The wall fills the view.
+				view = mViews.erase(view);
+			}
+			else if(cutsShallow)
+			{
+				AddShallowBump(topLeft, *view);
+				view = CheckView(view);
+			}
+			else if(cutsSteep)
+			{
+				AddSteepBump(bottomRight, *view);
+				view = CheckView(view);
+			}
+			else
+			{
+				// The wall sits inside the view: one part passes below it, a copy
+				// passes above.
+				ViewIt above = mViews.insert(std::next(view), *view);
+				AddSteepBump(bottomRight, *view);
+				AddShallowBump(topLeft, *above);
+
+				CheckView(above);
+				view = CheckView(view);
+			}
+		}
+
+		void AddShallowBump(Point p, View& view)
+		{
+			view.Shallow.Far = p;
+			mBumps.push_back(Bump{ p, view.ShallowBump });
+			view.ShallowBump = (int)mBumps.size() - 1;
+
+			for(int b = view.SteepBump; b >= 0; b = mBumps[b].Parent)
+			{
+				if(view.Shallow.IsAbove(mBumps[b].Location))
+					view.Shallow.Near = mBumps[b].Location;
+			}
+		}
+
+		void AddSteepBump(Point p, View& view)
+		{
+			view.Steep.Far = p;
+			mBumps.push_back(Bump{ p, view.SteepBump });
+			view.SteepBump = (int)mBumps.size() - 1;
+
+			for(int b = view.ShallowBump; b >= 0; b = mBumps[b].Parent)
+			{
+				if(view.Steep.IsBelow(mBumps[b].Location))
+					view.Steep.Near = mBumps[b].Location;
+			}
+		}
+
+		// Drops a view that has closed to a single line through a corner of the
+		// source cell; returns the view to carry on from.
+		ViewIt CheckView(ViewIt view)
+		{
+			const Line& shallow = view->Shallow;
+			const Line& steep = view->Steep;
+			if(shallow.Contains(steep.Near) && shallow.Contains(steep.Far) &&
+				(shallow.Contains(Point{ 0, 1 }) || shallow.Contains(Point{ 1, 0 })))
+			{
+				return mViews.erase(view);
+			}
+			return view;
+		}
+
+	private:
+		const TileMap& mMap;
+		const int mRow;
+		const int mCol;
+		const int mDirRow;
+		const int mDirCol;
+		int mExtentX = 0;
+		int mExtentY = 0;
+		std::vector<std::uint64_t>& mBits;
+
+		std::list<View> mViews;
+		std::vector<Bump> mBumps;
+	};
+}
+
+void TileMapPvs::Clear()
+{
+	mNumRows = 0;
+	mNumCols = 0;
+	mWordCount = 0;
+	mCellSets.clear();
+	mSetOffsets.clear();
+	mData.clear();
+}
+
+void TileMapPvs::Build(const TileMap& map, int threadCount)
+{
+	Clear();
+
+	mNumRows = map.RowCount();
+	mNumCols = map.ColumnCount();
+	const int cellCount = mNumRows * mNumCols;
+	if(cellCount == 0)
+		return;
+
+	mWordCount = (cellCount + 63) / 64;
+
+	if(threadCount <= 0)
+		threadCount = std::max((int)std::thread::hardware_concurrency(), 1);
+	threadCount = std::min(threadCount, mNumRows);
+
+	// Rows are handed out one at a time; rows near walls finish much faster
+	// than open ones, so a fixed split would leave threads idle.
+	std::vector<std::vector<std::uint64_t>> sets(cellCount);
+	std::atomic<int> nextRow(0);
+
+	auto work = [&]()
+	{
+		for(int row = nextRow++; row < mNumRows; row = nextRow++)
+			BuildRow(map, row, sets);
+	};
+
+	std::vector<std::thread> threads;
+	for(int i = 1; i < threadCount; ++i)
+		threads.emplace_back(work);
+	work();
+	for(auto& t : threads)
+		t.join();
+
+	// Store each distinct set once.
+	std::map<std::vector<std::uint64_t>, int> unique;
+
+	mCellSets.assign(cellCount, -1);
+	for(int i = 0; i < cellCount; ++i)
+	{
+		if(sets[i].empty())
+			continue;
+
+		auto it = unique.find(sets[i]);
+		if(it == unique.end())
+		{
+			it = unique.insert(std::make_pair(sets[i], (int)mSetOffsets.size())).first;
+			mSetOffsets.push_back(Encode(sets[i]));
+		}
+		mCellSets[i] = it->second;
+
+		std::vector<std::uint64_t>().swap(sets[i]);
+	}
+}
+
+void TileMapPvs::BuildRow(const TileMap& map, int row, std::vector<std::vector<std::uint64_t>>& sets)const
+{
+	for(int col = 0; col < mNumCols; ++col)
+	{
+		if(map.IsWall(row, col))
+			continue;
+
+		std::vector<std::uint64_t>& bits = sets[row * mNumCols + col];
+		bits.assign(mWordCount, 0);
+
+		const int source = row * mNumCols + col;
+		bits[source >> 6] |= std::uint64_t(1) << (source & 63);
+
+		// Cells on the source's row and column belong to two quadrants and are
+		// simply marked twice.
+		for(int dirRow = -1; dirRow <= 1; dirRow += 2)
+		{
+			for(int dirCol = -1; dirCol <= 1; dirCol += 2)
+				QuadrantCaster(map, row, col, dirRow, dirCol, bits).Cast();
+		}
+	}
+}
+
+std::uint32_t TileMapPvs::Encode(const std::vector<std::uint64_t>& bits)
+{
+	const std::uint32_t offset = (std::uint32_t)mData.size();
+
+	int i = 0;
+	while(i < mWordCount)
+	{
+		std::uint64_t zeros = 0;
+		while(i < mWordCount && bits[i] == 0)
+		{
+			++zeros;
+			++i;
+		}
+
+		const int first = i;
+		while(i < mWordCount && bits[i] != 0)
+			++i;
+
+		mData.push_back((zeros << 32) | (std::uint64_t)(i - first));
+		mData.insert(mData.end(), bits.begin() + first, bits.begin() + i);
+	}
+
+	return offset;
+}
+
+void TileMapPvs::Expand(int set, std::vector<std::uint64_t>& bits)const
+{
+	bits.assign(mWordCount, 0);
+	if(set < 0 || set >= (int)mSetOffsets.size())
+		return;
+
+	const std::uint64_t* p = mData.data() + mSetOffsets[set];
+
+	int i = 0;
+	while(i < mWordCount)
+	{
+		const std::uint64_t header = *p++;
+		i += (int)(header >> 32);
+
+		const int literals = (int)(header & 0xffffffff);
+		for(int j = 0; j < literals; ++j)
+			bits[i++] = *p++;
+	}
+}
+
+std::size_t TileMapPvs::UncompressedBytes()const
+{
+	return (std::size_t)mNumRows * mNumCols * mWordCount * sizeof(std::uint64_t);
+}
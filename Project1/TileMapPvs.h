@@ -0,0 +1,78 @@
+//***************************************************************************************
+// TileMapPvs.h
+//
+// Potentially visible sets for the cells of a TileMap.  A cell sees another if
+// any line from any point of it reaches any point of the other without crossing
+// the inside of a wall; lines that only graze a wall corner get through.  Each
+// open cell's set is found exactly with a permissive shadowcast over the four
+// quadrants around it, so the sets are conservative for a camera anywhere in
+// the cell.  Source rows are split across threads.
+//
+// Each set is a bitset over all cells, stored run-length encoded by 64-bit word.
+// Identical sets are stored once, and a cell's set is found with one table read.
+//***************************************************************************************
+
+#pragma once
+
+#include "TileMap.h"
+
+#include <cstdint>
+#include <vector>
+
+class TileMapPvs
+{
+public:
+	///<summary>
+	/// Computes the sets for every open cell of 'map'.  threadCount 0 uses one
+	/// thread per hardware thread.
+	///</summary>
+	void Build(const TileMap& map, int threadCount = 0);
+	void Clear();
+
+	bool Empty()const { return mCellSets.empty(); }
+	int RowCount()const { return mNumRows; }
+	int ColumnCount()const { return mNumCols; }
+
+	// Index of the set seen from (row, col), or -1 for walls and cells outside
+	// the map, where nothing can be ruled out.
+	int SetOf(int row, int col)const
+	{
+		if(row < 0 || col < 0 || row >= mNumRows || col >= mNumCols)
+			return -1;
+		return mCellSets[row * mNumCols + col];
+	}
+
+	// Unpacks set 'set' into 'bits', one bit per cell in row-major order.
+	void Expand(int set, std::vector<std::uint64_t>& bits)const;
+
+	static bool Test(const std::vector<std::uint64_t>& bits, int cellIndex)
+	{
+		return (bits[cellIndex >> 6] >> (cellIndex & 63)) & 1;
+	}
+
+	int UniqueSetCount()const { return (int)mSetOffsets.size(); }
+
+	// Bytes of encoded set data, and what plain bitsets for every cell would take.
+	std::size_t CompressedBytes()const { return mData.size() * sizeof(std::uint64_t); }
+	std::size_t UncompressedBytes()const;
+
+private:
+	// Sets of the open cells of one row.
+	void BuildRow(const TileMap& map, int row, std::vector<std::vector<std::uint64_t>>& sets)const;
+
+	// Appends the encoding of 'bits' to mData and returns its offset.
+	std::uint32_t Encode(const std::vector<std::uint64_t>& bits);
+
+private:
+	int mNumRows = 0;
+	int mNumCols = 0;
+	int mWordCount = 0;
+
+	// Set index per cell, -1 for walls.
+	std::vector<int> mCellSets;
+
+	// Encoded sets.  Each run starts with a header word, zero words in the high
+	// half and literal words in the low half, followed by the literal words.
+	std::vector<std::uint32_t> mSetOffsets;
+	std::vector<std::uint64_t> mData;
+};
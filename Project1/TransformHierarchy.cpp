@@ -0,0 +1,199 @@
+//***************************************************************************************
+// TransformHierarchy.cpp
+//***************************************************************************************
+
+#include "TransformHierarchy.h"
+
+#include <algorithm>
+#include <future>
+#include <thread>
+
+using namespace DirectX;
+
+const std::uint32_t TransformHierarchy::NoParent;
+
+std::uint32_t TransformHierarchy::Add(std::uint32_t parent, const XMFLOAT4X4& local)
+{
+	const std::uint32_t id = Count();
+	const std::uint32_t level = parent == NoParent ? 0 : mLevelOf[parent] + 1;
+	mParentOf.push_back(parent);
+	mLevelOf.push_back(level);
+
+	// Appending keeps the arrays breadth-first as long as the node goes on the
+	// deepest level or starts a new one; anything else waits for Rebuild.
+	const std::uint32_t position = (std::uint32_t)mLocal.size();
+	mPosition.push_back(position);
+	mLocal.push_back(local);
+	mWorld.push_back(local);
+	mParent.push_back(parent == NoParent ? NoParent : mPosition[parent]);
+	mId.push_back(id);
+	mDirty.push_back(0);
+
+	if(!mLayoutDirty)
+	{
+		const std::uint32_t levels = (std::uint32_t)LevelCount();
+		if(level == levels)
+			mLevelStart.push_back(position + 1);
+		else if(level + 1 == levels)
+			mLevelStart.back() = position + 1;
+		else
+			mLayoutDirty = true;
+	}
+
+	MarkDirty(position);
+	return id;
+}
+
+void TransformHierarchy::Clear()
+{
+	mParentOf.clear();
+	mLevelOf.clear();
+	mPosition.clear();
+	mLocal.clear();
+	mWorld.clear();
+	mParent.clear();
+	mId.clear();
+	mDirty.clear();
+	mLevelStart.assign(1, 0);
+	mFirstDirtyLevel = 0;
+	mLayoutDirty = false;
+	mLastUpdated = 0;
+}
+
+void TransformHierarchy::SetLocal(std::uint32_t id, const XMFLOAT4X4& local)
+{
+	const std::uint32_t position = mPosition[id];
+	mLocal[position] = local;
+	MarkDirty(position);
+}
+
+void TransformHierarchy::MarkDirty(std::uint32_t position)
+{
+	mDirty[position] = 1;
+	mFirstDirtyLevel = std::min(mFirstDirtyLevel, (int)mLevelOf[mId[position]]);
+}
+
+void TransformHierarchy::Rebuild()
+{
+	// Counting sort by level; nodes of a level keep the order they were added in.
+	std::uint32_t levels = 0;
+	for(std::uint32_t level : mLevelOf)
+		levels = std::max(levels, level + 1);
+
+	mLevelStart.assign(levels + 1, 0);
+	for(std::uint32_t level : mLevelOf)
+		++mLevelStart[level + 1];
+	for(std::uint32_t l = 0; l < levels; ++l)
+		mLevelStart[l + 1] += mLevelStart[l];
+
+	std::vector<std::uint32_t> next(mLevelStart.begin(), mLevelStart.end() - 1);
+	std::vector<XMFLOAT4X4> local(mLocal.size());
+	std::vector<XMFLOAT4X4> world(mWorld.size());
+	std::vector<std::uint8_t> dirty(mDirty.size());
+	for(std::uint32_t id = 0; id < Count(); ++id)
+	{
+		const std::uint32_t from = mPosition[id];
+		const std::uint32_t to = next[mLevelOf[id]]++;
+		local[to] = mLocal[from];
+		world[to] = mWorld[from];
+		dirty[to] = mDirty[from];
+		mPosition[id] = to;
+		mId[to] = id;
+	}
+
+	for(std::uint32_t position = 0; position < Count(); ++position)
+	{
+		const std::uint32_t parent = mParentOf[mId[position]];
+		mParent[position] = parent == NoParent ? NoParent : mPosition[parent];
+	}
+
+	mLocal.swap(local);
+	mWorld.swap(world);
+	mDirty.swap(dirty);
+	mLayoutDirty = false;
+}
+
+void TransformHierarchy::UpdateRange(std::uint32_t begin, std::uint32_t end, std::vector<std::uint32_t>& updated)
+{
+	for(std::uint32_t i = begin; i < end; ++i)
+	{
+		const std::uint32_t parent = mParent[i];
+		if(!mDirty[i] && (parent == NoParent || !mDirty[parent]))
+			continue;
+
+		XMMATRIX local = XMLoadFloat4x4(&mLocal[i]);
+		if(parent != NoParent)
+			local = XMMatrixMultiply(local, XMLoadFloat4x4(&mWorld[parent]));
+		XMStoreFloat4x4(&mWorld[i], local);
+
+		// Parents are a level up, so no other worker reads this flag until the
+		// level is done.
+		mDirty[i] = 1;
+		updated.push_back(i);
+	}
+}
+
+void TransformHierarchy::Update(std::vector<std::uint32_t>& changed, int parallelThreshold)
+{
+	if(mLayoutDirty)
+		Rebuild();
+
+	mLastUpdated = 0;
+	const int levels = LevelCount();
+	if(mFirstDirtyLevel >= levels)
+		return;
+
+	const int threadCount = mThreadCount > 0 ? mThreadCount : std::max((int)std::thread::hardware_concurrency(), 1);
+	if((int)mWorkerUpdated.size() < threadCount)
+		mWorkerUpdated.resize(threadCount);
+
+	// Worker lists hold positions until the end: the flags have to stay set
+	// while the levels below read them.
+	std::vector<std::uint32_t>& updated = mWorkerUpdated[0];
+	updated.clear();
+
+	for(int level = mFirstDirtyLevel; level < levels; ++level)
+	{
+		const std::uint32_t begin = mLevelStart[level];
+		const std::uint32_t end = mLevelStart[level + 1];
+		const std::uint32_t count = end - begin;
+
+		const int workers = (int)count >= parallelThreshold ? threadCount : 1;
+		if(workers == 1)
+		{
+			UpdateRange(begin, end, updated);
+			continue;
+		}
+
+		const std::uint32_t slice = (count + workers - 1) / workers;
+		std::vector<std::future<void>> jobs;
+		for(int worker = 1; worker < workers; ++worker)
+		{
+			const std::uint32_t first = std::min(begin + worker * slice, end);
+			const std::uint32_t last = std::min(first + slice, end);
+			mWorkerUpdated[worker].clear();
+			jobs.push_back(std::async(std::launch::async, [this, first, last, worker]()
+			{
+				UpdateRange(first, last, mWorkerUpdated[worker]);
+			}));
+		}
+
+		UpdateRange(begin, std::min(begin + slice, end), updated);
+
+		// Keep the level in position order.
+		for(int worker = 1; worker < workers; ++worker)
+		{
+			jobs[worker - 1].wait();
+			updated.insert(updated.end(), mWorkerUpdated[worker].begin(), mWorkerUpdated[worker].end());
+		}
+	}
+
+	for(std::uint32_t position : updated)
+	{
+		mDirty[position] = 0;
+		changed.push_back(mId[position]);
+	}
+
+	mLastUpdated = (std::uint32_t)updated.size();
+	mFirstDirtyLevel = levels;
+}
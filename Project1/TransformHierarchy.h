@@ -0,0 +1,90 @@
+//***************************************************************************************
+// TransformHierarchy.h
+//
+// Parent/child transforms.  Each node has a local matrix relative to its parent,
+// and its world matrix is local * parent world, so moving a tower means changing
+// the tower node alone; everything attached to it follows.
+//
+// Nodes are stored breadth-first as a structure of arrays: every level sits in
+// one contiguous range, after all of its parents.  Update walks the levels in
+// order, so a parent's world matrix is final before any child reads it, and the
+// nodes of one level are independent of each other; large levels are split over
+// worker threads.  Only nodes whose local matrix changed, and the subtrees below
+// them, are recomputed.
+//
+// Nodes are named by ids handed out by Add, which stay put when adding a node
+// reorders the arrays.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+
+class TransformHierarchy
+{
+public:
+	static const std::uint32_t NoParent = 0xffffffff;
+
+	///<summary>
+	/// Adds a node under 'parent', or a root for NoParent, and returns its id.
+	/// The parent must already exist.  The node is dirty until the next Update.
+	///</summary>
+	std::uint32_t Add(std::uint32_t parent, const DirectX::XMFLOAT4X4& local);
+	void Clear();
+
+	std::uint32_t Count()const { return (std::uint32_t)mParentOf.size(); }
+	int LevelCount()const { return (int)mLevelStart.size() - 1; }
+	std::uint32_t Parent(std::uint32_t id)const { return mParentOf[id]; }
+
+	const DirectX::XMFLOAT4X4& Local(std::uint32_t id)const { return mLocal[mPosition[id]]; }
+	void SetLocal(std::uint32_t id, const DirectX::XMFLOAT4X4& local);
+
+	// As of the last Update.
+	const DirectX::XMFLOAT4X4& World(std::uint32_t id)const { return mWorld[mPosition[id]]; }
+
+	///<summary>
+	/// Recomputes the world matrix of every dirty node and of everything below
+	/// it, and appends their ids to 'changed', parents before children.  Levels
+	/// with at least 'parallelThreshold' nodes are split over worker threads.
+	///</summary>
+	void Update(std::vector<std::uint32_t>& changed, int parallelThreshold = 4096);
+
+	// Nodes recomputed by the last Update.
+	std::uint32_t LastUpdated()const { return mLastUpdated; }
+
+	// Workers a large level is split over; 0, the default, picks one per core.
+	void SetThreadCount(int threadCount) { mThreadCount = threadCount; }
+
+private:
+	void Rebuild();
+	void MarkDirty(std::uint32_t position);
+	void UpdateRange(std::uint32_t begin, std::uint32_t end, std::vector<std::uint32_t>& updated);
+
+private:
+	// By id.
+	std::vector<std::uint32_t> mParentOf;
+	std::vector<std::uint32_t> mLevelOf;
+	std::vector<std::uint32_t> mPosition;
+
+	// By position, breadth-first.
+	std::vector<DirectX::XMFLOAT4X4> mLocal;
+	std::vector<DirectX::XMFLOAT4X4> mWorld;
+	std::vector<std::uint32_t> mParent;
+	std::vector<std::uint32_t> mId;
+	// Set for nodes to recompute; during Update, also for nodes already
+	// recomputed, which is what makes their children follow.
+	std::vector<std::uint8_t> mDirty;
+
+	// Level l covers positions [mLevelStart[l], mLevelStart[l + 1]).
+	std::vector<std::uint32_t> mLevelStart = { 0 };
+	// Lowest level holding a dirty node; LevelCount() when none is.
+	int mFirstDirtyLevel = 0;
+	// An Add put a node above the deepest level, so the arrays need sorting.
+	bool mLayoutDirty = false;
+
+	std::uint32_t mLastUpdated = 0;
+	int mThreadCount = 0;
+	std::vector<std::vector<std::uint32_t>> mWorkerUpdated;
+};
@@ -0,0 +1,166 @@
+//***************************************************************************************
+// UploadRing.cpp
+//***************************************************************************************
+
+#include "UploadRing.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace
+{
+	const std::uint64_t HeapGranularity = 64 * 1024;
+
+	std::uint64_t AlignUp(std::uint64_t value, std::uint64_t alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+}
+
+UploadRing::UploadRing(IUploadHeapSource& source, std::uint64_t initialSize)
+	: mSource(source),
+	mInitialSize(AlignUp(std::max<std::uint64_t>(initialSize, 1), HeapGranularity))
+{
+}
+
+UploadRing::~UploadRing()
+{
+	for(const RetiredHeap& retired : mRetired)
+		mSource.ReleaseHeap(retired.Heap);
+
+	if(mHeap.Size > 0)
+		mSource.ReleaseHeap(mHeap);
+}
+
+UploadRing::Allocation UploadRing::Allocate(std::uint64_t size, std::uint64_t alignment)
+{
+	assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+	Allocation result;
+	if(mHeap.Size == 0 && !Grow(size, alignment))
+		return result;
+
+	// Free space is [mHead, end) and [0, mTail) while the live bytes do not
+	// wrap, and [mHead, mTail) while they do.
+	const std::uint64_t capacity = mHeap.Size;
+	std::uint64_t offset = AlignUp(mHead, alignment);
+	bool fits;
+	if(mUsed > 0 && mHead == mTail)
+		fits = false;
+	else if(mHead >= mTail)
+	{
+		fits = offset + size <= capacity;
+		if(!fits && mHead > 0)
+		{
+			// Skip the end of the heap; the frame pays for it as padding.
+			offset = 0;
+			fits = size <= (mUsed == 0 ? capacity : mTail);
+		}
+	}
+	else
+		fits = offset + size <= mTail;
+
+	if(!fits)
+	{
+		if(!Grow(size, alignment))
+			return result;
+		offset = 0;
+	}
+
+	const std::uint64_t end = offset + size;
+	const std::uint64_t taken = offset >= mHead ? end - mHead : (mHeap.Size - mHead) + end;
+
+	mHead = end;
+	mUsed += taken;
+	mFrameBytes += taken;
+	mFrameTotalBytes += taken;
+	mFramePadding += taken - size;
+	++mFrameAllocations;
+
+	result.Cpu = static_cast<unsigned char*>(mHeap.Cpu) + offset;
+	result.Gpu = mHeap.Gpu + offset;
+	result.Size = size;
+	result.Heap = mHeap.Id;
+	result.Offset = offset;
+	return result;
+}
+
+bool UploadRing::Grow(std::uint64_t size, std::uint64_t alignment)
+{
+	const bool first = mHeap.Size == 0;
+	const std::uint64_t needed = AlignUp(size + alignment, HeapGranularity);
+	const std::uint64_t newSize = first ? std::max(mInitialSize, needed) : std::max(2 * mHeap.Size, 2 * needed);
+
+	UploadHeap heap;
+	if(!mSource.CreateHeap(newSize, heap))
+		return false;
+
+	// Frames still in flight read the old heap; it goes once the open frame,
+	// the last to touch it, is done.
+	if(!first)
+	{
+		RetiredHeap retired;
+		retired.Heap = mHeap;
+		retired.Fence = 0;
+		mRetired.push_back(retired);
+		++mStats.Grows;
+	}
+
+	mHeap = heap;
+	mHead = mTail = mUsed = 0;
+	mFrames.clear();
+	mFrameBytes = 0;
+
+	mStats.Capacity = mHeap.Size;
+	return true;
+}
+
+void UploadRing::EndFrame(std::uint64_t fence)
+{
+	Frame frame;
+	frame.Fence = fence;
+	frame.End = mHead;
+	frame.Bytes = mFrameBytes;
+	mFrames.push_back(frame);
+
+	for(RetiredHeap& retired : mRetired)
+	{
+		if(retired.Fence == 0)
+			retired.Fence = fence;
+	}
+
+	mStats.InFlightBytes = mUsed;
+	mStats.FrameBytes = mFrameTotalBytes;
+	mStats.PeakFrameBytes = std::max(mStats.PeakFrameBytes, mFrameTotalBytes);
+	mStats.FramePaddingBytes = mFramePadding;
+	mStats.FrameAllocations = mFrameAllocations;
+
+	mFrameBytes = 0;
+	mFrameTotalBytes = 0;
+	mFramePadding = 0;
+	mFrameAllocations = 0;
+}
+
+void UploadRing::Release(std::uint64_t completedFence)
+{
+	while(!mFrames.empty() && mFrames.front().Fence <= completedFence)
+	{
+		mTail = mFrames.front().End;
+		mUsed -= mFrames.front().Bytes;
+		mFrames.pop_front();
+	}
+
+	// Start from the bottom again while nothing can point into the heap.
+	if(mFrames.empty() && mFrameBytes == 0)
+		mHead = mTail = 0;
+
+	mRetired.erase(std::remove_if(mRetired.begin(), mRetired.end(), [&](const RetiredHeap& retired)
+	{
+		if(retired.Fence == 0 || retired.Fence > completedFence)
+			return false;
+		mSource.ReleaseHeap(retired.Heap);
+		return true;
+	}), mRetired.end());
+
+	mStats.InFlightBytes = mUsed;
+}
@@ -0,0 +1,136 @@
+//***************************************************************************************
+// UploadRing.h
+//
+// Per-frame upload memory carved out of one persistently mapped heap.  Each
+// allocation is an aligned bump of the head; EndFrame tags everything allocated
+// since the last call with the frame's fence value, and Release hands a frame's
+// bytes back once that fence has completed.  Frames are freed in the order they
+// were made, so the heap is used as a ring and nothing is ever copied or moved.
+//
+// When an allocation does not fit next to the frames still in flight, the ring
+// moves to a heap twice the size.  The old heap is kept until the fence of the
+// frame that outgrew it completes.  Stats() reports the capacity, the bytes a
+// frame used, alignment and wrap padding, and the number of times it grew, so
+// the initial size can be tuned from a run instead of guessed.
+//
+// The ring only does the bookkeeping; an IUploadHeapSource creates and maps the
+// heaps, so nothing here needs a device.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// A mapped block of upload memory.  Cpu and Gpu address the same first byte.
+struct UploadHeap
+{
+	void* Cpu = nullptr;
+	std::uint64_t Gpu = 0;
+	std::uint64_t Size = 0;
+	// The source's own handle.
+	int Id = -1;
+};
+
+class IUploadHeapSource
+{
+public:
+	virtual ~IUploadHeapSource() {}
+
+	// Creates and maps a heap of at least 'size' bytes.  Returns false on failure.
+	virtual bool CreateHeap(std::uint64_t size, UploadHeap& heap) = 0;
+	// Called once the GPU can no longer read the heap.
+	virtual void ReleaseHeap(const UploadHeap& heap) = 0;
+};
+
+class UploadRing
+{
+public:
+	struct Allocation
+	{
+		void* Cpu = nullptr;
+		std::uint64_t Gpu = 0;
+		std::uint64_t Size = 0;
+		// The heap it lies in and where, for APIs that take a buffer and an
+		// offset rather than an address.
+		int Heap = -1;
+		std::uint64_t Offset = 0;
+	};
+
+	struct Stats
+	{
+		std::uint64_t Capacity = 0;
+		// Bytes of the frames not yet released, and of the open one.
+		std::uint64_t InFlightBytes = 0;
+		// Bytes the last ended frame took, padding included, and the most any
+		// frame has taken.
+		std::uint64_t FrameBytes = 0;
+		std::uint64_t PeakFrameBytes = 0;
+		std::uint64_t FramePaddingBytes = 0;
+		int FrameAllocations = 0;
+		int Grows = 0;
+	};
+
+	// Heaps are at least 'initialSize' bytes, rounded up to 64 KB.
+	UploadRing(IUploadHeapSource& source, std::uint64_t initialSize);
+	UploadRing(const UploadRing& rhs) = delete;
+	UploadRing& operator=(const UploadRing& rhs) = delete;
+	~UploadRing();
+
+	///<summary>
+	/// Returns 'size' bytes aligned to 'alignment', a power of two, valid until
+	/// the fence passed to the next EndFrame completes.  Grows the ring when the
+	/// frames in flight leave no room.  Cpu is null if a heap could not be made.
+	///</summary>
+	Allocation Allocate(std::uint64_t size, std::uint64_t alignment);
+
+	// Everything allocated since the last EndFrame stays in use until 'fence'.
+	void EndFrame(std::uint64_t fence);
+
+	// Frees the frames, and the heaps the ring has grown out of, whose fence is
+	// at or below 'completedFence'.
+	void Release(std::uint64_t completedFence);
+
+	const Stats& GetStats()const { return mStats; }
+
+private:
+	struct Frame
+	{
+		std::uint64_t Fence;
+		std::uint64_t End;
+		std::uint64_t Bytes;
+	};
+
+	struct RetiredHeap
+	{
+		UploadHeap Heap;
+		// Zero until the frame that outgrew the heap ends.
+		std::uint64_t Fence;
+	};
+
+	bool Grow(std::uint64_t size, std::uint64_t alignment);
+
+private:
+	IUploadHeapSource& mSource;
+	const std::uint64_t mInitialSize;
+	// Made on the first Allocate.
+	UploadHeap mHeap;
+
+	// Live bytes are [mTail, mHead), wrapping at the end of the heap.  mUsed
+	// tells a full ring from an empty one when the two meet.
+	std::uint64_t mHead = 0;
+	std::uint64_t mTail = 0;
+	std::uint64_t mUsed = 0;
+
+	std::deque<Frame> mFrames;
+	std::vector<RetiredHeap> mRetired;
+
+	// The open frame, in the current heap and in all of them.
+	std::uint64_t mFrameBytes = 0;
+	std::uint64_t mFrameTotalBytes = 0;
+	std::uint64_t mFramePadding = 0;
+	int mFrameAllocations = 0;
+
+	Stats mStats;
+};
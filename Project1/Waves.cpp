@@ -3,7 +3,20 @@
 //***************************************************************************************
 
 #include "Waves.h"
+#if defined(_WIN32)
 #include <ppl.h>
+#else
+// No PPL off Windows; the rows are updated one after another instead.
+namespace concurrency
+{
+	template<typename F>
+	void parallel_for(int first, int last, const F& f)
+	{
+		for(int i = first; i < last; ++i)
+			f(i);
+	}
+}
+#endif
 #include <algorithm>
 #include <vector>
 #include <cassert>